@@ -0,0 +1,16 @@
+if(__CHECK_THREAD_LOCAL)
+  return()
+endif()
+set(__CHECK_THREAD_LOCAL 1)
+
+function(check_thread_local var)
+  try_compile(have_thread_local
+    "${CMAKE_BINARY_DIR}${CMAKE_FILES_DIRECTORY}/CMakeTmp/thread_local_test"
+    "${CMAKE_CURRENT_SOURCE_DIR}/cmake/thread_local_test.c")
+  if(have_thread_local)
+    message(STATUS "Checking for thread local storage - Success")
+    set(${var} ON PARENT_SCOPE)
+  else()
+    message(STATUS "Checking for thread local storage - Failure")
+  endif()
+endfunction()
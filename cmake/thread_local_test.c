@@ -0,0 +1,7 @@
+static _Thread_local int value = 0;
+
+int main()
+{
+    value++;
+    return value - 1;
+}
@@ -0,0 +1,374 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jaegertracingc/accounting_allocator.h"
+
+/* Padded so that the memory after the header is as aligned as memory from
+ * malloc. */
+typedef union alloc_header {
+    struct {
+        size_t size;
+        jaeger_alloc_tag tag;
+    } info;
+    long double align_float;
+    int64_t align_int;
+    void* align_ptr;
+} alloc_header;
+
+#if defined(HAVE_THREAD_LOCAL) || !defined(JAEGERTRACINGC_MT)
+
+#ifdef HAVE_THREAD_LOCAL
+#define THREAD_LOCAL _Thread_local
+#else
+#define THREAD_LOCAL
+#endif /* HAVE_THREAD_LOCAL */
+
+static THREAD_LOCAL jaeger_alloc_tag current_tag = jaeger_alloc_tag_other;
+
+static inline jaeger_alloc_tag get_tag(void)
+{
+    return current_tag;
+}
+
+static inline void set_tag(jaeger_alloc_tag tag)
+{
+    current_tag = tag;
+}
+
+#else
+
+/* Thread storage holds a pointer to one of these, so that changing the tag
+ * never allocates. */
+static jaeger_destructible tag_values[jaeger_alloc_tag_count];
+
+static jaeger_thread_local tag_storage = {.initialized = false};
+
+static jaeger_once once = JAEGERTRACINGC_ONCE_INIT;
+
+static void null_destroy(jaeger_destructible* d)
+{
+    (void) d;
+}
+
+static void cleanup_tag_storage(void)
+{
+    jaeger_thread_local_destroy(&tag_storage);
+}
+
+static void init_tag_storage(void)
+{
+    for (int i = 0; i < jaeger_alloc_tag_count; i++) {
+        tag_values[i].destroy = &null_destroy;
+    }
+    jaeger_thread_local_init(&tag_storage);
+    atexit(&cleanup_tag_storage);
+}
+
+static inline jaeger_alloc_tag get_tag(void)
+{
+    jaeger_do_once(&once, &init_tag_storage);
+    const jaeger_destructible* value =
+        jaeger_thread_local_get_value(&tag_storage);
+    return value == NULL ? jaeger_alloc_tag_other
+                         : (jaeger_alloc_tag)(value - tag_values);
+}
+
+static inline void set_tag(jaeger_alloc_tag tag)
+{
+    jaeger_do_once(&once, &init_tag_storage);
+    jaeger_thread_local_set_value(&tag_storage, &tag_values[tag]);
+}
+
+#endif /* HAVE_THREAD_LOCAL || !JAEGERTRACINGC_MT */
+
+jaeger_alloc_tag jaeger_alloc_context_enter(jaeger_alloc_tag tag)
+{
+    assert(tag >= 0 && tag < jaeger_alloc_tag_count);
+    const jaeger_alloc_tag prev = get_tag();
+    set_tag(tag);
+    return prev;
+}
+
+void jaeger_alloc_context_exit(jaeger_alloc_tag prev)
+{
+    assert(prev >= 0 && prev < jaeger_alloc_tag_count);
+    set_tag(prev);
+}
+
+jaeger_alloc_tag jaeger_alloc_context_current(void)
+{
+    return get_tag();
+}
+
+const char* jaeger_alloc_tag_name(jaeger_alloc_tag tag)
+{
+    switch (tag) {
+    case jaeger_alloc_tag_other:
+        return "other";
+#define TAG_NAME(tag)            \
+    case jaeger_alloc_tag_##tag: \
+        return #tag;
+        JAEGERTRACINGC_ALLOC_TAGS(TAG_NAME)
+#undef TAG_NAME
+    default:
+        return NULL;
+    }
+}
+
+#ifdef JAEGERTRACINGC_HAVE_ATOMICS
+
+#define LOCK(alloc) (void) (alloc)
+#define UNLOCK(alloc) (void) (alloc)
+#define ADD(x, delta) __atomic_add_fetch(&(x), (delta), __ATOMIC_RELAXED)
+#define LOAD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+
+static inline void update_peak(int64_t* peak, int64_t live)
+{
+    int64_t old_peak = __atomic_load_n(peak, __ATOMIC_RELAXED);
+    while (live > old_peak &&
+           !__atomic_compare_exchange_n(peak,
+                                        &old_peak,
+                                        live,
+                                        true,
+                                        __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED)) {
+    }
+}
+
+#else
+
+#define LOCK(alloc) jaeger_mutex_lock(&(alloc)->mutex)
+#define UNLOCK(alloc) jaeger_mutex_unlock(&(alloc)->mutex)
+#define ADD(x, delta) ((x) += (delta))
+#define LOAD(x) (x)
+
+static inline void update_peak(int64_t* peak, int64_t live)
+{
+    *peak = JAEGERTRACINGC_MAX(*peak, live);
+}
+
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+
+/* Charges delta bytes to a tag, or releases them if delta is negative.
+ * Returns false if the budget refuses the bytes. */
+static inline bool charge(jaeger_accounting_allocator* alloc,
+                          jaeger_alloc_tag tag,
+                          int64_t delta)
+{
+    LOCK(alloc);
+    const int64_t total_live = ADD(alloc->total.live_bytes, delta);
+    if (delta > 0 && tag == jaeger_alloc_tag_reporter && alloc->budget > 0 &&
+        total_live > alloc->budget) {
+        ADD(alloc->total.live_bytes, -delta);
+        UNLOCK(alloc);
+        return false;
+    }
+    update_peak(&alloc->total.peak_bytes, total_live);
+    jaeger_alloc_stats* stats = &alloc->stats[tag];
+    update_peak(&stats->peak_bytes, ADD(stats->live_bytes, delta));
+    UNLOCK(alloc);
+    return true;
+}
+
+/* Counts an allocation if delta is one, a free if it is minus one. */
+static inline void count_allocation(jaeger_accounting_allocator* alloc,
+                                    jaeger_alloc_tag tag,
+                                    int delta)
+{
+    LOCK(alloc);
+    ADD(alloc->total.live_allocations, delta);
+    ADD(alloc->stats[tag].live_allocations, delta);
+    if (delta > 0) {
+        ADD(alloc->total.num_allocations, 1);
+        ADD(alloc->stats[tag].num_allocations, 1);
+    }
+    UNLOCK(alloc);
+}
+
+static inline void count_failure(jaeger_accounting_allocator* alloc,
+                                 jaeger_alloc_tag tag)
+{
+    LOCK(alloc);
+    ADD(alloc->total.num_failures, 1);
+    ADD(alloc->stats[tag].num_failures, 1);
+    UNLOCK(alloc);
+}
+
+static void* accounting_malloc(jaeger_allocator* base, size_t sz)
+{
+    jaeger_accounting_allocator* alloc = (jaeger_accounting_allocator*) base;
+    const jaeger_alloc_tag tag = get_tag();
+    if (!charge(alloc, tag, (int64_t) sz)) {
+        count_failure(alloc, tag);
+        return NULL;
+    }
+    alloc_header* header =
+        alloc->delegate->malloc(alloc->delegate, sizeof(alloc_header) + sz);
+    if (header == NULL) {
+        charge(alloc, tag, -(int64_t) sz);
+        count_failure(alloc, tag);
+        return NULL;
+    }
+    header->info.size = sz;
+    header->info.tag = tag;
+    count_allocation(alloc, tag, 1);
+    return header + 1;
+}
+
+static void accounting_free(jaeger_allocator* base, void* ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    jaeger_accounting_allocator* alloc = (jaeger_accounting_allocator*) base;
+    alloc_header* header = (alloc_header*) ptr - 1;
+    const size_t size = header->info.size;
+    const jaeger_alloc_tag tag = header->info.tag;
+    charge(alloc, tag, -(int64_t) size);
+    count_allocation(alloc, tag, -1);
+    jaeger_allocator* delegate = alloc->delegate;
+    if (delegate->free_sized != NULL) {
+        delegate->free_sized(delegate, header, sizeof(alloc_header) + size);
+    }
+    else {
+        delegate->free(delegate, header);
+    }
+}
+
+static void accounting_free_sized(jaeger_allocator* base, void* ptr, size_t sz)
+{
+    assert(ptr == NULL || ((alloc_header*) ptr - 1)->info.size == sz);
+    (void) sz;
+    accounting_free(base, ptr);
+}
+
+static void* accounting_realloc(jaeger_allocator* base, void* ptr, size_t sz)
+{
+    if (ptr == NULL) {
+        return accounting_malloc(base, sz);
+    }
+    jaeger_accounting_allocator* alloc = (jaeger_accounting_allocator*) base;
+    alloc_header* header = (alloc_header*) ptr - 1;
+    const jaeger_alloc_tag tag = header->info.tag;
+    const int64_t delta = (int64_t) sz - (int64_t) header->info.size;
+    /* Charge growth up front so the budget can refuse it, but release
+     * shrinkage only once the delegate succeeds. */
+    if (delta > 0 && !charge(alloc, tag, delta)) {
+        count_failure(alloc, tag);
+        return NULL;
+    }
+    alloc_header* new_header = alloc->delegate->realloc(
+        alloc->delegate, header, sizeof(alloc_header) + sz);
+    if (new_header == NULL) {
+        if (delta > 0) {
+            charge(alloc, tag, -delta);
+        }
+        count_failure(alloc, tag);
+        return NULL;
+    }
+    if (delta < 0) {
+        charge(alloc, tag, delta);
+    }
+    new_header->info.size = sz;
+    return new_header + 1;
+}
+
+void jaeger_accounting_allocator_init(jaeger_accounting_allocator* alloc,
+                                      jaeger_allocator* delegate,
+                                      int64_t budget)
+{
+    assert(alloc != NULL);
+    assert(delegate != NULL);
+    assert(budget >= 0);
+    *alloc = (jaeger_accounting_allocator){
+        .base = {.malloc = &accounting_malloc,
+                 .realloc = &accounting_realloc,
+                 .free = &accounting_free,
+                 .free_sized = &accounting_free_sized},
+        .delegate = delegate,
+        .budget = budget,
+        .total = JAEGERTRACINGC_ALLOC_STATS_INIT};
+    for (int i = 0; i < jaeger_alloc_tag_count; i++) {
+        alloc->stats[i] = (jaeger_alloc_stats) JAEGERTRACINGC_ALLOC_STATS_INIT;
+    }
+#ifndef JAEGERTRACINGC_HAVE_ATOMICS
+    alloc->mutex = (jaeger_mutex) JAEGERTRACINGC_MUTEX_INIT;
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+}
+
+static inline void load_stats(const jaeger_accounting_allocator* alloc,
+                              const jaeger_alloc_stats* src,
+                              jaeger_alloc_stats* dst)
+{
+    LOCK((jaeger_accounting_allocator*) alloc);
+    dst->live_bytes = LOAD(src->live_bytes);
+    dst->peak_bytes = LOAD(src->peak_bytes);
+    dst->live_allocations = LOAD(src->live_allocations);
+    dst->num_allocations = LOAD(src->num_allocations);
+    dst->num_failures = LOAD(src->num_failures);
+    UNLOCK((jaeger_accounting_allocator*) alloc);
+}
+
+void jaeger_accounting_allocator_stats(
+    const jaeger_accounting_allocator* alloc,
+    jaeger_alloc_tag tag,
+    jaeger_alloc_stats* stats)
+{
+    assert(alloc != NULL);
+    assert(tag >= 0 && tag < jaeger_alloc_tag_count);
+    assert(stats != NULL);
+    load_stats(alloc, &alloc->stats[tag], stats);
+}
+
+void jaeger_accounting_allocator_total(
+    const jaeger_accounting_allocator* alloc, jaeger_alloc_stats* stats)
+{
+    assert(alloc != NULL);
+    assert(stats != NULL);
+    load_stats(alloc, &alloc->total, stats);
+}
+
+#define UPDATE_GAUGE(member, value)            \
+    do {                                       \
+        jaeger_gauge* gauge = metrics->member; \
+        assert(gauge != NULL);                 \
+        gauge->update(gauge, (value));         \
+    } while (0)
+
+void jaeger_accounting_allocator_update_metrics(
+    const jaeger_accounting_allocator* alloc, jaeger_metrics* metrics)
+{
+    assert(alloc != NULL);
+    assert(metrics != NULL);
+    jaeger_alloc_stats stats;
+    jaeger_accounting_allocator_total(alloc, &stats);
+    UPDATE_GAUGE(memory_bytes, stats.live_bytes);
+    UPDATE_GAUGE(memory_peak_bytes, stats.peak_bytes);
+    UPDATE_GAUGE(memory_allocations, stats.live_allocations);
+#define UPDATE_TAG_GAUGES(tag)                                                \
+    jaeger_accounting_allocator_stats(alloc, jaeger_alloc_tag_##tag, &stats); \
+    UPDATE_GAUGE(memory_##tag##_bytes, stats.live_bytes);                     \
+    UPDATE_GAUGE(memory_##tag##_peak_bytes, stats.peak_bytes);                \
+    UPDATE_GAUGE(memory_##tag##_allocations, stats.live_allocations);
+    JAEGERTRACINGC_ALLOC_TAGS(UPDATE_TAG_GAUGES)
+#undef UPDATE_TAG_GAUGES
+}
+
+#undef UPDATE_GAUGE
+#undef LOCK
+#undef UNLOCK
+#undef ADD
+#undef LOAD
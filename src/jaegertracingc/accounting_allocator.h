@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ * Allocator that accounts memory per subsystem and enforces a budget.
+ */
+
+#ifndef JAEGERTRACINGC_ACCOUNTING_ALLOCATOR_H
+#define JAEGERTRACINGC_ACCOUNTING_ALLOCATOR_H
+
+#include "jaegertracingc/alloc.h"
+#include "jaegertracingc/common.h"
+#include "jaegertracingc/metrics.h"
+#include "jaegertracingc/threading.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Subsystems memory is charged to, besides jaeger_alloc_tag_other. */
+#define JAEGERTRACINGC_ALLOC_TAGS(X) \
+    X(span)                          \
+    X(reporter)                      \
+    X(sampler)                       \
+    X(propagation)                   \
+    X(baggage)
+
+#define JAEGERTRACINGC_ALLOC_TAG_ENUM(tag) jaeger_alloc_tag_##tag,
+
+/** Subsystem an allocation is charged to. */
+typedef enum jaeger_alloc_tag {
+    /** Allocations made outside of any allocation context. */
+    jaeger_alloc_tag_other,
+    JAEGERTRACINGC_ALLOC_TAGS(JAEGERTRACINGC_ALLOC_TAG_ENUM)
+    /** Number of tags, not a valid tag. */
+    jaeger_alloc_tag_count
+} jaeger_alloc_tag;
+
+#undef JAEGERTRACINGC_ALLOC_TAG_ENUM
+
+/**
+ * Charge allocations made by the calling thread to a tag until the matching
+ * call to jaeger_alloc_context_exit. Contexts nest, and the innermost one
+ * wins. Memory stays charged to the tag it was allocated under, wherever it
+ * is reallocated or freed.
+ * @param tag Tag to charge.
+ * @return Tag of the enclosing context, to pass to jaeger_alloc_context_exit.
+ */
+jaeger_alloc_tag jaeger_alloc_context_enter(jaeger_alloc_tag tag);
+
+/**
+ * Leave the innermost allocation context.
+ * @param prev Tag returned by the matching jaeger_alloc_context_enter.
+ */
+void jaeger_alloc_context_exit(jaeger_alloc_tag prev);
+
+/**
+ * Get the tag allocations made by the calling thread are charged to.
+ * @return Tag of the innermost allocation context, or jaeger_alloc_tag_other.
+ */
+jaeger_alloc_tag jaeger_alloc_context_current(void);
+
+/**
+ * Get the name of a tag, i.e. "span" for jaeger_alloc_tag_span.
+ * @param tag Tag to name.
+ * @return Name of the tag, or NULL if the tag is invalid.
+ */
+const char* jaeger_alloc_tag_name(jaeger_alloc_tag tag);
+
+/** Memory usage of one tag, or of all of them. */
+typedef struct jaeger_alloc_stats {
+    /** Bytes requested by allocations that have not been freed yet. */
+    int64_t live_bytes;
+    /** Largest value live_bytes has reached. */
+    int64_t peak_bytes;
+    /** Number of allocations that have not been freed yet. */
+    int64_t live_allocations;
+    /** Number of successful allocations. */
+    int64_t num_allocations;
+    /** Number of allocations refused by the budget or the delegate. */
+    int64_t num_failures;
+} jaeger_alloc_stats;
+
+#define JAEGERTRACINGC_ALLOC_STATS_INIT                          \
+    {                                                            \
+        .live_bytes = 0, .peak_bytes = 0, .live_allocations = 0, \
+        .num_allocations = 0, .num_failures = 0                  \
+    }
+
+/**
+ * Allocator that forwards to another allocator and accounts every
+ * allocation to the tag of the allocation context it was made in. Each
+ * allocation carries a small header recording its size and tag, so frees
+ * are attributed correctly even without a size.
+ *
+ * A nonzero budget caps the total live bytes. Allocations made in the
+ * reporter context fail once they would exceed it, so the reporter drops new
+ * spans instead of queuing them. Other subsystems are never refused by the
+ * budget, since failing them would break spans that are still in progress,
+ * and the memory they hold is bounded by the spans in progress anyway.
+ * @extends jaeger_allocator
+ */
+typedef struct jaeger_accounting_allocator {
+    /** Base class member. */
+    jaeger_allocator base;
+    /** Allocator that provides the memory. */
+    jaeger_allocator* delegate;
+    /** Maximum total live bytes for reporter allocations, or zero. */
+    int64_t budget;
+    /** Usage of all tags combined. */
+    jaeger_alloc_stats total;
+    /** Usage of each tag. */
+    jaeger_alloc_stats stats[jaeger_alloc_tag_count];
+#ifndef JAEGERTRACINGC_HAVE_ATOMICS
+    /** Lock to avoid data races. */
+    jaeger_mutex mutex;
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+} jaeger_accounting_allocator;
+
+/**
+ * Initialize an accounting allocator. Install it with jaeger_set_allocator
+ * before any allocation made with the previous allocator is freed, or after
+ * all of them are.
+ * @param alloc Allocator to initialize.
+ * @param delegate Allocator that provides the memory, usually the one
+ *                 installed before.
+ * @param budget Maximum total live bytes before the reporter sheds spans, or
+ *               zero for no limit.
+ */
+void jaeger_accounting_allocator_init(jaeger_accounting_allocator* alloc,
+                                      jaeger_allocator* delegate,
+                                      int64_t budget);
+
+/**
+ * Read the usage of a tag.
+ * @param alloc Allocator to read.
+ * @param tag Tag to read.
+ * @param stats Output argument for the usage.
+ */
+void jaeger_accounting_allocator_stats(
+    const jaeger_accounting_allocator* alloc,
+    jaeger_alloc_tag tag,
+    jaeger_alloc_stats* stats);
+
+/**
+ * Read the usage of all tags combined.
+ * @param alloc Allocator to read.
+ * @param stats Output argument for the usage.
+ */
+void jaeger_accounting_allocator_total(
+    const jaeger_accounting_allocator* alloc, jaeger_alloc_stats* stats);
+
+/**
+ * Copy the current usage into the memory gauges of a metrics instance. Call
+ * it periodically, i.e. before taking a metrics snapshot.
+ * @param alloc Allocator to read.
+ * @param metrics Metrics to update.
+ */
+void jaeger_accounting_allocator_update_metrics(
+    const jaeger_accounting_allocator* alloc, jaeger_metrics* metrics);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif /* __cplusplus */
+
+#endif /* JAEGERTRACINGC_ACCOUNTING_ALLOCATOR_H */
@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jaegertracingc/accounting_allocator.h"
+#include "jaegertracingc/vector.h"
+#include "unity.h"
+
+#define NUM_THREADS 8
+#define NUM_BLOCKS 1000
+
+static inline jaeger_alloc_stats
+stats_of(const jaeger_accounting_allocator* alloc, jaeger_alloc_tag tag)
+{
+    jaeger_alloc_stats stats;
+    jaeger_accounting_allocator_stats(alloc, tag, &stats);
+    return stats;
+}
+
+static inline jaeger_alloc_stats
+total_of(const jaeger_accounting_allocator* alloc)
+{
+    jaeger_alloc_stats stats;
+    jaeger_accounting_allocator_total(alloc, &stats);
+    return stats;
+}
+
+static inline void test_context()
+{
+    TEST_ASSERT_EQUAL(jaeger_alloc_tag_other, jaeger_alloc_context_current());
+    const jaeger_alloc_tag outer =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_span);
+    TEST_ASSERT_EQUAL(jaeger_alloc_tag_other, outer);
+    const jaeger_alloc_tag inner =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_baggage);
+    TEST_ASSERT_EQUAL(jaeger_alloc_tag_span, inner);
+    TEST_ASSERT_EQUAL(jaeger_alloc_tag_baggage, jaeger_alloc_context_current());
+    jaeger_alloc_context_exit(inner);
+    TEST_ASSERT_EQUAL(jaeger_alloc_tag_span, jaeger_alloc_context_current());
+    jaeger_alloc_context_exit(outer);
+    TEST_ASSERT_EQUAL(jaeger_alloc_tag_other, jaeger_alloc_context_current());
+
+    TEST_ASSERT_EQUAL_STRING("other",
+                             jaeger_alloc_tag_name(jaeger_alloc_tag_other));
+    TEST_ASSERT_EQUAL_STRING("reporter",
+                             jaeger_alloc_tag_name(jaeger_alloc_tag_reporter));
+    TEST_ASSERT_NULL(jaeger_alloc_tag_name(jaeger_alloc_tag_count));
+}
+
+static inline void test_accounting()
+{
+    jaeger_accounting_allocator alloc;
+    jaeger_accounting_allocator_init(&alloc, jaeger_built_in_allocator(), 0);
+    jaeger_allocator* prev_alloc = jaeger_get_allocator();
+    jaeger_set_allocator((jaeger_allocator*) &alloc);
+
+    const jaeger_alloc_tag prev_tag =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_span);
+    char* ptr = jaeger_malloc(100);
+    TEST_ASSERT_NOT_NULL(ptr);
+    memset(ptr, 'a', 100);
+    jaeger_alloc_context_exit(prev_tag);
+    jaeger_alloc_stats stats = stats_of(&alloc, jaeger_alloc_tag_span);
+    TEST_ASSERT_EQUAL(100, stats.live_bytes);
+    TEST_ASSERT_EQUAL(1, stats.live_allocations);
+    TEST_ASSERT_EQUAL(1, stats.num_allocations);
+
+    /* Memory stays charged to the tag it was allocated under. */
+    ptr = jaeger_realloc(ptr, 200);
+    TEST_ASSERT_NOT_NULL(ptr);
+    ptr = jaeger_realloc(ptr, 50);
+    TEST_ASSERT_NOT_NULL(ptr);
+    stats = stats_of(&alloc, jaeger_alloc_tag_span);
+    TEST_ASSERT_EQUAL(50, stats.live_bytes);
+    TEST_ASSERT_EQUAL(200, stats.peak_bytes);
+    TEST_ASSERT_EQUAL(1, stats.live_allocations);
+    TEST_ASSERT_EQUAL(0, stats_of(&alloc, jaeger_alloc_tag_other).live_bytes);
+
+    char* str = jaeger_strdup("hello");
+    TEST_ASSERT_NOT_NULL(str);
+    TEST_ASSERT_EQUAL(sizeof("hello"),
+                      stats_of(&alloc, jaeger_alloc_tag_other).live_bytes);
+    stats = total_of(&alloc);
+    TEST_ASSERT_EQUAL(50 + sizeof("hello"), stats.live_bytes);
+    TEST_ASSERT_EQUAL(2, stats.live_allocations);
+
+    jaeger_free_sized(ptr, 50);
+    jaeger_free(str);
+    jaeger_free(NULL);
+    stats = total_of(&alloc);
+    TEST_ASSERT_EQUAL(0, stats.live_bytes);
+    TEST_ASSERT_EQUAL(0, stats.live_allocations);
+    TEST_ASSERT_EQUAL(2, stats.num_allocations);
+    TEST_ASSERT_EQUAL(0, stats.num_failures);
+
+    jaeger_set_allocator(prev_alloc);
+}
+
+static inline void test_budget()
+{
+    jaeger_accounting_allocator alloc;
+    jaeger_accounting_allocator_init(&alloc, jaeger_built_in_allocator(), 1000);
+    jaeger_allocator* prev_alloc = jaeger_get_allocator();
+    jaeger_set_allocator((jaeger_allocator*) &alloc);
+
+    jaeger_alloc_tag prev_tag =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_reporter);
+    void* first = jaeger_malloc(600);
+    TEST_ASSERT_NOT_NULL(first);
+    TEST_ASSERT_NULL(jaeger_malloc(600));
+    TEST_ASSERT_NULL(jaeger_realloc(first, 1200));
+    jaeger_alloc_context_exit(prev_tag);
+    TEST_ASSERT_EQUAL(2,
+                      stats_of(&alloc, jaeger_alloc_tag_reporter).num_failures);
+    TEST_ASSERT_EQUAL(600, total_of(&alloc).live_bytes);
+
+    /* Other subsystems may exceed the budget, but that leaves no room for the
+     * reporter. */
+    prev_tag = jaeger_alloc_context_enter(jaeger_alloc_tag_span);
+    void* second = jaeger_malloc(600);
+    TEST_ASSERT_NOT_NULL(second);
+    jaeger_alloc_context_exit(prev_tag);
+    prev_tag = jaeger_alloc_context_enter(jaeger_alloc_tag_reporter);
+    TEST_ASSERT_NULL(jaeger_malloc(1));
+    jaeger_alloc_context_exit(prev_tag);
+    jaeger_free(second);
+
+    /* Freeing memory makes room again, and a vector growing in the reporter
+     * context stops at the budget. */
+    prev_tag = jaeger_alloc_context_enter(jaeger_alloc_tag_reporter);
+    void* third = jaeger_malloc(300);
+    TEST_ASSERT_NOT_NULL(third);
+    jaeger_free(third);
+    jaeger_free(first);
+    jaeger_vector vec;
+    TEST_ASSERT_TRUE(jaeger_vector_init(&vec, sizeof(int64_t)));
+    bool refused = false;
+    for (int i = 0; i < 1000 && !refused; i++) {
+        refused = (jaeger_vector_append(&vec) == NULL);
+    }
+    TEST_ASSERT_TRUE(refused);
+    TEST_ASSERT_TRUE(total_of(&alloc).live_bytes <= 1000);
+    jaeger_vector_destroy(&vec);
+    jaeger_alloc_context_exit(prev_tag);
+    TEST_ASSERT_EQUAL(0, total_of(&alloc).live_bytes);
+    TEST_ASSERT_EQUAL(1200, total_of(&alloc).peak_bytes);
+
+    jaeger_set_allocator(prev_alloc);
+}
+
+static inline int64_t gauge_amount(jaeger_gauge* gauge)
+{
+    return ((jaeger_default_gauge*) gauge)->amount;
+}
+
+static inline void test_metrics()
+{
+    jaeger_accounting_allocator alloc;
+    jaeger_accounting_allocator_init(&alloc, jaeger_built_in_allocator(), 0);
+    jaeger_metrics metrics;
+    TEST_ASSERT_TRUE(jaeger_default_metrics_init(&metrics));
+
+    jaeger_allocator* base = (jaeger_allocator*) &alloc;
+    const jaeger_alloc_tag prev_tag =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_sampler);
+    void* ptr = base->malloc(base, 64);
+    TEST_ASSERT_NOT_NULL(ptr);
+    jaeger_alloc_context_exit(prev_tag);
+    void* other = base->malloc(base, 32);
+    TEST_ASSERT_NOT_NULL(other);
+    base->free(base, other);
+
+    jaeger_accounting_allocator_update_metrics(&alloc, &metrics);
+    TEST_ASSERT_EQUAL(64, gauge_amount(metrics.memory_bytes));
+    TEST_ASSERT_EQUAL(96, gauge_amount(metrics.memory_peak_bytes));
+    TEST_ASSERT_EQUAL(1, gauge_amount(metrics.memory_allocations));
+    TEST_ASSERT_EQUAL(64, gauge_amount(metrics.memory_sampler_bytes));
+    TEST_ASSERT_EQUAL(64, gauge_amount(metrics.memory_sampler_peak_bytes));
+    TEST_ASSERT_EQUAL(1, gauge_amount(metrics.memory_sampler_allocations));
+    TEST_ASSERT_EQUAL(0, gauge_amount(metrics.memory_span_bytes));
+
+    base->free(base, ptr);
+    jaeger_accounting_allocator_update_metrics(&alloc, &metrics);
+    TEST_ASSERT_EQUAL(0, gauge_amount(metrics.memory_sampler_bytes));
+    TEST_ASSERT_EQUAL(64, gauge_amount(metrics.memory_sampler_peak_bytes));
+    jaeger_metrics_destroy(&metrics);
+}
+
+static void* alloc_func(void* arg)
+{
+    jaeger_allocator* alloc = (jaeger_allocator*) arg;
+    static const jaeger_alloc_tag tags[] = {jaeger_alloc_tag_span,
+                                            jaeger_alloc_tag_reporter,
+                                            jaeger_alloc_tag_propagation};
+    void* blocks[NUM_BLOCKS];
+    for (int i = 0; i < NUM_BLOCKS; i++) {
+        const jaeger_alloc_tag prev_tag =
+            jaeger_alloc_context_enter(tags[i % 3]);
+        blocks[i] = alloc->malloc(alloc, i + 1);
+        TEST_ASSERT_NOT_NULL(blocks[i]);
+        jaeger_alloc_context_exit(prev_tag);
+    }
+    for (int i = 0; i < NUM_BLOCKS; i++) {
+        blocks[i] = alloc->realloc(alloc, blocks[i], 2 * (i + 1));
+        TEST_ASSERT_NOT_NULL(blocks[i]);
+    }
+    for (int i = 0; i < NUM_BLOCKS; i++) {
+        alloc->free_sized(alloc, blocks[i], 2 * (i + 1));
+    }
+    return NULL;
+}
+
+static inline void test_threads()
+{
+    jaeger_accounting_allocator alloc;
+    jaeger_accounting_allocator_init(&alloc, jaeger_built_in_allocator(), 0);
+    jaeger_thread threads[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; i++) {
+        TEST_ASSERT_EQUAL(0,
+                          jaeger_thread_init(&threads[i], &alloc_func, &alloc));
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        jaeger_thread_join(threads[i], NULL);
+    }
+    const jaeger_alloc_stats stats = total_of(&alloc);
+    TEST_ASSERT_EQUAL(0, stats.live_bytes);
+    TEST_ASSERT_EQUAL(0, stats.live_allocations);
+    TEST_ASSERT_EQUAL(NUM_THREADS * NUM_BLOCKS, stats.num_allocations);
+    TEST_ASSERT_EQUAL(NUM_THREADS * (NUM_BLOCKS / 3 + 1),
+                      stats_of(&alloc, jaeger_alloc_tag_span).num_allocations);
+    TEST_ASSERT_EQUAL(0, stats_of(&alloc, jaeger_alloc_tag_other).peak_bytes);
+}
+
+void test_accounting_allocator()
+{
+    test_context();
+    test_accounting();
+    test_budget();
+    test_metrics();
+    test_threads();
+}
@@ -21,6 +21,8 @@
 
 #include <jansson.h>
 
+#include "jaegertracingc/threading.h"
+
 static void* built_in_malloc(jaeger_allocator* alloc, size_t sz)
 {
     (void) alloc;
@@ -109,9 +111,71 @@ void jaeger_set_allocator(jaeger_allocator* alloc)
     *jaeger_global_allocator() = alloc;
 }
 
+#if defined(HAVE_THREAD_LOCAL) || !defined(JAEGERTRACINGC_MT)
+
+#ifdef HAVE_THREAD_LOCAL
+#define THREAD_LOCAL _Thread_local
+#else
+#define THREAD_LOCAL
+#endif /* HAVE_THREAD_LOCAL */
+
+static THREAD_LOCAL jaeger_allocator* thread_alloc = NULL;
+
+static inline jaeger_allocator* get_thread_alloc(void)
+{
+    return thread_alloc;
+}
+
+static inline void set_thread_alloc(jaeger_allocator* alloc)
+{
+    thread_alloc = alloc;
+}
+
+#else
+
+/* Not a jaeger_thread_local, since bindings are not owned by the thread and
+ * must not be destroyed on thread exit. */
+static pthread_key_t thread_alloc_key;
+
+static jaeger_once once = JAEGERTRACINGC_ONCE_INIT;
+
+static void init_thread_alloc_key(void)
+{
+    const int return_code = pthread_key_create(&thread_alloc_key, NULL);
+    (void) return_code;
+    assert(return_code == 0);
+}
+
+static inline jaeger_allocator* get_thread_alloc(void)
+{
+    jaeger_do_once(&once, &init_thread_alloc_key);
+    return (jaeger_allocator*) pthread_getspecific(thread_alloc_key);
+}
+
+static inline void set_thread_alloc(jaeger_allocator* alloc)
+{
+    jaeger_do_once(&once, &init_thread_alloc_key);
+    pthread_setspecific(thread_alloc_key, alloc);
+}
+
+#endif /* HAVE_THREAD_LOCAL || !JAEGERTRACINGC_MT */
+
 jaeger_allocator* jaeger_get_allocator(void)
 {
-    return *jaeger_global_allocator();
+    jaeger_allocator* alloc = get_thread_alloc();
+    return alloc != NULL ? alloc : *jaeger_global_allocator();
+}
+
+jaeger_allocator* jaeger_set_thread_allocator(jaeger_allocator* alloc)
+{
+    jaeger_allocator* prev = get_thread_alloc();
+    set_thread_alloc(alloc);
+    return prev;
+}
+
+jaeger_allocator* jaeger_get_thread_allocator(void)
+{
+    return get_thread_alloc();
 }
 
 void* jaeger_malloc(size_t sz)
@@ -132,6 +196,17 @@ void jaeger_free(void* ptr)
     alloc->free(alloc, ptr);
 }
 
+void jaeger_free_sized(void* ptr, size_t sz)
+{
+    jaeger_allocator* alloc = jaeger_get_allocator();
+    if (alloc->free_sized != NULL) {
+        alloc->free_sized(alloc, ptr, sz);
+    }
+    else {
+        alloc->free(alloc, ptr);
+    }
+}
+
 char* jaeger_strdup(const char* str)
 {
     assert(str != NULL);
@@ -32,7 +32,13 @@
 extern "C" {
 #endif /* __cplusplus */
 
-/** Interface to override default allocator. */
+/**
+ * Interface to override default allocator. Zero-initialize allocators, e.g.
+ * with a designated initializer or memset, before setting their functions,
+ * so that optional members added to the interface start out NULL. The
+ * interface grew free_sized after its first release, which changed its
+ * size and layout, so allocators must be compiled against this header.
+ */
 typedef struct jaeger_allocator {
     /**
      * malloc function override.
@@ -57,6 +63,18 @@ typedef struct jaeger_allocator {
      * @param ptr Pointer to he allocated memory to free.
      */
     void (*free)(struct jaeger_allocator* alloc, void* ptr);
+
+    /**
+     * Sized free function override. Optional, allocators that leave it NULL
+     * have free called instead. It is only NULL if the allocator was
+     * zero-initialized, otherwise it is indeterminate and will be called.
+     * Knowing the size lets an allocator find the size class of a block
+     * without a per-block header or a lookup.
+     * @param alloc Allocator instance.
+     * @param ptr Pointer to the allocated memory to free.
+     * @param sz Size most recently passed to malloc or realloc for ptr.
+     */
+    void (*free_sized)(struct jaeger_allocator* alloc, void* ptr, size_t sz);
 } jaeger_allocator;
 
 /**
@@ -79,11 +97,30 @@ jaeger_allocator* jaeger_null_allocator(void);
 void jaeger_set_allocator(jaeger_allocator* alloc);
 
 /**
- * Get the installed allocator.
+ * Get the allocator the calling thread allocates from, the one bound to the
+ * thread if any, or else the installed allocator.
  * @return alloc Allocator instance.
  */
 jaeger_allocator* jaeger_get_allocator(void);
 
+/**
+ * Bind an allocator to the calling thread, i.e. a request-scoped arena on a
+ * request-handling thread. Every allocation and free the thread makes goes to
+ * it until the binding changes. Spans remember the allocator they were started
+ * with and bind it again whenever they allocate or free, so they may be used
+ * from other threads.
+ * @param alloc Allocator instance, or NULL to use the installed allocator.
+ * @return Allocator previously bound to the thread, or NULL if none was. Pass
+ *         it to jaeger_set_thread_allocator to restore the binding.
+ */
+jaeger_allocator* jaeger_set_thread_allocator(jaeger_allocator* alloc);
+
+/**
+ * Get the allocator bound to the calling thread.
+ * @return Allocator bound to the thread, or NULL if none is.
+ */
+jaeger_allocator* jaeger_get_thread_allocator(void);
+
 /**
  * Returns result of call to malloc using installed allocator.
  * @param sz Size to be allocated.
@@ -105,6 +142,15 @@ void* jaeger_realloc(void* ptr, size_t sz);
  */
 void jaeger_free(void* ptr);
 
+/**
+ * Calls free_sized using installed allocator, or free if the allocator does
+ * not implement it.
+ * @param ptr Allocated address.
+ * @param sz Size most recently passed to jaeger_malloc or jaeger_realloc for
+ *           ptr.
+ */
+void jaeger_free_sized(void* ptr, size_t sz);
+
 /**
  * Duplicates string using provided allocator, logging to logger on failure.
  * @param str String to duplicate.
@@ -19,18 +19,52 @@
 #include <time.h>
 
 #include "jaegertracingc/logging.h"
+#include "jaegertracingc/threading.h"
 #include "unity.h"
 
+static void* unbound_thread_func(void* arg)
+{
+    (void) arg;
+    TEST_ASSERT_NULL(jaeger_get_thread_allocator());
+    void* mem = jaeger_malloc(1);
+    TEST_ASSERT_NOT_NULL(mem);
+    jaeger_free(mem);
+    return NULL;
+}
+
+static inline void test_thread_allocator()
+{
+    TEST_ASSERT_NULL(jaeger_get_thread_allocator());
+    TEST_ASSERT_NULL(jaeger_set_thread_allocator(jaeger_null_allocator()));
+    TEST_ASSERT_EQUAL_PTR(jaeger_null_allocator(), jaeger_get_allocator());
+    TEST_ASSERT_NULL(jaeger_malloc(1));
+
+    /* Bindings only affect the thread that made them. */
+    jaeger_thread thread;
+    TEST_ASSERT_EQUAL(
+        0, jaeger_thread_init(&thread, &unbound_thread_func, NULL));
+    jaeger_thread_join(thread, NULL);
+
+    TEST_ASSERT_EQUAL_PTR(jaeger_null_allocator(),
+                          jaeger_set_thread_allocator(NULL));
+    TEST_ASSERT_EQUAL_PTR(jaeger_built_in_allocator(), jaeger_get_allocator());
+}
+
 void test_alloc()
 {
     void* mem = jaeger_malloc(2);
     mem = jaeger_realloc(mem, 4);
     jaeger_free(mem);
+    mem = jaeger_malloc(8);
+    jaeger_free_sized(mem, 8);
 
     jaeger_set_allocator(jaeger_null_allocator());
     char* str = jaeger_strdup("hello world");
     TEST_ASSERT_NULL(str);
     /* Calling free even though null to improve coverage of null allocator. */
     jaeger_free(str);
+    jaeger_free_sized(str, 0);
     jaeger_set_allocator(jaeger_built_in_allocator());
+
+    test_thread_allocator();
 }
@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jaegertracingc/async_logger.h"
+#include "jaegertracingc/alloc.h"
+
+typedef enum log_level {
+    log_level_error,
+    log_level_warn,
+    log_level_info
+} log_level;
+
+/* The ring is a bounded queue in the style of Dmitry Vyukov's MPMC queue.
+ * Each entry's sequence tells whose turn it is: it equals the position when
+ * the entry is free to log into at that position, and the position plus one
+ * once the message is ready to write. The writer hands the entry back for
+ * the next lap by adding the capacity. */
+typedef struct jaeger_async_log_entry {
+    size_t sequence;
+    log_level level;
+    char message[JAEGERTRACINGC_ASYNC_LOG_MESSAGE_SIZE];
+} jaeger_async_log_entry;
+
+#ifdef JAEGERTRACINGC_HAVE_ATOMICS
+
+#define LOCK(logger) (void) (logger)
+#define UNLOCK(logger) (void) (logger)
+#define LOAD(x, order) __atomic_load_n(&(x), (order))
+#define STORE(x, value, order) __atomic_store_n(&(x), (value), (order))
+#define ADD(x, delta) __atomic_add_fetch(&(x), (delta), __ATOMIC_RELAXED)
+#define COMPARE_EXCHANGE(x, expected, desired)    \
+    __atomic_compare_exchange_n(&(x),             \
+                                (expected),       \
+                                (desired),        \
+                                true,             \
+                                __ATOMIC_RELAXED, \
+                                __ATOMIC_RELAXED)
+
+#else
+
+#define LOCK(logger) jaeger_mutex_lock(&(logger)->ring_mutex)
+#define UNLOCK(logger) jaeger_mutex_unlock(&(logger)->ring_mutex)
+#define LOAD(x, order) (x)
+#define STORE(x, value, order) ((x) = (value))
+#define ADD(x, delta) ((x) += (delta))
+
+static inline bool compare_exchange(size_t* x, size_t* expected, size_t desired)
+{
+    if (*x == *expected) {
+        *x = desired;
+        return true;
+    }
+    *expected = *x;
+    return false;
+}
+
+#define COMPARE_EXCHANGE(x, expected, desired) \
+    compare_exchange(&(x), (expected), (desired))
+
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+
+static inline jaeger_async_log_entry*
+entry_at(const jaeger_async_logger* logger, size_t position)
+{
+    return &logger->entries[position & (logger->capacity - 1)];
+}
+
+/* Returns the entry to log into, or NULL if the ring is full. */
+static inline jaeger_async_log_entry*
+claim_entry(jaeger_async_logger* logger, size_t* position)
+{
+    LOCK(logger);
+    size_t pos = LOAD(logger->head, __ATOMIC_RELAXED);
+    jaeger_async_log_entry* entry = NULL;
+    while (true) {
+        entry = entry_at(logger, pos);
+        const size_t sequence = LOAD(entry->sequence, __ATOMIC_ACQUIRE);
+        const intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+        if (diff == 0) {
+            if (COMPARE_EXCHANGE(logger->head, &pos, pos + 1)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            entry = NULL;
+            break;
+        }
+        else {
+            pos = LOAD(logger->head, __ATOMIC_RELAXED);
+        }
+    }
+    UNLOCK(logger);
+    *position = pos;
+    return entry;
+}
+
+static inline void publish_entry(jaeger_async_logger* logger,
+                                 jaeger_async_log_entry* entry,
+                                 size_t position)
+{
+    LOCK(logger);
+    STORE(entry->sequence, position + 1, __ATOMIC_SEQ_CST);
+    UNLOCK(logger);
+}
+
+/* Returns the next entry to write, or NULL if there is none yet. */
+static inline jaeger_async_log_entry*
+next_entry(jaeger_async_logger* logger)
+{
+    jaeger_async_log_entry* entry = entry_at(logger, logger->tail);
+    LOCK(logger);
+    const size_t sequence = LOAD(entry->sequence, __ATOMIC_SEQ_CST);
+    UNLOCK(logger);
+    return (sequence == logger->tail + 1) ? entry : NULL;
+}
+
+static inline void release_entry(jaeger_async_logger* logger,
+                                 jaeger_async_log_entry* entry)
+{
+    LOCK(logger);
+    STORE(entry->sequence,
+          logger->tail + logger->capacity,
+          __ATOMIC_RELEASE);
+    UNLOCK(logger);
+    logger->tail++;
+}
+
+static inline bool is_sleeping(jaeger_async_logger* logger)
+{
+    LOCK(logger);
+    const bool sleeping = LOAD(logger->sleeping, __ATOMIC_SEQ_CST);
+    UNLOCK(logger);
+    return sleeping;
+}
+
+static inline void set_sleeping(jaeger_async_logger* logger, bool sleeping)
+{
+    LOCK(logger);
+    STORE(logger->sleeping, sleeping, __ATOMIC_SEQ_CST);
+    UNLOCK(logger);
+}
+
+static inline int64_t load_num_dropped(jaeger_async_logger* logger)
+{
+    LOCK(logger);
+    const int64_t num_dropped = LOAD(logger->num_dropped, __ATOMIC_RELAXED);
+    UNLOCK(logger);
+    return num_dropped;
+}
+
+static inline const char* level_name(log_level level)
+{
+    switch (level) {
+    case log_level_error:
+        return "error";
+    case log_level_warn:
+        return "warn";
+    default:
+        return "info";
+    }
+}
+
+static void write_entries(jaeger_async_logger* logger)
+{
+    jaeger_async_log_entry* entry;
+    while ((entry = next_entry(logger)) != NULL) {
+        FILE* stream = (entry->level == log_level_info) ? logger->out
+                                                         : logger->err;
+        fprintf(stream, "%s: %s\n", level_name(entry->level), entry->message);
+        release_entry(logger, entry);
+    }
+
+    const int64_t num_dropped = load_num_dropped(logger);
+    if (num_dropped > logger->num_reported_dropped) {
+        fprintf(logger->err,
+                "warn: dropped %" PRId64 " log messages\n",
+                num_dropped - logger->num_reported_dropped);
+        logger->num_reported_dropped = num_dropped;
+    }
+}
+
+#ifdef JAEGERTRACINGC_MT
+
+static void* writer_main(void* arg)
+{
+    jaeger_async_logger* logger = (jaeger_async_logger*) arg;
+    bool running = true;
+    while (running) {
+        write_entries(logger);
+        jaeger_mutex_lock(&logger->mutex);
+        /* Loggers check sleeping after they publish, and the writer checks
+         * for entries after it sets sleeping. All four are sequentially
+         * consistent, so one side always sees the other and the wakeup is
+         * never lost. */
+        set_sleeping(logger, true);
+        while (logger->running && next_entry(logger) == NULL) {
+            jaeger_cond_wait(&logger->cond, &logger->mutex);
+        }
+        set_sleeping(logger, false);
+        running = logger->running;
+        jaeger_mutex_unlock(&logger->mutex);
+    }
+    write_entries(logger);
+    return NULL;
+}
+
+static inline void wake_writer(jaeger_async_logger* logger)
+{
+    if (is_sleeping(logger)) {
+        jaeger_mutex_lock(&logger->mutex);
+        jaeger_cond_signal(&logger->cond);
+        jaeger_mutex_unlock(&logger->mutex);
+    }
+}
+
+#else
+
+static inline void wake_writer(jaeger_async_logger* logger)
+{
+    /* No writer thread, so write right away. */
+    write_entries(logger);
+}
+
+#endif /* JAEGERTRACINGC_MT */
+
+static inline void
+async_log(jaeger_logger* l, log_level level, const char* format, va_list args)
+{
+    jaeger_async_logger* logger = (jaeger_async_logger*) l;
+    size_t position;
+    jaeger_async_log_entry* entry = claim_entry(logger, &position);
+    if (entry == NULL) {
+        LOCK(logger);
+        ADD(logger->num_dropped, 1);
+        UNLOCK(logger);
+        return;
+    }
+    entry->level = level;
+    vsnprintf(entry->message, sizeof(entry->message), format, args);
+    publish_entry(logger, entry, position);
+    wake_writer(logger);
+}
+
+#define ASYNC_LOG_FUNC(level)                                    \
+    static void async_log_##level(                               \
+        jaeger_logger* logger, const char* format, va_list args) \
+    {                                                            \
+        async_log(logger, log_level_##level, format, args);      \
+    }
+
+ASYNC_LOG_FUNC(error)
+ASYNC_LOG_FUNC(warn)
+ASYNC_LOG_FUNC(info)
+
+bool jaeger_async_logger_init(jaeger_async_logger* logger,
+                              size_t capacity,
+                              FILE* out,
+                              FILE* err)
+{
+    assert(logger != NULL);
+    assert(capacity > 0);
+    assert(out != NULL);
+    assert(err != NULL);
+    /* With one entry, a logger could claim it again before the writer sees
+     * it, since logging and writing the same position look alike. */
+    size_t power_of_two = 2;
+    while (power_of_two < capacity) {
+        power_of_two <<= 1;
+    }
+
+    *logger = (jaeger_async_logger){
+        .base = {.error = &async_log_error,
+                 .warn = &async_log_warn,
+                 .info = &async_log_info},
+        .entries = NULL,
+        .capacity = power_of_two,
+        .head = 0,
+        .tail = 0,
+        .num_dropped = 0,
+        .num_reported_dropped = 0,
+        .out = out,
+        .err = err,
+        .sleeping = false,
+        .running = true,
+        .mutex = JAEGERTRACINGC_MUTEX_INIT,
+        .cond = JAEGERTRACINGC_COND_INIT,
+#ifndef JAEGERTRACINGC_HAVE_ATOMICS
+        .ring_mutex = JAEGERTRACINGC_MUTEX_INIT,
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+    };
+
+    logger->entries = (jaeger_async_log_entry*) jaeger_malloc(
+        sizeof(jaeger_async_log_entry) * logger->capacity);
+    if (logger->entries == NULL) {
+        jaeger_log_error("Cannot allocate async logger ring, capacity = %zu",
+                         logger->capacity);
+        return false;
+    }
+    for (size_t i = 0; i < logger->capacity; i++) {
+        logger->entries[i].sequence = i;
+    }
+
+#ifdef JAEGERTRACINGC_MT
+    const int return_code =
+        jaeger_thread_init(&logger->thread, &writer_main, logger);
+    if (return_code != 0) {
+        jaeger_log_error("Cannot start async logger thread, return code = %d",
+                         return_code);
+        jaeger_free_sized(logger->entries,
+                          sizeof(jaeger_async_log_entry) * logger->capacity);
+        logger->entries = NULL;
+        return false;
+    }
+#endif /* JAEGERTRACINGC_MT */
+    return true;
+}
+
+int64_t jaeger_async_logger_num_dropped(jaeger_async_logger* logger)
+{
+    assert(logger != NULL);
+    return load_num_dropped(logger);
+}
+
+void jaeger_async_logger_destroy(jaeger_async_logger* logger)
+{
+    if (logger == NULL || logger->entries == NULL) {
+        return;
+    }
+
+#ifdef JAEGERTRACINGC_MT
+    jaeger_mutex_lock(&logger->mutex);
+    logger->running = false;
+    jaeger_cond_signal(&logger->cond);
+    jaeger_mutex_unlock(&logger->mutex);
+    jaeger_thread_join(logger->thread, NULL);
+#endif /* JAEGERTRACINGC_MT */
+
+    jaeger_free_sized(logger->entries,
+                      sizeof(jaeger_async_log_entry) * logger->capacity);
+    logger->entries = NULL;
+    jaeger_cond_destroy(&logger->cond);
+    jaeger_mutex_destroy(&logger->mutex);
+#ifndef JAEGERTRACINGC_HAVE_ATOMICS
+    jaeger_mutex_destroy(&logger->ring_mutex);
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+}
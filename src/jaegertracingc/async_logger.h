@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ * Logger that writes messages from a background thread.
+ */
+
+#ifndef JAEGERTRACINGC_ASYNC_LOGGER_H
+#define JAEGERTRACINGC_ASYNC_LOGGER_H
+
+#include "jaegertracingc/common.h"
+#include "jaegertracingc/logging.h"
+#include "jaegertracingc/threading.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Maximum length of a formatted message, including the null terminator.
+ *  Longer messages are truncated. */
+#define JAEGERTRACINGC_ASYNC_LOG_MESSAGE_SIZE 256
+
+struct jaeger_async_log_entry;
+
+/**
+ * Logger that formats messages into a fixed size ring and writes them from a
+ * background thread, so logging never blocks on the output streams. Logging
+ * threads do not lock unless the writer is idle and needs a wakeup. When the
+ * ring is full, messages are dropped and counted, and the writer reports the
+ * count once it catches up. Like the std logger, error and warn messages go
+ * to the error stream and info messages go to the output stream.
+ *
+ * Single-threaded builds have no background thread, so messages are written
+ * as soon as they are logged.
+ * @extends jaeger_logger
+ */
+typedef struct jaeger_async_logger {
+    /** Base class member. */
+    jaeger_logger base;
+    /** Ring of messages, capacity entries long. */
+    struct jaeger_async_log_entry* entries;
+    /** Number of entries, a power of two of at least two. */
+    size_t capacity;
+    /** Position of the next entry to log. */
+    size_t head;
+    /** Position of the next entry to write. Only used by the writer. */
+    size_t tail;
+    /** Number of messages dropped because the ring was full. */
+    int64_t num_dropped;
+    /** Number of dropped messages the writer has reported. */
+    int64_t num_reported_dropped;
+    /** Stream for info messages. */
+    FILE* out;
+    /** Stream for error and warn messages. */
+    FILE* err;
+    /** Whether the writer is waiting for messages. */
+    bool sleeping;
+    /** Whether the writer should keep running. */
+    bool running;
+    /** Background writer thread. */
+    jaeger_thread thread;
+    /** Lock for the writer's wakeups. */
+    jaeger_mutex mutex;
+    /** Condition the writer waits on. */
+    jaeger_cond cond;
+#ifndef JAEGERTRACINGC_HAVE_ATOMICS
+    /** Lock to avoid data races on the ring. */
+    jaeger_mutex ring_mutex;
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+} jaeger_async_logger;
+
+/**
+ * Initialize an async logger and start its writer. Install it with
+ * jaeger_set_logger_ptr, and destroy it only after installing another logger.
+ * @param logger Logger to initialize.
+ * @param capacity Maximum number of messages waiting to be written, rounded
+ *                 up to a power of two, and at least two.
+ * @param out Stream for info messages, i.e. stdout.
+ * @param err Stream for error and warn messages, i.e. stderr.
+ * @return True on success, false otherwise.
+ */
+bool jaeger_async_logger_init(jaeger_async_logger* logger,
+                              size_t capacity,
+                              FILE* out,
+                              FILE* err);
+
+/**
+ * Get the number of messages dropped because the ring was full.
+ * @param logger Logger to read.
+ * @return Number of dropped messages.
+ */
+int64_t jaeger_async_logger_num_dropped(jaeger_async_logger* logger);
+
+/**
+ * Write any pending messages, stop the writer and free the ring.
+ * @param logger Logger to destroy.
+ */
+void jaeger_async_logger_destroy(jaeger_async_logger* logger);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif /* __cplusplus */
+
+#endif /* JAEGERTRACINGC_ASYNC_LOGGER_H */
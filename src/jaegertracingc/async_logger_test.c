@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jaegertracingc/async_logger.h"
+#include "unity.h"
+
+#define NUM_THREADS 4
+#define NUM_MESSAGES 1000
+
+/* Counts lines in the stream that start with prefix. */
+static int count_lines(FILE* stream, const char* prefix)
+{
+    rewind(stream);
+    char line[JAEGERTRACINGC_ASYNC_LOG_MESSAGE_SIZE + 16];
+    int count = 0;
+    while (fgets(line, sizeof(line), stream) != NULL) {
+        if (strncmp(line, prefix, strlen(prefix)) == 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/* Adds up the drops the writer reported to the stream. */
+static int64_t sum_reported_drops(FILE* stream)
+{
+    rewind(stream);
+    char line[JAEGERTRACINGC_ASYNC_LOG_MESSAGE_SIZE + 16];
+    int64_t sum = 0;
+    while (fgets(line, sizeof(line), stream) != NULL) {
+        int64_t num_dropped;
+        if (sscanf(line, "warn: dropped %" SCNd64, &num_dropped) == 1) {
+            sum += num_dropped;
+        }
+    }
+    return sum;
+}
+
+static inline void test_async_logger_output()
+{
+    FILE* out = tmpfile();
+    TEST_ASSERT_NOT_NULL(out);
+    FILE* err = tmpfile();
+    TEST_ASSERT_NOT_NULL(err);
+
+    jaeger_async_logger logger;
+    TEST_ASSERT_TRUE(jaeger_async_logger_init(&logger, 3, out, err));
+    TEST_ASSERT_EQUAL(4, logger.capacity);
+    jaeger_set_logger_ptr((jaeger_logger*) &logger);
+    jaeger_log_error("error %d", 1);
+    jaeger_log_warn("warn %s", "2");
+    jaeger_log_info("info %d", 3);
+    jaeger_set_logger(jaeger_null_logger());
+    /* Destroying the logger writes everything still in the ring. */
+    jaeger_async_logger_destroy(&logger);
+
+    TEST_ASSERT_EQUAL(0, jaeger_async_logger_num_dropped(&logger));
+    TEST_ASSERT_EQUAL(1, count_lines(err, "error: error 1\n"));
+    TEST_ASSERT_EQUAL(1, count_lines(err, "warn: warn 2\n"));
+    TEST_ASSERT_EQUAL(0, count_lines(err, "info: "));
+    TEST_ASSERT_EQUAL(1, count_lines(out, "info: info 3\n"));
+    TEST_ASSERT_EQUAL(0, count_lines(out, "error: "));
+    fclose(out);
+    fclose(err);
+}
+
+static void* log_func(void* arg)
+{
+    (void) arg;
+    for (int i = 0; i < NUM_MESSAGES; i++) {
+        jaeger_log_error("message %d", i);
+    }
+    return NULL;
+}
+
+static inline void test_async_logger_drops()
+{
+    FILE* err = tmpfile();
+    TEST_ASSERT_NOT_NULL(err);
+
+    jaeger_async_logger logger;
+    TEST_ASSERT_TRUE(jaeger_async_logger_init(&logger, 1, stdout, err));
+    jaeger_set_logger_ptr((jaeger_logger*) &logger);
+    jaeger_thread threads[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; i++) {
+        TEST_ASSERT_EQUAL(0, jaeger_thread_init(&threads[i], &log_func, NULL));
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        jaeger_thread_join(threads[i], NULL);
+    }
+    jaeger_set_logger(jaeger_null_logger());
+    jaeger_async_logger_destroy(&logger);
+
+    /* Every message is either written or counted as dropped. */
+    const int64_t num_dropped = jaeger_async_logger_num_dropped(&logger);
+    TEST_ASSERT_EQUAL(NUM_THREADS * NUM_MESSAGES,
+                      count_lines(err, "error: message ") + num_dropped);
+    TEST_ASSERT_EQUAL(num_dropped, sum_reported_drops(err));
+    fclose(err);
+}
+
+void test_async_logger()
+{
+    test_async_logger_output();
+    test_async_logger_drops();
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * @file
+ * @internal
+ * Helpers for benchmark executables. A benchmark times a loop of iterations and
+ * counts the allocations made through the installed jaeger_allocator, so
+ * regressions in either show up in the output.
+ */
+
+#ifndef JAEGERTRACINGC_BENCHMARK_HELPERS_H
+#define JAEGERTRACINGC_BENCHMARK_HELPERS_H
+
+#include "jaegertracingc/alloc.h"
+#include "jaegertracingc/clock.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct jaeger_benchmark {
+    jaeger_allocator base;
+    jaeger_allocator* delegate;
+    const char* name;
+    int iterations;
+    int64_t num_allocations;
+    int64_t start;
+} jaeger_benchmark;
+
+static inline void* jaeger_benchmark_malloc(jaeger_allocator* alloc, size_t sz)
+{
+    jaeger_benchmark* benchmark = (jaeger_benchmark*) alloc;
+    benchmark->num_allocations++;
+    return benchmark->delegate->malloc(benchmark->delegate, sz);
+}
+
+static inline void*
+jaeger_benchmark_realloc(jaeger_allocator* alloc, void* ptr, size_t sz)
+{
+    jaeger_benchmark* benchmark = (jaeger_benchmark*) alloc;
+    benchmark->num_allocations++;
+    return benchmark->delegate->realloc(benchmark->delegate, ptr, sz);
+}
+
+static inline void jaeger_benchmark_free(jaeger_allocator* alloc, void* ptr)
+{
+    jaeger_benchmark* benchmark = (jaeger_benchmark*) alloc;
+    benchmark->delegate->free(benchmark->delegate, ptr);
+}
+
+static inline void
+jaeger_benchmark_free_sized(jaeger_allocator* alloc, void* ptr, size_t sz)
+{
+    jaeger_benchmark* benchmark = (jaeger_benchmark*) alloc;
+    jaeger_allocator* delegate = benchmark->delegate;
+    if (delegate->free_sized != NULL) {
+        delegate->free_sized(delegate, ptr, sz);
+    }
+    else {
+        delegate->free(delegate, ptr);
+    }
+}
+
+/**
+ * Start timing a benchmark and install its counting allocator.
+ * @param benchmark Benchmark instance.
+ * @param name Name to print in the results.
+ * @param iterations Number of iterations the caller will run.
+ */
+static inline void jaeger_benchmark_start(jaeger_benchmark* benchmark,
+                                          const char* name,
+                                          int iterations)
+{
+    assert(benchmark != NULL);
+    assert(iterations > 0);
+    *benchmark = (jaeger_benchmark){
+        .base = {.malloc = &jaeger_benchmark_malloc,
+                 .realloc = &jaeger_benchmark_realloc,
+                 .free = &jaeger_benchmark_free,
+                 .free_sized = &jaeger_benchmark_free_sized},
+        .delegate = jaeger_get_allocator(),
+        .name = name,
+        .iterations = iterations,
+        .num_allocations = 0,
+        .start = 0};
+    jaeger_set_allocator((jaeger_allocator*) benchmark);
+    benchmark->start = jaeger_duration_now_ns();
+}
+
+/**
+ * Stop timing a benchmark, restore the previous allocator, and print the
+ * time and allocations per iteration.
+ * @param benchmark Benchmark instance.
+ */
+static inline void jaeger_benchmark_stop(jaeger_benchmark* benchmark)
+{
+    assert(benchmark != NULL);
+    const int64_t end = jaeger_duration_now_ns();
+    jaeger_set_allocator(benchmark->delegate);
+    const double elapsed_ns = (double) (end - benchmark->start);
+    printf("%-40s %12.1f ns/op %10.2f allocs/op\n",
+           benchmark->name,
+           elapsed_ns / benchmark->iterations,
+           (double) benchmark->num_allocations / benchmark->iterations);
+}
+
+#ifdef __cplusplus
+} /* extern C */
+#endif /* __cplusplus */
+
+#endif /* JAEGERTRACINGC_BENCHMARK_HELPERS_H */
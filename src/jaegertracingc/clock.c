@@ -15,25 +15,314 @@
  */
 
 #include "jaegertracingc/clock.h"
+#include "jaegertracingc/threading.h"
 
-void jaeger_timestamp_now(jaeger_timestamp* timestamp)
+#if defined(__x86_64__) && defined(__GNUC__) && defined(__SIZEOF_INT128__)
+#define HAVE_TSC
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif /* __x86_64__ && __GNUC__ && __SIZEOF_INT128__ */
+
+#define CALIBRATION_NS (10 * 1000 * 1000)
+
+static inline int64_t read_clock(clockid_t clock_id)
 {
-    assert(timestamp != NULL);
     struct timespec t;
-    clock_gettime(CLOCK_REALTIME, &t);
-    timestamp->value.tv_sec = t.tv_sec;
-    timestamp->value.tv_nsec = t.tv_nsec;
+    clock_gettime(clock_id, &t);
+    return (int64_t) t.tv_sec * JAEGERTRACINGC_NANOSECONDS_PER_SECOND +
+           t.tv_nsec;
+}
+
+static int64_t system_timestamp_now(jaeger_clock* clock)
+{
+    (void) clock;
+    return read_clock(CLOCK_REALTIME);
+}
+
+static int64_t system_duration_now(jaeger_clock* clock)
+{
+    (void) clock;
+    return read_clock(CLOCK_MONOTONIC);
+}
+
+static void
+system_now(jaeger_clock* clock, int64_t* timestamp, int64_t* duration)
+{
+    assert(timestamp != NULL);
+    assert(duration != NULL);
+    *timestamp = system_timestamp_now(clock);
+    *duration = system_duration_now(clock);
 }
 
-#define JAEGERTRACINGC_DURATION_INIT JAEGERTRACINGC_TIMESTAMP_INIT
+#define SYSTEM_CLOCK_INIT                                        \
+    {                                                            \
+        .timestamp_now = &system_timestamp_now,                  \
+        .duration_now = &system_duration_now, .now = &system_now \
+    }
+
+jaeger_clock* jaeger_system_clock(void)
+{
+    static jaeger_clock system_clock = SYSTEM_CLOCK_INIT;
+    return &system_clock;
+}
+
+#if defined(CLOCK_REALTIME_COARSE) && defined(CLOCK_MONOTONIC_COARSE)
+
+static int64_t coarse_timestamp_now(jaeger_clock* clock)
+{
+    (void) clock;
+    return read_clock(CLOCK_REALTIME_COARSE);
+}
+
+static int64_t coarse_duration_now(jaeger_clock* clock)
+{
+    (void) clock;
+    return read_clock(CLOCK_MONOTONIC_COARSE);
+}
+
+static void
+coarse_now(jaeger_clock* clock, int64_t* timestamp, int64_t* duration)
+{
+    assert(timestamp != NULL);
+    assert(duration != NULL);
+    *timestamp = coarse_timestamp_now(clock);
+    *duration = coarse_duration_now(clock);
+}
+
+jaeger_clock* jaeger_coarse_clock(void)
+{
+    static jaeger_clock coarse_clock = {.timestamp_now = &coarse_timestamp_now,
+                                        .duration_now = &coarse_duration_now,
+                                        .now = &coarse_now};
+    return &coarse_clock;
+}
+
+#else
+
+jaeger_clock* jaeger_coarse_clock(void)
+{
+    return jaeger_system_clock();
+}
+
+#endif /* CLOCK_REALTIME_COARSE && CLOCK_MONOTONIC_COARSE */
+
+#ifdef HAVE_TSC
+
+/* Steady time is base_ns + ((rdtsc - base_tsc) * ns_per_tick >> 32). */
+static struct {
+    uint64_t base_tsc;
+    int64_t base_ns;
+    uint64_t ns_per_tick;
+    bool supported;
+} tsc_calibration;
+
+static jaeger_once tsc_once = JAEGERTRACINGC_ONCE_INIT;
+
+static inline bool have_invariant_tsc(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 ||
+        eax < 0x80000007) {
+        return false;
+    }
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx & (1u << 8u)) != 0;
+}
+
+static void calibrate_tsc(void)
+{
+    if (!have_invariant_tsc()) {
+        return;
+    }
+    const int64_t start_ns = read_clock(CLOCK_MONOTONIC);
+    const uint64_t start_tsc = __rdtsc();
+    const struct timespec delay = {.tv_sec = 0, .tv_nsec = CALIBRATION_NS};
+    nanosleep(&delay, NULL);
+    const int64_t end_ns = read_clock(CLOCK_MONOTONIC);
+    const uint64_t end_tsc = __rdtsc();
+    if (end_tsc <= start_tsc || end_ns <= start_ns) {
+        return;
+    }
+    tsc_calibration.ns_per_tick =
+        (uint64_t) (((unsigned __int128) (end_ns - start_ns) << 32u) /
+                    (end_tsc - start_tsc));
+    tsc_calibration.base_tsc = end_tsc;
+    tsc_calibration.base_ns = end_ns;
+    tsc_calibration.supported = tsc_calibration.ns_per_tick != 0;
+}
+
+static int64_t tsc_duration_now(jaeger_clock* clock)
+{
+    (void) clock;
+    /* Signed, in case another core's counter lags the calibrating one. */
+    const int64_t ticks = (int64_t) (__rdtsc() - tsc_calibration.base_tsc);
+    return tsc_calibration.base_ns +
+           (int64_t) (((__int128) ticks * tsc_calibration.ns_per_tick) >> 32);
+}
+
+static void tsc_now(jaeger_clock* clock, int64_t* timestamp, int64_t* duration)
+{
+    assert(timestamp != NULL);
+    assert(duration != NULL);
+    *timestamp = system_timestamp_now(clock);
+    *duration = tsc_duration_now(clock);
+}
+
+jaeger_clock* jaeger_tsc_clock(void)
+{
+    static jaeger_clock tsc_clock = {.timestamp_now = &system_timestamp_now,
+                                     .duration_now = &tsc_duration_now,
+                                     .now = &tsc_now};
+    jaeger_do_once(&tsc_once, &calibrate_tsc);
+    return tsc_calibration.supported ? &tsc_clock : NULL;
+}
+
+#else
+
+jaeger_clock* jaeger_tsc_clock(void)
+{
+    return NULL;
+}
+
+#endif /* HAVE_TSC */
+
+static inline int64_t load_int64(const int64_t* value)
+{
+#ifdef JAEGERTRACINGC_HAVE_ATOMICS
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#else
+    return *value;
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+}
+
+static inline void store_int64(int64_t* value, int64_t new_value)
+{
+#ifdef JAEGERTRACINGC_HAVE_ATOMICS
+    __atomic_store_n(value, new_value, __ATOMIC_RELEASE);
+#else
+    *value = new_value;
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+}
+
+/* Returns the offset of wall time from steady time, refreshing it if the
+ * interval has passed. The offset is stored before the refresh deadline and
+ * loaded after it, so a thread that sees a deadline also sees its offset.
+ * Threads that refresh at the same time store offsets that differ only by
+ * the time between their reads, so the race is harmless. */
+static inline int64_t derived_clock_offset(jaeger_derived_clock* clock,
+                                           int64_t steady_ns)
+{
+#ifndef JAEGERTRACINGC_HAVE_ATOMICS
+    jaeger_mutex_lock(&clock->mutex);
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+    const int64_t next_refresh = load_int64(&clock->next_refresh);
+    int64_t offset = load_int64(&clock->offset);
+    if (steady_ns >= next_refresh) {
+        offset = clock->source->timestamp_now(clock->source) - steady_ns;
+        store_int64(&clock->offset, offset);
+        store_int64(&clock->next_refresh, steady_ns + clock->refresh_interval);
+    }
+#ifndef JAEGERTRACINGC_HAVE_ATOMICS
+    jaeger_mutex_unlock(&clock->mutex);
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+    return offset;
+}
+
+static int64_t derived_duration_now(jaeger_clock* clock)
+{
+    assert(clock != NULL);
+    jaeger_clock* source = ((jaeger_derived_clock*) clock)->source;
+    return source->duration_now(source);
+}
+
+static void
+derived_now(jaeger_clock* clock, int64_t* timestamp, int64_t* duration)
+{
+    assert(timestamp != NULL);
+    assert(duration != NULL);
+    const int64_t steady_ns = derived_duration_now(clock);
+    *duration = steady_ns;
+    *timestamp = steady_ns + derived_clock_offset((jaeger_derived_clock*) clock,
+                                                  steady_ns);
+}
+
+static int64_t derived_timestamp_now(jaeger_clock* clock)
+{
+    int64_t timestamp;
+    int64_t duration;
+    derived_now(clock, &timestamp, &duration);
+    return timestamp;
+}
+
+void jaeger_derived_clock_init(jaeger_derived_clock* clock,
+                               jaeger_clock* source,
+                               int64_t refresh_interval)
+{
+    assert(clock != NULL);
+    assert(source != NULL);
+    assert(refresh_interval >= 0);
+    *clock = (jaeger_derived_clock){
+        .base = {.timestamp_now = &derived_timestamp_now,
+                 .duration_now = &derived_duration_now,
+                 .now = &derived_now},
+        .source = source,
+        .refresh_interval = refresh_interval,
+        .offset = 0,
+        .next_refresh = INT64_MIN,
+#ifndef JAEGERTRACINGC_HAVE_ATOMICS
+        .mutex = JAEGERTRACINGC_MUTEX_INIT
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+    };
+}
+
+static jaeger_clock** jaeger_global_clock(void)
+{
+    static jaeger_clock system_clock = SYSTEM_CLOCK_INIT;
+    static jaeger_clock* clock = &system_clock;
+    return &clock;
+}
+
+void jaeger_set_clock(jaeger_clock* clock)
+{
+    assert(clock != NULL);
+    *jaeger_global_clock() = clock;
+}
+
+jaeger_clock* jaeger_get_clock(void)
+{
+    return *jaeger_global_clock();
+}
+
+int64_t jaeger_timestamp_now_ns(void)
+{
+    jaeger_clock* clock = jaeger_get_clock();
+    return clock->timestamp_now(clock);
+}
+
+int64_t jaeger_duration_now_ns(void)
+{
+    jaeger_clock* clock = jaeger_get_clock();
+    return clock->duration_now(clock);
+}
+
+void jaeger_time_now(int64_t* timestamp, int64_t* duration)
+{
+    assert(timestamp != NULL);
+    assert(duration != NULL);
+    jaeger_clock* clock = jaeger_get_clock();
+    clock->now(clock, timestamp, duration);
+}
+
+void jaeger_timestamp_now(jaeger_timestamp* timestamp)
+{
+    assert(timestamp != NULL);
+    jaeger_time_value_from_ns(jaeger_timestamp_now_ns(), &timestamp->value);
+}
 
 void jaeger_duration_now(jaeger_duration* duration)
 {
     assert(duration != NULL);
-    struct timespec t;
-    clock_gettime(CLOCK_MONOTONIC, &t);
-    duration->value.tv_sec = t.tv_sec;
-    duration->value.tv_nsec = t.tv_nsec;
+    jaeger_time_value_from_ns(jaeger_duration_now_ns(), &duration->value);
 }
 
 // Algorithm based on
@@ -24,6 +24,10 @@
 
 #include "jaegertracingc/common.h"
 
+#ifndef JAEGERTRACINGC_HAVE_ATOMICS
+#include "jaegertracingc/threading.h"
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -54,14 +58,177 @@ typedef opentracing_timestamp jaeger_timestamp;
         .value = {.tv_sec = 0, .tv_nsec = 0 } \
     }
 
+#define JAEGERTRACINGC_DURATION_INIT JAEGERTRACINGC_TIMESTAMP_INIT
+
+/**
+ * Convert a time value to nanoseconds. Internally, times are kept as
+ * nanosecond counts, so that computing durations is a subtraction.
+ * @param value Time value.
+ * @return Nanoseconds in value.
+ */
+static inline int64_t
+jaeger_time_value_to_ns(const opentracing_time_value* value)
+{
+    assert(value != NULL);
+    return (int64_t) value->tv_sec * JAEGERTRACINGC_NANOSECONDS_PER_SECOND +
+           value->tv_nsec;
+}
+
+/**
+ * Convert nanoseconds to a time value with tv_nsec in [0, 1e9).
+ * @param ns Nanoseconds.
+ * @param value Output argument for the time value.
+ */
+static inline void jaeger_time_value_from_ns(int64_t ns,
+                                             opentracing_time_value* value)
+{
+    assert(value != NULL);
+    int64_t sec = ns / JAEGERTRACINGC_NANOSECONDS_PER_SECOND;
+    int64_t nsec = ns % JAEGERTRACINGC_NANOSECONDS_PER_SECOND;
+    if (nsec < 0) {
+        nsec += JAEGERTRACINGC_NANOSECONDS_PER_SECOND;
+        sec--;
+    }
+    value->tv_sec = sec;
+    value->tv_nsec = nsec;
+}
+
+/**
+ * Interface to override how the tracer reads time. Wall time (timestamps) is
+ * used for span start times and logs, steady time (durations) for span
+ * durations and rate limiting. Both are nanosecond counts.
+ */
+typedef struct jaeger_clock {
+    /**
+     * Read wall time.
+     * @param clock Clock instance.
+     * @return Nanoseconds since the Unix epoch.
+     */
+    int64_t (*timestamp_now)(struct jaeger_clock* clock);
+
+    /**
+     * Read steady time, which never goes backwards.
+     * @param clock Clock instance.
+     * @return Nanoseconds since an arbitrary, fixed point.
+     */
+    int64_t (*duration_now)(struct jaeger_clock* clock);
+
+    /**
+     * Read wall and steady time together, as when starting a span.
+     * @param clock Clock instance.
+     * @param timestamp Output argument for the current wall time.
+     * @param duration Output argument for the current steady time.
+     */
+    void (*now)(struct jaeger_clock* clock,
+                int64_t* timestamp,
+                int64_t* duration);
+} jaeger_clock;
+/**
+ * Clock that reads CLOCK_REALTIME and CLOCK_MONOTONIC. Used by default.
+ * @return Shared instance of system clock. DO NOT MODIFY MEMBERS!
+ */
+jaeger_clock* jaeger_system_clock(void);
+
+/**
+ * Clock that reads CLOCK_REALTIME_COARSE and CLOCK_MONOTONIC_COARSE where
+ * available, and the system clocks otherwise. Much cheaper to read, but
+ * only as precise as the kernel tick, typically 1-4ms, so short spans may
+ * report a zero duration.
+ * @return Shared instance of coarse clock. DO NOT MODIFY MEMBERS!
+ */
+jaeger_clock* jaeger_coarse_clock(void);
+
+/**
+ * Clock that derives steady time from the CPU timestamp counter, calibrated
+ * against CLOCK_MONOTONIC on first use. Wall time is still read from
+ * CLOCK_REALTIME; wrap in a derived clock to avoid that.
+ * @return Shared instance of TSC clock, or NULL if the CPU does not have an
+ *         invariant timestamp counter. DO NOT MODIFY MEMBERS!
+ */
+jaeger_clock* jaeger_tsc_clock(void);
+
+/**
+ * Clock that reads only steady time and derives wall time by adding an
+ * offset, which is refreshed from the wall clock at a fixed interval. Reading
+ * both times costs a single steady read. Wall time follows adjustments to
+ * the system clock only at the next refresh.
+ * @extends jaeger_clock
+ */
+typedef struct jaeger_derived_clock {
+    /** Base class member. */
+    jaeger_clock base;
+    /** Clock providing steady time, and wall time for refreshes. */
+    jaeger_clock* source;
+    /** Interval between offset refreshes, in nanoseconds. */
+    int64_t refresh_interval;
+    /** Wall time minus steady time, in nanoseconds. */
+    int64_t offset;
+    /** Steady time of the next refresh, in nanoseconds. */
+    int64_t next_refresh;
+#ifndef JAEGERTRACINGC_HAVE_ATOMICS
+    /** Lock to avoid data races. */
+    jaeger_mutex mutex;
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+} jaeger_derived_clock;
+
+/**
+ * Initialize a derived clock.
+ * @param clock Clock to initialize.
+ * @param source Clock to derive time from. Must outlive clock.
+ * @param refresh_interval Interval between offset refreshes, in
+ *                         nanoseconds.
+ */
+void jaeger_derived_clock_init(jaeger_derived_clock* clock,
+                               jaeger_clock* source,
+                               int64_t refresh_interval);
+
+/**
+ * Set the installed clock.
+ * @param clock Clock instance.
+ */
+void jaeger_set_clock(jaeger_clock* clock);
+
+/**
+ * Get the installed clock.
+ * @return Clock instance.
+ */
+jaeger_clock* jaeger_get_clock(void);
+
+/**
+ * Read wall time from the installed clock.
+ * @param timestamp Output argument for the current wall time.
+ */
 void jaeger_timestamp_now(jaeger_timestamp* timestamp);
 
 int64_t jaeger_timestamp_microseconds(const jaeger_timestamp* const timestamp);
 
-#define JAEGERTRACINGC_DURATION_INIT JAEGERTRACINGC_TIMESTAMP_INIT
-
+/**
+ * Read steady time from the installed clock.
+ * @param duration Output argument for the current steady time.
+ */
 void jaeger_duration_now(jaeger_duration* duration);
 
+/**
+ * Read wall time from the installed clock.
+ * @return Nanoseconds since the Unix epoch.
+ */
+int64_t jaeger_timestamp_now_ns(void);
+
+/**
+ * Read steady time from the installed clock.
+ * @return Nanoseconds since an arbitrary, fixed point.
+ */
+int64_t jaeger_duration_now_ns(void);
+
+/**
+ * Read wall and steady time from the installed clock in one call.
+ * @param timestamp Output argument for the current wall time, in
+ *                  nanoseconds.
+ * @param duration Output argument for the current steady time, in
+ *                 nanoseconds.
+ */
+void jaeger_time_now(int64_t* timestamp, int64_t* duration);
+
 // Algorithm based on
 // http://www.gnu.org/software/libc/manual/html_node/Elapsed-Time.html.
 bool jaeger_time_subtract(opentracing_time_value lhs,
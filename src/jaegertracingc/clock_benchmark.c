@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jaegertracingc/benchmark_helpers.h"
+#include "jaegertracingc/clock.h"
+
+#define NUM_ITERATIONS 10000000
+
+/* Keeps the compiler from discarding results of the benchmarked calls. */
+static volatile int64_t sink;
+
+static void benchmark_clock(const char* name, jaeger_clock* clock)
+{
+    char benchmark_name[64];
+    int64_t timestamp;
+    int64_t duration;
+    jaeger_benchmark benchmark;
+
+    snprintf(benchmark_name, sizeof(benchmark_name), "%s/duration_now", name);
+    jaeger_benchmark_start(&benchmark, benchmark_name, NUM_ITERATIONS);
+    for (int i = 0; i < NUM_ITERATIONS; i++) {
+        sink += clock->duration_now(clock);
+    }
+    jaeger_benchmark_stop(&benchmark);
+
+    /* What starting a span costs. */
+    snprintf(benchmark_name, sizeof(benchmark_name), "%s/now", name);
+    jaeger_benchmark_start(&benchmark, benchmark_name, NUM_ITERATIONS);
+    for (int i = 0; i < NUM_ITERATIONS; i++) {
+        clock->now(clock, &timestamp, &duration);
+        sink += timestamp + duration;
+    }
+    jaeger_benchmark_stop(&benchmark);
+}
+
+int main()
+{
+    const int64_t refresh_interval = JAEGERTRACINGC_NANOSECONDS_PER_SECOND;
+    benchmark_clock("system", jaeger_system_clock());
+    benchmark_clock("coarse", jaeger_coarse_clock());
+
+    jaeger_derived_clock derived_clock;
+    jaeger_derived_clock_init(
+        &derived_clock, jaeger_system_clock(), refresh_interval);
+    benchmark_clock("derived_system", (jaeger_clock*) &derived_clock);
+    jaeger_derived_clock_init(
+        &derived_clock, jaeger_coarse_clock(), refresh_interval);
+    benchmark_clock("derived_coarse", (jaeger_clock*) &derived_clock);
+
+    jaeger_clock* tsc_clock = jaeger_tsc_clock();
+    if (tsc_clock != NULL) {
+        benchmark_clock("tsc", tsc_clock);
+        jaeger_derived_clock_init(&derived_clock, tsc_clock, refresh_interval);
+        benchmark_clock("derived_tsc", (jaeger_clock*) &derived_clock);
+    }
+    return 0;
+}
@@ -18,10 +18,148 @@
 #include "jaegertracingc/clock.h"
 #include "unity.h"
 
-#define NS_PER_S JAEGERTRACINGC_NANOSECONDS_PER_SECOND
+#define NS_PER_S ((int64_t) JAEGERTRACINGC_NANOSECONDS_PER_SECOND)
+
+/* Clock whose readings are set by the test. */
+typedef struct fake_clock {
+    jaeger_clock base;
+    int64_t wall;
+    int64_t steady;
+    int num_wall_reads;
+} fake_clock;
+
+static int64_t fake_timestamp_now(jaeger_clock* clock)
+{
+    fake_clock* fake = (fake_clock*) clock;
+    fake->num_wall_reads++;
+    return fake->wall;
+}
+
+static int64_t fake_duration_now(jaeger_clock* clock)
+{
+    return ((fake_clock*) clock)->steady;
+}
+
+static void fake_now(jaeger_clock* clock, int64_t* timestamp, int64_t* duration)
+{
+    *timestamp = fake_timestamp_now(clock);
+    *duration = fake_duration_now(clock);
+}
+
+/* Checks that a clock agrees with the system clock within tolerance. */
+static inline void check_clock(jaeger_clock* clock, int64_t tolerance)
+{
+    jaeger_clock* system_clock = jaeger_system_clock();
+    int64_t expected_wall;
+    int64_t expected_steady;
+    system_clock->now(system_clock, &expected_wall, &expected_steady);
+    int64_t wall;
+    int64_t steady;
+    clock->now(clock, &wall, &steady);
+    TEST_ASSERT_LESS_OR_EQUAL(tolerance, llabs(wall - expected_wall));
+    TEST_ASSERT_LESS_OR_EQUAL(tolerance, llabs(steady - expected_steady));
+
+    for (int i = 0; i < 1000; i++) {
+        const int64_t later = clock->duration_now(clock);
+        TEST_ASSERT_GREATER_OR_EQUAL(steady, later);
+        steady = later;
+    }
+    wall = clock->timestamp_now(clock);
+    TEST_ASSERT_LESS_OR_EQUAL(tolerance, llabs(wall - expected_wall));
+}
+
+static inline void test_clocks()
+{
+    const int64_t tolerance = NS_PER_S / 10;
+    check_clock(jaeger_system_clock(), tolerance);
+    check_clock(jaeger_coarse_clock(), tolerance);
+
+    /* Not every CPU, or virtual machine, has an invariant TSC. */
+    jaeger_clock* tsc_clock = jaeger_tsc_clock();
+    if (tsc_clock != NULL) {
+        check_clock(tsc_clock, tolerance);
+        TEST_ASSERT_EQUAL_PTR(tsc_clock, jaeger_tsc_clock());
+    }
+
+    jaeger_derived_clock derived_clock;
+    jaeger_derived_clock_init(&derived_clock, jaeger_system_clock(), NS_PER_S);
+    check_clock((jaeger_clock*) &derived_clock, tolerance);
+}
+
+static inline void test_derived_clock()
+{
+    fake_clock source = {.base = {.timestamp_now = &fake_timestamp_now,
+                                  .duration_now = &fake_duration_now,
+                                  .now = &fake_now},
+                         .wall = 1000 * NS_PER_S,
+                         .steady = 10 * NS_PER_S,
+                         .num_wall_reads = 0};
+    jaeger_derived_clock clock;
+    jaeger_derived_clock_init(&clock, (jaeger_clock*) &source, NS_PER_S);
+    jaeger_clock* c = (jaeger_clock*) &clock;
+
+    /* The first read sets the offset. */
+    int64_t wall;
+    int64_t steady;
+    c->now(c, &wall, &steady);
+    TEST_ASSERT_EQUAL(1000 * NS_PER_S, wall);
+    TEST_ASSERT_EQUAL(10 * NS_PER_S, steady);
+    TEST_ASSERT_EQUAL(1, source.num_wall_reads);
+
+    /* Until the next refresh, wall time follows steady time, even if the wall
+     * clock is adjusted. */
+    source.steady += NS_PER_S / 2;
+    source.wall = 2000 * NS_PER_S;
+    TEST_ASSERT_EQUAL(1000 * NS_PER_S + NS_PER_S / 2, c->timestamp_now(c));
+    TEST_ASSERT_EQUAL(1, source.num_wall_reads);
+
+    source.steady = 11 * NS_PER_S;
+    c->now(c, &wall, &steady);
+    TEST_ASSERT_EQUAL(2000 * NS_PER_S, wall);
+    TEST_ASSERT_EQUAL(2, source.num_wall_reads);
+    TEST_ASSERT_EQUAL(11 * NS_PER_S, c->duration_now(c));
+    TEST_ASSERT_EQUAL(2, source.num_wall_reads);
+
+    /* The installed clock serves every read. */
+    jaeger_set_clock(c);
+    TEST_ASSERT_EQUAL_PTR(c, jaeger_get_clock());
+    jaeger_timestamp timestamp;
+    jaeger_timestamp_now(&timestamp);
+    TEST_ASSERT_EQUAL(2000, timestamp.value.tv_sec);
+    TEST_ASSERT_EQUAL(0, timestamp.value.tv_nsec);
+    jaeger_duration duration;
+    jaeger_duration_now(&duration);
+    TEST_ASSERT_EQUAL(11, duration.value.tv_sec);
+    source.steady += NS_PER_S / 4;
+    jaeger_time_now(&wall, &steady);
+    TEST_ASSERT_EQUAL(2000 * NS_PER_S + NS_PER_S / 4, wall);
+    TEST_ASSERT_EQUAL(wall, jaeger_timestamp_now_ns());
+    TEST_ASSERT_EQUAL(11 * NS_PER_S + NS_PER_S / 4, steady);
+    TEST_ASSERT_EQUAL(steady, jaeger_duration_now_ns());
+    jaeger_set_clock(jaeger_system_clock());
+}
+
+static inline void test_time_value_conversion()
+{
+    opentracing_time_value value = {.tv_sec = 12, .tv_nsec = 345};
+    TEST_ASSERT_EQUAL(12 * NS_PER_S + 345, jaeger_time_value_to_ns(&value));
+    jaeger_time_value_from_ns(12 * NS_PER_S + 345, &value);
+    TEST_ASSERT_EQUAL(12, value.tv_sec);
+    TEST_ASSERT_EQUAL(345, value.tv_nsec);
+
+    /* Nanoseconds stay in [0, 1e9) for negative values. */
+    jaeger_time_value_from_ns(-1, &value);
+    TEST_ASSERT_EQUAL(-1, value.tv_sec);
+    TEST_ASSERT_EQUAL(NS_PER_S - 1, value.tv_nsec);
+    TEST_ASSERT_EQUAL(-1, jaeger_time_value_to_ns(&value));
+}
 
 void test_clock()
 {
+    test_clocks();
+    test_derived_clock();
+    test_time_value_conversion();
+
     jaeger_duration x = {.value = {.tv_sec = 1, .tv_nsec = 0}};
     jaeger_duration y = {.value = {.tv_sec = 0, .tv_nsec = NS_PER_S * 0.5}};
     jaeger_duration result;
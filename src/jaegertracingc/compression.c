@@ -0,0 +1,463 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "jaegertracingc/compression.h"
+
+#include <limits.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif /* HAVE_ZLIB */
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif /* HAVE_ZSTD */
+
+#include "jaegertracingc/alloc.h"
+#include "jaegertracingc/logging.h"
+
+#ifdef HAVE_ZLIB
+
+/* Adds 16 to the default window bits for a gzip header and trailer. */
+#define GZIP_WINDOW_BITS (15 + 16)
+#define GZIP_MEM_LEVEL 8
+
+/* zlib allocates its state through these so it counts against the reporter
+ * like the rest of its memory. */
+static voidpf gzip_alloc(voidpf opaque, uInt items, uInt size)
+{
+    (void) opaque;
+    if (size != 0 && items > SIZE_MAX / size) {
+        return Z_NULL;
+    }
+    return jaeger_malloc((size_t) items * size);
+}
+
+static void gzip_free(voidpf opaque, voidpf address)
+{
+    (void) opaque;
+    jaeger_free(address);
+}
+
+static inline bool gzip_init(jaeger_compressor* compressor)
+{
+    int level = compressor->level;
+    if (level == JAEGERTRACINGC_COMPRESSION_DEFAULT_LEVEL) {
+        level = Z_DEFAULT_COMPRESSION;
+    }
+    if (level != Z_DEFAULT_COMPRESSION && (level < 1 || level > 9)) {
+        jaeger_log_error("Invalid gzip compression level, level = %d", level);
+        return false;
+    }
+    z_stream* stream = jaeger_malloc(sizeof(z_stream));
+    if (stream == NULL) {
+        jaeger_log_error("Cannot allocate gzip stream");
+        return false;
+    }
+    memset(stream, 0, sizeof(*stream));
+    stream->zalloc = &gzip_alloc;
+    stream->zfree = &gzip_free;
+    const int result = deflateInit2(stream,
+                                    level,
+                                    Z_DEFLATED,
+                                    GZIP_WINDOW_BITS,
+                                    GZIP_MEM_LEVEL,
+                                    Z_DEFAULT_STRATEGY);
+    if (result != Z_OK) {
+        jaeger_log_error("Cannot initialize gzip stream, result = %d", result);
+        jaeger_free(stream);
+        return false;
+    }
+    compressor->context = stream;
+    return true;
+}
+
+static inline size_t gzip_bound(jaeger_compressor* compressor, size_t src_len)
+{
+    return deflateBound((z_stream*) compressor->context, src_len);
+}
+
+static inline bool gzip_begin(jaeger_compressor* compressor, size_t src_len)
+{
+    if (src_len > UINT_MAX || compressor->buffer_size > UINT_MAX) {
+        jaeger_log_error("Payload too large for gzip, length = %zu", src_len);
+        return false;
+    }
+    /* Keeps the allocated state and only clears the stream position. */
+    deflateReset((z_stream*) compressor->context);
+    return true;
+}
+
+static inline bool gzip_deflate(jaeger_compressor* compressor,
+                                const uint8_t* src,
+                                size_t src_len,
+                                int flush)
+{
+    z_stream* stream = (z_stream*) compressor->context;
+    stream->next_in = (Bytef*) src;
+    stream->avail_in = src_len;
+    stream->next_out = &compressor->buffer[compressor->len];
+    stream->avail_out = compressor->buffer_size - compressor->len;
+    const int result = deflate(stream, flush);
+    compressor->len = compressor->buffer_size - stream->avail_out;
+    if (result != ((flush == Z_FINISH) ? Z_STREAM_END : Z_OK) ||
+        stream->avail_in != 0) {
+        jaeger_log_error("Cannot compress payload with gzip, result = %d",
+                         result);
+        return false;
+    }
+    return true;
+}
+
+static inline bool
+gzip_append(jaeger_compressor* compressor, const uint8_t* src, size_t src_len)
+{
+    return gzip_deflate(compressor, src, src_len, Z_NO_FLUSH);
+}
+
+static inline bool gzip_finish(jaeger_compressor* compressor)
+{
+    return gzip_deflate(compressor, NULL, 0, Z_FINISH);
+}
+
+static inline void gzip_destroy(jaeger_compressor* compressor)
+{
+    z_stream* stream = (z_stream*) compressor->context;
+    deflateEnd(stream);
+    jaeger_free(stream);
+}
+
+#endif /* HAVE_ZLIB */
+
+#ifdef HAVE_ZSTD
+
+static inline bool zstd_init(jaeger_compressor* compressor)
+{
+    int level = compressor->level;
+    if (level == JAEGERTRACINGC_COMPRESSION_DEFAULT_LEVEL) {
+        level = ZSTD_CLEVEL_DEFAULT;
+    }
+    if (level < 1 || level > ZSTD_maxCLevel()) {
+        jaeger_log_error("Invalid zstd compression level, level = %d", level);
+        return false;
+    }
+    ZSTD_CCtx* context = ZSTD_createCCtx();
+    if (context == NULL) {
+        jaeger_log_error("Cannot allocate zstd context");
+        return false;
+    }
+    /* Parameters stick to the context across frames. */
+    const size_t result =
+        ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, level);
+    if (ZSTD_isError(result)) {
+        jaeger_log_error("Cannot set zstd compression level, error = \"%s\"",
+                         ZSTD_getErrorName(result));
+        ZSTD_freeCCtx(context);
+        return false;
+    }
+    compressor->context = context;
+    return true;
+}
+
+static inline size_t zstd_bound(jaeger_compressor* compressor, size_t src_len)
+{
+    (void) compressor;
+    return ZSTD_compressBound(src_len);
+}
+
+static inline bool zstd_begin(jaeger_compressor* compressor, size_t src_len)
+{
+    ZSTD_CCtx* context = (ZSTD_CCtx*) compressor->context;
+    /* Keeps the parameters and only starts a new frame. The pledged size
+     * goes in the frame header, as it would for a one-shot frame. */
+    size_t result = ZSTD_CCtx_reset(context, ZSTD_reset_session_only);
+    if (!ZSTD_isError(result)) {
+        result = ZSTD_CCtx_setPledgedSrcSize(context, src_len);
+    }
+    if (ZSTD_isError(result)) {
+        jaeger_log_error("Cannot start zstd frame, error = \"%s\"",
+                         ZSTD_getErrorName(result));
+        return false;
+    }
+    return true;
+}
+
+static inline bool zstd_stream(jaeger_compressor* compressor,
+                               const uint8_t* src,
+                               size_t src_len,
+                               ZSTD_EndDirective directive)
+{
+    ZSTD_inBuffer input = {.src = src, .size = src_len, .pos = 0};
+    ZSTD_outBuffer output = {.dst = compressor->buffer,
+                             .size = compressor->buffer_size,
+                             .pos = compressor->len};
+    size_t remaining;
+    /* The buffer fits the whole frame, so each call makes progress. */
+    do {
+        remaining = ZSTD_compressStream2(
+            (ZSTD_CCtx*) compressor->context, &output, &input, directive);
+    } while (!ZSTD_isError(remaining) && output.pos < output.size &&
+             (directive == ZSTD_e_end ? remaining != 0
+                                      : input.pos < input.size));
+    compressor->len = output.pos;
+    if (ZSTD_isError(remaining)) {
+        jaeger_log_error("Cannot compress payload with zstd, error = \"%s\"",
+                         ZSTD_getErrorName(remaining));
+        return false;
+    }
+    if (input.pos < input.size || (directive == ZSTD_e_end && remaining != 0)) {
+        jaeger_log_error("Compression buffer too small for zstd frame");
+        return false;
+    }
+    return true;
+}
+
+static inline bool
+zstd_append(jaeger_compressor* compressor, const uint8_t* src, size_t src_len)
+{
+    return zstd_stream(compressor, src, src_len, ZSTD_e_continue);
+}
+
+static inline bool zstd_finish(jaeger_compressor* compressor)
+{
+    return zstd_stream(compressor, NULL, 0, ZSTD_e_end);
+}
+
+static inline void zstd_destroy(jaeger_compressor* compressor)
+{
+    ZSTD_freeCCtx((ZSTD_CCtx*) compressor->context);
+}
+
+#endif /* HAVE_ZSTD */
+
+bool jaeger_compression_available(jaeger_compression_type type)
+{
+    switch (type) {
+    case jaeger_compression_none:
+        return true;
+#ifdef HAVE_ZLIB
+    case jaeger_compression_gzip:
+        return true;
+#endif /* HAVE_ZLIB */
+#ifdef HAVE_ZSTD
+    case jaeger_compression_zstd:
+        return true;
+#endif /* HAVE_ZSTD */
+    default:
+        return false;
+    }
+}
+
+const char* jaeger_compression_encoding(jaeger_compression_type type)
+{
+    switch (type) {
+    case jaeger_compression_gzip:
+        return "gzip";
+    case jaeger_compression_zstd:
+        return "zstd";
+    default:
+        return NULL;
+    }
+}
+
+bool jaeger_compressor_init(jaeger_compressor* compressor,
+                            jaeger_compression_type type,
+                            int level)
+{
+    assert(compressor != NULL);
+    *compressor = (jaeger_compressor) JAEGERTRACINGC_COMPRESSOR_INIT;
+    compressor->type = type;
+    compressor->level = level;
+    compressor->allocator = jaeger_get_allocator();
+    bool success = false;
+    switch (type) {
+    case jaeger_compression_none:
+        success = true;
+        break;
+#ifdef HAVE_ZLIB
+    case jaeger_compression_gzip:
+        success = gzip_init(compressor);
+        break;
+#endif /* HAVE_ZLIB */
+#ifdef HAVE_ZSTD
+    case jaeger_compression_zstd:
+        success = zstd_init(compressor);
+        break;
+#endif /* HAVE_ZSTD */
+    default:
+        jaeger_log_error("Compression type not available in this build, "
+                         "type = %d",
+                         type);
+        break;
+    }
+    if (!success) {
+        *compressor = (jaeger_compressor) JAEGERTRACINGC_COMPRESSOR_INIT;
+        compressor->allocator = jaeger_get_allocator();
+    }
+    return success;
+}
+
+bool jaeger_compressor_begin(jaeger_compressor* compressor, size_t src_len)
+{
+    assert(compressor != NULL);
+    size_t max_len = src_len;
+    switch (compressor->type) {
+#ifdef HAVE_ZLIB
+    case jaeger_compression_gzip:
+        max_len = gzip_bound(compressor, src_len);
+        break;
+#endif /* HAVE_ZLIB */
+#ifdef HAVE_ZSTD
+    case jaeger_compression_zstd:
+        max_len = zstd_bound(compressor, src_len);
+        break;
+#endif /* HAVE_ZSTD */
+    default:
+        break;
+    }
+
+    /* Worst case output fits, so appending never runs out of room. */
+    compressor->len = 0;
+    if (compressor->buffer_size < max_len || compressor->buffer == NULL) {
+        jaeger_allocator* prev_alloc =
+            jaeger_set_thread_allocator(compressor->allocator);
+        uint8_t* buffer =
+            jaeger_realloc(compressor->buffer, max_len > 0 ? max_len : 1);
+        jaeger_set_thread_allocator(prev_alloc);
+        if (buffer == NULL) {
+            jaeger_log_error(
+                "Cannot allocate compression buffer, size = %zu", max_len);
+            return false;
+        }
+        compressor->buffer = buffer;
+        compressor->buffer_size = max_len > 0 ? max_len : 1;
+    }
+    switch (compressor->type) {
+#ifdef HAVE_ZLIB
+    case jaeger_compression_gzip:
+        return gzip_begin(compressor, src_len);
+#endif /* HAVE_ZLIB */
+#ifdef HAVE_ZSTD
+    case jaeger_compression_zstd:
+        return zstd_begin(compressor, src_len);
+#endif /* HAVE_ZSTD */
+    default:
+        return true;
+    }
+}
+
+bool jaeger_compressor_append(jaeger_compressor* compressor,
+                              const uint8_t* src,
+                              size_t src_len)
+{
+    assert(compressor != NULL);
+    assert(src != NULL || src_len == 0);
+    if (src_len == 0) {
+        return true;
+    }
+    switch (compressor->type) {
+#ifdef HAVE_ZLIB
+    case jaeger_compression_gzip:
+        return gzip_append(compressor, src, src_len);
+#endif /* HAVE_ZLIB */
+#ifdef HAVE_ZSTD
+    case jaeger_compression_zstd:
+        return zstd_append(compressor, src, src_len);
+#endif /* HAVE_ZSTD */
+    default:
+        if (src_len > compressor->buffer_size - compressor->len) {
+            jaeger_log_error("Payload longer than its declared length");
+            return false;
+        }
+        memcpy(&compressor->buffer[compressor->len], src, src_len);
+        compressor->len += src_len;
+        return true;
+    }
+}
+
+const uint8_t* jaeger_compressor_finish(jaeger_compressor* compressor,
+                                        size_t* dst_len)
+{
+    assert(compressor != NULL);
+    assert(dst_len != NULL);
+    bool success = true;
+    switch (compressor->type) {
+#ifdef HAVE_ZLIB
+    case jaeger_compression_gzip:
+        success = gzip_finish(compressor);
+        break;
+#endif /* HAVE_ZLIB */
+#ifdef HAVE_ZSTD
+    case jaeger_compression_zstd:
+        success = zstd_finish(compressor);
+        break;
+#endif /* HAVE_ZSTD */
+    default:
+        break;
+    }
+    *dst_len = compressor->len;
+    return success ? compressor->buffer : NULL;
+}
+
+const uint8_t* jaeger_compressor_compress(jaeger_compressor* compressor,
+                                          const uint8_t* src,
+                                          size_t src_len,
+                                          size_t* dst_len)
+{
+    assert(compressor != NULL);
+    assert(src != NULL || src_len == 0);
+    assert(dst_len != NULL);
+    if (compressor->type == jaeger_compression_none) {
+        *dst_len = src_len;
+        return src;
+    }
+    if (!jaeger_compressor_begin(compressor, src_len) ||
+        !jaeger_compressor_append(compressor, src, src_len)) {
+        return NULL;
+    }
+    return jaeger_compressor_finish(compressor, dst_len);
+}
+
+void jaeger_compressor_destroy(jaeger_compressor* compressor)
+{
+    if (compressor == NULL) {
+        return;
+    }
+    jaeger_allocator* prev_alloc =
+        jaeger_set_thread_allocator(compressor->allocator);
+    if (compressor->context != NULL) {
+        switch (compressor->type) {
+#ifdef HAVE_ZLIB
+        case jaeger_compression_gzip:
+            gzip_destroy(compressor);
+            break;
+#endif /* HAVE_ZLIB */
+#ifdef HAVE_ZSTD
+        case jaeger_compression_zstd:
+            zstd_destroy(compressor);
+            break;
+#endif /* HAVE_ZSTD */
+        default:
+            break;
+        }
+    }
+    if (compressor->buffer != NULL) {
+        jaeger_free_sized(compressor->buffer, compressor->buffer_size);
+    }
+    jaeger_set_thread_allocator(prev_alloc);
+    *compressor = (jaeger_compressor) JAEGERTRACINGC_COMPRESSOR_INIT;
+}
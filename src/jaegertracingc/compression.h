@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * @file
+ * Compression of request bodies for reporters that are not bound by the
+ * size of a UDP packet.
+ */
+
+#ifndef JAEGERTRACINGC_COMPRESSION_H
+#define JAEGERTRACINGC_COMPRESSION_H
+
+#include "jaegertracingc/common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Use the default level of the compression type. */
+#define JAEGERTRACINGC_COMPRESSION_DEFAULT_LEVEL -1
+
+/**
+ * Compression type. Types other than jaeger_compression_none are only
+ * available if the library was built with the matching CMake option,
+ * JAEGERTRACINGC_ZLIB or JAEGERTRACINGC_ZSTD.
+ */
+typedef enum jaeger_compression_type {
+    jaeger_compression_none,
+    jaeger_compression_gzip,
+    jaeger_compression_zstd
+} jaeger_compression_type;
+
+/**
+ * Compressor that keeps its compression context and output buffer between
+ * payloads, so compressing a payload does not allocate once both have
+ * grown to fit. Not thread-safe, i.e. owned by one reporter and used under
+ * its lock.
+ */
+typedef struct jaeger_compressor {
+    /** Compression type. */
+    jaeger_compression_type type;
+    /** Compression level of the type. */
+    int level;
+    /** Library context, i.e. z_stream or ZSTD_CCtx. */
+    void* context;
+    /** Output buffer. */
+    uint8_t* buffer;
+    /** Size of output buffer. */
+    size_t buffer_size;
+    /** Length of the output of the payload being compressed. */
+    size_t len;
+    /** Allocator the compressor was initialized with, used for its context
+     *  and buffer whatever thread compresses. */
+    jaeger_allocator* allocator;
+} jaeger_compressor;
+
+#define JAEGERTRACINGC_COMPRESSOR_INIT                                        \
+    {                                                                         \
+        .type = jaeger_compression_none,                                      \
+        .level = JAEGERTRACINGC_COMPRESSION_DEFAULT_LEVEL, .context = NULL,   \
+        .buffer = NULL, .buffer_size = 0, .len = 0, .allocator = NULL         \
+    }
+
+/**
+ * Check whether the library was built with a compression type.
+ * @param type Compression type.
+ * @return True if compressors of the type can be initialized, false
+ *         otherwise.
+ */
+bool jaeger_compression_available(jaeger_compression_type type);
+
+/**
+ * Get the HTTP content coding of a compression type.
+ * @param type Compression type.
+ * @return Value of the Content-Encoding header, or NULL for
+ *         jaeger_compression_none.
+ */
+const char* jaeger_compression_encoding(jaeger_compression_type type);
+
+/**
+ * Initialize a compressor. The compressor allocates from the calling
+ * thread's allocator from then on, whichever thread uses it.
+ * @param compressor Compressor to initialize.
+ * @param type Compression type.
+ * @param level Compression level, 1 to 9 for gzip and 1 to 22 for zstd, or
+ *              JAEGERTRACINGC_COMPRESSION_DEFAULT_LEVEL.
+ * @return True on success, false otherwise, in which case the compressor is
+ *         left with jaeger_compression_none.
+ */
+bool jaeger_compressor_init(jaeger_compressor* compressor,
+                            jaeger_compression_type type,
+                            int level);
+
+/**
+ * Compress a payload into the compressor's buffer.
+ * @param compressor Compressor to use.
+ * @param src Payload to compress.
+ * @param src_len Length of payload.
+ * @param[out] dst_len Length of compressed payload.
+ * @return Compressed payload, valid until the next call, or NULL on
+ *         failure. For jaeger_compression_none, src itself.
+ */
+const uint8_t* jaeger_compressor_compress(jaeger_compressor* compressor,
+                                          const uint8_t* src,
+                                          size_t src_len,
+                                          size_t* dst_len);
+
+/**
+ * Start compressing a payload that arrives in pieces, so it need not be
+ * copied into one buffer first. Reserves room for the worst case output of
+ * the whole payload.
+ * @param compressor Compressor to use.
+ * @param src_len Length of the whole payload.
+ * @return True on success, false otherwise.
+ */
+bool jaeger_compressor_begin(jaeger_compressor* compressor, size_t src_len);
+
+/**
+ * Compress the next piece of the payload started by jaeger_compressor_begin.
+ * @param compressor Compressor to use.
+ * @param src Piece of the payload.
+ * @param src_len Length of the piece.
+ * @return True on success, false otherwise.
+ */
+bool jaeger_compressor_append(jaeger_compressor* compressor,
+                              const uint8_t* src,
+                              size_t src_len);
+
+/**
+ * Finish compressing the payload started by jaeger_compressor_begin.
+ * @param compressor Compressor to use.
+ * @param[out] dst_len Length of compressed payload.
+ * @return Compressed payload, valid until the next call to
+ *         jaeger_compressor_begin or jaeger_compressor_compress, or NULL
+ *         on failure. For jaeger_compression_none, the payload copied into
+ *         the compressor's buffer.
+ */
+const uint8_t* jaeger_compressor_finish(jaeger_compressor* compressor,
+                                        size_t* dst_len);
+
+/**
+ * Free the compression context and output buffer.
+ * @param compressor Compressor to destroy.
+ */
+void jaeger_compressor_destroy(jaeger_compressor* compressor);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif /* __cplusplus */
+
+#endif /* JAEGERTRACINGC_COMPRESSION_H */
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "jaegertracingc/benchmark_helpers.h"
+#include "jaegertracingc/compression.h"
+#include "jaegertracingc/span.h"
+
+/* Each configuration compresses this many spans in total, whatever the batch
+ * size. */
+#define NUM_SPANS 100000
+#define MAX_BATCH_SIZE 1000
+
+typedef struct compression_config {
+    const char* name;
+    jaeger_compression_type type;
+    int level;
+} compression_config;
+
+static const compression_config configs[] = {
+    {"gzip_1", jaeger_compression_gzip, 1},
+    {"gzip_6", jaeger_compression_gzip, 6},
+    {"gzip_9", jaeger_compression_gzip, 9},
+    {"zstd_1", jaeger_compression_zstd, 1},
+    {"zstd_3", jaeger_compression_zstd, 3},
+    {"zstd_9", jaeger_compression_zstd, 9}};
+
+static const char* operation_names[] = {
+    "HTTP GET /orders", "HTTP POST /orders", "SELECT orders", "redis GET"};
+
+/* Fills in a span the way instrumented server code does, with IDs and
+ * timestamps that differ from span to span. */
+static void make_span(Jaeger__Model__Span* dst, int index)
+{
+    jaeger_span span = JAEGERTRACINGC_SPAN_INIT;
+    if (!jaeger_span_init(&span)) {
+        fprintf(stderr, "Cannot initialize span\n");
+        exit(EXIT_FAILURE);
+    }
+    span.context.trace_id = (jaeger_trace_id){
+        .high = 0x3f9a1c2b4d5e6f70 + index / 8, .low = 0xa1b2c3d4e5f60718};
+    span.context.span_id = 0x1b2c3d4e5f607180 + index;
+    span.context.flags = jaeger_sampling_flag_sampled;
+    span.start_time_system = 1530000000000000000 + index * 1500000;
+    span.duration = 250000 + (index % 97) * 1000;
+    jaeger_span_set_operation_name(
+        (opentracing_span*) &span,
+        operation_names[index % (sizeof(operation_names) /
+                                 sizeof(operation_names[0]))]);
+
+    char url[64];
+    snprintf(url, sizeof(url), "https://api.example.com/orders/%d", index);
+    const struct {
+        const char* key;
+        opentracing_value value;
+    } tags[] = {
+        {"span.kind",
+         {.type = opentracing_value_string,
+          .value = {.string_value = "server"}}},
+        {"component",
+         {.type = opentracing_value_string,
+          .value = {.string_value = "net/http"}}},
+        {"http.method",
+         {.type = opentracing_value_string, .value = {.string_value = "GET"}}},
+        {"http.url",
+         {.type = opentracing_value_string, .value = {.string_value = url}}},
+        {"http.status_code",
+         {.type = opentracing_value_uint64, .value = {.uint64_value = 200}}},
+        {"peer.service",
+         {.type = opentracing_value_string,
+          .value = {.string_value = "orders-db"}}},
+        {"error",
+         {.type = opentracing_value_bool, .value = {.bool_value = false}}}};
+    for (int i = 0; i < (int) (sizeof(tags) / sizeof(tags[0])); i++) {
+        jaeger_span_set_tag(
+            (opentracing_span*) &span, tags[i].key, &tags[i].value);
+    }
+
+    *dst = (Jaeger__Model__Span) JAEGER__MODEL__SPAN__INIT;
+    if (!jaeger_span_to_protobuf(dst, &span)) {
+        fprintf(stderr, "Cannot convert span\n");
+        exit(EXIT_FAILURE);
+    }
+    jaeger_span_destroy((jaeger_destructible*) &span);
+}
+
+/* Packs a batch the way the HTTP reporter packs a request body. */
+static uint8_t* pack_batch(Jaeger__Model__Span** spans,
+                           int num_spans,
+                           size_t* len)
+{
+    Jaeger__Model__Process process = JAEGER__MODEL__PROCESS__INIT;
+    process.service_name = "checkout-service";
+    Jaeger__Model__Batch batch = JAEGER__MODEL__BATCH__INIT;
+    batch.spans = spans;
+    batch.n_spans = num_spans;
+    batch.process = &process;
+    *len = jaeger__model__batch__get_packed_size(&batch);
+    uint8_t* buffer = jaeger_malloc(*len);
+    if (buffer == NULL) {
+        fprintf(stderr, "Cannot allocate batch buffer\n");
+        exit(EXIT_FAILURE);
+    }
+    jaeger__model__batch__pack(&batch, buffer);
+    return buffer;
+}
+
+static void benchmark_compression(const compression_config* config,
+                                  const uint8_t* payload,
+                                  size_t payload_len,
+                                  int batch_size)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "%s/%d_spans", config->name, batch_size);
+    jaeger_compressor compressor;
+    if (!jaeger_compressor_init(&compressor, config->type, config->level)) {
+        fprintf(stderr, "%s: cannot initialize compressor\n", name);
+        exit(EXIT_FAILURE);
+    }
+    size_t compressed_len = 0;
+    const int iterations = NUM_SPANS / batch_size;
+    jaeger_benchmark benchmark;
+    jaeger_benchmark_start(&benchmark, name, iterations);
+    for (int i = 0; i < iterations; i++) {
+        if (jaeger_compressor_compress(
+                &compressor, payload, payload_len, &compressed_len) == NULL) {
+            fprintf(stderr, "%s: compression failed\n", name);
+            exit(EXIT_FAILURE);
+        }
+    }
+    jaeger_benchmark_stop(&benchmark);
+    printf("%-40s %12zu bytes %10zu compressed %6.1f%% saved\n",
+           name,
+           payload_len,
+           compressed_len,
+           100.0 * (1.0 - (double) compressed_len / payload_len));
+    jaeger_compressor_destroy(&compressor);
+}
+
+/* Prints the CPU time of each compression type and level next to the bytes
+ * it saves, for batches from a few spans to a full request. */
+int main()
+{
+    Jaeger__Model__Span* span_buffer =
+        jaeger_malloc(sizeof(Jaeger__Model__Span) * MAX_BATCH_SIZE);
+    Jaeger__Model__Span** spans =
+        jaeger_malloc(sizeof(Jaeger__Model__Span*) * MAX_BATCH_SIZE);
+    if (span_buffer == NULL || spans == NULL) {
+        return 1;
+    }
+    for (int i = 0; i < MAX_BATCH_SIZE; i++) {
+        make_span(&span_buffer[i], i);
+        spans[i] = &span_buffer[i];
+    }
+
+    for (int batch_size = 10; batch_size <= MAX_BATCH_SIZE; batch_size *= 10) {
+        size_t payload_len = 0;
+        uint8_t* payload = pack_batch(spans, batch_size, &payload_len);
+        for (int i = 0; i < (int) (sizeof(configs) / sizeof(configs[0]));
+             i++) {
+            if (jaeger_compression_available(configs[i].type)) {
+                benchmark_compression(
+                    &configs[i], payload, payload_len, batch_size);
+            }
+        }
+        jaeger_free(payload);
+    }
+
+    for (int i = 0; i < MAX_BATCH_SIZE; i++) {
+        jaeger_span_protobuf_destroy(&span_buffer[i]);
+    }
+    jaeger_free(spans);
+    jaeger_free(span_buffer);
+    return 0;
+}
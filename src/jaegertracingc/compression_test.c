@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "jaegertracingc/compression.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif /* HAVE_ZLIB */
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif /* HAVE_ZSTD */
+
+#include "jaegertracingc/alloc.h"
+#include "unity.h"
+
+#define PAYLOAD_LEN 4096
+
+/* Repeats like the strings in a span batch do. */
+static inline void fill_payload(uint8_t* payload)
+{
+    const char words[] = "service-name operation-name http.status_code ";
+    for (int i = 0; i < PAYLOAD_LEN; i++) {
+        payload[i] = words[i % (sizeof(words) - 1)];
+    }
+}
+
+static inline size_t decompress(jaeger_compression_type type,
+                                const uint8_t* src,
+                                size_t src_len,
+                                uint8_t* dst,
+                                size_t dst_len)
+{
+    switch (type) {
+#ifdef HAVE_ZLIB
+    case jaeger_compression_gzip: {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        TEST_ASSERT_EQUAL(Z_OK, inflateInit2(&stream, 15 + 16));
+        stream.next_in = (Bytef*) src;
+        stream.avail_in = src_len;
+        stream.next_out = dst;
+        stream.avail_out = dst_len;
+        TEST_ASSERT_EQUAL(Z_STREAM_END, inflate(&stream, Z_FINISH));
+        const size_t len = stream.total_out;
+        inflateEnd(&stream);
+        return len;
+    }
+#endif /* HAVE_ZLIB */
+#ifdef HAVE_ZSTD
+    case jaeger_compression_zstd: {
+        const size_t len = ZSTD_decompress(dst, dst_len, src, src_len);
+        TEST_ASSERT_FALSE(ZSTD_isError(len));
+        return len;
+    }
+#endif /* HAVE_ZSTD */
+    default:
+        (void) src;
+        (void) src_len;
+        (void) dst;
+        (void) dst_len;
+        TEST_FAIL();
+        return 0;
+    }
+}
+
+static inline void test_round_trip(jaeger_compression_type type)
+{
+    uint8_t payload[PAYLOAD_LEN];
+    fill_payload(payload);
+    jaeger_compressor compressor;
+    TEST_ASSERT_TRUE(jaeger_compressor_init(
+        &compressor, type, JAEGERTRACINGC_COMPRESSION_DEFAULT_LEVEL));
+    TEST_ASSERT_NOT_NULL(jaeger_compression_encoding(type));
+
+    const uint8_t* buffer = NULL;
+    for (int i = 0; i < 2; i++) {
+        size_t compressed_len = 0;
+        const uint8_t* compressed = jaeger_compressor_compress(
+            &compressor, payload, sizeof(payload), &compressed_len);
+        TEST_ASSERT_NOT_NULL(compressed);
+        TEST_ASSERT_LESS_THAN(sizeof(payload) / 4, compressed_len);
+        /* Second payload reuses the buffer of the first. */
+        if (buffer != NULL) {
+            TEST_ASSERT_EQUAL_PTR(buffer, compressed);
+        }
+        buffer = compressed;
+
+        uint8_t decompressed[PAYLOAD_LEN];
+        TEST_ASSERT_EQUAL(sizeof(payload),
+                          decompress(type,
+                                     compressed,
+                                     compressed_len,
+                                     decompressed,
+                                     sizeof(decompressed)));
+        TEST_ASSERT_EQUAL_MEMORY(payload, decompressed, sizeof(payload));
+    }
+
+    /* A payload compressed in pieces decompresses to the whole payload. */
+    TEST_ASSERT_TRUE(jaeger_compressor_begin(&compressor, sizeof(payload)));
+    for (size_t i = 0; i < sizeof(payload); i += 1000) {
+        const size_t len = JAEGERTRACINGC_MIN(sizeof(payload) - i, 1000);
+        TEST_ASSERT_TRUE(
+            jaeger_compressor_append(&compressor, &payload[i], len));
+    }
+    size_t compressed_len = 0;
+    const uint8_t* compressed =
+        jaeger_compressor_finish(&compressor, &compressed_len);
+    TEST_ASSERT_NOT_NULL(compressed);
+    uint8_t decompressed[PAYLOAD_LEN];
+    TEST_ASSERT_EQUAL(sizeof(payload),
+                      decompress(type,
+                                 compressed,
+                                 compressed_len,
+                                 decompressed,
+                                 sizeof(decompressed)));
+    TEST_ASSERT_EQUAL_MEMORY(payload, decompressed, sizeof(payload));
+    jaeger_compressor_destroy(&compressor);
+
+    TEST_ASSERT_FALSE(jaeger_compressor_init(&compressor, type, 100));
+    TEST_ASSERT_EQUAL(jaeger_compression_none, compressor.type);
+
+    /* Only zlib allocates through the installed allocator. */
+    if (type == jaeger_compression_gzip) {
+        jaeger_set_allocator(jaeger_null_allocator());
+        TEST_ASSERT_FALSE(jaeger_compressor_init(
+            &compressor, type, JAEGERTRACINGC_COMPRESSION_DEFAULT_LEVEL));
+        jaeger_set_allocator(jaeger_built_in_allocator());
+    }
+}
+
+void test_compression()
+{
+    uint8_t payload[PAYLOAD_LEN];
+    fill_payload(payload);
+    jaeger_compressor compressor;
+    TEST_ASSERT_TRUE(jaeger_compressor_init(
+        &compressor,
+        jaeger_compression_none,
+        JAEGERTRACINGC_COMPRESSION_DEFAULT_LEVEL));
+    TEST_ASSERT_NULL(jaeger_compression_encoding(jaeger_compression_none));
+    size_t len = 0;
+    TEST_ASSERT_EQUAL_PTR(
+        payload,
+        jaeger_compressor_compress(
+            &compressor, payload, sizeof(payload), &len));
+    TEST_ASSERT_EQUAL(sizeof(payload), len);
+    /* Pieces are copied together, and no more than the declared length is
+     * accepted. */
+    TEST_ASSERT_TRUE(jaeger_compressor_begin(&compressor, sizeof(payload)));
+    TEST_ASSERT_TRUE(jaeger_compressor_append(&compressor, payload, 1));
+    TEST_ASSERT_TRUE(jaeger_compressor_append(
+        &compressor, &payload[1], sizeof(payload) - 1));
+    TEST_ASSERT_FALSE(jaeger_compressor_append(&compressor, payload, 1));
+    const uint8_t* copy = jaeger_compressor_finish(&compressor, &len);
+    TEST_ASSERT_EQUAL(sizeof(payload), len);
+    TEST_ASSERT_EQUAL_MEMORY(payload, copy, sizeof(payload));
+    jaeger_compressor_destroy(&compressor);
+
+    const jaeger_compression_type types[] = {jaeger_compression_gzip,
+                                             jaeger_compression_zstd};
+    for (int i = 0; i < (int) (sizeof(types) / sizeof(types[0])); i++) {
+        if (jaeger_compression_available(types[i])) {
+            test_round_trip(types[i]);
+        }
+        else {
+            TEST_ASSERT_FALSE(jaeger_compressor_init(
+                &compressor,
+                types[i],
+                JAEGERTRACINGC_COMPRESSION_DEFAULT_LEVEL));
+        }
+    }
+}
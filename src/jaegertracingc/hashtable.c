@@ -36,7 +36,7 @@ static uint8_t* hash_seed()
 void jaeger_key_value_node_dealloc(jaeger_destructible* d)
 {
     jaeger_key_value_destroy(&((jaeger_key_value_node*) d)->data);
-    jaeger_free(d);
+    jaeger_free_sized(d, sizeof(jaeger_key_value_node));
 }
 
 jaeger_key_value_node* jaeger_key_value_node_new(jaeger_key_value data)
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jaegertracingc/header_table.h"
+#include "jaegertracingc/strings.h"
+
+#define BUCKET_MASK (JAEGERTRACINGC_HEADER_TABLE_NUM_BUCKETS - 1)
+
+#define B3_FORMATS                                       \
+    ((unsigned int) jaeger_propagation_format_b3 |       \
+     (unsigned int) jaeger_propagation_format_b3_single)
+
+static inline void add_entry(jaeger_header_table_entry* entries,
+                             int* num_entries,
+                             const char* name,
+                             jaeger_header_type type)
+{
+    assert(*num_entries < JAEGERTRACINGC_HEADER_TABLE_MAX_ENTRIES);
+    entries[*num_entries] =
+        (jaeger_header_table_entry){.name = name,
+                                    .len = strlen(name),
+                                    .type = type,
+                                    .ignore_case = false};
+    (*num_entries)++;
+}
+
+/* B3 header names are case-insensitive in every carrier, since they are
+ * usually written as X-B3-TraceId even outside HTTP. */
+static inline void add_b3_entry(jaeger_header_table_entry* entries,
+                                int* num_entries,
+                                const char* name,
+                                jaeger_header_type type)
+{
+    add_entry(entries, num_entries, name, type);
+    entries[*num_entries - 1].ignore_case = true;
+}
+
+/* Returns the first position at which every name in the bucket has a
+ * different character, ignoring case, or zero if there is none. */
+static inline uint8_t
+discriminating_pos(const jaeger_header_table_entry* entries, int count)
+{
+    if (count < 2) {
+        return 0;
+    }
+    size_t min_len = entries[0].len;
+    for (int i = 1; i < count; i++) {
+        min_len = JAEGERTRACINGC_MIN(min_len, entries[i].len);
+    }
+    for (size_t pos = 0; pos < min_len && pos <= UINT8_MAX; pos++) {
+        bool distinct = true;
+        for (int i = 0; i < count && distinct; i++) {
+            for (int j = i + 1; j < count; j++) {
+                if (((unsigned char) entries[i].name[pos] | 0x20u) ==
+                    ((unsigned char) entries[j].name[pos] | 0x20u)) {
+                    distinct = false;
+                    break;
+                }
+            }
+        }
+        if (distinct) {
+            return (uint8_t) pos;
+        }
+    }
+    return 0;
+}
+
+void jaeger_header_table_init(jaeger_header_table* table,
+                              const jaeger_headers_config* config)
+{
+    assert(table != NULL);
+    assert(config != NULL);
+    table->config = *config;
+    table->formats = config->propagation_formats == 0
+                         ? (unsigned int) jaeger_propagation_format_jaeger
+                         : config->propagation_formats;
+    table->trace_baggage_header_prefix_len =
+        strlen(config->trace_baggage_header_prefix);
+
+    /* Added in order of precedence, which lookups preserve within a bucket.
+     * Only enabled formats are added, so they cost nothing otherwise. */
+    jaeger_header_table_entry entries[JAEGERTRACINGC_HEADER_TABLE_MAX_ENTRIES];
+    int num_entries = 0;
+    if ((table->formats & (unsigned int) jaeger_propagation_format_jaeger) !=
+        0) {
+        add_entry(entries,
+                  &num_entries,
+                  config->trace_context_header,
+                  jaeger_header_type_trace_context);
+    }
+    if ((table->formats & (unsigned int) jaeger_propagation_format_w3c) != 0) {
+        add_entry(entries,
+                  &num_entries,
+                  JAEGERTRACINGC_TRACEPARENT_HEADER,
+                  jaeger_header_type_traceparent);
+        add_entry(entries,
+                  &num_entries,
+                  JAEGERTRACINGC_TRACESTATE_HEADER,
+                  jaeger_header_type_tracestate);
+    }
+    if ((table->formats & B3_FORMATS) != 0) {
+        add_b3_entry(entries,
+                     &num_entries,
+                     JAEGERTRACINGC_B3_HEADER,
+                     jaeger_header_type_b3);
+        add_b3_entry(entries,
+                     &num_entries,
+                     JAEGERTRACINGC_B3_TRACE_ID_HEADER,
+                     jaeger_header_type_b3_trace_id);
+        add_b3_entry(entries,
+                     &num_entries,
+                     JAEGERTRACINGC_B3_SPAN_ID_HEADER,
+                     jaeger_header_type_b3_span_id);
+        add_b3_entry(entries,
+                     &num_entries,
+                     JAEGERTRACINGC_B3_PARENT_SPAN_ID_HEADER,
+                     jaeger_header_type_b3_parent_span_id);
+        add_b3_entry(entries,
+                     &num_entries,
+                     JAEGERTRACINGC_B3_SAMPLED_HEADER,
+                     jaeger_header_type_b3_sampled);
+        add_b3_entry(entries,
+                     &num_entries,
+                     JAEGERTRACINGC_B3_FLAGS_HEADER,
+                     jaeger_header_type_b3_flags);
+    }
+    add_entry(entries,
+              &num_entries,
+              config->debug_header,
+              jaeger_header_type_debug);
+    add_entry(entries,
+              &num_entries,
+              config->baggage_header,
+              jaeger_header_type_baggage);
+
+    /* Stable counting sort by bucket. */
+    memset(table->buckets, 0, sizeof(table->buckets));
+    for (int i = 0; i < num_entries; i++) {
+        table->buckets[entries[i].len & BUCKET_MASK].count++;
+    }
+    int first = 0;
+    for (int i = 0; i < JAEGERTRACINGC_HEADER_TABLE_NUM_BUCKETS; i++) {
+        table->buckets[i].first = (uint8_t) first;
+        first += table->buckets[i].count;
+    }
+    uint8_t filled[JAEGERTRACINGC_HEADER_TABLE_NUM_BUCKETS] = {0};
+    for (int i = 0; i < num_entries; i++) {
+        const size_t bucket = entries[i].len & BUCKET_MASK;
+        table->entries[table->buckets[bucket].first + filled[bucket]] =
+            entries[i];
+        filled[bucket]++;
+    }
+    table->num_entries = num_entries;
+    for (int i = 0; i < JAEGERTRACINGC_HEADER_TABLE_NUM_BUCKETS; i++) {
+        jaeger_header_table_bucket* bucket = &table->buckets[i];
+        bucket->pos =
+            discriminating_pos(&table->entries[bucket->first], bucket->count);
+    }
+}
+
+static inline bool
+key_equals(const char* key, const char* name, size_t len, bool ignore_case)
+{
+    return ignore_case ? lowercase_equals(key, name, len)
+                       : memcmp(key, name, len) == 0;
+}
+
+jaeger_header_type jaeger_header_table_lookup(const jaeger_header_table* table,
+                                              const char* key,
+                                              size_t key_len,
+                                              bool ignore_case)
+{
+    assert(table != NULL);
+    assert(key != NULL);
+    const jaeger_header_table_bucket* bucket =
+        &table->buckets[key_len & BUCKET_MASK];
+    if (bucket->count > 0 && key_len > bucket->pos) {
+        /* Folding case by setting bit 5 lets some non-letters through, but
+         * never rejects a match, so it is good enough to skip the full
+         * comparison for every other name in the bucket. */
+        const int pos = bucket->pos;
+        const unsigned int ch = (unsigned char) key[pos] | 0x20u;
+        const int end = bucket->first + bucket->count;
+        for (int i = bucket->first; i < end; i++) {
+            const jaeger_header_table_entry* entry = &table->entries[i];
+            if (entry->len == key_len &&
+                ((unsigned char) entry->name[pos] | 0x20u) == ch &&
+                key_equals(key,
+                           entry->name,
+                           key_len,
+                           ignore_case || entry->ignore_case)) {
+                return entry->type;
+            }
+        }
+    }
+    const size_t prefix_len = table->trace_baggage_header_prefix_len;
+    if (key_len > prefix_len &&
+        key_equals(key,
+                   table->config.trace_baggage_header_prefix,
+                   prefix_len,
+                   ignore_case)) {
+        return jaeger_header_type_trace_baggage;
+    }
+    return jaeger_header_type_unknown;
+}
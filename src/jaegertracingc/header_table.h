@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ * @internal
+ * Lookup table that classifies carrier keys during span context extraction.
+ */
+
+#ifndef JAEGERTRACINGC_HEADER_TABLE_H
+#define JAEGERTRACINGC_HEADER_TABLE_H
+
+#include "jaegertracingc/common.h"
+#include "jaegertracingc/options.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Number of length buckets. Must be a power of two. */
+#define JAEGERTRACINGC_HEADER_TABLE_NUM_BUCKETS 32
+/** Max number of exact header names in a table. */
+#define JAEGERTRACINGC_HEADER_TABLE_MAX_ENTRIES 16
+
+/** Role of a carrier key in span context extraction. */
+typedef enum jaeger_header_type {
+    /** Not used for propagation. */
+    jaeger_header_type_unknown,
+    /** Jaeger span context header. */
+    jaeger_header_type_trace_context,
+    /** W3C traceparent header. */
+    jaeger_header_type_traceparent,
+    /** W3C tracestate header. */
+    jaeger_header_type_tracestate,
+    /** B3 single header. */
+    jaeger_header_type_b3,
+    /** B3 trace ID header. */
+    jaeger_header_type_b3_trace_id,
+    /** B3 span ID header. */
+    jaeger_header_type_b3_span_id,
+    /** B3 parent span ID header. */
+    jaeger_header_type_b3_parent_span_id,
+    /** B3 sampling state header. */
+    jaeger_header_type_b3_sampled,
+    /** B3 debug flag header. */
+    jaeger_header_type_b3_flags,
+    /** Jaeger debug ID header. */
+    jaeger_header_type_debug,
+    /** Comma-separated baggage header. */
+    jaeger_header_type_baggage,
+    /** Single baggage item, identified by the baggage key prefix. */
+    jaeger_header_type_trace_baggage
+} jaeger_header_type;
+
+/** Exact header name stored in a table. */
+typedef struct jaeger_header_table_entry {
+    /** Header name. Points into the headers config or a constant. */
+    const char* name;
+    /** Length of the header name. */
+    size_t len;
+    /** Type to report for keys matching the name. */
+    jaeger_header_type type;
+    /**
+     * Whether keys match the name regardless of case even in carriers that
+     * are otherwise case-sensitive, as B3 header names do.
+     */
+    bool ignore_case;
+} jaeger_header_table_entry;
+
+/** Range of entries whose name lengths share a bucket. */
+typedef struct jaeger_header_table_bucket {
+    /** Index of the first entry in the bucket. */
+    uint8_t first;
+    /** Number of entries in the bucket. */
+    uint8_t count;
+    /**
+     * Character position at which the names in the bucket differ, if any.
+     * Lets lookups skip all but one full comparison.
+     */
+    uint8_t pos;
+} jaeger_header_table_bucket;
+
+/**
+ * Header names of every enabled propagation format, bucketed by length.
+ * Built once from a headers config, typically when the tracer is
+ * constructed. Classifying a key costs a bucket lookup and at most one full
+ * comparison per name of that length, regardless of how many formats are
+ * enabled. Holds pointers to the header names of the config it was built
+ * from, which must outlive it.
+ */
+typedef struct jaeger_header_table {
+    /** Config the table was built from. */
+    jaeger_headers_config config;
+    /** Enabled jaeger_propagation_format values, never zero. */
+    unsigned int formats;
+    /** Length of the trace baggage header prefix. */
+    size_t trace_baggage_header_prefix_len;
+    /** Buckets indexed by name length modulo the number of buckets. */
+    jaeger_header_table_bucket buckets[JAEGERTRACINGC_HEADER_TABLE_NUM_BUCKETS];
+    /** Entries ordered by bucket. */
+    jaeger_header_table_entry entries[JAEGERTRACINGC_HEADER_TABLE_MAX_ENTRIES];
+    /** Number of entries in use. */
+    int num_entries;
+} jaeger_header_table;
+
+/**
+ * Build a header table from a headers config.
+ * @param table The table to initialize.
+ * @param config The headers config. Its header names must outlive table.
+ */
+void jaeger_header_table_init(jaeger_header_table* table,
+                              const jaeger_headers_config* config);
+
+/**
+ * Classify a carrier key. When several formats share a header name, the
+ * format with the highest precedence wins.
+ * @param table The header table.
+ * @param key The carrier key.
+ * @param key_len The length of key.
+ * @param ignore_case Whether to ignore the case of key, as HTTP headers
+ *                    require. Header names must then be lowercase. Names
+ *                    of entries that ignore case always match this way.
+ * @return The role of key in extraction.
+ */
+jaeger_header_type jaeger_header_table_lookup(const jaeger_header_table* table,
+                                              const char* key,
+                                              size_t key_len,
+                                              bool ignore_case);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif /* __cplusplus */
+
+#endif /* JAEGERTRACINGC_HEADER_TABLE_H */
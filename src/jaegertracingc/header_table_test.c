@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jaegertracingc/header_table.h"
+#include "unity.h"
+
+static inline jaeger_header_type
+lookup(const jaeger_header_table* table, const char* key, bool ignore_case)
+{
+    return jaeger_header_table_lookup(table, key, strlen(key), ignore_case);
+}
+
+static inline void test_default_config()
+{
+    const jaeger_headers_config config = JAEGERTRACINGC_HEADERS_CONFIG_INIT;
+    jaeger_header_table table;
+    jaeger_header_table_init(&table, &config);
+    TEST_ASSERT_EQUAL(3, table.num_entries);
+    TEST_ASSERT_EQUAL(jaeger_propagation_format_jaeger, table.formats);
+
+    TEST_ASSERT_EQUAL(jaeger_header_type_trace_context,
+                      lookup(&table, "uber-trace-id", false));
+    TEST_ASSERT_EQUAL(jaeger_header_type_debug,
+                      lookup(&table, "jaeger-debug-id", false));
+    TEST_ASSERT_EQUAL(jaeger_header_type_baggage,
+                      lookup(&table, "jaeger-baggage", false));
+    TEST_ASSERT_EQUAL(jaeger_header_type_trace_baggage,
+                      lookup(&table, "uberctx-key", false));
+
+    /* Text map keys are case sensitive, HTTP headers are not. */
+    TEST_ASSERT_EQUAL(jaeger_header_type_unknown,
+                      lookup(&table, "Uber-Trace-Id", false));
+    TEST_ASSERT_EQUAL(jaeger_header_type_trace_context,
+                      lookup(&table, "Uber-Trace-Id", true));
+    TEST_ASSERT_EQUAL(jaeger_header_type_trace_baggage,
+                      lookup(&table, "UberCtx-Key", true));
+
+    /* The prefix alone is not a baggage key. */
+    TEST_ASSERT_EQUAL(jaeger_header_type_unknown,
+                      lookup(&table, "uberctx-", false));
+    TEST_ASSERT_EQUAL(jaeger_header_type_unknown,
+                      lookup(&table, "uber-trace-ix", false));
+    TEST_ASSERT_EQUAL(jaeger_header_type_unknown,
+                      lookup(&table, "uber-trace-id2", false));
+    TEST_ASSERT_EQUAL(jaeger_header_type_unknown, lookup(&table, "", false));
+
+    /* Disabled formats are not in the table at all. */
+    TEST_ASSERT_EQUAL(jaeger_header_type_unknown,
+                      lookup(&table, "traceparent", false));
+    TEST_ASSERT_EQUAL(jaeger_header_type_unknown, lookup(&table, "b3", false));
+
+    /* Configs that leave the formats unset use the Jaeger format. */
+    jaeger_headers_config unset_config = config;
+    unset_config.propagation_formats = 0;
+    jaeger_header_table_init(&table, &unset_config);
+    TEST_ASSERT_EQUAL(jaeger_propagation_format_jaeger, table.formats);
+    TEST_ASSERT_EQUAL(jaeger_header_type_trace_context,
+                      lookup(&table, "uber-trace-id", false));
+}
+
+static inline void test_all_formats()
+{
+    jaeger_headers_config config = JAEGERTRACINGC_HEADERS_CONFIG_INIT;
+    config.propagation_formats = jaeger_propagation_format_jaeger |
+                                 jaeger_propagation_format_w3c |
+                                 jaeger_propagation_format_b3 |
+                                 jaeger_propagation_format_b3_single;
+    jaeger_header_table table;
+    jaeger_header_table_init(&table, &config);
+    TEST_ASSERT_EQUAL(11, table.num_entries);
+
+    typedef struct test_case {
+        const char* key;
+        jaeger_header_type type;
+    } test_case;
+    /* Several of these share a length, and so a bucket. */
+    const test_case cases[] = {
+        {"Uber-Trace-Id", jaeger_header_type_trace_context},
+        {"Traceparent", jaeger_header_type_traceparent},
+        {"Tracestate", jaeger_header_type_tracestate},
+        {"B3", jaeger_header_type_b3},
+        {"X-B3-TraceId", jaeger_header_type_b3_trace_id},
+        {"X-B3-SpanId", jaeger_header_type_b3_span_id},
+        {"X-B3-ParentSpanId", jaeger_header_type_b3_parent_span_id},
+        {"X-B3-Sampled", jaeger_header_type_b3_sampled},
+        {"X-B3-Flags", jaeger_header_type_b3_flags},
+        {"Jaeger-Debug-Id", jaeger_header_type_debug},
+        {"Jaeger-Baggage", jaeger_header_type_baggage},
+        {"X-B3-Flagz", jaeger_header_type_unknown},
+        {"X-B3-SpanIx", jaeger_header_type_unknown},
+        {"Tracestatf", jaeger_header_type_unknown},
+        {"B4", jaeger_header_type_unknown},
+        {"Content-Type", jaeger_header_type_unknown}};
+    const int num_cases = sizeof(cases) / sizeof(cases[0]);
+    for (int i = 0; i < num_cases; i++) {
+        TEST_ASSERT_EQUAL_MESSAGE(
+            cases[i].type, lookup(&table, cases[i].key, true), cases[i].key);
+    }
+
+    /* B3 names ignore case in text maps too, unlike the others. */
+    TEST_ASSERT_EQUAL(jaeger_header_type_b3_trace_id,
+                      lookup(&table, "X-B3-TraceId", false));
+    TEST_ASSERT_EQUAL(jaeger_header_type_b3, lookup(&table, "B3", false));
+    TEST_ASSERT_EQUAL(jaeger_header_type_unknown,
+                      lookup(&table, "Traceparent", false));
+}
+
+static inline void test_custom_config()
+{
+    /* Names whose lengths differ by the number of buckets share a bucket, and
+     * names shared by two formats resolve to the one with precedence. */
+    jaeger_headers_config config = {
+        .debug_header = "dbg",
+        .baggage_header = "baggage-header-with-a-longer-name",
+        .trace_context_header = "traceparent",
+        .trace_baggage_header_prefix = "ctx-",
+        .propagation_formats =
+            jaeger_propagation_format_jaeger | jaeger_propagation_format_w3c};
+    TEST_ASSERT_EQUAL(strlen("b") + JAEGERTRACINGC_HEADER_TABLE_NUM_BUCKETS,
+                      strlen(config.baggage_header));
+    jaeger_header_table table;
+    jaeger_header_table_init(&table, &config);
+    TEST_ASSERT_EQUAL(jaeger_header_type_trace_context,
+                      lookup(&table, "traceparent", false));
+    TEST_ASSERT_EQUAL(jaeger_header_type_tracestate,
+                      lookup(&table, "tracestate", false));
+    TEST_ASSERT_EQUAL(jaeger_header_type_debug, lookup(&table, "dbg", false));
+    TEST_ASSERT_EQUAL(jaeger_header_type_baggage,
+                      lookup(&table, config.baggage_header, false));
+    TEST_ASSERT_EQUAL(jaeger_header_type_unknown, lookup(&table, "b", false));
+    TEST_ASSERT_EQUAL(jaeger_header_type_trace_baggage,
+                      lookup(&table, "ctx-b", false));
+    TEST_ASSERT_EQUAL(jaeger_header_type_unknown,
+                      lookup(&table, "uberctx-key", false));
+}
+
+void test_header_table()
+{
+    test_default_config();
+    test_all_formats();
+    test_custom_config();
+}
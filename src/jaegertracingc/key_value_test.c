@@ -37,7 +37,7 @@ static void* counted_allocator_malloc(jaeger_allocator* alloc, size_t sz)
 
 void test_key_value()
 {
-    counted_allocator alloc;
+    counted_allocator alloc = {0};
     jaeger_allocator* old_alloc = jaeger_get_allocator();
     ((jaeger_allocator*) &alloc)->malloc = &counted_allocator_malloc;
     ((jaeger_allocator*) &alloc)->realloc = old_alloc->realloc;
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jaegertracingc/log_limiter.h"
+
+bool jaeger_log_limiter_check(jaeger_log_limiter* limiter,
+                              int64_t* num_suppressed)
+{
+    assert(limiter != NULL);
+    assert(num_suppressed != NULL);
+    jaeger_mutex_lock(&limiter->mutex);
+    const bool allowed = jaeger_token_bucket_check_credit(&limiter->bucket, 1);
+    if (allowed) {
+        *num_suppressed = limiter->num_suppressed;
+        limiter->num_suppressed = 0;
+    }
+    else {
+        limiter->num_suppressed++;
+    }
+    jaeger_mutex_unlock(&limiter->mutex);
+    return allowed;
+}
+
+#define LOG_LIMITED_FUNC(level)                                           \
+    void jaeger_log_##level##_limited(                                    \
+        jaeger_log_limiter* limiter, const char* format, ...)             \
+    {                                                                     \
+        int64_t num_suppressed;                                           \
+        if (!jaeger_log_limiter_check(limiter, &num_suppressed)) {        \
+            return;                                                       \
+        }                                                                 \
+        va_list args;                                                     \
+        va_start(args, format);                                           \
+        jaeger_logger* logger = jaeger_get_logger();                      \
+        logger->level(logger, format, args);                              \
+        va_end(args);                                                     \
+        if (num_suppressed > 0) {                                         \
+            jaeger_log_##level("Suppressed %" PRId64 " similar messages", \
+                               num_suppressed);                           \
+        }                                                                 \
+    }
+
+LOG_LIMITED_FUNC(error)
+LOG_LIMITED_FUNC(warn)
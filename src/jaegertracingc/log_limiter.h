@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ * Rate limiting for messages that can repeat on every failure.
+ */
+
+#ifndef JAEGERTRACINGC_LOG_LIMITER_H
+#define JAEGERTRACINGC_LOG_LIMITER_H
+
+#include "jaegertracingc/common.h"
+#include "jaegertracingc/logging.h"
+#include "jaegertracingc/threading.h"
+#include "jaegertracingc/token_bucket.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Number of messages per second a call site may log in the long run. */
+#define JAEGERTRACINGC_LOG_LIMIT_PER_SECOND 0.1
+
+/** Number of messages a call site may log in a burst. */
+#define JAEGERTRACINGC_LOG_LIMIT_BURST 3
+
+/**
+ * Rate limit for one message. Messages over the limit are counted instead of
+ * formatted, and the count is logged with the next message that gets
+ * through.
+ */
+typedef struct jaeger_log_limiter {
+    /** Bucket holding one credit per message. */
+    jaeger_token_bucket bucket;
+    /** Number of messages suppressed since the last one logged. */
+    int64_t num_suppressed;
+    /** Lock to avoid data races. */
+    jaeger_mutex mutex;
+} jaeger_log_limiter;
+
+/* The last tick starts at zero, so the bucket starts full. */
+#define JAEGERTRACINGC_LOG_LIMITER_INIT(per_second, burst)      \
+    {                                                           \
+        .bucket = {.credits_per_second = (per_second),          \
+                   .max_balance = (burst),                      \
+                   .balance = (burst),                          \
+                   .last_tick = 0},                             \
+        .num_suppressed = 0, .mutex = JAEGERTRACINGC_MUTEX_INIT \
+    }
+
+/**
+ * Decide whether a message may be logged.
+ * @param limiter Limiter of the message.
+ * @param num_suppressed Output argument for the number of messages
+ *                       suppressed since the last one logged. Only set when
+ *                       the message may be logged.
+ * @return True if the message may be logged, false if it is suppressed.
+ */
+bool jaeger_log_limiter_check(jaeger_log_limiter* limiter,
+                              int64_t* num_suppressed);
+
+/**
+ * Log error to installed logger unless the limiter suppresses it.
+ * @param limiter Limiter of the message.
+ * @param format Format string.
+ * @param[in] ... Arguments to format.
+ */
+void jaeger_log_error_limited(jaeger_log_limiter* limiter,
+                              const char* format,
+                              ...)
+    JAEGERTRACINGC_FORMAT_ATTRIBUTE(printf, 2, 3);
+
+/**
+ * Log warning to installed logger unless the limiter suppresses it.
+ * @param limiter Limiter of the message.
+ * @param format Format string.
+ * @param[in] ... Arguments to format.
+ */
+void jaeger_log_warn_limited(jaeger_log_limiter* limiter,
+                             const char* format,
+                             ...)
+    JAEGERTRACINGC_FORMAT_ATTRIBUTE(printf, 2, 3);
+
+/**
+ * Log error with a limiter of its own, so each call site is limited
+ * separately. Use it for errors that can fire on every span, flush or poll.
+ */
+#define JAEGERTRACINGC_LOG_ERROR_LIMITED(...)                \
+    do {                                                     \
+        static jaeger_log_limiter log_limiter =              \
+            JAEGERTRACINGC_LOG_LIMITER_INIT(                 \
+                JAEGERTRACINGC_LOG_LIMIT_PER_SECOND,         \
+                JAEGERTRACINGC_LOG_LIMIT_BURST);             \
+        jaeger_log_error_limited(&log_limiter, __VA_ARGS__); \
+    } while (0)
+
+/**
+ * Log warning with a limiter of its own.
+ * @see JAEGERTRACINGC_LOG_ERROR_LIMITED
+ */
+#define JAEGERTRACINGC_LOG_WARN_LIMITED(...)                \
+    do {                                                    \
+        static jaeger_log_limiter log_limiter =             \
+            JAEGERTRACINGC_LOG_LIMITER_INIT(                \
+                JAEGERTRACINGC_LOG_LIMIT_PER_SECOND,        \
+                JAEGERTRACINGC_LOG_LIMIT_BURST);            \
+        jaeger_log_warn_limited(&log_limiter, __VA_ARGS__); \
+    } while (0)
+
+#ifdef __cplusplus
+} /* extern C */
+#endif /* __cplusplus */
+
+#endif /* JAEGERTRACINGC_LOG_LIMITER_H */
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jaegertracingc/log_limiter.h"
+#include "unity.h"
+
+typedef struct counting_logger {
+    jaeger_logger base;
+    int num_errors;
+    int num_warnings;
+    char last_message[64];
+} counting_logger;
+
+#define COUNTING_LOG_FUNC(level, counter)                                  \
+    static void counting_log_##level(                                      \
+        jaeger_logger* logger, const char* format, va_list args)           \
+    {                                                                      \
+        counting_logger* l = (counting_logger*) logger;                    \
+        l->counter++;                                                      \
+        vsnprintf(l->last_message, sizeof(l->last_message), format, args); \
+    }
+
+COUNTING_LOG_FUNC(error, num_errors)
+COUNTING_LOG_FUNC(warn, num_warnings)
+
+static void counting_log_info(jaeger_logger* logger,
+                              const char* format,
+                              va_list args)
+{
+    (void) logger;
+    (void) format;
+    (void) args;
+}
+
+static inline void log_site(void)
+{
+    JAEGERTRACINGC_LOG_WARN_LIMITED("Repeated warning %d", 0);
+}
+
+void test_log_limiter()
+{
+    counting_logger logger = {.base = {.error = &counting_log_error,
+                                       .warn = &counting_log_warn,
+                                       .info = &counting_log_info},
+                              .num_errors = 0,
+                              .num_warnings = 0,
+                              .last_message = {'\0'}};
+    jaeger_set_logger_ptr((jaeger_logger*) &logger);
+
+    /* Refills too slowly to matter during the test. */
+    jaeger_log_limiter limiter = JAEGERTRACINGC_LOG_LIMITER_INIT(1e-9, 2);
+    for (int i = 0; i < 5; i++) {
+        jaeger_log_error_limited(&limiter, "Repeated error %d", i);
+    }
+    TEST_ASSERT_EQUAL(2, logger.num_errors);
+    TEST_ASSERT_EQUAL_STRING("Repeated error 1", logger.last_message);
+    TEST_ASSERT_EQUAL(3, limiter.num_suppressed);
+
+    /* The next message through reports how many were suppressed. */
+    limiter.bucket.balance = 1;
+    jaeger_log_error_limited(&limiter, "Repeated error %d", 5);
+    TEST_ASSERT_EQUAL(4, logger.num_errors);
+    TEST_ASSERT_EQUAL_STRING("Suppressed 3 similar messages",
+                             logger.last_message);
+    TEST_ASSERT_EQUAL(0, limiter.num_suppressed);
+    jaeger_mutex_destroy(&limiter.mutex);
+
+    /* Each call site has a limiter of its own. */
+    for (int i = 0; i < JAEGERTRACINGC_LOG_LIMIT_BURST * 2; i++) {
+        log_site();
+    }
+    TEST_ASSERT_EQUAL(JAEGERTRACINGC_LOG_LIMIT_BURST, logger.num_warnings);
+    JAEGERTRACINGC_LOG_WARN_LIMITED("Other warning");
+    TEST_ASSERT_EQUAL(JAEGERTRACINGC_LOG_LIMIT_BURST + 1, logger.num_warnings);
+
+    jaeger_set_logger(jaeger_null_logger());
+}
@@ -29,7 +29,7 @@ void jaeger_log_record_destroy(jaeger_log_record* log_record)
 bool jaeger_log_record_init(jaeger_log_record* log_record)
 {
     assert(log_record != NULL);
-    jaeger_timestamp_now(&log_record->timestamp);
+    log_record->timestamp = jaeger_timestamp_now_ns();
     return jaeger_vector_init(&log_record->fields, sizeof(jaeger_tag));
 }
 
@@ -63,7 +63,7 @@ bool jaeger_log_record_from_opentracing(
             dst->fields.len--;
         }
     }
-    dst->timestamp = src->timestamp;
+    dst->timestamp = jaeger_time_value_to_ns(&src->timestamp.value);
     return true;
 
 cleanup:
@@ -80,11 +80,12 @@ void jaeger_log_record_protobuf_destroy(Jaeger__Model__Log* log_record)
     for (size_t i = 0; i < log_record->n_fields; i++) {
         if (log_record->fields[i] != NULL) {
             jaeger_tag_destroy(log_record->fields[i]);
-            jaeger_free(log_record->fields[i]);
+            jaeger_free_sized(log_record->fields[i], sizeof(jaeger_tag));
         }
     }
     jaeger_free(log_record->fields);
-    jaeger_free(log_record->timestamp);
+    jaeger_free_sized(log_record->timestamp,
+                      sizeof(Google__Protobuf__Timestamp));
     *log_record = (Jaeger__Model__Log) JAEGER__MODEL__LOG__INIT;
 }
 
@@ -100,8 +101,10 @@ bool jaeger_log_record_to_protobuf(Jaeger__Model__Log* restrict dst,
     }
     *dst->timestamp =
         (Google__Protobuf__Timestamp) GOOGLE__PROTOBUF__TIMESTAMP__INIT;
-    dst->timestamp->seconds = src->timestamp.value.tv_sec;
-    dst->timestamp->nanos = src->timestamp.value.tv_nsec;
+    opentracing_time_value time_value;
+    jaeger_time_value_from_ns(src->timestamp, &time_value);
+    dst->timestamp->seconds = time_value.tv_sec;
+    dst->timestamp->nanos = time_value.tv_nsec;
     if (!jaeger_vector_protobuf_copy((void***) &dst->fields,
                                      &dst->n_fields,
                                      &src->fields,
@@ -34,7 +34,8 @@ extern "C" {
 #endif /* __cplusplus */
 
 typedef struct jaeger_log_record {
-    jaeger_timestamp timestamp;
+    /** Wall time of the log record, in nanoseconds since the epoch. */
+    int64_t timestamp;
     jaeger_vector fields;
 } jaeger_log_record;
 
@@ -42,10 +43,9 @@ void jaeger_log_record_destroy(jaeger_log_record* log_record);
 
 JAEGERTRACINGC_WRAP_DESTROY(jaeger_log_record_destroy, jaeger_log_record)
 
-#define JAEGERTRACINGC_LOG_RECORD_INIT              \
-    {                                               \
-        .timestamp = JAEGERTRACINGC_TIMESTAMP_INIT, \
-        .fields = JAEGERTRACINGC_VECTOR_INIT        \
+#define JAEGERTRACINGC_LOG_RECORD_INIT                       \
+    {                                                        \
+        .timestamp = 0, .fields = JAEGERTRACINGC_VECTOR_INIT \
     }
 
 bool jaeger_log_record_init(jaeger_log_record* log_record);
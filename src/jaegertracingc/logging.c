@@ -64,16 +64,26 @@ void jaeger_std_logger_init(jaeger_logger* logger)
     logger->info = &std_log_info;
 }
 
+static jaeger_logger shared_logger = STD_LOGGER_INIT;
+
+static jaeger_logger* installed_logger = &shared_logger;
+
 jaeger_logger* jaeger_get_logger(void)
 {
-    static jaeger_logger logger = STD_LOGGER_INIT;
-    return &logger;
+    return installed_logger;
 }
 
 void jaeger_set_logger(jaeger_logger* logger)
 {
     assert(logger != NULL);
-    *jaeger_get_logger() = *logger;
+    shared_logger = *logger;
+    installed_logger = &shared_logger;
+}
+
+void jaeger_set_logger_ptr(jaeger_logger* logger)
+{
+    assert(logger != NULL);
+    installed_logger = logger;
 }
 
 void jaeger_log_error(const char* format, ...)
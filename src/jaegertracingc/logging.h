@@ -87,6 +87,14 @@ jaeger_logger* jaeger_null_logger();
  */
 void jaeger_set_logger(jaeger_logger* logger);
 
+/**
+ * Install logger in place rather than copying it, so loggers with state of
+ * their own receive themselves in their callbacks. The logger must stay
+ * valid until another logger is installed.
+ * @param Logger to install.
+ */
+void jaeger_set_logger_ptr(jaeger_logger* logger);
+
 /**
  * Get instance of installed logger. DO NOT MODIFY MEMBERS!
  * @return Installed logger instance.
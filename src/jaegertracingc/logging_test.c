@@ -15,6 +15,7 @@
  */
 
 #include "jaegertracingc/logging.h"
+#include "unity.h"
 
 void test_logging()
 {
@@ -24,5 +25,12 @@ void test_logging()
     jaeger_log_error("Testing error logging");
     jaeger_log_warn("Testing warn logging");
     jaeger_log_info("Testing info logging");
+
+    /* jaeger_set_logger copies the logger, jaeger_set_logger_ptr does not. */
+    TEST_ASSERT_NOT_EQUAL(&std_logger, jaeger_get_logger());
+    jaeger_set_logger_ptr(&std_logger);
+    TEST_ASSERT_EQUAL_PTR(&std_logger, jaeger_get_logger());
+    jaeger_log_info("Testing info logging in place");
     jaeger_set_logger(jaeger_null_logger());
+    TEST_ASSERT_NOT_EQUAL(jaeger_null_logger(), jaeger_get_logger());
 }
@@ -39,10 +39,82 @@ void jaeger_default_counter_init(jaeger_default_counter* counter)
 {
     assert(counter != NULL);
     counter->total = 0;
+#ifndef JAEGERTRACINGC_HAVE_ATOMICS
+    counter->mutex = (jaeger_mutex) JAEGERTRACINGC_MUTEX_INIT;
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
     ((jaeger_destructible*) counter)->destroy = &null_destroy;
     ((jaeger_counter*) counter)->inc = &jaeger_default_counter_inc;
 }
 
+/* Returns the cell the calling thread increments. Threads take cells in
+ * turn, so that up to JAEGERTRACINGC_COUNTER_STRIPES threads never share
+ * one. */
+static inline int stripe_index(void)
+{
+#if !defined(JAEGERTRACINGC_MT) || !defined(JAEGERTRACINGC_HAVE_ATOMICS)
+    /* Single threaded, or serialized by the counter lock. */
+    return 0;
+#elif defined(HAVE_THREAD_LOCAL)
+    static int next_index = 0;
+    static _Thread_local int index = -1;
+    if (index < 0) {
+        index = __atomic_fetch_add(&next_index, 1, __ATOMIC_RELAXED) &
+                (JAEGERTRACINGC_COUNTER_STRIPES - 1);
+    }
+    return index;
+#else
+    /* Without thread storage, hash the thread ID instead. */
+    const pthread_t self = pthread_self();
+    uint64_t id = 0;
+    memcpy(&id, &self, JAEGERTRACINGC_MIN(sizeof(id), sizeof(self)));
+    return (int) ((id * 0x9e3779b97f4a7c15) >> 32u) &
+           (JAEGERTRACINGC_COUNTER_STRIPES - 1);
+#endif /* !JAEGERTRACINGC_MT || !JAEGERTRACINGC_HAVE_ATOMICS */
+}
+
+static void jaeger_striped_counter_inc(jaeger_counter* counter, int64_t delta)
+{
+    assert(counter != NULL);
+    jaeger_striped_counter* c = (jaeger_striped_counter*) counter;
+    jaeger_counter_stripe* stripe = &c->stripes[stripe_index()];
+#ifdef JAEGERTRACINGC_HAVE_ATOMICS
+    __atomic_add_fetch(&stripe->value, delta, __ATOMIC_RELAXED);
+#else
+    jaeger_mutex_lock(&c->mutex);
+    stripe->value += delta;
+    jaeger_mutex_unlock(&c->mutex);
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+}
+
+void jaeger_striped_counter_init(jaeger_striped_counter* counter)
+{
+    assert(counter != NULL);
+    memset(counter->stripes, 0, sizeof(counter->stripes));
+#ifndef JAEGERTRACINGC_HAVE_ATOMICS
+    counter->mutex = (jaeger_mutex) JAEGERTRACINGC_MUTEX_INIT;
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+    ((jaeger_destructible*) counter)->destroy = &null_destroy;
+    ((jaeger_counter*) counter)->inc = &jaeger_striped_counter_inc;
+}
+
+int64_t jaeger_striped_counter_total(const jaeger_striped_counter* counter)
+{
+    assert(counter != NULL);
+    int64_t total = 0;
+#ifdef JAEGERTRACINGC_HAVE_ATOMICS
+    for (int i = 0; i < JAEGERTRACINGC_COUNTER_STRIPES; i++) {
+        total += __atomic_load_n(&counter->stripes[i].value, __ATOMIC_RELAXED);
+    }
+#else
+    jaeger_mutex_lock((jaeger_mutex*) &counter->mutex);
+    for (int i = 0; i < JAEGERTRACINGC_COUNTER_STRIPES; i++) {
+        total += counter->stripes[i].value;
+    }
+    jaeger_mutex_unlock((jaeger_mutex*) &counter->mutex);
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+    return total;
+}
+
 static void null_counter_inc(jaeger_counter* counter, int64_t delta)
 {
     (void) counter;
@@ -83,6 +155,9 @@ void jaeger_default_gauge_init(jaeger_default_gauge* gauge)
     ((jaeger_destructible*) gauge)->destroy = &null_destroy;
     ((jaeger_gauge*) gauge)->update = &jaeger_default_gauge_update;
     gauge->amount = 0;
+#ifndef JAEGERTRACINGC_HAVE_ATOMICS
+    gauge->mutex = (jaeger_mutex) JAEGERTRACINGC_MUTEX_INIT;
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
 }
 
 static void null_gauge_update(jaeger_gauge* gauge, int64_t amount)
@@ -106,6 +181,186 @@ jaeger_gauge* jaeger_null_gauge()
     return &null_gauge;
 }
 
+#define SUB_BUCKET_MASK (JAEGERTRACINGC_HISTOGRAM_SUB_BUCKETS - 1)
+
+int jaeger_histogram_bucket_index(int64_t value)
+{
+    if (value < JAEGERTRACINGC_HISTOGRAM_SUB_BUCKETS) {
+        return value < 0 ? 0 : (int) value;
+    }
+    /* Keep the top bits of the value below its leading one. Their position
+     * picks the group, and the bits pick the bucket within it. */
+#ifdef HAVE_BUILTIN
+    const int msb = 63 - __builtin_clzll((uint64_t) value);
+#else
+    int msb = 0;
+    for (uint64_t x = (uint64_t) value >> 1u; x != 0; x >>= 1u) {
+        msb++;
+    }
+#endif /* HAVE_BUILTIN */
+    const int shift = msb - JAEGERTRACINGC_HISTOGRAM_SUB_BUCKET_BITS;
+    return ((shift + 1) << JAEGERTRACINGC_HISTOGRAM_SUB_BUCKET_BITS) +
+           (int) (((uint64_t) value >> (unsigned) shift) & SUB_BUCKET_MASK);
+}
+
+int64_t jaeger_histogram_bucket_lower_bound(int index)
+{
+    assert(index >= 0 && index < JAEGERTRACINGC_HISTOGRAM_NUM_BUCKETS);
+    if (index < JAEGERTRACINGC_HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+    const int shift = (index >> JAEGERTRACINGC_HISTOGRAM_SUB_BUCKET_BITS) - 1;
+    return (int64_t) (((uint64_t) (index & SUB_BUCKET_MASK) |
+                       JAEGERTRACINGC_HISTOGRAM_SUB_BUCKETS)
+                      << (unsigned) shift);
+}
+
+int64_t jaeger_histogram_bucket_upper_bound(int index)
+{
+    assert(index >= 0 && index < JAEGERTRACINGC_HISTOGRAM_NUM_BUCKETS);
+    if (index == JAEGERTRACINGC_HISTOGRAM_NUM_BUCKETS - 1) {
+        return INT64_MAX;
+    }
+    return jaeger_histogram_bucket_lower_bound(index + 1) - 1;
+}
+
+#undef SUB_BUCKET_MASK
+
+static void jaeger_default_histogram_record(jaeger_histogram* histogram,
+                                            int64_t value)
+{
+    assert(histogram != NULL);
+    jaeger_default_histogram* h = (jaeger_default_histogram*) histogram;
+    if (value < 0) {
+        value = 0;
+    }
+    const int index = jaeger_histogram_bucket_index(value);
+#ifdef JAEGERTRACINGC_HAVE_ATOMICS
+    __atomic_add_fetch(&h->buckets[index], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->sum, value, __ATOMIC_RELAXED);
+    int64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+    while (value > max &&
+           !__atomic_compare_exchange_n(&h->max,
+                                        &max,
+                                        value,
+                                        true,
+                                        __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED)) {
+    }
+#else
+    jaeger_mutex_lock(&h->mutex);
+    h->buckets[index]++;
+    h->count++;
+    h->sum += value;
+    h->max = JAEGERTRACINGC_MAX(h->max, value);
+    jaeger_mutex_unlock(&h->mutex);
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+}
+
+void jaeger_default_histogram_init(jaeger_default_histogram* histogram)
+{
+    assert(histogram != NULL);
+    histogram->count = 0;
+    histogram->sum = 0;
+    histogram->max = 0;
+    memset(histogram->buckets, 0, sizeof(histogram->buckets));
+#ifndef JAEGERTRACINGC_HAVE_ATOMICS
+    histogram->mutex = (jaeger_mutex) JAEGERTRACINGC_MUTEX_INIT;
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+    ((jaeger_destructible*) histogram)->destroy = &null_destroy;
+    ((jaeger_histogram*) histogram)->record = &jaeger_default_histogram_record;
+}
+
+/* Copies the buckets and returns the number of values in them. */
+static int64_t load_histogram(const jaeger_default_histogram* histogram,
+                              int64_t* buckets,
+                              int64_t* sum,
+                              int64_t* max)
+{
+#ifdef JAEGERTRACINGC_HAVE_ATOMICS
+    for (int i = 0; i < JAEGERTRACINGC_HISTOGRAM_NUM_BUCKETS; i++) {
+        buckets[i] = __atomic_load_n(&histogram->buckets[i], __ATOMIC_RELAXED);
+    }
+    *sum = __atomic_load_n(&histogram->sum, __ATOMIC_RELAXED);
+    *max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+#else
+    jaeger_mutex_lock((jaeger_mutex*) &histogram->mutex);
+    memcpy(buckets,
+           histogram->buckets,
+           sizeof(*buckets) * JAEGERTRACINGC_HISTOGRAM_NUM_BUCKETS);
+    *sum = histogram->sum;
+    *max = histogram->max;
+    jaeger_mutex_unlock((jaeger_mutex*) &histogram->mutex);
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+
+    /* Count from the buckets themselves, so a racing record cannot leave a
+     * rank past the last bucket. */
+    int64_t total = 0;
+    for (int i = 0; i < JAEGERTRACINGC_HISTOGRAM_NUM_BUCKETS; i++) {
+        total += buckets[i];
+    }
+    return total;
+}
+
+static int64_t value_at_quantile(const int64_t* buckets,
+                                 int64_t total,
+                                 int64_t max,
+                                 double quantile)
+{
+    if (total == 0) {
+        return 0;
+    }
+    /* Rank of the quantile, rounded up, counting from one. */
+    const double exact_rank = JAEGERTRACINGC_CLAMP(quantile, 0.0, 1.0) * total;
+    int64_t rank = (int64_t) exact_rank;
+    if (rank < exact_rank || rank == 0) {
+        rank++;
+    }
+    int64_t seen = 0;
+    for (int i = 0; i < JAEGERTRACINGC_HISTOGRAM_NUM_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return JAEGERTRACINGC_MIN(jaeger_histogram_bucket_upper_bound(i),
+                                      max);
+        }
+    }
+    return max;
+}
+
+int64_t jaeger_default_histogram_value_at_quantile(
+    const jaeger_default_histogram* histogram, double quantile)
+{
+    assert(histogram != NULL);
+    int64_t buckets[JAEGERTRACINGC_HISTOGRAM_NUM_BUCKETS];
+    int64_t sum;
+    int64_t max;
+    const int64_t total = load_histogram(histogram, buckets, &sum, &max);
+    return value_at_quantile(buckets, total, max, quantile);
+}
+
+static void null_histogram_record(jaeger_histogram* histogram, int64_t value)
+{
+    (void) histogram;
+    (void) value;
+}
+
+static jaeger_histogram null_histogram;
+
+static void init_null_histogram()
+{
+    null_histogram =
+        (jaeger_histogram){.base = {.destroy = &null_destroy},
+                           .record = &null_histogram_record};
+}
+
+jaeger_histogram* jaeger_null_histogram()
+{
+    static jaeger_once once = JAEGERTRACINGC_ONCE_INIT;
+    jaeger_do_once(&once, &init_null_histogram);
+    return &null_histogram;
+}
+
 static jaeger_metrics null_metrics;
 
 static void init_null_metrics()
@@ -114,7 +369,9 @@ static void init_null_metrics()
 #define SET_COUNTERS(member) .member = jaeger_null_counter(),
         JAEGERTRACINGC_METRICS_COUNTERS(SET_COUNTERS)
 #define SET_GAUGES(member) .member = jaeger_null_gauge(),
-            JAEGERTRACINGC_METRICS_GAUGES(SET_GAUGES)};
+            JAEGERTRACINGC_METRICS_GAUGES(SET_GAUGES)
+#define SET_HISTOGRAMS(member) .member = jaeger_null_histogram(),
+                JAEGERTRACINGC_METRICS_HISTOGRAMS(SET_HISTOGRAMS)};
 }
 
 jaeger_metrics* jaeger_null_metrics()
@@ -142,6 +399,8 @@ void jaeger_metrics_destroy(jaeger_metrics* metrics)
 
     JAEGERTRACINGC_METRICS_COUNTERS(JAEGERTRACINGC_METRICS_DESTROY_IF_NOT_NULL)
     JAEGERTRACINGC_METRICS_GAUGES(JAEGERTRACINGC_METRICS_DESTROY_IF_NOT_NULL)
+    JAEGERTRACINGC_METRICS_HISTOGRAMS(
+        JAEGERTRACINGC_METRICS_DESTROY_IF_NOT_NULL)
 
 #undef JAEGERTRACINGC_METRICS_DESTROY_IF_NOT_NULL
 }
@@ -160,20 +419,22 @@ void jaeger_metrics_destroy(jaeger_metrics* metrics)
         }                                                                    \
     } while (0)
 
-#define JAEGERTRACINGC_METRICS_INIT_IMPL(counter_init, gauge_init) \
-    do {                                                           \
-        assert(metrics != NULL);                                   \
-        memset(metrics, 0, sizeof(*metrics));                      \
-        bool success = true;                                       \
-                                                                   \
-        JAEGERTRACINGC_METRICS_COUNTERS(counter_init)              \
-        JAEGERTRACINGC_METRICS_GAUGES(gauge_init)                  \
-                                                                   \
-        if (!success) {                                            \
-            jaeger_metrics_destroy(metrics);                       \
-        }                                                          \
-                                                                   \
-        return success;                                            \
+#define JAEGERTRACINGC_METRICS_INIT_IMPL(                 \
+    counter_init, gauge_init, histogram_init)             \
+    do {                                                  \
+        assert(metrics != NULL);                          \
+        memset(metrics, 0, sizeof(*metrics));             \
+        bool success = true;                              \
+                                                          \
+        JAEGERTRACINGC_METRICS_COUNTERS(counter_init)     \
+        JAEGERTRACINGC_METRICS_GAUGES(gauge_init)         \
+        JAEGERTRACINGC_METRICS_HISTOGRAMS(histogram_init) \
+                                                          \
+        if (!success) {                                   \
+            jaeger_metrics_destroy(metrics);              \
+        }                                                 \
+                                                          \
+        return success;                                   \
     } while (0)
 
 bool jaeger_default_metrics_init(jaeger_metrics* metrics)
@@ -181,17 +442,303 @@ bool jaeger_default_metrics_init(jaeger_metrics* metrics)
 #define JAEGERTRACINGC_DEFAULT_COUNTER_ALLOC_INIT(member)     \
     JAEGERTRACINGC_METRICS_ALLOC_INIT(member,                 \
                                       jaeger_counter,         \
-                                      jaeger_default_counter, \
-                                      jaeger_default_counter_init);
+                                      jaeger_striped_counter, \
+                                      jaeger_striped_counter_init);
 #define JAEGERTRACINGC_DEFAULT_GAUGE_ALLOC_INIT(member)     \
     JAEGERTRACINGC_METRICS_ALLOC_INIT(member,               \
                                       jaeger_gauge,         \
                                       jaeger_default_gauge, \
                                       jaeger_default_gauge_init);
 
-    JAEGERTRACINGC_METRICS_INIT_IMPL(JAEGERTRACINGC_DEFAULT_COUNTER_ALLOC_INIT,
-                                     JAEGERTRACINGC_DEFAULT_GAUGE_ALLOC_INIT);
+#define JAEGERTRACINGC_DEFAULT_HISTOGRAM_ALLOC_INIT(member)     \
+    JAEGERTRACINGC_METRICS_ALLOC_INIT(member,                   \
+                                      jaeger_histogram,         \
+                                      jaeger_default_histogram, \
+                                      jaeger_default_histogram_init);
+
+    JAEGERTRACINGC_METRICS_INIT_IMPL(
+        JAEGERTRACINGC_DEFAULT_COUNTER_ALLOC_INIT,
+        JAEGERTRACINGC_DEFAULT_GAUGE_ALLOC_INIT,
+        JAEGERTRACINGC_DEFAULT_HISTOGRAM_ALLOC_INIT);
 
 #undef JAEGERTRACINGC_DEFAULT_COUNTER_ALLOC_INIT
 #undef JAEGERTRACINGC_DEFAULT_GAUGE_ALLOC_INIT
+#undef JAEGERTRACINGC_DEFAULT_HISTOGRAM_ALLOC_INIT
+}
+
+/* Metrics are read through the update function of their implementation,
+ * which identifies the implementations this file knows how to read. */
+
+static int64_t counter_value(const jaeger_counter* counter)
+{
+    if (counter == NULL) {
+        return 0;
+    }
+    if (counter->inc == &jaeger_striped_counter_inc) {
+        return jaeger_striped_counter_total(
+            (const jaeger_striped_counter*) counter);
+    }
+    if (counter->inc == &jaeger_default_counter_inc) {
+        jaeger_default_counter* c = (jaeger_default_counter*) counter;
+#ifdef JAEGERTRACINGC_HAVE_ATOMICS
+        return __atomic_load_n(&c->total, __ATOMIC_RELAXED);
+#else
+        jaeger_mutex_lock(&c->mutex);
+        const int64_t total = c->total;
+        jaeger_mutex_unlock(&c->mutex);
+        return total;
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+    }
+    return 0;
+}
+
+static int64_t gauge_value(const jaeger_gauge* gauge)
+{
+    if (gauge == NULL || gauge->update != &jaeger_default_gauge_update) {
+        return 0;
+    }
+    jaeger_default_gauge* g = (jaeger_default_gauge*) gauge;
+#ifdef JAEGERTRACINGC_HAVE_ATOMICS
+    return __atomic_load_n(&g->amount, __ATOMIC_RELAXED);
+#else
+    jaeger_mutex_lock(&g->mutex);
+    const int64_t amount = g->amount;
+    jaeger_mutex_unlock(&g->mutex);
+    return amount;
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+}
+
+static void histogram_snapshot_init(jaeger_histogram_snapshot* snapshot,
+                                    const jaeger_histogram* histogram)
+{
+    memset(snapshot, 0, sizeof(*snapshot));
+    if (histogram == NULL ||
+        histogram->record != &jaeger_default_histogram_record) {
+        return;
+    }
+    int64_t buckets[JAEGERTRACINGC_HISTOGRAM_NUM_BUCKETS];
+    snapshot->count =
+        load_histogram((const jaeger_default_histogram*) histogram,
+                       buckets,
+                       &snapshot->sum,
+                       &snapshot->max);
+#define SET_QUANTILE(member, quantile) \
+    snapshot->member =                 \
+        value_at_quantile(buckets, snapshot->count, snapshot->max, quantile);
+    JAEGERTRACINGC_HISTOGRAM_QUANTILES(SET_QUANTILE)
+#undef SET_QUANTILE
+}
+
+void jaeger_metrics_snapshot_init(jaeger_metrics_snapshot* snapshot,
+                                  const jaeger_metrics* metrics)
+{
+    assert(snapshot != NULL);
+    memset(snapshot, 0, sizeof(*snapshot));
+    if (metrics == NULL) {
+        return;
+    }
+#define READ_COUNTER(member) snapshot->member = counter_value(metrics->member);
+#define READ_GAUGE(member) snapshot->member = gauge_value(metrics->member);
+#define READ_HISTOGRAM(member) \
+    histogram_snapshot_init(&snapshot->member, metrics->member);
+    JAEGERTRACINGC_METRICS_COUNTERS(READ_COUNTER)
+    JAEGERTRACINGC_METRICS_GAUGES(READ_GAUGE)
+    JAEGERTRACINGC_METRICS_HISTOGRAMS(READ_HISTOGRAM)
+#undef READ_COUNTER
+#undef READ_GAUGE
+#undef READ_HISTOGRAM
+}
+
+static void append_printf(char* buffer,
+                          int buffer_len,
+                          int* len,
+                          const char* format,
+                          ...) JAEGERTRACINGC_FORMAT_ATTRIBUTE(printf, 4, 5);
+
+/* Appends like snprintf, counting characters that do not fit. */
+static void append_printf(
+    char* buffer, int buffer_len, int* len, const char* format, ...)
+{
+    const int available = buffer_len - *len;
+    va_list args;
+    va_start(args, format);
+    const int num_written = vsnprintf(available > 0 ? &buffer[*len] : NULL,
+                                      JAEGERTRACINGC_MAX(available, 0),
+                                      format,
+                                      args);
+    va_end(args);
+    if (num_written > 0) {
+        *len += num_written;
+    }
+}
+
+int jaeger_metrics_snapshot_format_prometheus(
+    const jaeger_metrics_snapshot* snapshot,
+    const char* prefix,
+    char* buffer,
+    int buffer_len)
+{
+    assert(snapshot != NULL);
+    assert(prefix != NULL);
+    assert(buffer != NULL);
+    assert(buffer_len >= 0);
+    const char* separator = prefix[0] == '\0' ? "" : "_";
+    int len = 0;
+    if (buffer_len > 0) {
+        buffer[0] = '\0';
+    }
+
+#define FORMAT_COUNTER(member)                             \
+    append_printf(buffer,                                  \
+                  buffer_len,                              \
+                  &len,                                    \
+                  "# TYPE %s%s" #member "_total counter\n" \
+                  "%s%s" #member "_total %" PRId64 "\n",   \
+                  prefix,                                  \
+                  separator,                               \
+                  prefix,                                  \
+                  separator,                               \
+                  snapshot->member);
+#define FORMAT_GAUGE(member)                       \
+    append_printf(buffer,                          \
+                  buffer_len,                      \
+                  &len,                            \
+                  "# TYPE %s%s" #member " gauge\n" \
+                  "%s%s" #member " %" PRId64 "\n", \
+                  prefix,                          \
+                  separator,                       \
+                  prefix,                          \
+                  separator,                       \
+                  snapshot->member);
+#define FORMAT_QUANTILE(member, quantile)                             \
+    append_printf(buffer,                                             \
+                  buffer_len,                                         \
+                  &len,                                               \
+                  "%s%s%s{quantile=\"" #quantile "\"} %" PRId64 "\n", \
+                  prefix,                                             \
+                  separator,                                          \
+                  name,                                               \
+                  histogram->member);
+#define FORMAT_HISTOGRAM(member)                                        \
+    do {                                                                \
+        const char* name = #member;                                     \
+        const jaeger_histogram_snapshot* histogram = &snapshot->member; \
+        append_printf(buffer,                                           \
+                      buffer_len,                                       \
+                      &len,                                             \
+                      "# TYPE %s%s%s summary\n",                        \
+                      prefix,                                           \
+                      separator,                                        \
+                      name);                                            \
+        JAEGERTRACINGC_HISTOGRAM_QUANTILES(FORMAT_QUANTILE)             \
+        append_printf(buffer,                                           \
+                      buffer_len,                                       \
+                      &len,                                             \
+                      "%s%s%s_sum %" PRId64 "\n"                        \
+                      "%s%s%s_count %" PRId64 "\n",                     \
+                      prefix,                                           \
+                      separator,                                        \
+                      name,                                             \
+                      histogram->sum,                                   \
+                      prefix,                                           \
+                      separator,                                        \
+                      name,                                             \
+                      histogram->count);                                \
+    } while (0);
+
+    JAEGERTRACINGC_METRICS_COUNTERS(FORMAT_COUNTER)
+    JAEGERTRACINGC_METRICS_GAUGES(FORMAT_GAUGE)
+    JAEGERTRACINGC_METRICS_HISTOGRAMS(FORMAT_HISTOGRAM)
+
+#undef FORMAT_COUNTER
+#undef FORMAT_GAUGE
+#undef FORMAT_QUANTILE
+#undef FORMAT_HISTOGRAM
+
+    return len;
+}
+
+int jaeger_metrics_snapshot_format_statsd(
+    const jaeger_metrics_snapshot* snapshot,
+    const jaeger_metrics_snapshot* previous,
+    const char* prefix,
+    char* buffer,
+    int buffer_len)
+{
+    assert(snapshot != NULL);
+    assert(prefix != NULL);
+    assert(buffer != NULL);
+    assert(buffer_len >= 0);
+    const jaeger_metrics_snapshot zero_snapshot = {0};
+    if (previous == NULL) {
+        previous = &zero_snapshot;
+    }
+    const char* separator = prefix[0] == '\0' ? "" : ".";
+    int len = 0;
+    if (buffer_len > 0) {
+        buffer[0] = '\0';
+    }
+
+#define FORMAT_COUNTER(member)                       \
+    append_printf(buffer,                            \
+                  buffer_len,                        \
+                  &len,                              \
+                  "%s%s" #member ":%" PRId64 "|c\n", \
+                  prefix,                            \
+                  separator,                         \
+                  snapshot->member - previous->member);
+#define FORMAT_GAUGE(member)                         \
+    append_printf(buffer,                            \
+                  buffer_len,                        \
+                  &len,                              \
+                  "%s%s" #member ":%" PRId64 "|g\n", \
+                  prefix,                            \
+                  separator,                         \
+                  snapshot->member);
+#define FORMAT_QUANTILE(member, quantile)               \
+    append_printf(buffer,                               \
+                  buffer_len,                           \
+                  &len,                                 \
+                  "%s%s%s." #member ":%" PRId64 "|g\n", \
+                  prefix,                               \
+                  separator,                            \
+                  name,                                 \
+                  histogram->member);
+#define FORMAT_HISTOGRAM(member)                                        \
+    do {                                                                \
+        const char* name = #member;                                     \
+        const jaeger_histogram_snapshot* histogram = &snapshot->member; \
+        const jaeger_histogram_snapshot* previous_histogram =           \
+            &previous->member;                                          \
+        append_printf(buffer,                                           \
+                      buffer_len,                                       \
+                      &len,                                             \
+                      "%s%s%s.count:%" PRId64 "|c\n"                    \
+                      "%s%s%s.sum:%" PRId64 "|c\n"                      \
+                      "%s%s%s.max:%" PRId64 "|g\n",                     \
+                      prefix,                                           \
+                      separator,                                        \
+                      name,                                             \
+                      histogram->count - previous_histogram->count,     \
+                      prefix,                                           \
+                      separator,                                        \
+                      name,                                             \
+                      histogram->sum - previous_histogram->sum,         \
+                      prefix,                                           \
+                      separator,                                        \
+                      name,                                             \
+                      histogram->max);                                  \
+        JAEGERTRACINGC_HISTOGRAM_QUANTILES(FORMAT_QUANTILE)             \
+    } while (0);
+
+    JAEGERTRACINGC_METRICS_COUNTERS(FORMAT_COUNTER)
+    JAEGERTRACINGC_METRICS_GAUGES(FORMAT_GAUGE)
+    JAEGERTRACINGC_METRICS_HISTOGRAMS(FORMAT_HISTOGRAM)
+
+#undef FORMAT_COUNTER
+#undef FORMAT_GAUGE
+#undef FORMAT_QUANTILE
+#undef FORMAT_HISTOGRAM
+
+    return len;
 }
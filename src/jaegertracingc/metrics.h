@@ -74,6 +74,52 @@ jaeger_counter* jaeger_null_counter();
  */
 void jaeger_default_counter_init(jaeger_default_counter* counter);
 
+/** Number of cells in a striped counter. Must be a power of two. */
+#define JAEGERTRACINGC_COUNTER_STRIPES 16
+
+/** Assumed size of a cache line. */
+#define JAEGERTRACINGC_CACHE_LINE_SIZE 64
+
+/** Cell of a striped counter, padded to fill a cache line. */
+typedef struct jaeger_counter_stripe {
+    /** Part of the total. */
+    int64_t value;
+    /** Keeps neighboring cells off this cache line. */
+    char padding[JAEGERTRACINGC_CACHE_LINE_SIZE - sizeof(int64_t)];
+} jaeger_counter_stripe;
+
+/**
+ * Implements the counter interface by spreading increments over cells on
+ * separate cache lines, one per group of threads, so that threads
+ * incrementing the same counter do not contend for one cache line. Reading
+ * the total sums the cells.
+ */
+typedef struct jaeger_striped_counter {
+    jaeger_counter base;
+    /** Keeps the cells off the cache line holding the base members. */
+    char padding[JAEGERTRACINGC_CACHE_LINE_SIZE];
+    /** Cells that add up to the total. */
+    jaeger_counter_stripe stripes[JAEGERTRACINGC_COUNTER_STRIPES];
+#ifndef JAEGERTRACINGC_HAVE_ATOMICS
+    /** Lock to avoid data races. */
+    jaeger_mutex mutex;
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+} jaeger_striped_counter;
+
+/**
+ * Initialize a striped counter.
+ * @param counter Counter to initialize.
+ */
+void jaeger_striped_counter_init(jaeger_striped_counter* counter);
+
+/**
+ * Read the total of a striped counter. Increments that race with the read
+ * may or may not be included.
+ * @param counter Counter to read.
+ * @return Sum of all increments.
+ */
+int64_t jaeger_striped_counter_total(const jaeger_striped_counter* counter);
+
 /**
  * Gauge metric interface. Gauges are used to keep track of a changing number
  * (i.e. number of items currently in a queue).
@@ -113,6 +159,103 @@ void jaeger_default_gauge_init(jaeger_default_gauge* gauge);
 /* Shared instance of null gauge. DO NOT MODIFY MEMBERS! */
 jaeger_gauge* jaeger_null_gauge();
 
+/**
+ * Histogram metric interface. Histograms are used to keep track of the
+ * distribution of a measurement (i.e. time taken to flush a batch).
+ * @extends jaeger_destructible
+ */
+typedef struct jaeger_histogram {
+    /** Base class member. */
+    jaeger_destructible base;
+
+    /**
+     * Record one measurement.
+     * @param histogram Histogram to update.
+     * @param value Measured value. Negative values are recorded as zero.
+     */
+    void (*record)(struct jaeger_histogram* histogram, int64_t value);
+} jaeger_histogram;
+
+/**
+ * Number of bits of each value a histogram keeps. Buckets are exact below
+ * 2^bits, and each power of two above is split into 2^bits linear buckets,
+ * bounding the relative error of a bucket by 2^-bits.
+ */
+#define JAEGERTRACINGC_HISTOGRAM_SUB_BUCKET_BITS 3
+/** Number of linear buckets per power of two. */
+#define JAEGERTRACINGC_HISTOGRAM_SUB_BUCKETS \
+    (1 << JAEGERTRACINGC_HISTOGRAM_SUB_BUCKET_BITS)
+/** Number of buckets needed to cover every non-negative int64_t. */
+#define JAEGERTRACINGC_HISTOGRAM_NUM_BUCKETS           \
+    ((64 - JAEGERTRACINGC_HISTOGRAM_SUB_BUCKET_BITS) * \
+     JAEGERTRACINGC_HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * Find the bucket of a value.
+ * @param value Value to look up. Negative values map to the first bucket.
+ * @return Index of the bucket, less than JAEGERTRACINGC_HISTOGRAM_NUM_BUCKETS.
+ */
+int jaeger_histogram_bucket_index(int64_t value);
+
+/**
+ * Find the smallest value in a bucket.
+ * @param index Index of the bucket.
+ * @return Lower bound of the bucket, inclusive.
+ */
+int64_t jaeger_histogram_bucket_lower_bound(int index);
+
+/**
+ * Find the largest value in a bucket.
+ * @param index Index of the bucket.
+ * @return Upper bound of the bucket, inclusive.
+ */
+int64_t jaeger_histogram_bucket_upper_bound(int index);
+
+/**
+ * Implements the histogram interface with log-linear buckets, in the style of
+ * HDR histograms. Recording a value increments one bucket without locking,
+ * and takes constant time regardless of the value.
+ */
+typedef struct jaeger_default_histogram {
+    jaeger_histogram base;
+    /** Number of recorded values. */
+    int64_t count;
+    /** Sum of recorded values. */
+    int64_t sum;
+    /** Largest recorded value. */
+    int64_t max;
+    /** Number of recorded values in each bucket. */
+    int64_t buckets[JAEGERTRACINGC_HISTOGRAM_NUM_BUCKETS];
+#ifndef JAEGERTRACINGC_HAVE_ATOMICS
+    /** Lock to avoid data races. */
+    jaeger_mutex mutex;
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+} jaeger_default_histogram;
+
+/**
+ * Initialize a default histogram.
+ * @param histogram Histogram to initialize.
+ */
+void jaeger_default_histogram_init(jaeger_default_histogram* histogram);
+
+/**
+ * Estimate a quantile of the recorded values. Values recorded during the
+ * call may or may not be included.
+ * @param histogram Histogram to read.
+ * @param quantile Quantile between 0 and 1, i.e. 0.99 for the 99th
+ *                 percentile.
+ * @return Upper bound of the bucket holding the quantile, capped at the
+ *         largest recorded value, or zero if the histogram is empty.
+ */
+int64_t jaeger_default_histogram_value_at_quantile(
+    const jaeger_default_histogram* histogram, double quantile);
+
+/**
+ * Shared instance of null histogram. The null histogram does not do anything
+ * in its record() function. DO NOT MODIFY MEMBERS!
+ */
+jaeger_histogram* jaeger_null_histogram();
+
 #define JAEGERTRACINGC_METRICS_COUNTERS(X) \
     X(traces_started_sampled)              \
     X(traces_started_not_sampled)          \
@@ -136,23 +279,56 @@ jaeger_gauge* jaeger_null_gauge();
     X(baggage_restrictions_update_success) \
     X(baggage_restrictions_update_failure)
 
-#define JAEGERTRACINGC_METRICS_GAUGES(X) X(reporter_queue_length)
+/* Memory gauges are only updated by an accounting allocator, see
+ * jaeger_accounting_allocator_update_metrics. */
+#define JAEGERTRACINGC_METRICS_GAUGES(X) \
+    X(reporter_queue_length)             \
+    X(memory_bytes)                      \
+    X(memory_peak_bytes)                 \
+    X(memory_allocations)                \
+    X(memory_span_bytes)                 \
+    X(memory_span_peak_bytes)            \
+    X(memory_span_allocations)           \
+    X(memory_reporter_bytes)             \
+    X(memory_reporter_peak_bytes)        \
+    X(memory_reporter_allocations)       \
+    X(memory_sampler_bytes)              \
+    X(memory_sampler_peak_bytes)         \
+    X(memory_sampler_allocations)        \
+    X(memory_propagation_bytes)          \
+    X(memory_propagation_peak_bytes)     \
+    X(memory_propagation_allocations)    \
+    X(memory_baggage_bytes)              \
+    X(memory_baggage_peak_bytes)         \
+    X(memory_baggage_allocations)
+
+/* Durations are in nanoseconds, sizes in bytes. */
+#define JAEGERTRACINGC_METRICS_HISTOGRAMS(X) \
+    X(reporter_flush_latency)                \
+    X(reporter_packet_size)                  \
+    X(reporter_batch_spans)                  \
+    X(sampler_query_latency)
 
 #define JAEGERTRACINGC_COUNTER_DECL(member) jaeger_counter* member;
 #define JAEGERTRACINGC_GAUGE_DECL(member) jaeger_gauge* member;
+#define JAEGERTRACINGC_HISTOGRAM_DECL(member) jaeger_histogram* member;
 
 typedef struct jaeger_metrics {
     JAEGERTRACINGC_METRICS_COUNTERS(JAEGERTRACINGC_COUNTER_DECL)
     JAEGERTRACINGC_METRICS_GAUGES(JAEGERTRACINGC_GAUGE_DECL)
+    JAEGERTRACINGC_METRICS_HISTOGRAMS(JAEGERTRACINGC_HISTOGRAM_DECL)
 } jaeger_metrics;
 
 #undef JAEGERTRACINGC_COUNTER_DECL
 #undef JAEGERTRACINGC_GAUGE_DECL
+#undef JAEGERTRACINGC_HISTOGRAM_DECL
 
 void jaeger_metrics_destroy(jaeger_metrics* metrics);
 
 /**
  * Initialize a new metrics container with default metric implementations.
+ * Counters are striped counters, gauges are default gauges and histograms
+ * are default histograms.
  * @param metrics Metrics instance to initialize.
  * @return True on success, false otherwise.
  */
@@ -161,6 +337,97 @@ bool jaeger_default_metrics_init(jaeger_metrics* metrics);
 /* Shared instance of null metrics. DO NOT MODIFY MEMBERS! */
 jaeger_metrics* jaeger_null_metrics();
 
+/** Quantiles kept in a histogram snapshot, as (member, quantile) pairs. */
+#define JAEGERTRACINGC_HISTOGRAM_QUANTILES(X) \
+    X(p50, 0.5)                               \
+    X(p90, 0.9)                               \
+    X(p99, 0.99)
+
+#define JAEGERTRACINGC_QUANTILE_DECL(member, quantile) int64_t member;
+
+/** Summary of a histogram at one point in time. */
+typedef struct jaeger_histogram_snapshot {
+    /** Number of recorded values. */
+    int64_t count;
+    /** Sum of recorded values. */
+    int64_t sum;
+    /** Largest recorded value. */
+    int64_t max;
+    JAEGERTRACINGC_HISTOGRAM_QUANTILES(JAEGERTRACINGC_QUANTILE_DECL)
+} jaeger_histogram_snapshot;
+
+#undef JAEGERTRACINGC_QUANTILE_DECL
+
+#define JAEGERTRACINGC_COUNTER_SNAPSHOT_DECL(member) int64_t member;
+#define JAEGERTRACINGC_GAUGE_SNAPSHOT_DECL(member) int64_t member;
+#define JAEGERTRACINGC_HISTOGRAM_SNAPSHOT_DECL(member) \
+    jaeger_histogram_snapshot member;
+
+/**
+ * Values of every metric in a metrics container, with one member per metric
+ * of the same name.
+ */
+typedef struct jaeger_metrics_snapshot {
+    JAEGERTRACINGC_METRICS_COUNTERS(JAEGERTRACINGC_COUNTER_SNAPSHOT_DECL)
+    JAEGERTRACINGC_METRICS_GAUGES(JAEGERTRACINGC_GAUGE_SNAPSHOT_DECL)
+    JAEGERTRACINGC_METRICS_HISTOGRAMS(JAEGERTRACINGC_HISTOGRAM_SNAPSHOT_DECL)
+} jaeger_metrics_snapshot;
+
+#undef JAEGERTRACINGC_COUNTER_SNAPSHOT_DECL
+#undef JAEGERTRACINGC_GAUGE_SNAPSHOT_DECL
+#undef JAEGERTRACINGC_HISTOGRAM_SNAPSHOT_DECL
+
+/**
+ * Read every metric in a metrics container. Each value is read atomically,
+ * but updates that race with the snapshot may be included in some values
+ * and not others. Only the default implementations can be read. Other
+ * implementations, including the null metrics, read as zero.
+ * @param snapshot Snapshot to fill in.
+ * @param metrics Metrics to read. May be NULL, which reads as all zero.
+ */
+void jaeger_metrics_snapshot_init(jaeger_metrics_snapshot* snapshot,
+                                  const jaeger_metrics* metrics);
+
+/**
+ * Format a snapshot in the Prometheus text exposition format. Counters are
+ * suffixed with "_total" and histograms are written as summaries. Does not
+ * allocate.
+ * @param snapshot Snapshot to format.
+ * @param prefix Prefix for every metric name, i.e. "jaeger_tracer". Joined
+ *               to the name with an underscore unless empty.
+ * @param buffer The output character buffer.
+ * @param buffer_len The length of the output character buffer.
+ * @return The number of characters needed to represent the entire snapshot,
+ *         similar to the behavior of snprintf.
+ */
+int jaeger_metrics_snapshot_format_prometheus(
+    const jaeger_metrics_snapshot* snapshot,
+    const char* prefix,
+    char* buffer,
+    int buffer_len);
+
+/**
+ * Format a snapshot in the StatsD line protocol. StatsD counters count
+ * increments since the last flush, so counters and histogram counts and sums
+ * are written as the change since a previous snapshot. Gauges and histogram
+ * quantiles are written as StatsD gauges. Does not allocate.
+ * @param snapshot Snapshot to format.
+ * @param previous Snapshot formatted last time, or NULL to write the change
+ *                 since the metrics were initialized.
+ * @param prefix Prefix for every metric name, i.e. "jaeger.tracer". Joined
+ *               to the name with a period unless empty.
+ * @param buffer The output character buffer.
+ * @param buffer_len The length of the output character buffer.
+ * @return The number of characters needed to represent the entire snapshot,
+ *         similar to the behavior of snprintf.
+ */
+int jaeger_metrics_snapshot_format_statsd(
+    const jaeger_metrics_snapshot* snapshot,
+    const jaeger_metrics_snapshot* previous,
+    const char* prefix,
+    char* buffer,
+    int buffer_len);
+
 #ifdef __cplusplus
 } /* extern C */
 #endif /* __cplusplus */
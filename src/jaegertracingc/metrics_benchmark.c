@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jaegertracingc/benchmark_helpers.h"
+#include "jaegertracingc/metrics.h"
+#include "jaegertracingc/threading.h"
+
+#define NUM_INCREMENTS 16777216
+#define MAX_THREADS 64
+
+typedef struct metric_arg {
+    void* metric;
+    int num_increments;
+} metric_arg;
+
+static void* inc_func(void* arg)
+{
+    metric_arg* a = (metric_arg*) arg;
+    jaeger_counter* counter = (jaeger_counter*) a->metric;
+    for (int i = 0; i < a->num_increments; i++) {
+        counter->inc(counter, 1);
+    }
+    return NULL;
+}
+
+static void* record_func(void* arg)
+{
+    metric_arg* a = (metric_arg*) arg;
+    jaeger_histogram* histogram = (jaeger_histogram*) a->metric;
+    for (int i = 0; i < a->num_increments; i++) {
+        histogram->record(histogram, i);
+    }
+    return NULL;
+}
+
+/* Splits a fixed number of updates across threads, so the time per update
+ * shows how well a metric scales with contention. */
+static void benchmark_metric(const char* name,
+                             void* (*func)(void*),
+                             void* metric,
+                             int num_threads)
+{
+    char benchmark_name[64];
+    snprintf(benchmark_name,
+             sizeof(benchmark_name),
+             "%s/%d_threads",
+             name,
+             num_threads);
+    metric_arg arg = {.metric = metric,
+                      .num_increments = NUM_INCREMENTS / num_threads};
+    jaeger_thread threads[MAX_THREADS];
+    jaeger_benchmark benchmark;
+    jaeger_benchmark_start(&benchmark, benchmark_name, NUM_INCREMENTS);
+    for (int i = 0; i < num_threads; i++) {
+        jaeger_thread_init(&threads[i], func, &arg);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        jaeger_thread_join(threads[i], NULL);
+    }
+    jaeger_benchmark_stop(&benchmark);
+}
+
+int main()
+{
+    jaeger_default_counter default_counter;
+    jaeger_default_counter_init(&default_counter);
+    jaeger_striped_counter striped_counter;
+    jaeger_striped_counter_init(&striped_counter);
+    jaeger_default_histogram default_histogram;
+    jaeger_default_histogram_init(&default_histogram);
+    for (int num_threads = 1; num_threads <= MAX_THREADS; num_threads *= 2) {
+        benchmark_metric(
+            "default_counter", &inc_func, &default_counter, num_threads);
+        benchmark_metric(
+            "striped_counter", &inc_func, &striped_counter, num_threads);
+        benchmark_metric(
+            "default_histogram", &record_func, &default_histogram, num_threads);
+    }
+    return 0;
+}
@@ -17,10 +17,225 @@
 #include "jaegertracingc/alloc.h"
 #include "jaegertracingc/logging.h"
 #include "jaegertracingc/metrics.h"
+#include "jaegertracingc/threading.h"
 #include "unity.h"
 
+#define NUM_THREADS 32
+#define NUM_INCREMENTS 10000
+
+static void* inc_func(void* arg)
+{
+    jaeger_counter* counter = (jaeger_counter*) arg;
+    for (int i = 0; i < NUM_INCREMENTS; i++) {
+        counter->inc(counter, 1);
+    }
+    return NULL;
+}
+
+static inline void test_striped_counter()
+{
+    jaeger_striped_counter counter;
+    jaeger_striped_counter_init(&counter);
+    TEST_ASSERT_EQUAL(0, jaeger_striped_counter_total(&counter));
+    jaeger_counter* c = (jaeger_counter*) &counter;
+    c->inc(c, 2);
+    c->inc(c, -3);
+    TEST_ASSERT_EQUAL(-1, jaeger_striped_counter_total(&counter));
+
+    /* More threads than cells, so some threads share a cell. */
+    jaeger_thread threads[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; i++) {
+        TEST_ASSERT_EQUAL(0, jaeger_thread_init(&threads[i], &inc_func, c));
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        jaeger_thread_join(threads[i], NULL);
+    }
+    TEST_ASSERT_EQUAL(NUM_THREADS * NUM_INCREMENTS - 1,
+                      jaeger_striped_counter_total(&counter));
+    ((jaeger_destructible*) c)->destroy((jaeger_destructible*) c);
+}
+
+static void* record_func(void* arg)
+{
+    jaeger_histogram* histogram = (jaeger_histogram*) arg;
+    for (int i = 0; i < NUM_INCREMENTS; i++) {
+        histogram->record(histogram, i);
+    }
+    return NULL;
+}
+
+static inline void test_histogram_buckets()
+{
+    for (int i = 0; i < JAEGERTRACINGC_HISTOGRAM_NUM_BUCKETS; i++) {
+        const int64_t lower = jaeger_histogram_bucket_lower_bound(i);
+        const int64_t upper = jaeger_histogram_bucket_upper_bound(i);
+        TEST_ASSERT_TRUE(lower <= upper);
+        TEST_ASSERT_EQUAL(i, jaeger_histogram_bucket_index(lower));
+        TEST_ASSERT_EQUAL(i, jaeger_histogram_bucket_index(upper));
+        if (i > 0) {
+            TEST_ASSERT_EQUAL(jaeger_histogram_bucket_upper_bound(i - 1) + 1,
+                              lower);
+        }
+        /* Bucket width stays within the relative error bound. */
+        TEST_ASSERT_TRUE((upper - lower) <=
+                         lower / JAEGERTRACINGC_HISTOGRAM_SUB_BUCKETS);
+    }
+    TEST_ASSERT_EQUAL(0, jaeger_histogram_bucket_index(-1));
+    TEST_ASSERT_EQUAL(JAEGERTRACINGC_HISTOGRAM_NUM_BUCKETS - 1,
+                      jaeger_histogram_bucket_index(INT64_MAX));
+}
+
+static inline void test_default_histogram()
+{
+    jaeger_default_histogram histogram;
+    jaeger_default_histogram_init(&histogram);
+    TEST_ASSERT_EQUAL(
+        0, jaeger_default_histogram_value_at_quantile(&histogram, 0.5));
+    jaeger_histogram* h = (jaeger_histogram*) &histogram;
+    for (int i = 1; i <= 100; i++) {
+        h->record(h, i);
+    }
+    h->record(h, -5);
+    TEST_ASSERT_EQUAL(101, histogram.count);
+    TEST_ASSERT_EQUAL(5050, histogram.sum);
+    TEST_ASSERT_EQUAL(100, histogram.max);
+    TEST_ASSERT_EQUAL(
+        0, jaeger_default_histogram_value_at_quantile(&histogram, 0));
+    TEST_ASSERT_INT_WITHIN(
+        50 / JAEGERTRACINGC_HISTOGRAM_SUB_BUCKETS,
+        50,
+        jaeger_default_histogram_value_at_quantile(&histogram, 0.5));
+    TEST_ASSERT_INT_WITHIN(
+        99 / JAEGERTRACINGC_HISTOGRAM_SUB_BUCKETS,
+        99,
+        jaeger_default_histogram_value_at_quantile(&histogram, 0.99));
+    TEST_ASSERT_EQUAL(
+        100, jaeger_default_histogram_value_at_quantile(&histogram, 1));
+
+    jaeger_default_histogram_init(&histogram);
+    jaeger_thread threads[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; i++) {
+        TEST_ASSERT_EQUAL(0, jaeger_thread_init(&threads[i], &record_func, h));
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        jaeger_thread_join(threads[i], NULL);
+    }
+    TEST_ASSERT_EQUAL(NUM_THREADS * NUM_INCREMENTS, histogram.count);
+    TEST_ASSERT_EQUAL((int64_t) NUM_THREADS * NUM_INCREMENTS *
+                          (NUM_INCREMENTS - 1) / 2,
+                      histogram.sum);
+    TEST_ASSERT_EQUAL(NUM_INCREMENTS - 1, histogram.max);
+    ((jaeger_destructible*) h)->destroy((jaeger_destructible*) h);
+
+    jaeger_histogram* null_histogram = jaeger_null_histogram();
+    null_histogram->record(null_histogram, 1);
+}
+
+static inline void test_snapshot()
+{
+    jaeger_metrics_snapshot snapshot;
+    jaeger_metrics_snapshot_init(&snapshot, jaeger_null_metrics());
+    TEST_ASSERT_EQUAL(0, snapshot.spans_started);
+    TEST_ASSERT_EQUAL(0, snapshot.reporter_flush_latency.count);
+
+    jaeger_metrics metrics;
+    TEST_ASSERT_TRUE(jaeger_default_metrics_init(&metrics));
+    metrics.spans_started->inc(metrics.spans_started, 3);
+    metrics.reporter_queue_length->update(metrics.reporter_queue_length, 7);
+    for (int i = 1; i <= 4; i++) {
+        metrics.reporter_flush_latency->record(metrics.reporter_flush_latency,
+                                               i);
+    }
+    jaeger_metrics_snapshot_init(&snapshot, &metrics);
+    TEST_ASSERT_EQUAL(3, snapshot.spans_started);
+    TEST_ASSERT_EQUAL(0, snapshot.spans_finished);
+    TEST_ASSERT_EQUAL(7, snapshot.reporter_queue_length);
+    TEST_ASSERT_EQUAL(4, snapshot.reporter_flush_latency.count);
+    TEST_ASSERT_EQUAL(10, snapshot.reporter_flush_latency.sum);
+    TEST_ASSERT_EQUAL(4, snapshot.reporter_flush_latency.max);
+    TEST_ASSERT_EQUAL(2, snapshot.reporter_flush_latency.p50);
+    TEST_ASSERT_EQUAL(4, snapshot.reporter_flush_latency.p99);
+
+    /* Default counters can be read too. */
+    jaeger_default_counter default_counter;
+    jaeger_default_counter_init(&default_counter);
+    jaeger_counter* spans_finished = metrics.spans_finished;
+    metrics.spans_finished = (jaeger_counter*) &default_counter;
+    metrics.spans_finished->inc(metrics.spans_finished, 2);
+    jaeger_metrics_snapshot_init(&snapshot, &metrics);
+    TEST_ASSERT_EQUAL(2, snapshot.spans_finished);
+    metrics.spans_finished = spans_finished;
+
+    char buffer[8192];
+    const int prometheus_len = jaeger_metrics_snapshot_format_prometheus(
+        &snapshot, "jaeger_tracer", buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL(strlen(buffer), prometheus_len);
+    TEST_ASSERT_NOT_NULL(
+        strstr(buffer,
+               "# TYPE jaeger_tracer_spans_started_total counter\n"
+               "jaeger_tracer_spans_started_total 3\n"));
+    TEST_ASSERT_NOT_NULL(
+        strstr(buffer,
+               "# TYPE jaeger_tracer_reporter_queue_length gauge\n"
+               "jaeger_tracer_reporter_queue_length 7\n"));
+    TEST_ASSERT_NOT_NULL(
+        strstr(buffer,
+               "# TYPE jaeger_tracer_reporter_flush_latency summary\n"
+               "jaeger_tracer_reporter_flush_latency{quantile=\"0.5\"} 2\n"));
+    TEST_ASSERT_NOT_NULL(
+        strstr(buffer,
+               "jaeger_tracer_reporter_flush_latency_sum 10\n"
+               "jaeger_tracer_reporter_flush_latency_count 4\n"));
+
+    /* Output is truncated like snprintf. */
+    char small_buffer[16];
+    TEST_ASSERT_EQUAL(prometheus_len,
+                      jaeger_metrics_snapshot_format_prometheus(
+                          &snapshot,
+                          "jaeger_tracer",
+                          small_buffer,
+                          sizeof(small_buffer)));
+    TEST_ASSERT_EQUAL(sizeof(small_buffer) - 1, strlen(small_buffer));
+    TEST_ASSERT_EQUAL(0, strncmp(buffer, small_buffer, strlen(small_buffer)));
+    TEST_ASSERT_EQUAL(
+        prometheus_len,
+        jaeger_metrics_snapshot_format_prometheus(
+            &snapshot, "jaeger_tracer", small_buffer, 0));
+
+    jaeger_metrics_snapshot previous = snapshot;
+    metrics.spans_started->inc(metrics.spans_started, 2);
+    metrics.reporter_flush_latency->record(metrics.reporter_flush_latency, 5);
+    jaeger_metrics_snapshot_init(&snapshot, &metrics);
+    const int statsd_len = jaeger_metrics_snapshot_format_statsd(
+        &snapshot, &previous, "jaeger.tracer", buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL(strlen(buffer), statsd_len);
+    TEST_ASSERT_NOT_NULL(strstr(buffer, "jaeger.tracer.spans_started:2|c\n"));
+    TEST_ASSERT_NOT_NULL(
+        strstr(buffer, "jaeger.tracer.reporter_queue_length:7|g\n"));
+    TEST_ASSERT_NOT_NULL(
+        strstr(buffer,
+               "jaeger.tracer.reporter_flush_latency.count:1|c\n"
+               "jaeger.tracer.reporter_flush_latency.sum:5|c\n"
+               "jaeger.tracer.reporter_flush_latency.max:5|g\n"));
+    TEST_ASSERT_NOT_NULL(
+        strstr(buffer, "jaeger.tracer.reporter_flush_latency.p99:5|g\n"));
+
+    /* Without a previous snapshot, counters are written in full. */
+    jaeger_metrics_snapshot_format_statsd(
+        &snapshot, NULL, "", buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL(0, strncmp(buffer, "traces_started_sampled:0|c\n", 27));
+    TEST_ASSERT_NOT_NULL(strstr(buffer, "\nspans_started:5|c\n"));
+
+    jaeger_metrics_destroy(&metrics);
+}
+
 void test_metrics()
 {
+    test_striped_counter();
+    test_histogram_buckets();
+    test_default_histogram();
+    test_snapshot();
+
     jaeger_default_counter default_counter;
     jaeger_default_counter_init(&default_counter);
     ((jaeger_counter*) &default_counter)
@@ -39,7 +254,15 @@ void test_metrics()
     null_gauge->update(null_gauge, 4);
 
     jaeger_metrics metrics;
-    jaeger_default_metrics_init(&metrics);
+    TEST_ASSERT_TRUE(jaeger_default_metrics_init(&metrics));
+    metrics.spans_started->inc(metrics.spans_started, 5);
+    TEST_ASSERT_EQUAL(5,
+                      jaeger_striped_counter_total(
+                          (jaeger_striped_counter*) metrics.spans_started));
+    metrics.reporter_batch_spans->record(metrics.reporter_batch_spans, 6);
+    TEST_ASSERT_EQUAL(
+        6,
+        ((jaeger_default_histogram*) metrics.reporter_batch_spans)->max);
     jaeger_metrics_destroy(&metrics);
     jaeger_metrics_destroy(NULL);
 
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ * Mock collector for HTTP reporter tests.
+ */
+
+#ifndef JAEGERTRACINGC_MOCK_COLLECTOR_H
+#define JAEGERTRACINGC_MOCK_COLLECTOR_H
+
+#include <arpa/inet.h>
+#include <http_parser.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "jaegertracingc/common.h"
+#include "jaegertracingc/threading.h"
+#include "unity.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#define MOCK_COLLECTOR_MAX_STATUS_CODES 8
+#define MOCK_COLLECTOR_MAX_HEADER_LEN 64
+#define MOCK_COLLECTOR_MAX_FAILURE_LEN 128
+
+/* Status code that makes the collector reset the connection instead of
+ * answering. */
+#define MOCK_COLLECTOR_RESET 0
+
+/* Unity assertions abort the thread that fails them, so the collector thread
+ * records its failures for mock_collector_stop to assert on the main
+ * thread. */
+typedef struct mock_collector {
+    int server_fd;
+    jaeger_thread thread;
+    /* Status codes to answer requests with, in order. Requests past the end
+     * get 200. */
+    int status_codes[MOCK_COLLECTOR_MAX_STATUS_CODES];
+    int num_status_codes;
+    int num_connections;
+    int num_requests;
+    /* Content-Encoding of the last request, or "" if it had none. */
+    char content_encoding[MOCK_COLLECTOR_MAX_HEADER_LEN];
+    char header_field[MOCK_COLLECTOR_MAX_HEADER_LEN];
+    bool in_header_value;
+    char failure[MOCK_COLLECTOR_MAX_FAILURE_LEN];
+} mock_collector;
+
+#define MOCK_COLLECTOR_CHECK(collector, condition)                            \
+    do {                                                                      \
+        if (!(condition) && (collector)->failure[0] == '\0') {                \
+            snprintf((collector)->failure,                                    \
+                     sizeof((collector)->failure),                            \
+                     "%s:%d: %s",                                             \
+                     __FILE__,                                                \
+                     __LINE__,                                                \
+                     #condition);                                             \
+        }                                                                     \
+    } while (0)
+
+static inline void
+mock_collector_append(char* dst, size_t dst_size, const char* src, size_t len)
+{
+    const size_t dst_len = strlen(dst);
+    if (dst_len + len >= dst_size) {
+        len = dst_size - dst_len - 1;
+    }
+    memcpy(&dst[dst_len], src, len);
+    dst[dst_len + len] = '\0';
+}
+
+static inline int mock_collector_on_message_begin(http_parser* parser)
+{
+    mock_collector* collector = (mock_collector*) parser->data;
+    collector->content_encoding[0] = '\0';
+    collector->header_field[0] = '\0';
+    collector->in_header_value = false;
+    return 0;
+}
+
+static inline int
+mock_collector_on_header_field(http_parser* parser, const char* at, size_t len)
+{
+    mock_collector* collector = (mock_collector*) parser->data;
+    /* Fields and values may each arrive in several pieces. */
+    if (collector->in_header_value) {
+        collector->header_field[0] = '\0';
+        collector->in_header_value = false;
+    }
+    mock_collector_append(
+        collector->header_field, sizeof(collector->header_field), at, len);
+    return 0;
+}
+
+static inline int
+mock_collector_on_header_value(http_parser* parser, const char* at, size_t len)
+{
+    mock_collector* collector = (mock_collector*) parser->data;
+    collector->in_header_value = true;
+    if (strcasecmp(collector->header_field, "Content-Encoding") == 0) {
+        mock_collector_append(collector->content_encoding,
+                              sizeof(collector->content_encoding),
+                              at,
+                              len);
+    }
+    return 0;
+}
+
+static inline int mock_collector_on_message_complete(http_parser* parser)
+{
+    mock_collector* collector = (mock_collector*) parser->data;
+    collector->num_requests++;
+    return 0;
+}
+
+static inline int mock_collector_status_code(const mock_collector* collector,
+                                             int request_index)
+{
+    return (request_index < collector->num_status_codes)
+               ? collector->status_codes[request_index]
+               : 200;
+}
+
+/* Answers one request, returning false if the connection was reset. */
+static inline bool mock_collector_respond(mock_collector* collector,
+                                          int client_fd,
+                                          int status_code)
+{
+    if (status_code == MOCK_COLLECTOR_RESET) {
+        /* Closing with a zero linger time sends a reset. */
+        const struct linger linger = {.l_onoff = 1, .l_linger = 0};
+        setsockopt(client_fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+        return false;
+    }
+    char response[64];
+    const int response_len =
+        snprintf(response,
+                 sizeof(response),
+                 "HTTP/1.1 %d Mock\r\nContent-Length: 0\r\n\r\n",
+                 status_code);
+    MOCK_COLLECTOR_CHECK(collector,
+                         response_len > 0 &&
+                             response_len < (int) sizeof(response));
+    MOCK_COLLECTOR_CHECK(
+        collector, send(client_fd, response, response_len, 0) == response_len);
+    return true;
+}
+
+/* Accepts connections one at a time and answers every request with the next
+ * status code, keeping the connection open until the client closes it. */
+static inline void* mock_collector_run_loop(void* arg)
+{
+    mock_collector* collector = (mock_collector*) arg;
+    http_parser_settings settings;
+    http_parser_settings_init(&settings);
+    settings.on_message_begin = &mock_collector_on_message_begin;
+    settings.on_header_field = &mock_collector_on_header_field;
+    settings.on_header_value = &mock_collector_on_header_value;
+    settings.on_message_complete = &mock_collector_on_message_complete;
+    int client_fd;
+    while ((client_fd = accept(collector->server_fd, NULL, 0)) >= 0) {
+        collector->num_connections++;
+        http_parser parser;
+        http_parser_init(&parser, HTTP_REQUEST);
+        parser.data = collector;
+        char buffer[1024];
+        ssize_t num_read;
+        bool open = true;
+        while (open &&
+               (num_read = recv(client_fd, buffer, sizeof(buffer), 0)) > 0) {
+            const int num_requests = collector->num_requests;
+            MOCK_COLLECTOR_CHECK(
+                collector,
+                http_parser_execute(&parser, &settings, buffer, num_read) ==
+                    (size_t) num_read);
+            for (int i = num_requests; open && i < collector->num_requests;
+                 i++) {
+                open = mock_collector_respond(
+                    collector,
+                    client_fd,
+                    mock_collector_status_code(collector, i));
+            }
+        }
+        close(client_fd);
+    }
+    return NULL;
+}
+
+/* Starts the collector on a loopback port and writes its URL to url. */
+static inline void mock_collector_start(mock_collector* collector,
+                                        const int* status_codes,
+                                        int num_status_codes,
+                                        char* url,
+                                        int url_len)
+{
+    TEST_ASSERT_LESS_OR_EQUAL(MOCK_COLLECTOR_MAX_STATUS_CODES,
+                              num_status_codes);
+    memset(collector, 0, sizeof(*collector));
+    if (num_status_codes > 0) {
+        memcpy(collector->status_codes,
+               status_codes,
+               sizeof(int) * num_status_codes);
+    }
+    collector->num_status_codes = num_status_codes;
+    collector->server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, collector->server_fd);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST_ASSERT_EQUAL(
+        0,
+        bind(collector->server_fd, (struct sockaddr*) &addr, sizeof(addr)));
+    TEST_ASSERT_EQUAL(0, listen(collector->server_fd, 1));
+    socklen_t addr_len = sizeof(addr);
+    TEST_ASSERT_EQUAL(
+        0,
+        getsockname(collector->server_fd, (struct sockaddr*) &addr, &addr_len));
+    TEST_ASSERT_LESS_THAN(url_len,
+                          snprintf(url,
+                                   url_len,
+                                   "http://127.0.0.1:%d/api/v2/spans",
+                                   ntohs(addr.sin_port)));
+    TEST_ASSERT_EQUAL(0,
+                      jaeger_thread_init(&collector->thread,
+                                         &mock_collector_run_loop,
+                                         collector));
+}
+
+/* Stops the collector and fails the test if the collector thread found a
+ * problem. Counts are safe to read once this returns. */
+static inline void mock_collector_stop(mock_collector* collector)
+{
+    shutdown(collector->server_fd, SHUT_RDWR);
+    close(collector->server_fd);
+    jaeger_thread_join(collector->thread, NULL);
+    TEST_ASSERT_EQUAL_STRING("", collector->failure);
+}
+
+#ifdef __cplusplus
+} /* extern C */
+#endif /* __cplusplus */
+
+#endif /* JAEGERTRACINGC_MOCK_COLLECTOR_H */
@@ -29,6 +29,27 @@
 extern "C" {
 #endif /* __cplusplus */
 
+/**
+ * Span context propagation formats. Combine formats with bitwise or to
+ * extract and inject more than one.
+ */
+typedef enum jaeger_propagation_format {
+    /** Jaeger trace context header (uber-trace-id). */
+    jaeger_propagation_format_jaeger = 1u << 0u,
+    /** W3C Trace Context traceparent and tracestate headers. */
+    jaeger_propagation_format_w3c = 1u << 1u,
+    /**
+     * B3 multiple headers (X-B3-TraceId, X-B3-SpanId, etc.). Extraction
+     * accepts the single b3 header as well.
+     */
+    jaeger_propagation_format_b3 = 1u << 2u,
+    /**
+     * B3 single header (b3). Extraction accepts the multiple headers as
+     * well.
+     */
+    jaeger_propagation_format_b3_single = 1u << 3u
+} jaeger_propagation_format;
+
 /**
  * HTTP headers to use for span context propagation.
  */
@@ -41,6 +62,15 @@ typedef struct jaeger_headers_config {
     const char* trace_context_header;
     /** Header prefix to prepend to baggage keys. */
     const char* trace_baggage_header_prefix;
+    /**
+     * Bitwise or of jaeger_propagation_format values to extract and inject.
+     * Zero means jaeger_propagation_format_jaeger, so configs written before
+     * this field existed keep working. All enabled formats are extracted in
+     * a single pass over the carrier. When a carrier holds more than one
+     * format, Jaeger takes precedence over W3C, and W3C over B3. Debug and
+     * baggage headers are used with every format.
+     */
+    unsigned int propagation_formats;
 } jaeger_headers_config;
 
 #define JAEGERTRACINGC_HEADERS_CONFIG_INIT                                \
@@ -49,7 +79,8 @@ typedef struct jaeger_headers_config {
         .baggage_header = JAEGERTRACINGC_BAGGAGE_HEADER,                  \
         .trace_context_header = JAEGERTRACINGC_TRACE_CONTEXT_HEADER_NAME, \
         .trace_baggage_header_prefix =                                    \
-            JAEGERTRACINGC_TRACE_BAGGAGE_HEADER_PREFIX                    \
+            JAEGERTRACINGC_TRACE_BAGGAGE_HEADER_PREFIX,                   \
+        .propagation_formats = jaeger_propagation_format_jaeger           \
     }
 
 /** Sampler config. */
@@ -21,60 +21,262 @@
 
 #include "jaegertracingc/propagation.h"
 #include "jaegertracingc/endian.h"
+#include "jaegertracingc/header_table.h"
 #include "jaegertracingc/metrics.h"
 #include "jaegertracingc/options.h"
 #include "jaegertracingc/span.h"
 #include "jaegertracingc/strings.h"
+#include "jaegertracingc/trace_state.h"
 #include "jaegertracingc/tracer.h"
 
+/* Keys and values shorter than this are normalized and decoded on the stack.
+ * Longer ones fall back to the heap. */
+#define SCRATCH_BUFFER_SIZE 256
+
+/* Leaves room for whitespace and members that truncation will drop. */
+#define TRACE_STATE_BUFFER_SIZE (JAEGERTRACINGC_TRACE_STATE_MAX_STR_LEN * 2)
+
+/* Carriers only guarantee header values for the duration of a callback, so
+ * tracestate headers are copied into buffer and parsed in place. */
+typedef struct trace_state_buffer {
+    char buffer[TRACE_STATE_BUFFER_SIZE];
+    int len;
+    bool discard;
+    jaeger_trace_state state;
+} trace_state_buffer;
+
+/* B3 multiple headers arrive separately, so their fields are collected here
+ * and only applied once every header has been seen. */
+typedef struct b3_context {
+    jaeger_trace_id trace_id;
+    uint64_t span_id;
+    uint8_t flags;
+    bool has_trace_id;
+    bool has_span_id;
+} b3_context;
+
 typedef struct extract_text_map_arg {
     jaeger_span_context* ctx;
     jaeger_metrics* metrics;
-    const jaeger_headers_config* config;
-    void (*normalize_key)(char* restrict, const char* restrict);
+    const jaeger_header_table* headers;
+    bool ignore_key_case;
     void (*decode_value)(char* restrict, const char* restrict);
+    bool has_jaeger_context;
+    bool has_traceparent;
+    bool traceparent_corrupted;
+    jaeger_trace_id traceparent_trace_id;
+    trace_state_buffer* trace_state;
+    b3_context b3;
+    bool has_b3_context;
+    bool b3_corrupted;
 } extract_text_map_arg;
 
+static inline unsigned int
+propagation_formats(const jaeger_headers_config* config)
+{
+    return config->propagation_formats == 0
+               ? (unsigned int) jaeger_propagation_format_jaeger
+               : config->propagation_formats;
+}
+
+static inline char* scratch_buffer_alloc(char* scratch, size_t len)
+{
+    if (len < SCRATCH_BUFFER_SIZE) {
+        return scratch;
+    }
+    return jaeger_malloc(len + 1);
+}
+
+static inline void scratch_buffer_free(char* scratch, char* buffer)
+{
+    if (buffer != NULL && buffer != scratch) {
+        jaeger_free(buffer);
+    }
+}
+
+/* Decodes value into a mutable buffer, using scratch if it is large enough.
+ * Decoding never grows the value. */
+static inline char* decode_value_copy(const extract_text_map_arg* arg,
+                                      const char* value,
+                                      char* scratch)
+{
+    const size_t value_len = strlen(value);
+    char* buffer = scratch_buffer_alloc(scratch, value_len);
+    if (buffer == NULL) {
+        return NULL;
+    }
+    if (arg->decode_value != NULL) {
+        arg->decode_value(buffer, value);
+    }
+    else {
+        memcpy(buffer, value, value_len + 1);
+    }
+    return buffer;
+}
+
+/* Returns value itself if decoding would not change it, otherwise the decoded
+ * copy. Check result against value before freeing it. */
+static inline const char* decode_value(const extract_text_map_arg* arg,
+                                       const char* value,
+                                       char* scratch)
+{
+    if (arg->decode_value == NULL || strchr(value, '%') == NULL) {
+        return value;
+    }
+    return decode_value_copy(arg, value, scratch);
+}
+
+/* Copies a tracestate header value and appends its members to the trace
+ * state. Malformed or oversized trace state is discarded without failing the
+ * extraction, as the W3C Trace Context specification requires. */
+static inline void append_trace_state(trace_state_buffer* trace_state,
+                                      const char* value)
+{
+    if (trace_state->discard) {
+        return;
+    }
+    const size_t value_len = strlen(value);
+    if (value_len > (size_t) (TRACE_STATE_BUFFER_SIZE - trace_state->len)) {
+        trace_state->discard = true;
+        return;
+    }
+    char* copy = &trace_state->buffer[trace_state->len];
+    memcpy(copy, value, value_len);
+    trace_state->len += value_len;
+    if (!jaeger_trace_state_parse(&trace_state->state, copy, value_len)) {
+        trace_state->discard = true;
+    }
+}
+
+/* Parses the value of one of the B3 multiple headers into b3. */
+static inline bool
+parse_b3_header(b3_context* b3, jaeger_header_type type, const char* value)
+{
+    const size_t len = strlen(value);
+    uint64_t id = 0;
+    switch (type) {
+    case jaeger_header_type_b3_trace_id:
+        b3->has_trace_id = true;
+        return (len == JAEGERTRACINGC_UINT64_MAX_STR_LEN ||
+                len == JAEGERTRACINGC_TRACE_ID_MAX_STR_LEN) &&
+               jaeger_trace_id_scan_n(&b3->trace_id, value, len);
+    case jaeger_header_type_b3_span_id:
+        b3->has_span_id = true;
+        return len == JAEGERTRACINGC_UINT64_MAX_STR_LEN &&
+               decode_hex_uint64(value, len, &b3->span_id);
+    case jaeger_header_type_b3_parent_span_id:
+        /* Validated, but the span context has nowhere to keep it. */
+        return len == JAEGERTRACINGC_UINT64_MAX_STR_LEN &&
+               decode_hex_uint64(value, len, &id);
+    case jaeger_header_type_b3_sampled:
+        /* Older tracers send "true" and "false". */
+        if (strcmp(value, "1") == 0 || strcmp(value, "true") == 0) {
+            b3->flags |= (uint8_t) jaeger_sampling_flag_sampled;
+            return true;
+        }
+        return strcmp(value, "0") == 0 || strcmp(value, "false") == 0;
+    default:
+        assert(type == jaeger_header_type_b3_flags);
+        /* Debug implies sampled. */
+        if (strcmp(value, "1") == 0) {
+            b3->flags |= (uint8_t) jaeger_sampling_flag_sampled |
+                         (uint8_t) jaeger_sampling_flag_debug;
+            return true;
+        }
+        return strcmp(value, "0") == 0;
+    }
+}
+
 static opentracing_propagation_error_code
 extract_text_map_callback(void* arg, const char* key, const char* value)
 {
-    jaeger_span_context* ctx = ((extract_text_map_arg*) arg)->ctx;
-    const jaeger_headers_config* config = ((extract_text_map_arg*) arg)->config;
-    void (*normalize_key)(char*, const char*) =
-        ((extract_text_map_arg*) arg)->normalize_key;
-    void (*decode_value)(char*, const char*) =
-        ((extract_text_map_arg*) arg)->decode_value;
-    char* key_buffer = jaeger_malloc(strlen(key) + 1);
+    extract_text_map_arg* extract_arg = (extract_text_map_arg*) arg;
+    jaeger_span_context* ctx = extract_arg->ctx;
+    assert(ctx != NULL);
+    const size_t key_len = strlen(key);
+    const jaeger_header_type type = jaeger_header_table_lookup(
+        extract_arg->headers, key, key_len, extract_arg->ignore_key_case);
+    if (type == jaeger_header_type_unknown) {
+        return opentracing_propagation_error_code_success;
+    }
+
+    char key_scratch[SCRATCH_BUFFER_SIZE];
+    char value_scratch[SCRATCH_BUFFER_SIZE];
     char* suffix = NULL;
     char* value_buffer = NULL;
-    if (key_buffer == NULL) {
-        return opentracing_propagation_error_code_unknown;
-    }
+    const char* decoded_value = NULL;
     opentracing_propagation_error_code error_code =
         opentracing_propagation_error_code_success;
-    normalize_key(key_buffer, key);
-    assert(ctx != NULL);
-    if (strcmp(key_buffer, config->trace_context_header) == 0) {
-        value_buffer = jaeger_malloc(strlen(value) + 1);
-        if (value_buffer == NULL) {
+    switch (type) {
+    case jaeger_header_type_trace_context:
+        decoded_value = decode_value(extract_arg, value, value_scratch);
+        if (decoded_value == NULL) {
             error_code = opentracing_propagation_error_code_unknown;
             goto cleanup;
         }
-        decode_value(value_buffer, value);
-        if (!jaeger_span_context_scan(ctx, value_buffer)) {
+        if (!jaeger_span_context_scan(ctx, decoded_value)) {
             error_code =
                 opentracing_propagation_error_code_span_context_corrupted;
             goto cleanup;
         }
-    }
-    else if (strcmp(key_buffer, config->debug_header) == 0) {
-        value_buffer = jaeger_malloc(strlen(value) + 1);
-        if (value_buffer == NULL) {
+        extract_arg->has_jaeger_context = true;
+        break;
+    case jaeger_header_type_traceparent: {
+        /* W3C headers are never URI encoded. */
+        jaeger_span_context traceparent = JAEGERTRACINGC_SPAN_CONTEXT_INIT;
+        if (!jaeger_span_context_scan_traceparent(&traceparent, value)) {
+            /* Corrupted only if no other format has a span context, which
+             * is known once every header has been seen. */
+            extract_arg->traceparent_corrupted = true;
+            break;
+        }
+        extract_arg->has_traceparent = true;
+        extract_arg->traceparent_trace_id = traceparent.trace_id;
+        if (!extract_arg->has_jaeger_context) {
+            ctx->trace_id = traceparent.trace_id;
+            ctx->span_id = traceparent.span_id;
+            /* Keeps the debug flag of a debug header. */
+            ctx->flags = (uint8_t)(ctx->flags | traceparent.flags);
+        }
+    } break;
+    case jaeger_header_type_tracestate:
+        append_trace_state(extract_arg->trace_state, value);
+        break;
+    case jaeger_header_type_b3: {
+        /* A lone sampling state ("0", "1", or "d") carries no span
+         * context. */
+        if (strlen(value) <= 1) {
+            break;
+        }
+        jaeger_span_context b3 = JAEGERTRACINGC_SPAN_CONTEXT_INIT;
+        if (!jaeger_span_context_scan_b3(&b3, value)) {
+            /* Corrupted only if no other format has a span context, as for
+             * traceparent. */
+            extract_arg->b3_corrupted = true;
+            break;
+        }
+        extract_arg->b3 = (b3_context){.trace_id = b3.trace_id,
+                                       .span_id = b3.span_id,
+                                       .flags = b3.flags,
+                                       .has_trace_id = true,
+                                       .has_span_id = true};
+    } break;
+    case jaeger_header_type_b3_trace_id:
+    case jaeger_header_type_b3_span_id:
+    case jaeger_header_type_b3_parent_span_id:
+    case jaeger_header_type_b3_sampled:
+    case jaeger_header_type_b3_flags:
+        if (!parse_b3_header(&extract_arg->b3, type, value)) {
+            extract_arg->b3_corrupted = true;
+        }
+        break;
+    case jaeger_header_type_debug:
+        decoded_value = decode_value(extract_arg, value, value_scratch);
+        if (decoded_value == NULL) {
             error_code = opentracing_propagation_error_code_unknown;
             goto cleanup;
         }
-        decode_value(value_buffer, value);
-        ctx->debug_id = jaeger_strdup(value_buffer);
+        ctx->debug_id = jaeger_strdup(decoded_value);
         if (ctx->debug_id == NULL) {
             error_code = opentracing_propagation_error_code_unknown;
             goto cleanup;
@@ -82,56 +284,117 @@ extract_text_map_callback(void* arg, const char* key, const char* value)
         ctx->flags =
             ((uint8_t)(ctx->flags | ((uint8_t) jaeger_sampling_flag_debug)) |
              ((uint8_t) jaeger_sampling_flag_sampled));
-    }
-    else if (strcmp(key_buffer, config->baggage_header) == 0) {
-        value_buffer = jaeger_malloc(strlen(value) + 1);
-        decode_value(value_buffer, value);
+        break;
+    case jaeger_header_type_baggage:
+        /* parse_comma_separated_map tokenizes in place, so always copy. */
+        value_buffer = decode_value_copy(extract_arg, value, value_scratch);
+        if (value_buffer == NULL) {
+            error_code = opentracing_propagation_error_code_unknown;
+            goto cleanup;
+        }
         error_code = parse_comma_separated_map(&ctx->baggage, value_buffer);
-        if (error_code != opentracing_propagation_error_code_success) {
+        break;
+    default: {
+        assert(type == jaeger_header_type_trace_baggage);
+        const size_t prefix_len =
+            extract_arg->headers->trace_baggage_header_prefix_len;
+        const char* key_suffix = &key[prefix_len];
+        suffix = scratch_buffer_alloc(key_scratch, key_len - prefix_len);
+        if (suffix == NULL) {
+            error_code = opentracing_propagation_error_code_unknown;
             goto cleanup;
         }
-    }
-    else {
-        const int prefix_len = strlen(config->trace_baggage_header_prefix);
-        const int key_len = strlen(key_buffer);
-        if (key_len > prefix_len && memcmp(key_buffer,
-                                           config->trace_baggage_header_prefix,
-                                           prefix_len) == 0) {
-            const size_t suffix_len = key_len - prefix_len;
-            suffix = jaeger_malloc(suffix_len + 1);
-            if (suffix == NULL) {
-                error_code = opentracing_propagation_error_code_unknown;
-                goto cleanup;
-            }
-            strncpy(suffix, key_buffer + prefix_len, suffix_len + 1);
+        if (extract_arg->ignore_key_case) {
+            to_lowercase(suffix, key_suffix);
+        }
+        else {
+            copy_str(suffix, key_suffix);
+        }
 
-            value_buffer = jaeger_malloc(strlen(value) + 1);
-            if (value_buffer == NULL) {
-                error_code = opentracing_propagation_error_code_unknown;
-                goto cleanup;
-            }
-            decode_value(value_buffer, value);
+        decoded_value = decode_value(extract_arg, value, value_scratch);
+        if (decoded_value == NULL) {
+            error_code = opentracing_propagation_error_code_unknown;
+            goto cleanup;
+        }
 
-            if (!jaeger_hashtable_put(&ctx->baggage, suffix, value_buffer)) {
-                error_code = opentracing_propagation_error_code_unknown;
-                goto cleanup;
-            }
+        /* The hashtable copies the key and value, so these are the only
+         * allocations made for a kept baggage item. */
+        if (!jaeger_hashtable_put(&ctx->baggage, suffix, decoded_value)) {
+            error_code = opentracing_propagation_error_code_unknown;
+            goto cleanup;
         }
+    } break;
     }
 
 cleanup:
-    jaeger_free(key_buffer);
-    jaeger_free(suffix);
-    jaeger_free(value_buffer);
+    scratch_buffer_free(key_scratch, suffix);
+    scratch_buffer_free(value_scratch, value_buffer);
+    if (decoded_value != value) {
+        scratch_buffer_free(value_scratch, (char*) decoded_value);
+    }
     return error_code;
 }
 
+/* Applies the B3 span context unless a format with higher precedence was
+ * present. A partial B3 context marks B3 as corrupted. */
+static inline void apply_b3_context(extract_text_map_arg* arg)
+{
+    const b3_context* b3 = &arg->b3;
+    if (!b3->has_trace_id && !b3->has_span_id) {
+        return;
+    }
+    if (!b3->has_trace_id || !b3->has_span_id ||
+        (b3->trace_id.high == 0 && b3->trace_id.low == 0) ||
+        b3->span_id == 0) {
+        arg->b3_corrupted = true;
+        return;
+    }
+    arg->has_b3_context = true;
+    if (!arg->has_jaeger_context && !arg->has_traceparent) {
+        arg->ctx->trace_id = b3->trace_id;
+        arg->ctx->span_id = b3->span_id;
+        /* Keeps the debug flag of a debug header. */
+        arg->ctx->flags = (uint8_t)(arg->ctx->flags | b3->flags);
+    }
+}
+
+/* Attaches the normalized trace state to the extracted context if it belongs
+ * to the same trace. */
+static inline bool attach_trace_state(const extract_text_map_arg* arg)
+{
+    trace_state_buffer* trace_state = arg->trace_state;
+    if (!arg->has_traceparent || trace_state->discard ||
+        arg->traceparent_trace_id.high != arg->ctx->trace_id.high ||
+        arg->traceparent_trace_id.low != arg->ctx->trace_id.low) {
+        return true;
+    }
+    jaeger_trace_state_truncate(&trace_state->state,
+                                JAEGERTRACINGC_TRACE_STATE_MAX_STR_LEN);
+    if (trace_state->state.num_members == 0) {
+        return true;
+    }
+    char str[JAEGERTRACINGC_TRACE_STATE_MAX_STR_LEN + 1];
+    const int len =
+        jaeger_trace_state_format(&trace_state->state, str, sizeof(str));
+    assert(len <= JAEGERTRACINGC_TRACE_STATE_MAX_STR_LEN);
+    (void) len;
+    arg->ctx->trace_state = jaeger_strdup(str);
+    return arg->ctx->trace_state != NULL;
+}
+
 static inline opentracing_propagation_error_code
 extract_from_text_map_helper(opentracing_text_map_reader* reader,
                              extract_text_map_arg* arg)
 {
     opentracing_propagation_error_code error_code =
         opentracing_propagation_error_code_success;
+    /* Only the header fields are initialized, leaving the buffer untouched
+     * until a tracestate header shows up. */
+    trace_state_buffer trace_state;
+    trace_state.len = 0;
+    trace_state.discard = false;
+    trace_state.state.num_members = 0;
+    arg->trace_state = &trace_state;
     arg->ctx = jaeger_malloc(sizeof(*arg->ctx));
     if (arg->ctx == NULL || !jaeger_span_context_init(arg->ctx)) {
         error_code = opentracing_propagation_error_code_unknown;
@@ -141,6 +404,19 @@ extract_from_text_map_helper(opentracing_text_map_reader* reader,
     if (error_code != opentracing_propagation_error_code_success) {
         goto cleanup;
     }
+    apply_b3_context(arg);
+    /* Malformed traceparent and B3 headers fall back to the other
+     * formats. */
+    if ((arg->traceparent_corrupted || arg->b3_corrupted) &&
+        !arg->has_jaeger_context && !arg->has_traceparent &&
+        !arg->has_b3_context) {
+        error_code = opentracing_propagation_error_code_span_context_corrupted;
+        goto cleanup;
+    }
+    if (!attach_trace_state(arg)) {
+        error_code = opentracing_propagation_error_code_unknown;
+        goto cleanup;
+    }
     if (arg->ctx->trace_id.high == 0 && arg->ctx->trace_id.low == 0 &&
         arg->ctx->debug_id == NULL && arg->ctx->baggage.size == 0) {
         /* Successfully decoded an empty span context. */
@@ -162,18 +438,18 @@ cleanup:
 }
 
 opentracing_propagation_error_code
-jaeger_extract_from_text_map(opentracing_text_map_reader* reader,
-                             jaeger_span_context** ctx,
-                             jaeger_metrics* metrics,
-                             const jaeger_headers_config* config)
+jaeger_extract_from_text_map_table(opentracing_text_map_reader* reader,
+                                   jaeger_span_context** ctx,
+                                   jaeger_metrics* metrics,
+                                   const jaeger_header_table* headers)
 {
     assert(ctx != NULL);
-    assert(config != NULL);
+    assert(headers != NULL);
     extract_text_map_arg arg = {.ctx = NULL,
-                                .config = config,
+                                .headers = headers,
                                 .metrics = metrics,
-                                .normalize_key = &copy_str,
-                                .decode_value = &copy_str};
+                                .ignore_key_case = false,
+                                .decode_value = NULL};
     const opentracing_propagation_error_code error_code =
         extract_from_text_map_helper(reader, &arg);
     *ctx = arg.ctx;
@@ -181,17 +457,29 @@ jaeger_extract_from_text_map(opentracing_text_map_reader* reader,
 }
 
 opentracing_propagation_error_code
-jaeger_extract_from_http_headers(opentracing_http_headers_reader* reader,
-                                 jaeger_span_context** ctx,
-                                 jaeger_metrics* metrics,
-                                 const jaeger_headers_config* config)
+jaeger_extract_from_text_map(opentracing_text_map_reader* reader,
+                             jaeger_span_context** ctx,
+                             jaeger_metrics* metrics,
+                             const jaeger_headers_config* config)
 {
-    assert(ctx != NULL);
     assert(config != NULL);
+    jaeger_header_table headers;
+    jaeger_header_table_init(&headers, config);
+    return jaeger_extract_from_text_map_table(reader, ctx, metrics, &headers);
+}
+
+opentracing_propagation_error_code
+jaeger_extract_from_http_headers_table(opentracing_http_headers_reader* reader,
+                                       jaeger_span_context** ctx,
+                                       jaeger_metrics* metrics,
+                                       const jaeger_header_table* headers)
+{
+    assert(ctx != NULL);
+    assert(headers != NULL);
     extract_text_map_arg arg = {.ctx = NULL,
-                                .config = config,
+                                .headers = headers,
                                 .metrics = metrics,
-                                .normalize_key = &to_lowercase,
+                                .ignore_key_case = true,
                                 .decode_value = &decode_uri_value};
     const opentracing_propagation_error_code error_code =
         extract_from_text_map_helper((opentracing_text_map_reader*) reader,
@@ -200,104 +488,144 @@ jaeger_extract_from_http_headers(opentracing_http_headers_reader* reader,
     return error_code;
 }
 
-static inline bool read_binary(int (*callback)(void*, char*, size_t),
-                               void* arg,
-                               char* buffer,
-                               void* result,
-                               int result_size)
+opentracing_propagation_error_code
+jaeger_extract_from_http_headers(opentracing_http_headers_reader* reader,
+                                 jaeger_span_context** ctx,
+                                 jaeger_metrics* metrics,
+                                 const jaeger_headers_config* config)
+{
+    assert(config != NULL);
+    jaeger_header_table headers;
+    jaeger_header_table_init(&headers, config);
+    return jaeger_extract_from_http_headers_table(
+        reader, ctx, metrics, &headers);
+}
+
+/* trace_id.high, trace_id.low, span_id, flags, and the number of baggage
+ * items, in that order. */
+#define BINARY_HEADER_SIZE                                              \
+    (sizeof(uint64_t) * 3 + sizeof(uint8_t) + sizeof(uint32_t))
+#define BINARY_LEN_SIZE sizeof(uint32_t)
+#define BINARY_CHUNK_SIZE 4096
+
+static inline uint64_t read_uint64(const char* data)
+{
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    /* NOLINTNEXTLINE(hicpp-signed-bitwise) */
+    return BIG_ENDIAN_64_TO_HOST(value);
+}
+
+static inline uint32_t read_uint32(const char* data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    /* NOLINTNEXTLINE(hicpp-signed-bitwise) */
+    return BIG_ENDIAN_32_TO_HOST(value);
+}
+
+static inline void write_uint64(char* data, uint64_t value)
+{
+    /* NOLINTNEXTLINE(hicpp-signed-bitwise) */
+    value = HOST_TO_BIG_ENDIAN_64(value);
+    memcpy(data, &value, sizeof(value));
+}
+
+static inline void write_uint32(char* data, uint32_t value)
+{
+    /* NOLINTNEXTLINE(hicpp-signed-bitwise) */
+    value = HOST_TO_BIG_ENDIAN_32(value);
+    memcpy(data, &value, sizeof(value));
+}
+
+/* Parses the fixed size header into ctx.
+ * @return The number of baggage items that follow. */
+static inline uint32_t parse_binary_header(const char* data,
+                                           jaeger_span_context* ctx)
 {
-    const int num_read = callback(arg, buffer, result_size);
-    if (num_read != result_size) {
-        return false;
+    ctx->trace_id.high = read_uint64(data);
+    ctx->trace_id.low = read_uint64(&data[sizeof(uint64_t)]);
+    ctx->span_id = read_uint64(&data[sizeof(uint64_t) * 2]);
+    ctx->flags = (uint8_t) data[sizeof(uint64_t) * 3];
+    return read_uint32(&data[sizeof(uint64_t) * 3 + sizeof(uint8_t)]);
+}
+
+static inline opentracing_propagation_error_code
+extract_binary_failed(opentracing_propagation_error_code error_code,
+                      jaeger_span_context** ctx,
+                      jaeger_metrics* metrics)
+{
+    if (error_code ==
+            opentracing_propagation_error_code_span_context_corrupted &&
+        metrics != NULL) {
+        metrics->decoding_errors->inc(metrics->decoding_errors, 1);
     }
-    switch (result_size) {
-    case sizeof(uint64_t): {
-        uint64_t value;
-        memcpy(&value, buffer, sizeof(value));
-        /* NOLINTNEXTLINE(hicpp-signed-bitwise) */
-        *(uint64_t*) result = BIG_ENDIAN_64_TO_HOST(value);
-    } break;
-    case sizeof(uint32_t): {
-        uint32_t value;
-        memcpy(&value, buffer, sizeof(value));
-        /* NOLINTNEXTLINE(hicpp-signed-bitwise) */
-        *(uint32_t*) result = BIG_ENDIAN_32_TO_HOST(value);
-    } break;
-    default: {
-        assert(result_size == sizeof(uint8_t));
-        uint8_t value;
-        memcpy(&value, buffer, sizeof(value));
-        *(uint8_t*) result = value;
-    } break;
+    jaeger_span_context_destroy((jaeger_destructible*) *ctx);
+    jaeger_free(*ctx);
+    *ctx = NULL;
+    return error_code;
+}
+
+/* Reads len bytes into a scratch buffer. Lengths come from the stream
+ * itself, so longer strings are read in chunks of growing size and a corrupt
+ * length fails at the end of the stream instead of allocating whatever it
+ * claims up front. */
+static inline char* read_binary_chunked(int (*callback)(void*, char*, size_t),
+                                        void* arg,
+                                        char* scratch,
+                                        size_t len)
+{
+    size_t capacity = JAEGERTRACINGC_MIN(len, (size_t) BINARY_CHUNK_SIZE);
+    char* buffer = scratch_buffer_alloc(scratch, capacity);
+    if (buffer == NULL) {
+        return NULL;
     }
-    return true;
-}
-
-static opentracing_propagation_error_code parse_baggage_binary(
-    int (*callback)(void*, char*, size_t), void* arg, jaeger_hashtable* baggage)
-{
-#define READ_BINARY(x)                                                     \
-    do {                                                                   \
-        if (!read_binary(callback, arg, buffer, &(x), sizeof((x)))) {      \
-            error_code =                                                   \
-                opentracing_propagation_error_code_span_context_corrupted; \
-            goto cleanup;                                                  \
-        }                                                                  \
-    } while (0)
-
-#define READ_BUFFER(buffer, len)                                           \
-    do {                                                                   \
-        if (callback(arg, (buffer), (len)) != (int) (len)) {               \
-            error_code =                                                   \
-                opentracing_propagation_error_code_span_context_corrupted; \
-            goto cleanup;                                                  \
-        }                                                                  \
-        (buffer)[len] = '\0';                                              \
-    } while (0)
-
-    char buffer[sizeof(uint64_t)];
-    uint32_t num_baggage_items;
-    char* key_buffer = NULL;
-    char* value_buffer = NULL;
-    opentracing_propagation_error_code error_code =
-        opentracing_propagation_error_code_success;
-    READ_BINARY(num_baggage_items);
-    for (int i = 0; i < (int) num_baggage_items; i++) {
-        uint32_t key_len;
-        READ_BINARY(key_len);
-        key_buffer = jaeger_malloc(key_len + 1);
-        if (key_buffer == NULL) {
-            error_code = opentracing_propagation_error_code_unknown;
-            goto cleanup;
+    size_t pos = 0;
+    while (true) {
+        const size_t chunk_len = capacity - pos;
+        if (callback(arg, &buffer[pos], chunk_len) != (int) chunk_len) {
+            scratch_buffer_free(scratch, buffer);
+            return NULL;
         }
-        READ_BUFFER(key_buffer, key_len);
-
-        uint32_t value_len;
-        READ_BINARY(value_len);
-        value_buffer = jaeger_malloc(value_len + 1);
-        if (value_buffer == NULL) {
-            error_code = opentracing_propagation_error_code_unknown;
-            goto cleanup;
+        pos = capacity;
+        if (pos == len) {
+            return buffer;
         }
-        READ_BUFFER(value_buffer, value_len);
-        if (!jaeger_hashtable_put(baggage, key_buffer, value_buffer)) {
-            error_code = opentracing_propagation_error_code_unknown;
-            goto cleanup;
+        capacity = JAEGERTRACINGC_MIN(capacity * 2, len);
+        char* new_buffer = (buffer == scratch)
+                               ? jaeger_malloc(capacity + 1)
+                               : jaeger_realloc(buffer, capacity + 1);
+        if (new_buffer == NULL) {
+            scratch_buffer_free(scratch, buffer);
+            return NULL;
         }
-
-        jaeger_free(key_buffer);
-        jaeger_free(value_buffer);
+        if (buffer == scratch) {
+            memcpy(new_buffer, scratch, pos);
+        }
+        buffer = new_buffer;
     }
+}
 
-    return opentracing_propagation_error_code_success;
-
-cleanup:
-    jaeger_free(key_buffer);
-    jaeger_free(value_buffer);
-    return error_code;
-
-#undef READ_BINARY
-#undef READ_BUFFER
+/* Reads a string into a scratch buffer, null-terminated after str_len bytes.
+ * If has_next_len is true, the length that follows the string is read too
+ * and returned through next_len. */
+static inline char* read_binary_str(int (*callback)(void*, char*, size_t),
+                                    void* arg,
+                                    char* scratch,
+                                    uint32_t str_len,
+                                    bool has_next_len,
+                                    uint32_t* next_len)
+{
+    const size_t len = (size_t) str_len + (has_next_len ? BINARY_LEN_SIZE : 0);
+    char* buffer = read_binary_chunked(callback, arg, scratch, len);
+    if (buffer == NULL) {
+        return NULL;
+    }
+    if (has_next_len) {
+        *next_len = read_uint32(&buffer[str_len]);
+    }
+    buffer[str_len] = '\0';
+    return buffer;
 }
 
 opentracing_propagation_error_code
@@ -309,48 +637,143 @@ jaeger_extract_from_binary(int (*callback)(void*, char*, size_t),
     assert(callback != NULL);
     assert(ctx != NULL);
 
-    opentracing_propagation_error_code error_code =
-        opentracing_propagation_error_code_success;
     *ctx = (jaeger_span_context*) jaeger_malloc(sizeof(jaeger_span_context));
     if (*ctx == NULL || !jaeger_span_context_init(*ctx)) {
-        error_code = opentracing_propagation_error_code_unknown;
-        goto cleanup;
+        return extract_binary_failed(
+            opentracing_propagation_error_code_unknown, ctx, metrics);
+    }
+
+    /* Every length is read together with the bytes before it, so each
+     * baggage item takes two reads instead of four. */
+    char header[BINARY_HEADER_SIZE + BINARY_LEN_SIZE];
+    if (callback(arg, header, BINARY_HEADER_SIZE) !=
+        (int) BINARY_HEADER_SIZE) {
+        return extract_binary_failed(
+            opentracing_propagation_error_code_span_context_corrupted,
+            ctx,
+            metrics);
+    }
+    const uint32_t num_baggage_items = parse_binary_header(header, *ctx);
+    uint32_t key_len = 0;
+    if (num_baggage_items > 0) {
+        if (callback(arg, &header[BINARY_HEADER_SIZE], BINARY_LEN_SIZE) !=
+            (int) BINARY_LEN_SIZE) {
+            return extract_binary_failed(
+                opentracing_propagation_error_code_span_context_corrupted,
+                ctx,
+                metrics);
+        }
+        key_len = read_uint32(&header[BINARY_HEADER_SIZE]);
     }
 
-#define READ_BINARY(x)                                                     \
-    do {                                                                   \
-        if (!read_binary(callback, arg, buffer, &(x), sizeof((x)))) {      \
-            error_code =                                                   \
-                opentracing_propagation_error_code_span_context_corrupted; \
-            goto cleanup;                                                  \
-        }                                                                  \
-    } while (0)
+    char key_scratch[SCRATCH_BUFFER_SIZE];
+    char value_scratch[SCRATCH_BUFFER_SIZE];
+    for (uint32_t i = 0; i < num_baggage_items; i++) {
+        uint32_t value_len = 0;
+        char* key = read_binary_str(
+            callback, arg, key_scratch, key_len, true, &value_len);
+        if (key == NULL) {
+            return extract_binary_failed(
+                opentracing_propagation_error_code_span_context_corrupted,
+                ctx,
+                metrics);
+        }
+        const bool has_next_len = i + 1 < num_baggage_items;
+        char* value = read_binary_str(
+            callback, arg, value_scratch, value_len, has_next_len, &key_len);
+        const bool success =
+            value != NULL && jaeger_hashtable_put(&(*ctx)->baggage, key, value);
+        scratch_buffer_free(key_scratch, key);
+        scratch_buffer_free(value_scratch, value);
+        if (!success) {
+            return extract_binary_failed(
+                value == NULL
+                    ? opentracing_propagation_error_code_span_context_corrupted
+                    : opentracing_propagation_error_code_unknown,
+                ctx,
+                metrics);
+        }
+    }
+    return opentracing_propagation_error_code_success;
+}
 
-    char buffer[sizeof(uint64_t)];
-    READ_BINARY((*ctx)->trace_id.high);
-    READ_BINARY((*ctx)->trace_id.low);
-    READ_BINARY((*ctx)->span_id);
-    READ_BINARY((*ctx)->flags);
+/* Copies len bytes of data into a null-terminated scratch buffer. */
+static inline char*
+copy_binary_str(char* scratch, const char* data, uint32_t len)
+{
+    char* buffer = scratch_buffer_alloc(scratch, len);
+    if (buffer != NULL) {
+        memcpy(buffer, data, len);
+        buffer[len] = '\0';
+    }
+    return buffer;
+}
 
-#undef READ_BINARY
+opentracing_propagation_error_code
+jaeger_extract_from_binary_buffer(const char* data,
+                                  size_t len,
+                                  jaeger_span_context** ctx,
+                                  jaeger_metrics* metrics)
+{
+    assert(data != NULL || len == 0);
+    assert(ctx != NULL);
 
-    error_code = parse_baggage_binary(callback, arg, &(*ctx)->baggage);
-    if (error_code != opentracing_propagation_error_code_success) {
-        goto cleanup;
+    *ctx = (jaeger_span_context*) jaeger_malloc(sizeof(jaeger_span_context));
+    if (*ctx == NULL || !jaeger_span_context_init(*ctx)) {
+        return extract_binary_failed(
+            opentracing_propagation_error_code_unknown, ctx, metrics);
+    }
+    if (len < BINARY_HEADER_SIZE) {
+        return extract_binary_failed(
+            opentracing_propagation_error_code_span_context_corrupted,
+            ctx,
+            metrics);
     }
+    const uint32_t num_baggage_items = parse_binary_header(data, *ctx);
+    size_t pos = BINARY_HEADER_SIZE;
 
-    return opentracing_propagation_error_code_success;
+    char key_scratch[SCRATCH_BUFFER_SIZE];
+    char value_scratch[SCRATCH_BUFFER_SIZE];
+    uint32_t i = 0;
+    for (; i < num_baggage_items; i++) {
+        /* Lengths are checked against the remaining bytes before anything
+         * is allocated, so corrupt input cannot cause huge allocations. */
+        if (len - pos < BINARY_LEN_SIZE) {
+            break;
+        }
+        const uint32_t key_len = read_uint32(&data[pos]);
+        pos += BINARY_LEN_SIZE;
+        if (len - pos < key_len || len - pos - key_len < BINARY_LEN_SIZE) {
+            break;
+        }
+        const char* key_data = &data[pos];
+        pos += key_len;
+        const uint32_t value_len = read_uint32(&data[pos]);
+        pos += BINARY_LEN_SIZE;
+        if (len - pos < value_len) {
+            break;
+        }
+        const char* value_data = &data[pos];
+        pos += value_len;
 
-cleanup:
-    if (error_code ==
-            opentracing_propagation_error_code_span_context_corrupted &&
-        metrics != NULL) {
-        metrics->decoding_errors->inc(metrics->decoding_errors, 1);
+        char* key = copy_binary_str(key_scratch, key_data, key_len);
+        char* value = copy_binary_str(value_scratch, value_data, value_len);
+        const bool success = key != NULL && value != NULL &&
+                             jaeger_hashtable_put(&(*ctx)->baggage, key, value);
+        scratch_buffer_free(key_scratch, key);
+        scratch_buffer_free(value_scratch, value);
+        if (!success) {
+            return extract_binary_failed(
+                opentracing_propagation_error_code_unknown, ctx, metrics);
+        }
     }
-    jaeger_span_context_destroy((jaeger_destructible*) *ctx);
-    jaeger_free(*ctx);
-    *ctx = NULL;
-    return error_code;
+    if (i != num_baggage_items || pos != len) {
+        return extract_binary_failed(
+            opentracing_propagation_error_code_span_context_corrupted,
+            ctx,
+            metrics);
+    }
+    return opentracing_propagation_error_code_success;
 }
 
 opentracing_propagation_error_code
@@ -372,6 +795,77 @@ jaeger_extract_from_custom(opentracing_custom_carrier_reader* reader,
     return error_code;
 }
 
+static inline opentracing_propagation_error_code
+inject_w3c_headers(opentracing_text_map_writer* writer,
+                   const jaeger_span_context* ctx)
+{
+    char traceparent_buffer[JAEGERTRACINGC_TRACEPARENT_STR_LEN + 1];
+    jaeger_span_context_format_traceparent(
+        ctx, traceparent_buffer, sizeof(traceparent_buffer));
+    /* Extraction truncates trace states to the maximum length, and spans
+     * only copy them. */
+    char trace_state_buffer[JAEGERTRACINGC_TRACE_STATE_MAX_STR_LEN + 1];
+    bool has_trace_state = false;
+    jaeger_mutex_lock((jaeger_mutex*) &ctx->mutex);
+    if (ctx->trace_state != NULL) {
+        const size_t len = strlen(ctx->trace_state);
+        assert(len <= JAEGERTRACINGC_TRACE_STATE_MAX_STR_LEN);
+        if (len <= JAEGERTRACINGC_TRACE_STATE_MAX_STR_LEN) {
+            memcpy(trace_state_buffer, ctx->trace_state, len + 1);
+            has_trace_state = true;
+        }
+    }
+    jaeger_mutex_unlock((jaeger_mutex*) &ctx->mutex);
+
+    opentracing_propagation_error_code error_code = writer->set(
+        writer, JAEGERTRACINGC_TRACEPARENT_HEADER, traceparent_buffer);
+    if (has_trace_state &&
+        error_code == opentracing_propagation_error_code_success) {
+        error_code = writer->set(
+            writer, JAEGERTRACINGC_TRACESTATE_HEADER, trace_state_buffer);
+    }
+    return error_code;
+}
+
+static inline opentracing_propagation_error_code
+inject_b3_headers(opentracing_text_map_writer* writer,
+                  const jaeger_span_context* ctx)
+{
+    char trace_id_buffer[JAEGERTRACINGC_TRACE_ID_MAX_STR_LEN + 1];
+    char span_id_buffer[JAEGERTRACINGC_UINT64_MAX_STR_LEN + 1];
+    int trace_id_len = 0;
+    jaeger_mutex_lock((jaeger_mutex*) &ctx->mutex);
+    if (ctx->trace_id.high != 0) {
+        encode_hex_uint64(trace_id_buffer, ctx->trace_id.high);
+        trace_id_len += JAEGERTRACINGC_UINT64_MAX_STR_LEN;
+    }
+    encode_hex_uint64(&trace_id_buffer[trace_id_len], ctx->trace_id.low);
+    trace_id_len += JAEGERTRACINGC_UINT64_MAX_STR_LEN;
+    encode_hex_uint64(span_id_buffer, ctx->span_id);
+    const uint8_t flags = ctx->flags;
+    jaeger_mutex_unlock((jaeger_mutex*) &ctx->mutex);
+    trace_id_buffer[trace_id_len] = '\0';
+    span_id_buffer[JAEGERTRACINGC_UINT64_MAX_STR_LEN] = '\0';
+
+    opentracing_propagation_error_code error_code = writer->set(
+        writer, JAEGERTRACINGC_B3_TRACE_ID_HEADER, trace_id_buffer);
+    if (error_code == opentracing_propagation_error_code_success) {
+        error_code = writer->set(
+            writer, JAEGERTRACINGC_B3_SPAN_ID_HEADER, span_id_buffer);
+    }
+    if (error_code != opentracing_propagation_error_code_success) {
+        return error_code;
+    }
+    /* Debug implies sampled, so X-B3-Sampled is left out for debug spans. */
+    if ((flags & (uint8_t) jaeger_sampling_flag_debug) != 0) {
+        return writer->set(writer, JAEGERTRACINGC_B3_FLAGS_HEADER, "1");
+    }
+    return writer->set(
+        writer,
+        JAEGERTRACINGC_B3_SAMPLED_HEADER,
+        (flags & (uint8_t) jaeger_sampling_flag_sampled) != 0 ? "1" : "0");
+}
+
 static inline opentracing_propagation_error_code inject_text_map_helper(
     opentracing_text_map_writer* writer,
     const jaeger_span_context* ctx,
@@ -381,53 +875,90 @@ static inline opentracing_propagation_error_code inject_text_map_helper(
     assert(writer != NULL);
     assert(ctx != NULL);
     assert(config != NULL);
-    char trace_context_buffer[JAEGERTRACINGC_SPAN_CONTEXT_MAX_STR_LEN + 1];
-    const int trace_context_len = jaeger_span_context_format(
-        ctx, trace_context_buffer, sizeof(trace_context_buffer));
-    assert(trace_context_len <= JAEGERTRACINGC_SPAN_CONTEXT_MAX_STR_LEN);
-    (void) trace_context_len;
+    const unsigned int formats = propagation_formats(config);
     opentracing_propagation_error_code error_code =
-        writer->set(writer, config->trace_context_header, trace_context_buffer);
-    /* Loop will not execute if error_code is not
+        opentracing_propagation_error_code_success;
+    if ((formats & (unsigned int) jaeger_propagation_format_jaeger) != 0) {
+        char trace_context_buffer[JAEGERTRACINGC_SPAN_CONTEXT_MAX_STR_LEN + 1];
+        const int trace_context_len = jaeger_span_context_format(
+            ctx, trace_context_buffer, sizeof(trace_context_buffer));
+        assert(trace_context_len <= JAEGERTRACINGC_SPAN_CONTEXT_MAX_STR_LEN);
+        (void) trace_context_len;
+        error_code = writer->set(
+            writer, config->trace_context_header, trace_context_buffer);
+    }
+    if ((formats & (unsigned int) jaeger_propagation_format_w3c) != 0 &&
+        error_code == opentracing_propagation_error_code_success) {
+        error_code = inject_w3c_headers(writer, ctx);
+    }
+    if ((formats & (unsigned int) jaeger_propagation_format_b3) != 0 &&
+        error_code == opentracing_propagation_error_code_success) {
+        error_code = inject_b3_headers(writer, ctx);
+    }
+    if ((formats & (unsigned int) jaeger_propagation_format_b3_single) != 0 &&
+        error_code == opentracing_propagation_error_code_success) {
+        char b3_buffer[JAEGERTRACINGC_B3_MAX_STR_LEN + 1];
+        jaeger_span_context_format_b3(ctx, b3_buffer, sizeof(b3_buffer));
+        error_code = writer->set(writer, JAEGERTRACINGC_B3_HEADER, b3_buffer);
+    }
+
+    /* Header names are built in key_scratch, which holds the prefix for the
+     * whole call, so each baggage item only costs a copy of its key. Keys and
+     * encoded values too large for the scratch buffers fall back to the heap.
+     */
+    char key_scratch[SCRATCH_BUFFER_SIZE];
+    char value_scratch[SCRATCH_BUFFER_SIZE];
+    const char* prefix = config->trace_baggage_header_prefix;
+    const size_t prefix_len = strlen(prefix);
+    if (prefix_len < SCRATCH_BUFFER_SIZE) {
+        memcpy(key_scratch, prefix, prefix_len);
+    }
+    /* The maximum a string can grow through encoding occurs if every
+     * character is encoded. In that case the output is three times as
+     * large as the input. For example, "xyz" becomes "%78%79%80".
+     */
+    const int max_encode_factor = 3;
+    /* Loops will not execute if error_code is not
      * opentracing_propagation_error_code_success. */
     for (size_t i = 0; i < ((size_t) 1 << ctx->baggage.order) &&
                        error_code == opentracing_propagation_error_code_success;
          i++) {
         for (const jaeger_list_node* node = ctx->baggage.buckets[i].head;
-             node != NULL;
+             node != NULL &&
+             error_code == opentracing_propagation_error_code_success;
              node = node->next) {
             const jaeger_key_value* kv =
                 &((const jaeger_key_value_node*) node)->data;
-            const int prefix_len = strlen(config->trace_baggage_header_prefix);
-            const int key_len = strlen(kv->key);
+            const size_t key_len = strlen(kv->key);
             char* value_buffer = NULL;
-            char* key_buffer = jaeger_malloc(prefix_len + key_len + 1);
+            char* key_buffer =
+                scratch_buffer_alloc(key_scratch, prefix_len + key_len);
             if (key_buffer == NULL) {
                 error_code = opentracing_propagation_error_code_unknown;
                 goto cleanup;
             }
-            strncpy(
-                key_buffer, config->trace_baggage_header_prefix, prefix_len);
-            strncpy(&key_buffer[prefix_len], kv->key, key_len + 1);
-            assert(key_buffer[prefix_len + key_len] == '\0');
-            /* The maximum a string can grow through encoding occurs if every
-             * character is encoded. In that case the output is three times as
-             * large as the input. For example, "xyz" becomes "%78%79%80".
-             */
-            const int max_encode_factor = 3;
-            value_buffer =
-                jaeger_malloc(strlen(kv->value) * max_encode_factor + 1);
-            if (value_buffer == NULL) {
-                error_code = opentracing_propagation_error_code_unknown;
-                goto cleanup;
+            if (key_buffer != key_scratch) {
+                memcpy(key_buffer, prefix, prefix_len);
+            }
+            memcpy(&key_buffer[prefix_len], kv->key, key_len + 1);
+
+            const char* value = kv->value;
+            if (encode_value != NULL) {
+                value_buffer = scratch_buffer_alloc(
+                    value_scratch, strlen(kv->value) * max_encode_factor);
+                if (value_buffer == NULL) {
+                    error_code = opentracing_propagation_error_code_unknown;
+                    goto cleanup;
+                }
+                encode_value(value_buffer, kv->value);
+                value = value_buffer;
             }
-            encode_value(value_buffer, kv->value);
 
-            error_code = writer->set(writer, key_buffer, value_buffer);
+            error_code = writer->set(writer, key_buffer, value);
 
         cleanup:
-            jaeger_free(key_buffer);
-            jaeger_free(value_buffer);
+            scratch_buffer_free(key_scratch, key_buffer);
+            scratch_buffer_free(value_scratch, value_buffer);
         }
     }
     return error_code;
@@ -438,7 +969,7 @@ jaeger_inject_into_text_map(opentracing_text_map_writer* writer,
                             const jaeger_span_context* ctx,
                             const jaeger_headers_config* config)
 {
-    return inject_text_map_helper(writer, ctx, config, &copy_str);
+    return inject_text_map_helper(writer, ctx, config, NULL);
 }
 
 opentracing_propagation_error_code
@@ -450,39 +981,43 @@ jaeger_inject_into_http_headers(opentracing_http_headers_writer* writer,
         (opentracing_text_map_writer*) writer, ctx, config, &encode_uri_value);
 }
 
-opentracing_propagation_error_code
-jaeger_inject_into_binary(int (*callback)(void*, const char*, size_t),
-                          void* arg,
-                          const jaeger_span_context* ctx)
+/* Caller must hold ctx->mutex, so baggage cannot change between sizing and
+ * writing. */
+static inline size_t binary_size(const jaeger_span_context* ctx)
 {
-    assert(callback != NULL);
-    assert(ctx != NULL);
-
-#define WRITE_BINARY(x, bits)                                                  \
-    do {                                                                       \
-                                                                               \
-        const uint##bits##_t value =                                           \
-            HOST_TO_BIG_ENDIAN_##bits((x)); /* NOLINT(hicpp-signed-bitwise) */ \
-        char value_buffer[sizeof(value)];                                      \
-        memcpy(value_buffer, &value, sizeof(value));                           \
-        if (callback(arg, value_buffer, sizeof(value_buffer)) !=               \
-            (int) sizeof(value_buffer)) {                                      \
-            return opentracing_propagation_error_code_unknown;                 \
-        }                                                                      \
-    } while (0)
-
-    WRITE_BINARY(ctx->trace_id.high, 64);
-    WRITE_BINARY(ctx->trace_id.low, 64);
-    WRITE_BINARY(ctx->span_id, 64);
-
-    char buffer[1];
-    buffer[0] = (char) ctx->flags;
-    if (callback(arg, buffer, sizeof(buffer)) != (int) sizeof(buffer)) {
-        return opentracing_propagation_error_code_unknown;
+    size_t size = BINARY_HEADER_SIZE;
+    for (size_t i = 0, len = (1u << ctx->baggage.order); i < len; i++) {
+        for (const jaeger_list_node* node = ctx->baggage.buckets[i].head;
+             node != NULL;
+             node = node->next) {
+            const jaeger_key_value* kv =
+                &((const jaeger_key_value_node*) node)->data;
+            size += BINARY_LEN_SIZE * 2 + strlen(kv->key) + strlen(kv->value);
+        }
     }
+    return size;
+}
 
-    const uint32_t num_baggage_items = ctx->baggage.size;
-    WRITE_BINARY(num_baggage_items, 32);
+size_t jaeger_binary_size(const jaeger_span_context* ctx)
+{
+    assert(ctx != NULL);
+    jaeger_mutex_lock((jaeger_mutex*) &ctx->mutex);
+    const size_t size = binary_size(ctx);
+    jaeger_mutex_unlock((jaeger_mutex*) &ctx->mutex);
+    return size;
+}
+
+/* Serializes ctx into buffer, which must hold binary_size(ctx) bytes. Caller
+ * must hold ctx->mutex. */
+static inline void write_binary(char* buffer, const jaeger_span_context* ctx)
+{
+    write_uint64(buffer, ctx->trace_id.high);
+    write_uint64(&buffer[sizeof(uint64_t)], ctx->trace_id.low);
+    write_uint64(&buffer[sizeof(uint64_t) * 2], ctx->span_id);
+    buffer[sizeof(uint64_t) * 3] = (char) ctx->flags;
+    write_uint32(&buffer[sizeof(uint64_t) * 3 + sizeof(uint8_t)],
+                 (uint32_t) ctx->baggage.size);
+    char* pos = &buffer[BINARY_HEADER_SIZE];
     uint32_t size = 0;
     for (size_t i = 0, len = (1u << ctx->baggage.order); i < len; i++) {
         for (const jaeger_list_node* node = ctx->baggage.buckets[i].head;
@@ -492,22 +1027,60 @@ jaeger_inject_into_binary(int (*callback)(void*, const char*, size_t),
             const jaeger_key_value* kv =
                 &((const jaeger_key_value_node*) node)->data;
             const uint32_t key_len = strlen(kv->key);
-            WRITE_BINARY(key_len, 32);
-            if (callback(arg, kv->key, key_len) != (int) key_len) {
-                return opentracing_propagation_error_code_unknown;
-            }
+            write_uint32(pos, key_len);
+            memcpy(&pos[BINARY_LEN_SIZE], kv->key, key_len);
+            pos += BINARY_LEN_SIZE + key_len;
             const uint32_t value_len = strlen(kv->value);
-            WRITE_BINARY(value_len, 32);
-            if (callback(arg, kv->value, value_len) != (int) value_len) {
-                return opentracing_propagation_error_code_unknown;
-            }
+            write_uint32(pos, value_len);
+            memcpy(&pos[BINARY_LEN_SIZE], kv->value, value_len);
+            pos += BINARY_LEN_SIZE + value_len;
         }
     }
     assert(ctx->baggage.size == size);
+    (void) size;
+}
 
-    return opentracing_propagation_error_code_success;
+size_t jaeger_inject_into_binary_buffer(char* buffer,
+                                        size_t buffer_len,
+                                        const jaeger_span_context* ctx)
+{
+    assert(buffer != NULL || buffer_len == 0);
+    assert(ctx != NULL);
+    jaeger_mutex_lock((jaeger_mutex*) &ctx->mutex);
+    const size_t size = binary_size(ctx);
+    if (size <= buffer_len) {
+        write_binary(buffer, ctx);
+    }
+    jaeger_mutex_unlock((jaeger_mutex*) &ctx->mutex);
+    return size;
+}
+
+opentracing_propagation_error_code
+jaeger_inject_into_binary(int (*callback)(void*, const char*, size_t),
+                          void* arg,
+                          const jaeger_span_context* ctx)
+{
+    assert(callback != NULL);
+    assert(ctx != NULL);
 
-#undef WRITE_BINARY
+    /* Serialize everything up front so the callback runs once. Contexts
+     * with little baggage fit on the stack. */
+    char scratch[SCRATCH_BUFFER_SIZE];
+    jaeger_mutex_lock((jaeger_mutex*) &ctx->mutex);
+    const size_t size = binary_size(ctx);
+    char* buffer = size <= sizeof(scratch) ? scratch : jaeger_malloc(size);
+    if (buffer == NULL) {
+        jaeger_mutex_unlock((jaeger_mutex*) &ctx->mutex);
+        return opentracing_propagation_error_code_unknown;
+    }
+    write_binary(buffer, ctx);
+    jaeger_mutex_unlock((jaeger_mutex*) &ctx->mutex);
+    const bool success = callback(arg, buffer, size) == (int) size;
+    if (buffer != scratch) {
+        jaeger_free(buffer);
+    }
+    return success ? opentracing_propagation_error_code_success
+                   : opentracing_propagation_error_code_unknown;
 }
 
 opentracing_propagation_error_code
@@ -28,6 +28,7 @@
 extern "C" {
 #endif /* __cplusplus */
 
+struct jaeger_header_table;
 struct jaeger_headers_config;
 struct jaeger_metrics;
 struct jaeger_span_context;
@@ -39,18 +40,51 @@ jaeger_extract_from_text_map(opentracing_text_map_reader* reader,
                              struct jaeger_metrics* metrics,
                              const struct jaeger_headers_config* config);
 
+/* Same as jaeger_extract_from_text_map, but with a header table built ahead
+ * of time instead of one built from the config on every call. */
+opentracing_propagation_error_code
+jaeger_extract_from_text_map_table(opentracing_text_map_reader* reader,
+                                   struct jaeger_span_context** ctx,
+                                   struct jaeger_metrics* metrics,
+                                   const struct jaeger_header_table* headers);
+
 opentracing_propagation_error_code
 jaeger_extract_from_http_headers(opentracing_http_headers_reader* reader,
                                  struct jaeger_span_context** ctx,
                                  struct jaeger_metrics* metrics,
                                  const struct jaeger_headers_config* config);
 
+/* Same as jaeger_extract_from_http_headers, but with a header table built
+ * ahead of time instead of one built from the config on every call. */
+opentracing_propagation_error_code
+jaeger_extract_from_http_headers_table(
+    opentracing_http_headers_reader* reader,
+    struct jaeger_span_context** ctx,
+    struct jaeger_metrics* metrics,
+    const struct jaeger_header_table* headers);
+
 opentracing_propagation_error_code
 jaeger_extract_from_binary(int (*callback)(void*, char*, size_t),
                            void* arg,
                            struct jaeger_span_context** ctx,
                            struct jaeger_metrics* metrics);
 
+/**
+ * Extract a span context from a buffer holding exactly one context in the
+ * format written by jaeger_inject_into_binary(). Parses in place, without
+ * the per-field reads of jaeger_extract_from_binary().
+ * @param data The serialized span context.
+ * @param len The length of data.
+ * @param ctx Set to the extracted span context on success, NULL otherwise.
+ * @param metrics Metrics to count decoding errors. May be NULL.
+ * @return Error code.
+ */
+opentracing_propagation_error_code
+jaeger_extract_from_binary_buffer(const char* data,
+                                  size_t len,
+                                  struct jaeger_span_context** ctx,
+                                  struct jaeger_metrics* metrics);
+
 opentracing_propagation_error_code
 jaeger_extract_from_custom(opentracing_custom_carrier_reader* reader,
                            struct jaeger_tracer* tracer,
@@ -72,6 +106,27 @@ jaeger_inject_into_binary(int (*callback)(void*, const char*, size_t),
                           void* arg,
                           const struct jaeger_span_context* ctx);
 
+/**
+ * Compute the number of bytes needed to serialize a span context in binary.
+ * @param ctx The span context.
+ * @return The serialized size.
+ */
+size_t jaeger_binary_size(const struct jaeger_span_context* ctx);
+
+/**
+ * Serialize a span context into a caller-provided buffer. Writes nothing if
+ * buffer is too small. The context stays locked between sizing and writing,
+ * so baggage set concurrently cannot overrun the buffer.
+ * @param buffer The output buffer.
+ * @param buffer_len The length of buffer.
+ * @param ctx The span context.
+ * @return The number of bytes needed, as returned by jaeger_binary_size().
+ *         The context was written if this is at most buffer_len.
+ */
+size_t jaeger_inject_into_binary_buffer(char* buffer,
+                                        size_t buffer_len,
+                                        const struct jaeger_span_context* ctx);
+
 opentracing_propagation_error_code
 jaeger_inject_into_custom(opentracing_custom_carrier_writer* writer,
                           struct jaeger_tracer* tracer,
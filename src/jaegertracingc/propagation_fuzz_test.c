@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jaegertracingc/propagation.h"
+#include "jaegertracingc/span.h"
+
+typedef struct byte_stream {
+    const char* data;
+    size_t len;
+    size_t pos;
+} byte_stream;
+
+static int byte_stream_read(void* arg, char* buffer, size_t len)
+{
+    byte_stream* stream = (byte_stream*) arg;
+    len = JAEGERTRACINGC_MIN(len, stream->len - stream->pos);
+    memcpy(buffer, &stream->data[stream->pos], len);
+    stream->pos += len;
+    return len;
+}
+
+static void destroy_span_context(jaeger_span_context* ctx)
+{
+    if (ctx != NULL) {
+        jaeger_span_context_destroy((jaeger_destructible*) ctx);
+        jaeger_free(ctx);
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    /* The stream and buffer parsers must agree whenever the stream parser
+     * consumes the entire input. */
+    jaeger_span_context* ctx = NULL;
+    const opentracing_propagation_error_code error_code =
+        jaeger_extract_from_binary_buffer(
+            (const char*) data, size, &ctx, NULL);
+    byte_stream stream = {.data = (const char*) data, .len = size, .pos = 0};
+    jaeger_span_context* stream_ctx = NULL;
+    const opentracing_propagation_error_code stream_error_code =
+        jaeger_extract_from_binary(
+            &byte_stream_read, &stream, &stream_ctx, NULL);
+    if (stream.pos == size &&
+        (error_code == opentracing_propagation_error_code_success) !=
+            (stream_error_code == opentracing_propagation_error_code_success)) {
+        abort();
+    }
+    destroy_span_context(stream_ctx);
+    if (error_code != opentracing_propagation_error_code_success) {
+        return 0;
+    }
+
+    /* Anything accepted must survive an inject/extract round trip. */
+    const size_t len = jaeger_binary_size(ctx);
+    char* buffer = jaeger_malloc(len);
+    if (buffer == NULL ||
+        jaeger_inject_into_binary_buffer(buffer, len, ctx) != len) {
+        abort();
+    }
+    jaeger_span_context* decoded_ctx = NULL;
+    if (jaeger_extract_from_binary_buffer(buffer, len, &decoded_ctx, NULL) !=
+            opentracing_propagation_error_code_success ||
+        decoded_ctx->trace_id.high != ctx->trace_id.high ||
+        decoded_ctx->trace_id.low != ctx->trace_id.low ||
+        decoded_ctx->span_id != ctx->span_id ||
+        decoded_ctx->flags != ctx->flags ||
+        decoded_ctx->baggage.size != ctx->baggage.size) {
+        abort();
+    }
+    jaeger_free(buffer);
+    destroy_span_context(decoded_ctx);
+    destroy_span_context(ctx);
+    return 0;
+}
@@ -19,6 +19,7 @@
 #include "unity.h"
 
 #include "jaegertracingc/hashtable.h"
+#include "jaegertracingc/header_table.h"
 #include "jaegertracingc/metrics.h"
 #include "jaegertracingc/options.h"
 #include "jaegertracingc/span.h"
@@ -118,6 +119,182 @@ static inline void test_encode_uri_value()
     }
 }
 
+/* Previous byte-at-a-time implementations, which the table-driven codecs
+ * must match exactly. */
+static inline void reference_decode_uri_value(char* restrict dst,
+                                              const char* restrict src)
+{
+    enum state { default_state, percent_state, first_hex_state };
+
+    enum state state = default_state;
+    const int src_len = strlen(src);
+    int dst_len = 0;
+    int first_nibble = 0;
+    int second_nibble = 0;
+
+#define APPEND_CHAR(x)                      \
+    do {                                    \
+        assert(dst_len + 1 <= src_len + 1); \
+        dst[dst_len] = (x);                 \
+        dst_len++;                          \
+    } while (0)
+
+    for (int i = 0; i < src_len; i++) {
+        char ch = src[i];
+        switch (state) {
+        case default_state:
+            if (ch == '%') {
+                state = percent_state;
+            }
+            else {
+                APPEND_CHAR(ch);
+            }
+            break;
+        case percent_state:
+            first_nibble = decode_hex(ch);
+            if (first_nibble == -1) {
+                APPEND_CHAR('%');
+                APPEND_CHAR(ch);
+                state = default_state;
+            }
+            else {
+                state = first_hex_state;
+            }
+            break;
+        default:
+            assert(state == first_hex_state);
+            second_nibble = decode_hex(ch);
+            if (second_nibble == -1) {
+                APPEND_CHAR('%');
+                APPEND_CHAR(encode_hex(first_nibble));
+                APPEND_CHAR(ch);
+            }
+            else {
+                APPEND_CHAR((char) (((((uint8_t) first_nibble) & 0xfu) << 4u) |
+                                    (((uint8_t) second_nibble) & 0xfu)));
+            }
+            state = default_state;
+            break;
+        }
+    }
+    switch (state) {
+    case percent_state:
+        APPEND_CHAR('%');
+        break;
+    case first_hex_state:
+        APPEND_CHAR('%');
+        APPEND_CHAR(encode_hex(first_nibble));
+        break;
+    default:
+        break;
+    }
+    APPEND_CHAR('\0');
+
+#undef APPEND_CHAR
+}
+
+static inline void reference_encode_uri_value(char* restrict dst,
+                                              const char* restrict src)
+{
+    int pos = 0;
+    for (int i = 0; i < (int) strlen(src); i++) {
+        const char ch = src[i];
+        if (isalnum((unsigned char) ch)) {
+            dst[pos++] = ch;
+        }
+        else {
+            switch (ch) {
+            case ';':
+            case '/':
+            case '?':
+            case ':':
+            case '@':
+            case '&':
+            case '=':
+            case '+':
+            case '$':
+            case ',':
+            case '-':
+            case '_':
+            case '.':
+            case '!':
+            case '~':
+            case '*':
+            case '\'':
+            case '(':
+            case ')':
+                dst[pos++] = ch;
+                break;
+            default: {
+                dst[pos++] = '%';
+                const uint8_t first_nibble = (((uint32_t) ch) >> 4u) & 0x0fu;
+                const uint8_t second_nibble = ((uint8_t) ch) & 0x0fu;
+                dst[pos++] = encode_hex(first_nibble);
+                dst[pos++] = encode_hex(second_nibble);
+            } break;
+            }
+        }
+    }
+    dst[pos] = '\0';
+}
+
+static inline void check_uri_codec(const char* str)
+{
+    const int len = strlen(str);
+    char expected[len * 3 + 1];
+    char actual[len * 3 + 1];
+    char decoded[len * 3 + 1];
+
+    reference_decode_uri_value(expected, str);
+    decode_uri_value(actual, str);
+    TEST_ASSERT_EQUAL_STRING(expected, actual);
+
+    reference_encode_uri_value(expected, str);
+    encode_uri_value(actual, str);
+    TEST_ASSERT_EQUAL_STRING(expected, actual);
+    decode_uri_value(decoded, actual);
+    TEST_ASSERT_EQUAL_STRING(str, decoded);
+}
+
+static inline void test_uri_codec_matches_reference()
+{
+    /* Every string of up to three characters drawn from an alphabet that
+     * covers each branch of the decoder. */
+    const char alphabet[] = "%0aAfFgz ~;#\x7f\x80\xc3\xff";
+    const int alphabet_len = sizeof(alphabet) - 1;
+    for (int a = -1; a < alphabet_len; a++) {
+        for (int b = -1; b < alphabet_len; b++) {
+            for (int c = 0; c < alphabet_len; c++) {
+                char str[4] = {0};
+                int len = 0;
+                if (a >= 0) {
+                    str[len++] = alphabet[a];
+                }
+                if (b >= 0) {
+                    str[len++] = alphabet[b];
+                }
+                str[len] = alphabet[c];
+                check_uri_codec(str);
+            }
+        }
+    }
+    check_uri_codec("");
+
+    /* Longer random strings, biased towards escape sequences. */
+    for (int i = 0; i < 1000; i++) {
+        char str[128];
+        const int len = rand() % (int) sizeof(str);
+        for (int j = 0; j < len; j++) {
+            const int choice = rand() % 4;
+            str[j] = choice == 0 ? '%'
+                                 : choice == 1 ? encode_hex(rand() % 16)
+                                               : (char) (1 + rand() % 255);
+        }
+        str[len] = '\0';
+        check_uri_codec(str);
+    }
+}
+
 static inline void test_to_lowercase()
 {
     const char* uppercase[] = {"HELLO", "WORLD", "test"};
@@ -249,6 +426,8 @@ static inline void test_text_map()
         .key_values = &key_values};
     jaeger_span_context* ctx;
     jaeger_headers_config headers = JAEGERTRACINGC_HEADERS_CONFIG_INIT;
+    jaeger_header_table table;
+    jaeger_header_table_init(&table, &headers);
     TEST_ASSERT_EQUAL(
         opentracing_propagation_error_code_success,
         jaeger_extract_from_text_map(
@@ -288,10 +467,8 @@ static inline void test_text_map()
     jaeger_span_context* ctx_copy;
     TEST_ASSERT_EQUAL(
         opentracing_propagation_error_code_success,
-        jaeger_extract_from_text_map((opentracing_text_map_reader*) &reader,
-                                     &ctx_copy,
-                                     &metrics,
-                                     &config));
+        jaeger_extract_from_text_map_table(
+            (opentracing_text_map_reader*) &reader, &ctx_copy, &metrics, &table));
     TEST_ASSERT_EQUAL(ctx->trace_id.high, ctx_copy->trace_id.high);
     TEST_ASSERT_EQUAL(ctx->trace_id.low, ctx_copy->trace_id.low);
     TEST_ASSERT_EQUAL(ctx->span_id, ctx_copy->span_id);
@@ -328,12 +505,14 @@ static inline void test_http_headers()
         .key_values = &key_values};
     jaeger_span_context* ctx = NULL;
     jaeger_headers_config headers = JAEGERTRACINGC_HEADERS_CONFIG_INIT;
+    jaeger_header_table table;
+    jaeger_header_table_init(&table, &headers);
     TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
-                      jaeger_extract_from_http_headers(
+                      jaeger_extract_from_http_headers_table(
                           (opentracing_http_headers_reader*) &reader,
                           &ctx,
                           &metrics,
-                          &headers));
+                          &table));
     TEST_ASSERT_NOT_NULL(ctx);
     TEST_ASSERT_EQUAL(0xab, ctx->trace_id.low);
     TEST_ASSERT_EQUAL(0xcd, ctx->span_id);
@@ -353,11 +532,11 @@ static inline void test_http_headers()
     /* Test alternative baggage format. */
     set_up_alternative_baggage_format(&key_values);
     TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
-                      jaeger_extract_from_http_headers(
+                      jaeger_extract_from_http_headers_table(
                           (opentracing_http_headers_reader*) &reader,
                           &ctx,
                           &metrics,
-                          &headers));
+                          &table));
     TEST_ASSERT_NOT_NULL(ctx);
     TEST_ASSERT_EQUAL(0xab, ctx->trace_id.low);
     TEST_ASSERT_EQUAL(0xcd, ctx->span_id);
@@ -377,11 +556,11 @@ static inline void test_http_headers()
     /* Test debug header. */
     set_up_debug_header(&key_values);
     TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
-                      jaeger_extract_from_http_headers(
+                      jaeger_extract_from_http_headers_table(
                           (opentracing_http_headers_reader*) &reader,
                           &ctx,
                           &metrics,
-                          &headers));
+                          &table));
     TEST_ASSERT_NOT_NULL(ctx);
     TEST_ASSERT_EQUAL(0xab, ctx->trace_id.low);
     TEST_ASSERT_EQUAL(0xcd, ctx->span_id);
@@ -394,31 +573,31 @@ static inline void test_http_headers()
     /* Test corrupt baggage. */
     set_up_corrupt_baggage(&key_values);
     TEST_ASSERT_EQUAL(opentracing_propagation_error_code_span_context_corrupted,
-                      jaeger_extract_from_http_headers(
+                      jaeger_extract_from_http_headers_table(
                           (opentracing_http_headers_reader*) &reader,
                           &ctx,
                           &metrics,
-                          &headers));
+                          &table));
     TEST_ASSERT_NULL(ctx);
 
     /* Test empty headers. */
     set_up_empty_headers(&key_values);
     TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
-                      jaeger_extract_from_http_headers(
+                      jaeger_extract_from_http_headers_table(
                           (opentracing_http_headers_reader*) &reader,
                           &ctx,
                           &metrics,
-                          &headers));
+                          &table));
     TEST_ASSERT_NULL(ctx);
 
     /* Test decode failure. */
     set_up_decode_failure(&key_values);
     TEST_ASSERT_EQUAL(opentracing_propagation_error_code_span_context_corrupted,
-                      jaeger_extract_from_http_headers(
+                      jaeger_extract_from_http_headers_table(
                           (opentracing_http_headers_reader*) &reader,
                           &ctx,
                           &metrics,
-                          &headers));
+                          &table));
     TEST_ASSERT_NULL(ctx);
 
     JAEGERTRACINGC_VECTOR_FOR_EACH(
@@ -427,9 +606,651 @@ static inline void test_http_headers()
     jaeger_metrics_destroy(&metrics);
 }
 
+typedef struct counting_allocator {
+    jaeger_allocator base;
+    jaeger_allocator* delegate;
+    int num_allocations;
+} counting_allocator;
+
+static void* counting_allocator_malloc(jaeger_allocator* alloc, size_t sz)
+{
+    counting_allocator* a = (counting_allocator*) alloc;
+    a->num_allocations++;
+    return a->delegate->malloc(a->delegate, sz);
+}
+
+static void*
+counting_allocator_realloc(jaeger_allocator* alloc, void* ptr, size_t sz)
+{
+    counting_allocator* a = (counting_allocator*) alloc;
+    a->num_allocations++;
+    return a->delegate->realloc(a->delegate, ptr, sz);
+}
+
+static void counting_allocator_free(jaeger_allocator* alloc, void* ptr)
+{
+    counting_allocator* a = (counting_allocator*) alloc;
+    a->delegate->free(a->delegate, ptr);
+}
+
+static inline void append_key_value(jaeger_vector* key_values,
+                                    const char* key,
+                                    const char* value)
+{
+    jaeger_key_value* kv = jaeger_vector_append(key_values);
+    TEST_ASSERT_NOT_NULL(kv);
+    TEST_ASSERT_TRUE(jaeger_key_value_init(kv, key, value));
+}
+
+static inline int count_extract_allocations(jaeger_vector* key_values)
+{
+    mock_http_headers_reader reader = {
+        .base = {.base = {.foreach_key = &mock_reader_foreach_key}},
+        .key_values = key_values};
+    const jaeger_headers_config headers = JAEGERTRACINGC_HEADERS_CONFIG_INIT;
+    jaeger_header_table table;
+    jaeger_header_table_init(&table, &headers);
+    counting_allocator alloc = {.base = {.malloc = &counting_allocator_malloc,
+                                         .realloc = &counting_allocator_realloc,
+                                         .free = &counting_allocator_free},
+                                .delegate = jaeger_get_allocator(),
+                                .num_allocations = 0};
+    jaeger_span_context* ctx = NULL;
+    jaeger_set_allocator((jaeger_allocator*) &alloc);
+    const opentracing_propagation_error_code error_code =
+        jaeger_extract_from_http_headers_table(
+            (opentracing_http_headers_reader*) &reader, &ctx, NULL, &table);
+    jaeger_set_allocator(alloc.delegate);
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success, error_code);
+    TEST_ASSERT_NOT_NULL(ctx);
+    TEST_ASSERT_EQUAL(0xab, ctx->trace_id.low);
+    jaeger_span_context_destroy((jaeger_destructible*) ctx);
+    jaeger_free(ctx);
+    return alloc.num_allocations;
+}
+
+static inline void test_extract_allocations()
+{
+    jaeger_vector key_values;
+    TEST_ASSERT_TRUE(jaeger_vector_init(&key_values, sizeof(jaeger_key_value)));
+    append_key_value(
+        &key_values, JAEGERTRACINGC_TRACE_CONTEXT_HEADER_NAME, "ab:cd:0:1");
+    const int num_allocations = count_extract_allocations(&key_values);
+
+    /* Unrelated headers should not cost any allocations. */
+    enum { num_unrelated_headers = 30 };
+    for (int i = 0; i < num_unrelated_headers; i++) {
+        char key[i + 2];
+        random_string(key, sizeof(key));
+        char value[sizeof(key) * 2];
+        random_string(value, sizeof(value));
+        append_key_value(&key_values, key, value);
+    }
+    append_key_value(&key_values, "Uber-Trace-Idx", "x");
+    append_key_value(&key_values, "Uberctx", "x");
+    TEST_ASSERT_EQUAL(num_allocations, count_extract_allocations(&key_values));
+
+    /* Keys and values too long for the stack still decode correctly. */
+    enum { long_str_len = 1000 };
+    char long_key[sizeof(JAEGERTRACINGC_TRACE_BAGGAGE_HEADER_PREFIX) +
+                  long_str_len];
+    memcpy(long_key,
+           JAEGERTRACINGC_TRACE_BAGGAGE_HEADER_PREFIX,
+           sizeof(JAEGERTRACINGC_TRACE_BAGGAGE_HEADER_PREFIX) - 1);
+    memset(&long_key[sizeof(JAEGERTRACINGC_TRACE_BAGGAGE_HEADER_PREFIX) - 1],
+           'K',
+           long_str_len);
+    long_key[sizeof(long_key) - 1] = '\0';
+    char long_value[long_str_len * 3 + 1];
+    for (int i = 0; i < long_str_len; i++) {
+        memcpy(&long_value[i * 3], "%20", 3);
+    }
+    long_value[sizeof(long_value) - 1] = '\0';
+    append_key_value(&key_values, long_key, long_value);
+    mock_http_headers_reader reader = {
+        .base = {.base = {.foreach_key = &mock_reader_foreach_key}},
+        .key_values = &key_values};
+    const jaeger_headers_config headers = JAEGERTRACINGC_HEADERS_CONFIG_INIT;
+    jaeger_header_table table;
+    jaeger_header_table_init(&table, &headers);
+    jaeger_span_context* ctx = NULL;
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      jaeger_extract_from_http_headers_table(
+                          (opentracing_http_headers_reader*) &reader,
+                          &ctx,
+                          NULL,
+                          &table));
+    TEST_ASSERT_NOT_NULL(ctx);
+    TEST_ASSERT_EQUAL(1, ctx->baggage.size);
+    char expected_key[long_str_len + 1];
+    memset(expected_key, 'k', long_str_len);
+    expected_key[long_str_len] = '\0';
+    const jaeger_key_value* kv =
+        jaeger_hashtable_find(&ctx->baggage, expected_key);
+    TEST_ASSERT_NOT_NULL(kv);
+    TEST_ASSERT_EQUAL(long_str_len, strlen(kv->value));
+    TEST_ASSERT_EQUAL(long_str_len, strspn(kv->value, " "));
+    jaeger_span_context_destroy((jaeger_destructible*) ctx);
+    jaeger_free(ctx);
+
+    JAEGERTRACINGC_VECTOR_FOR_EACH(
+        &key_values, jaeger_key_value_destroy, jaeger_key_value);
+    jaeger_vector_destroy(&key_values);
+}
+
+typedef struct counting_text_map_writer {
+    opentracing_text_map_writer base;
+    int num_headers;
+} counting_text_map_writer;
+
+static inline opentracing_propagation_error_code counting_writer_set(
+    opentracing_text_map_writer* writer, const char* key, const char* value)
+{
+    TEST_ASSERT_NOT_NULL(key);
+    TEST_ASSERT_NOT_NULL(value);
+    ((counting_text_map_writer*) writer)->num_headers++;
+    return opentracing_propagation_error_code_success;
+}
+
+static inline void test_inject_allocations()
+{
+    jaeger_span_context ctx;
+    TEST_ASSERT_TRUE(jaeger_span_context_init(&ctx));
+    ctx.trace_id.low = 0xab;
+    ctx.span_id = 0xcd;
+    TEST_ASSERT_TRUE(jaeger_hashtable_put(&ctx.baggage, "k1", "v1"));
+    TEST_ASSERT_TRUE(jaeger_hashtable_put(&ctx.baggage, "k2", "hello world"));
+    const jaeger_headers_config config = JAEGERTRACINGC_HEADERS_CONFIG_INIT;
+
+    /* Injecting baggage that fits in the scratch buffers should not
+     * allocate. */
+    counting_text_map_writer counting_writer = {
+        .base = {.set = &counting_writer_set}, .num_headers = 0};
+    counting_allocator alloc = {.base = {.malloc = &counting_allocator_malloc,
+                                         .realloc = &counting_allocator_realloc,
+                                         .free = &counting_allocator_free},
+                                .delegate = jaeger_get_allocator(),
+                                .num_allocations = 0};
+    jaeger_set_allocator((jaeger_allocator*) &alloc);
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      jaeger_inject_into_http_headers(
+                          (opentracing_http_headers_writer*) &counting_writer,
+                          &ctx,
+                          &config));
+    TEST_ASSERT_EQUAL(
+        opentracing_propagation_error_code_success,
+        jaeger_inject_into_text_map(
+            (opentracing_text_map_writer*) &counting_writer, &ctx, &config));
+    jaeger_set_allocator(alloc.delegate);
+    TEST_ASSERT_EQUAL(0, alloc.num_allocations);
+    TEST_ASSERT_EQUAL(6, counting_writer.num_headers);
+
+    /* Keys and values too long for the scratch buffers still encode
+     * correctly. */
+    enum { long_str_len = 1000 };
+    char long_key[long_str_len + 1];
+    memset(long_key, 'k', long_str_len);
+    long_key[long_str_len] = '\0';
+    char long_value[long_str_len + 1];
+    memset(long_value, ' ', long_str_len);
+    long_value[long_str_len] = '\0';
+    jaeger_hashtable_clear(&ctx.baggage);
+    TEST_ASSERT_TRUE(jaeger_hashtable_put(&ctx.baggage, long_key, long_value));
+    jaeger_vector key_values;
+    TEST_ASSERT_TRUE(jaeger_vector_init(&key_values, sizeof(jaeger_key_value)));
+    mock_http_headers_writer writer = {
+        .base = {.base = {.set = &mock_writer_set}}, .key_values = &key_values};
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      jaeger_inject_into_http_headers(
+                          (opentracing_http_headers_writer*) &writer,
+                          &ctx,
+                          &config));
+    TEST_ASSERT_EQUAL(2, jaeger_vector_length(&key_values));
+    const jaeger_key_value* kv = jaeger_vector_get(&key_values, 1);
+    const size_t prefix_len =
+        sizeof(JAEGERTRACINGC_TRACE_BAGGAGE_HEADER_PREFIX) - 1;
+    TEST_ASSERT_EQUAL(prefix_len + long_str_len, strlen(kv->key));
+    TEST_ASSERT_EQUAL(0,
+                      strncmp(kv->key,
+                              JAEGERTRACINGC_TRACE_BAGGAGE_HEADER_PREFIX,
+                              prefix_len));
+    TEST_ASSERT_EQUAL(long_str_len, strspn(&kv->key[prefix_len], "k"));
+    TEST_ASSERT_EQUAL(long_str_len * 3, strlen(kv->value));
+    TEST_ASSERT_EQUAL(0, strncmp(kv->value, "%20%20", strlen("%20%20")));
+
+    JAEGERTRACINGC_VECTOR_FOR_EACH(
+        &key_values, jaeger_key_value_destroy, jaeger_key_value);
+    jaeger_vector_destroy(&key_values);
+    jaeger_span_context_destroy((jaeger_destructible*) &ctx);
+}
+
+static inline opentracing_propagation_error_code
+extract_http_headers(jaeger_vector* key_values,
+                     const jaeger_headers_config* config,
+                     jaeger_span_context** ctx)
+{
+    mock_http_headers_reader reader = {
+        .base = {.base = {.foreach_key = &mock_reader_foreach_key}},
+        .key_values = key_values};
+    return jaeger_extract_from_http_headers(
+        (opentracing_http_headers_reader*) &reader, ctx, NULL, config);
+}
+
+static inline void clear_key_values(jaeger_vector* key_values)
+{
+    JAEGERTRACINGC_VECTOR_FOR_EACH(
+        key_values, jaeger_key_value_destroy, jaeger_key_value);
+    jaeger_vector_clear(key_values);
+}
+
+static inline void test_w3c_headers()
+{
+    const char* traceparent =
+        "00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01";
+    jaeger_headers_config config = JAEGERTRACINGC_HEADERS_CONFIG_INIT;
+    config.propagation_formats = jaeger_propagation_format_w3c;
+    jaeger_vector key_values;
+    TEST_ASSERT_TRUE(jaeger_vector_init(&key_values, sizeof(jaeger_key_value)));
+
+    /* Tracestate headers are combined and normalized. The Jaeger header is
+     * ignored unless its format is enabled. */
+    append_key_value(&key_values, "Traceparent", traceparent);
+    append_key_value(&key_values, "TraceState", " rojo=00f067aa0ba902b7 ,");
+    append_key_value(&key_values, "tracestate", "congo=t61rcWkgMzE");
+    append_key_value(
+        &key_values, JAEGERTRACINGC_TRACE_CONTEXT_HEADER_NAME, "ab:cd:0:0");
+    append_key_value(&key_values, "uberctx-k1", "hello%20world");
+    jaeger_span_context* ctx = NULL;
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      extract_http_headers(&key_values, &config, &ctx));
+    TEST_ASSERT_NOT_NULL(ctx);
+    TEST_ASSERT_EQUAL_HEX64(0x0af7651916cd43dd, ctx->trace_id.high);
+    TEST_ASSERT_EQUAL_HEX64(0x8448eb211c80319c, ctx->trace_id.low);
+    TEST_ASSERT_EQUAL_HEX64(0xb7ad6b7169203331, ctx->span_id);
+    TEST_ASSERT_EQUAL(jaeger_sampling_flag_sampled, ctx->flags);
+    TEST_ASSERT_EQUAL_STRING("rojo=00f067aa0ba902b7,congo=t61rcWkgMzE",
+                             ctx->trace_state);
+    const jaeger_key_value* kv = jaeger_hashtable_find(&ctx->baggage, "k1");
+    TEST_ASSERT_NOT_NULL(kv);
+    TEST_ASSERT_EQUAL_STRING("hello world", kv->value);
+
+    /* Injection writes the same headers back without allocating. */
+    counting_text_map_writer counting_writer = {
+        .base = {.set = &counting_writer_set}, .num_headers = 0};
+    counting_allocator alloc = {.base = {.malloc = &counting_allocator_malloc,
+                                         .realloc = &counting_allocator_realloc,
+                                         .free = &counting_allocator_free},
+                                .delegate = jaeger_get_allocator(),
+                                .num_allocations = 0};
+    jaeger_set_allocator((jaeger_allocator*) &alloc);
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      jaeger_inject_into_http_headers(
+                          (opentracing_http_headers_writer*) &counting_writer,
+                          ctx,
+                          &config));
+    jaeger_set_allocator(alloc.delegate);
+    TEST_ASSERT_EQUAL(0, alloc.num_allocations);
+    TEST_ASSERT_EQUAL(3, counting_writer.num_headers);
+
+    clear_key_values(&key_values);
+    mock_http_headers_writer writer = {
+        .base = {.base = {.set = &mock_writer_set}}, .key_values = &key_values};
+    TEST_ASSERT_EQUAL(
+        opentracing_propagation_error_code_success,
+        jaeger_inject_into_http_headers(
+            (opentracing_http_headers_writer*) &writer, ctx, &config));
+    kv = jaeger_vector_get(&key_values, 0);
+    TEST_ASSERT_EQUAL_STRING(JAEGERTRACINGC_TRACEPARENT_HEADER, kv->key);
+    TEST_ASSERT_EQUAL_STRING(traceparent, kv->value);
+    kv = jaeger_vector_get(&key_values, 1);
+    TEST_ASSERT_EQUAL_STRING(JAEGERTRACINGC_TRACESTATE_HEADER, kv->key);
+    TEST_ASSERT_EQUAL_STRING(ctx->trace_state, kv->value);
+    jaeger_span_context* ctx_copy = NULL;
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      extract_http_headers(&key_values, &config, &ctx_copy));
+    TEST_ASSERT_EQUAL(ctx->trace_id.high, ctx_copy->trace_id.high);
+    TEST_ASSERT_EQUAL(ctx->trace_id.low, ctx_copy->trace_id.low);
+    TEST_ASSERT_EQUAL(ctx->span_id, ctx_copy->span_id);
+    TEST_ASSERT_EQUAL(ctx->flags, ctx_copy->flags);
+    TEST_ASSERT_EQUAL_STRING(ctx->trace_state, ctx_copy->trace_state);
+    jaeger_span_context_destroy((jaeger_destructible*) ctx_copy);
+    jaeger_free(ctx_copy);
+    jaeger_span_context_destroy((jaeger_destructible*) ctx);
+    jaeger_free(ctx);
+
+    /* Malformed trace state is dropped without failing extraction. */
+    clear_key_values(&key_values);
+    append_key_value(&key_values, "traceparent", traceparent);
+    append_key_value(&key_values, "tracestate", "rojo=1,Congo=2");
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      extract_http_headers(&key_values, &config, &ctx));
+    TEST_ASSERT_NOT_NULL(ctx);
+    TEST_ASSERT_NULL(ctx->trace_state);
+    jaeger_span_context_destroy((jaeger_destructible*) ctx);
+    jaeger_free(ctx);
+
+    /* A malformed traceparent is a corrupted span context, and so is one
+     * with uppercase hex digits. */
+    clear_key_values(&key_values);
+    append_key_value(&key_values,
+                     "traceparent",
+                     "00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-0");
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_span_context_corrupted,
+                      extract_http_headers(&key_values, &config, &ctx));
+    TEST_ASSERT_NULL(ctx);
+    clear_key_values(&key_values);
+    append_key_value(&key_values,
+                     "traceparent",
+                     "00-0AF7651916CD43DD8448EB211C80319C-b7ad6b7169203331-01");
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_span_context_corrupted,
+                      extract_http_headers(&key_values, &config, &ctx));
+    TEST_ASSERT_NULL(ctx);
+
+    /* The debug flag of a debug header survives the traceparent. */
+    clear_key_values(&key_values);
+    append_key_value(&key_values, JAEGERTRACINGC_DEBUG_HEADER, "debug-id");
+    append_key_value(&key_values,
+                     "traceparent",
+                     "00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-00");
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      extract_http_headers(&key_values, &config, &ctx));
+    TEST_ASSERT_NOT_NULL(ctx);
+    TEST_ASSERT_EQUAL_HEX64(0xb7ad6b7169203331, ctx->span_id);
+    TEST_ASSERT_EQUAL(jaeger_sampling_flag_sampled | jaeger_sampling_flag_debug,
+                      ctx->flags);
+    jaeger_span_context_destroy((jaeger_destructible*) ctx);
+    jaeger_free(ctx);
+
+    /* With both formats enabled, the Jaeger header takes precedence and
+     * trace state from a different trace is dropped. */
+    config.propagation_formats =
+        jaeger_propagation_format_jaeger | jaeger_propagation_format_w3c;
+    clear_key_values(&key_values);
+    append_key_value(&key_values, "traceparent", traceparent);
+    append_key_value(&key_values, "tracestate", "rojo=1");
+    append_key_value(
+        &key_values, JAEGERTRACINGC_TRACE_CONTEXT_HEADER_NAME, "ab:cd:0:0");
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      extract_http_headers(&key_values, &config, &ctx));
+    TEST_ASSERT_NOT_NULL(ctx);
+    TEST_ASSERT_EQUAL(0, ctx->trace_id.high);
+    TEST_ASSERT_EQUAL(0xab, ctx->trace_id.low);
+    TEST_ASSERT_EQUAL(0xcd, ctx->span_id);
+    TEST_ASSERT_NULL(ctx->trace_state);
+    counting_writer.num_headers = 0;
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      jaeger_inject_into_text_map(
+                          (opentracing_text_map_writer*) &counting_writer,
+                          ctx,
+                          &config));
+    TEST_ASSERT_EQUAL(2, counting_writer.num_headers);
+    jaeger_span_context_destroy((jaeger_destructible*) ctx);
+    jaeger_free(ctx);
+
+    /* Configs that leave the formats unset use the Jaeger format. */
+    config.propagation_formats = 0;
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      extract_http_headers(&key_values, &config, &ctx));
+    TEST_ASSERT_NOT_NULL(ctx);
+    TEST_ASSERT_EQUAL(0xab, ctx->trace_id.low);
+    jaeger_span_context_destroy((jaeger_destructible*) ctx);
+    jaeger_free(ctx);
+
+    /* A malformed traceparent falls back to the Jaeger header. */
+    config.propagation_formats =
+        jaeger_propagation_format_jaeger | jaeger_propagation_format_w3c;
+    clear_key_values(&key_values);
+    append_key_value(&key_values, "traceparent", "00-malformed");
+    append_key_value(
+        &key_values, JAEGERTRACINGC_TRACE_CONTEXT_HEADER_NAME, "ab:cd:0:0");
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      extract_http_headers(&key_values, &config, &ctx));
+    TEST_ASSERT_NOT_NULL(ctx);
+    TEST_ASSERT_EQUAL(0xab, ctx->trace_id.low);
+    TEST_ASSERT_EQUAL(0xcd, ctx->span_id);
+    jaeger_span_context_destroy((jaeger_destructible*) ctx);
+    jaeger_free(ctx);
+
+    clear_key_values(&key_values);
+    jaeger_vector_destroy(&key_values);
+}
+
+static inline void test_b3_headers()
+{
+    jaeger_headers_config config = JAEGERTRACINGC_HEADERS_CONFIG_INIT;
+    config.propagation_formats = jaeger_propagation_format_b3;
+    jaeger_vector key_values;
+    TEST_ASSERT_TRUE(jaeger_vector_init(&key_values, sizeof(jaeger_key_value)));
+
+    /* Multiple headers, matched case-insensitively. */
+    append_key_value(
+        &key_values, "X-B3-TraceId", "80f198ee56343ba864fe8b2a57d3eff7");
+    append_key_value(&key_values, "X-B3-ParentSpanId", "05e3ac9a4f6e3b90");
+    append_key_value(&key_values, "X-B3-SpanId", "e457b5a2e4d86bd1");
+    append_key_value(&key_values, "X-B3-Sampled", "1");
+    jaeger_span_context* ctx = NULL;
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      extract_http_headers(&key_values, &config, &ctx));
+    TEST_ASSERT_NOT_NULL(ctx);
+    TEST_ASSERT_EQUAL_HEX64(0x80f198ee56343ba8, ctx->trace_id.high);
+    TEST_ASSERT_EQUAL_HEX64(0x64fe8b2a57d3eff7, ctx->trace_id.low);
+    TEST_ASSERT_EQUAL_HEX64(0xe457b5a2e4d86bd1, ctx->span_id);
+    TEST_ASSERT_EQUAL(jaeger_sampling_flag_sampled, ctx->flags);
+
+    /* Text maps match B3 names case-insensitively too. */
+    mock_text_map_reader reader = {
+        .base = {.foreach_key = &mock_reader_foreach_key},
+        .key_values = &key_values};
+    jaeger_span_context* text_map_ctx = NULL;
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      jaeger_extract_from_text_map(
+                          (opentracing_text_map_reader*) &reader,
+                          &text_map_ctx,
+                          NULL,
+                          &config));
+    TEST_ASSERT_NOT_NULL(text_map_ctx);
+    TEST_ASSERT_EQUAL_HEX64(0xe457b5a2e4d86bd1, text_map_ctx->span_id);
+    jaeger_span_context_destroy((jaeger_destructible*) text_map_ctx);
+    jaeger_free(text_map_ctx);
+
+    /* Injection round trips through the multiple headers. */
+    clear_key_values(&key_values);
+    mock_http_headers_writer writer = {
+        .base = {.base = {.set = &mock_writer_set}}, .key_values = &key_values};
+    TEST_ASSERT_EQUAL(
+        opentracing_propagation_error_code_success,
+        jaeger_inject_into_http_headers(
+            (opentracing_http_headers_writer*) &writer, ctx, &config));
+    TEST_ASSERT_EQUAL(3, jaeger_vector_length(&key_values));
+    const jaeger_key_value* kv = jaeger_vector_get(&key_values, 0);
+    TEST_ASSERT_EQUAL_STRING(JAEGERTRACINGC_B3_TRACE_ID_HEADER, kv->key);
+    TEST_ASSERT_EQUAL_STRING("80f198ee56343ba864fe8b2a57d3eff7", kv->value);
+    kv = jaeger_vector_get(&key_values, 1);
+    TEST_ASSERT_EQUAL_STRING(JAEGERTRACINGC_B3_SPAN_ID_HEADER, kv->key);
+    TEST_ASSERT_EQUAL_STRING("e457b5a2e4d86bd1", kv->value);
+    kv = jaeger_vector_get(&key_values, 2);
+    TEST_ASSERT_EQUAL_STRING(JAEGERTRACINGC_B3_SAMPLED_HEADER, kv->key);
+    TEST_ASSERT_EQUAL_STRING("1", kv->value);
+    jaeger_span_context* ctx_copy = NULL;
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      extract_http_headers(&key_values, &config, &ctx_copy));
+    TEST_ASSERT_EQUAL(ctx->trace_id.high, ctx_copy->trace_id.high);
+    TEST_ASSERT_EQUAL(ctx->trace_id.low, ctx_copy->trace_id.low);
+    TEST_ASSERT_EQUAL(ctx->span_id, ctx_copy->span_id);
+    TEST_ASSERT_EQUAL(ctx->flags, ctx_copy->flags);
+    jaeger_span_context_destroy((jaeger_destructible*) ctx_copy);
+    jaeger_free(ctx_copy);
+
+    /* Debug spans send X-B3-Flags in place of X-B3-Sampled. */
+    ctx->trace_id.high = 0;
+    ctx->flags |= (uint8_t) jaeger_sampling_flag_debug;
+    clear_key_values(&key_values);
+    TEST_ASSERT_EQUAL(
+        opentracing_propagation_error_code_success,
+        jaeger_inject_into_http_headers(
+            (opentracing_http_headers_writer*) &writer, ctx, &config));
+    kv = jaeger_vector_get(&key_values, 0);
+    TEST_ASSERT_EQUAL_STRING("64fe8b2a57d3eff7", kv->value);
+    kv = jaeger_vector_get(&key_values, 2);
+    TEST_ASSERT_EQUAL_STRING(JAEGERTRACINGC_B3_FLAGS_HEADER, kv->key);
+    TEST_ASSERT_EQUAL_STRING("1", kv->value);
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      extract_http_headers(&key_values, &config, &ctx_copy));
+    TEST_ASSERT_EQUAL(ctx->flags, ctx_copy->flags);
+    jaeger_span_context_destroy((jaeger_destructible*) ctx_copy);
+    jaeger_free(ctx_copy);
+
+    /* The single header format writes one header without allocating. */
+    config.propagation_formats = jaeger_propagation_format_b3_single;
+    counting_text_map_writer counting_writer = {
+        .base = {.set = &counting_writer_set}, .num_headers = 0};
+    counting_allocator alloc = {.base = {.malloc = &counting_allocator_malloc,
+                                         .realloc = &counting_allocator_realloc,
+                                         .free = &counting_allocator_free},
+                                .delegate = jaeger_get_allocator(),
+                                .num_allocations = 0};
+    jaeger_set_allocator((jaeger_allocator*) &alloc);
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      jaeger_inject_into_text_map(
+                          (opentracing_text_map_writer*) &counting_writer,
+                          ctx,
+                          &config));
+    jaeger_set_allocator(alloc.delegate);
+    TEST_ASSERT_EQUAL(0, alloc.num_allocations);
+    TEST_ASSERT_EQUAL(1, counting_writer.num_headers);
+    clear_key_values(&key_values);
+    TEST_ASSERT_EQUAL(
+        opentracing_propagation_error_code_success,
+        jaeger_inject_into_http_headers(
+            (opentracing_http_headers_writer*) &writer, ctx, &config));
+    kv = jaeger_vector_get(&key_values, 0);
+    TEST_ASSERT_EQUAL_STRING(JAEGERTRACINGC_B3_HEADER, kv->key);
+    TEST_ASSERT_EQUAL_STRING("64fe8b2a57d3eff7-e457b5a2e4d86bd1-d", kv->value);
+    jaeger_span_context_destroy((jaeger_destructible*) ctx);
+    jaeger_free(ctx);
+
+    /* Extraction with either B3 format accepts both encodings. */
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      extract_http_headers(&key_values, &config, &ctx));
+    TEST_ASSERT_NOT_NULL(ctx);
+    TEST_ASSERT_EQUAL_HEX64(0x64fe8b2a57d3eff7, ctx->trace_id.low);
+    TEST_ASSERT_EQUAL(jaeger_sampling_flag_sampled | jaeger_sampling_flag_debug,
+                      ctx->flags);
+    jaeger_span_context_destroy((jaeger_destructible*) ctx);
+    jaeger_free(ctx);
+    config.propagation_formats = jaeger_propagation_format_b3;
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      extract_http_headers(&key_values, &config, &ctx));
+    TEST_ASSERT_NOT_NULL(ctx);
+    jaeger_span_context_destroy((jaeger_destructible*) ctx);
+    jaeger_free(ctx);
+
+    /* A lone sampling state carries no span context. */
+    clear_key_values(&key_values);
+    append_key_value(&key_values, "b3", "0");
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      extract_http_headers(&key_values, &config, &ctx));
+    TEST_ASSERT_NULL(ctx);
+
+    /* A trace ID without a span ID is corrupted, as are malformed values. */
+    typedef struct corrupt_case {
+        const char* key;
+        const char* value;
+    } corrupt_case;
+    const corrupt_case corrupt_cases[] = {
+        {"x-b3-traceid", "64fe8b2a57d3eff7"},
+        {"x-b3-spanid", "e457b5a2e4d86bd1"},
+        {"x-b3-sampled", "yes"},
+        {"x-b3-flags", "2"},
+        {"x-b3-parentspanid", "05e3ac9a"},
+        {"b3", "64fe8b2a57d3eff7-e457b5a2e4d86bd1-x"}};
+    const int num_corrupt_cases =
+        sizeof(corrupt_cases) / sizeof(corrupt_cases[0]);
+    for (int i = 0; i < num_corrupt_cases; i++) {
+        clear_key_values(&key_values);
+        append_key_value(
+            &key_values, corrupt_cases[i].key, corrupt_cases[i].value);
+        TEST_ASSERT_EQUAL_MESSAGE(
+            opentracing_propagation_error_code_span_context_corrupted,
+            extract_http_headers(&key_values, &config, &ctx),
+            corrupt_cases[i].key);
+        TEST_ASSERT_NULL(ctx);
+    }
+
+    /* Jaeger and W3C headers take precedence over B3 in a single pass. */
+    config.propagation_formats = jaeger_propagation_format_jaeger |
+                                 jaeger_propagation_format_w3c |
+                                 jaeger_propagation_format_b3;
+    clear_key_values(&key_values);
+    append_key_value(&key_values, "b3", "64fe8b2a57d3eff7-e457b5a2e4d86bd1-1");
+    append_key_value(&key_values,
+                     "traceparent",
+                     "00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-00");
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      extract_http_headers(&key_values, &config, &ctx));
+    TEST_ASSERT_NOT_NULL(ctx);
+    TEST_ASSERT_EQUAL_HEX64(0xb7ad6b7169203331, ctx->span_id);
+    TEST_ASSERT_EQUAL(0, ctx->flags);
+    jaeger_span_context_destroy((jaeger_destructible*) ctx);
+    jaeger_free(ctx);
+    append_key_value(
+        &key_values, JAEGERTRACINGC_TRACE_CONTEXT_HEADER_NAME, "ab:cd:0:0");
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      extract_http_headers(&key_values, &config, &ctx));
+    TEST_ASSERT_NOT_NULL(ctx);
+    TEST_ASSERT_EQUAL(0xcd, ctx->span_id);
+    jaeger_span_context_destroy((jaeger_destructible*) ctx);
+    jaeger_free(ctx);
+
+    /* Malformed or partial B3 headers fall back to the other formats. */
+    const corrupt_case fallback_cases[] = {
+        {"b3", "64fe8b2a57d3eff7-e457b5a2e4d86bd1-x"},
+        {"x-b3-sampled", "yes"},
+        {"x-b3-traceid", "64fe8b2a57d3eff7"}};
+    const int num_fallback_cases =
+        sizeof(fallback_cases) / sizeof(fallback_cases[0]);
+    for (int i = 0; i < num_fallback_cases; i++) {
+        clear_key_values(&key_values);
+        append_key_value(&key_values,
+                         JAEGERTRACINGC_TRACE_CONTEXT_HEADER_NAME,
+                         "ab:cd:0:0");
+        append_key_value(
+            &key_values, fallback_cases[i].key, fallback_cases[i].value);
+        TEST_ASSERT_EQUAL_MESSAGE(
+            opentracing_propagation_error_code_success,
+            extract_http_headers(&key_values, &config, &ctx),
+            fallback_cases[i].key);
+        TEST_ASSERT_NOT_NULL(ctx);
+        TEST_ASSERT_EQUAL(0xab, ctx->trace_id.low);
+        TEST_ASSERT_EQUAL(0xcd, ctx->span_id);
+        jaeger_span_context_destroy((jaeger_destructible*) ctx);
+        jaeger_free(ctx);
+    }
+
+    /* A debug header keeps its flags when the context comes from B3. */
+    clear_key_values(&key_values);
+    append_key_value(&key_values, JAEGERTRACINGC_DEBUG_HEADER, "debug-id");
+    append_key_value(&key_values, "b3", "64fe8b2a57d3eff7-e457b5a2e4d86bd1-0");
+    TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
+                      extract_http_headers(&key_values, &config, &ctx));
+    TEST_ASSERT_NOT_NULL(ctx);
+    TEST_ASSERT_EQUAL_HEX64(0xe457b5a2e4d86bd1, ctx->span_id);
+    TEST_ASSERT_EQUAL(jaeger_sampling_flag_sampled | jaeger_sampling_flag_debug,
+                      ctx->flags);
+    TEST_ASSERT_EQUAL_STRING("debug-id", ctx->debug_id);
+    jaeger_span_context_destroy((jaeger_destructible*) ctx);
+    jaeger_free(ctx);
+
+    clear_key_values(&key_values);
+    jaeger_vector_destroy(&key_values);
+}
+
+static int num_binary_callbacks = 0;
+
 static inline int
 binary_writer_callback(void* arg, const char* data, size_t len)
 {
+    num_binary_callbacks++;
     jaeger_vector* buffer = (jaeger_vector*) arg;
     char* addr =
         (char*) jaeger_vector_extend(buffer, jaeger_vector_length(buffer), len);
@@ -440,8 +1261,10 @@ binary_writer_callback(void* arg, const char* data, size_t len)
 
 static inline int binary_reader_callback(void* arg, char* data, size_t len)
 {
+    num_binary_callbacks++;
     jaeger_vector* buffer = (jaeger_vector*) arg;
-    TEST_ASSERT_GREATER_OR_EQUAL_INT(len, jaeger_vector_length(buffer));
+    /* Short reads signal the end of the stream. */
+    len = JAEGERTRACINGC_MIN(len, (size_t) jaeger_vector_length(buffer));
     for (int i = 0; i < (int) len; i++) {
         data[i] = *(char*) jaeger_vector_get(buffer, 0);
         jaeger_vector_remove(buffer, 0);
@@ -472,25 +1295,90 @@ static inline void test_binary()
         random_string(value, sizeof(value));
         TEST_ASSERT_TRUE(jaeger_hashtable_put(&ctx.baggage, key, value));
     }
+    /* Long enough to be read in several chunks. */
+    char long_value[1000];
+    memset(long_value, 'x', sizeof(long_value) - 1);
+    long_value[sizeof(long_value) - 1] = '\0';
+    TEST_ASSERT_TRUE(
+        jaeger_hashtable_put(&ctx.baggage, "long-value", long_value));
 
+    /* The whole context is written in one callback and read back in two
+     * per baggage item, plus two for the header. */
     jaeger_vector binary_buffer;
     TEST_ASSERT_TRUE(jaeger_vector_init(&binary_buffer, 1));
+    num_binary_callbacks = 0;
     TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success,
                       jaeger_inject_into_binary(&binary_writer_callback,
                                                 (void*) &binary_buffer,
                                                 &ctx));
+    TEST_ASSERT_EQUAL(1, num_binary_callbacks);
+    const size_t size = jaeger_binary_size(&ctx);
+    TEST_ASSERT_EQUAL(size, jaeger_vector_length(&binary_buffer));
+    char serialized[size];
+    memcpy(serialized, jaeger_vector_get(&binary_buffer, 0), size);
+
     jaeger_span_context* ctx_copy;
+    num_binary_callbacks = 0;
     opentracing_propagation_error_code error_code = jaeger_extract_from_binary(
         &binary_reader_callback, &binary_buffer, &ctx_copy, &metrics);
     TEST_ASSERT_EQUAL(opentracing_propagation_error_code_success, error_code);
+    TEST_ASSERT_EQUAL(2 + 2 * ctx.baggage.size, num_binary_callbacks);
+    TEST_ASSERT_EQUAL(0, jaeger_vector_length(&binary_buffer));
     TEST_ASSERT_EQUAL(ctx.trace_id.high, ctx_copy->trace_id.high);
     TEST_ASSERT_EQUAL(ctx.trace_id.low, ctx_copy->trace_id.low);
     TEST_ASSERT_EQUAL(ctx.span_id, ctx_copy->span_id);
     TEST_ASSERT_EQUAL(ctx.baggage.size, ctx_copy->baggage.size);
+    jaeger_span_context_destroy((jaeger_destructible*) ctx_copy);
+    jaeger_free(ctx_copy);
 
-    jaeger_span_context_destroy((jaeger_destructible*) &ctx);
+    /* The buffer API produces and parses the same bytes. */
+    char buffer[size];
+    TEST_ASSERT_EQUAL(size,
+                      jaeger_inject_into_binary_buffer(buffer, size - 1, &ctx));
+    TEST_ASSERT_EQUAL(size, jaeger_inject_into_binary_buffer(NULL, 0, &ctx));
+    TEST_ASSERT_EQUAL(size,
+                      jaeger_inject_into_binary_buffer(buffer, size, &ctx));
+    TEST_ASSERT_EQUAL_MEMORY(serialized, buffer, size);
+    TEST_ASSERT_EQUAL(
+        opentracing_propagation_error_code_success,
+        jaeger_extract_from_binary_buffer(buffer, size, &ctx_copy, &metrics));
+    TEST_ASSERT_EQUAL(ctx.trace_id.low, ctx_copy->trace_id.low);
+    TEST_ASSERT_EQUAL(ctx.span_id, ctx_copy->span_id);
+    TEST_ASSERT_EQUAL(ctx.baggage.size, ctx_copy->baggage.size);
     jaeger_span_context_destroy((jaeger_destructible*) ctx_copy);
     jaeger_free(ctx_copy);
+
+    /* Truncated buffers and trailing bytes are corrupted. */
+    for (size_t len = 0; len < size; len++) {
+        TEST_ASSERT_EQUAL(
+            opentracing_propagation_error_code_span_context_corrupted,
+            jaeger_extract_from_binary_buffer(buffer, len, &ctx_copy, NULL));
+        TEST_ASSERT_NULL(ctx_copy);
+    }
+    char padded[size + 1];
+    memcpy(padded, buffer, size);
+    padded[size] = '\0';
+    TEST_ASSERT_EQUAL(
+        opentracing_propagation_error_code_span_context_corrupted,
+        jaeger_extract_from_binary_buffer(padded, size + 1, &ctx_copy, NULL));
+    TEST_ASSERT_NULL(ctx_copy);
+
+    /* Truncated streams are corrupted too. */
+    for (size_t len = 0; len < size; len += 7) {
+        jaeger_vector_clear(&binary_buffer);
+        if (len > 0) {
+            char* data = jaeger_vector_extend(&binary_buffer, 0, len);
+            TEST_ASSERT_NOT_NULL(data);
+            memcpy(data, buffer, len);
+        }
+        TEST_ASSERT_EQUAL(
+            opentracing_propagation_error_code_span_context_corrupted,
+            jaeger_extract_from_binary(
+                &binary_reader_callback, &binary_buffer, &ctx_copy, NULL));
+        TEST_ASSERT_NULL(ctx_copy);
+    }
+
+    jaeger_span_context_destroy((jaeger_destructible*) &ctx);
     jaeger_vector_destroy(&binary_buffer);
     jaeger_metrics_destroy(&metrics);
 }
@@ -541,9 +1429,14 @@ void test_propagation()
     test_encode_hex();
     test_decode_uri_value();
     test_encode_uri_value();
+    test_uri_codec_matches_reference();
     test_to_lowercase();
     test_text_map();
     test_http_headers();
+    test_extract_allocations();
+    test_inject_allocations();
+    test_w3c_headers();
+    test_b3_headers();
     test_binary();
     test_custom_carrier();
     test_parse_key_value();
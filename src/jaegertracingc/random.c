@@ -15,62 +15,118 @@
  */
 
 #include "jaegertracingc/random.h"
+#include "jaegertracingc/clock.h"
 
-jaeger_thread_local rng_storage = {.initialized = false};
+void jaeger_rng_init(jaeger_rng* rng)
+{
+    assert(rng != NULL);
+    memset(rng->state, 0, sizeof(rng->state));
+    random_seed(rng->state, sizeof(rng->state));
+    if ((rng->state[0] | rng->state[1] | rng->state[2] | rng->state[3]) != 0) {
+        return;
+    }
+    /* An all-zero state never leaves zero, so fall back to a weak seed that
+     * still differs between threads and processes. */
+    jaeger_log_warn("Random seed unavailable, seeding from clock");
+    jaeger_rng_seed(rng,
+                    (uint64_t) jaeger_duration_now_ns() ^
+                        (uint64_t) (uintptr_t) rng);
+}
+
+#if defined(HAVE_THREAD_LOCAL) || !defined(JAEGERTRACINGC_MT)
+
+#ifdef HAVE_THREAD_LOCAL
+#define THREAD_LOCAL _Thread_local
+#else
+#define THREAD_LOCAL
+#endif /* HAVE_THREAD_LOCAL */
+
+/* Seeded lazily on first use in each thread. Needs no allocation and no
+ * cleanup, since the state lives in thread storage. */
+static THREAD_LOCAL jaeger_rng thread_rng;
+static THREAD_LOCAL bool thread_rng_seeded = false;
+
+static inline jaeger_rng* get_rng(void)
+{
+    if (!thread_rng_seeded) {
+        jaeger_rng_init(&thread_rng);
+        thread_rng_seeded = true;
+    }
+    return &thread_rng;
+}
+
+#else
+
+static jaeger_thread_local rng_storage = {.initialized = false};
 
 static jaeger_once once = JAEGERTRACINGC_ONCE_INIT;
 
-void cleanup_rng(void)
+static void cleanup_rng(void)
 {
     jaeger_thread_local_destroy(&rng_storage);
 }
 
-void init_rng(void)
+static void init_rng(void)
 {
     jaeger_thread_local_init(&rng_storage);
     atexit(&cleanup_rng);
 }
 
-#ifdef HAVE_ARC4RANDOM
-
-static inline uint64_t random64(const unsigned int* state)
+static void rng_destroy(jaeger_destructible* d)
 {
-    (void) state;
-    uint64_t result;
-    arc4random_buf(&result, sizeof(result));
-    return result;
+    if (d == NULL) {
+        return;
+    }
+    jaeger_free(d);
 }
 
-#else
-
-static inline uint64_t random64(unsigned int* state)
+static inline jaeger_rng* get_rng(void)
 {
-    return (((uint64_t) rand_r(state)) << 32u) | (uint64_t) rand_r(state);
+    jaeger_do_once(&once, init_rng);
+    assert(rng_storage.initialized);
+    jaeger_rng* rng = (jaeger_rng*) jaeger_thread_local_get_value(&rng_storage);
+    if (rng != NULL) {
+        return rng;
+    }
+    rng = (jaeger_rng*) jaeger_malloc(sizeof(jaeger_rng));
+    if (rng == NULL) {
+        jaeger_log_error("Cannot allocate random number generator");
+        return NULL;
+    }
+    ((jaeger_destructible*) rng)->destroy = &rng_destroy;
+    jaeger_rng_init(rng);
+    if (!jaeger_thread_local_set_value(&rng_storage,
+                                       (jaeger_destructible*) rng)) {
+        jaeger_free(rng);
+        return NULL;
+    }
+    return rng;
 }
 
-#endif /* HAVE_ARC4RANDOM */
+#endif /* HAVE_THREAD_LOCAL || !JAEGERTRACINGC_MT */
 
 uint64_t jaeger_random64(void)
 {
-    jaeger_do_once(&once, init_rng);
-    assert(rng_storage.initialized);
-    jaeger_rng* rng = (jaeger_rng*) jaeger_thread_local_get_value(&rng_storage);
+    jaeger_rng* rng = get_rng();
     if (rng == NULL) {
-        rng = jaeger_rng_alloc();
-        if (rng == NULL) {
-            goto cleanup;
-        }
-        jaeger_rng_init(rng);
-        if (!jaeger_thread_local_set_value(&rng_storage,
-                                           (jaeger_destructible*) rng)) {
-            goto cleanup;
-        }
+        return 0;
     }
+    return jaeger_rng_next(rng);
+}
 
-    assert(rng != NULL);
-    return random64(&rng->state);
-
-cleanup:
-    jaeger_free(rng);
-    return 0;
+void jaeger_random64_fill(uint64_t* values, size_t num_values)
+{
+    assert(values != NULL || num_values == 0);
+    jaeger_rng* rng = get_rng();
+    if (rng == NULL) {
+        memset(values, 0, num_values * sizeof(values[0]));
+        return;
+    }
+    /* Work on a local copy so the compiler can keep the state in registers
+     * across the loop. */
+    jaeger_rng local = *rng;
+    for (size_t i = 0; i < num_values; i++) {
+        values[i] = jaeger_rng_next(&local);
+    }
+    memcpy(rng->state, local.state, sizeof(rng->state));
 }
@@ -38,11 +38,16 @@
 extern "C" {
 #endif /* __cplusplus */
 
-extern jaeger_thread_local rng_storage;
+/** Number of 64-bit words in the generator state. */
+#define NUM_UINT64_IN_SEED 4
 
+/**
+ * xoshiro256** generator. Each thread draws from its own instance, so
+ * generating IDs never takes a lock.
+ */
 typedef struct jaeger_rng {
     jaeger_destructible base;
-    unsigned int state;
+    uint64_t state[NUM_UINT64_IN_SEED];
 } jaeger_rng;
 
 static inline void
@@ -71,26 +76,6 @@ read_random_seed(void* seed, size_t len, const char* random_source_path)
     }
 }
 
-static void rng_destroy(jaeger_destructible* d)
-{
-    if (d == NULL) {
-        return;
-    }
-    jaeger_rng* rng = (jaeger_rng*) d;
-    jaeger_free(rng);
-}
-
-#define NUM_UINT64_IN_SEED 2
-
-static inline jaeger_rng* jaeger_rng_alloc(void)
-{
-    jaeger_rng* rng = (jaeger_rng*) jaeger_malloc(sizeof(jaeger_rng));
-    if (rng == NULL) {
-        jaeger_log_error("Cannot allocate random number generator");
-    }
-    return rng;
-}
-
 #if defined(HAVE_GETRANDOM)
 
 static inline void random_seed(void* seed, size_t size)
@@ -98,7 +83,7 @@ static inline void random_seed(void* seed, size_t size)
     syscall(SYS_getrandom, (seed), (size), GRND_NONBLOCK);
 }
 
-#elif defined(HAVE_ARC4RANDOM_BUF)
+#elif defined(HAVE_ARC4RANDOM)
 
 static inline void random_seed(void* seed, size_t size)
 {
@@ -109,20 +94,83 @@ static inline void random_seed(void* seed, size_t size)
 
 static inline void random_seed(void* seed, size_t size)
 {
-    read_random_seed((seed), (size), "/dev/random");
+    read_random_seed((seed), (size), "/dev/urandom");
 }
 
 #endif /* HAVE_GETRANDOM */
 
-static inline void jaeger_rng_init(jaeger_rng* rng)
+static inline uint64_t jaeger_rotl64(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * Advance a splitmix64 generator. Used to expand a single 64-bit seed into a
+ * full xoshiro256** state.
+ * @param state Generator state, updated in place.
+ * @return Next random value.
+ */
+static inline uint64_t jaeger_splitmix64(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30u)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27u)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31u);
+}
+
+/**
+ * Generate the next random value.
+ * @param rng Generator, whose state must not be all zeros.
+ * @return Next random value.
+ */
+static inline uint64_t jaeger_rng_next(jaeger_rng* rng)
+{
+    assert(rng != NULL);
+    uint64_t* s = rng->state;
+    const uint64_t result = jaeger_rotl64(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17u;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = jaeger_rotl64(s[3], 45);
+    return result;
+}
+
+/**
+ * Seed a generator deterministically. Mostly useful for tests.
+ * @param rng Generator to seed.
+ * @param seed Seed, expanded to the full state with splitmix64.
+ */
+static inline void jaeger_rng_seed(jaeger_rng* rng, uint64_t seed)
 {
     assert(rng != NULL);
-    ((jaeger_destructible*) rng)->destroy = &rng_destroy;
-    random_seed(&rng->state, sizeof(rng->state));
+    for (int i = 0; i < NUM_UINT64_IN_SEED; i++) {
+        rng->state[i] = jaeger_splitmix64(&seed);
+    }
 }
 
+/**
+ * Seed a generator with 256 bits from the system random source.
+ * @param rng Generator to initialize.
+ */
+void jaeger_rng_init(jaeger_rng* rng);
+
+/**
+ * Generate a random 64-bit value from the calling thread's generator.
+ * @return Random value.
+ */
 uint64_t jaeger_random64(void);
 
+/**
+ * Fill an array with random 64-bit values from the calling thread's
+ * generator. Cheaper than calling jaeger_random64 once per value.
+ * @param values Array to fill.
+ * @param num_values Number of values to generate.
+ */
+void jaeger_random64_fill(uint64_t* values, size_t num_values);
+
 #ifdef __cplusplus
 } /* extern C */
 #endif /* __cplusplus */
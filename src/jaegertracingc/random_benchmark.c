@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jaegertracingc/benchmark_helpers.h"
+#include "jaegertracingc/random.h"
+
+#define NUM_ITERATIONS 100000000
+#define BATCH_SIZE 64
+
+/* Keeps the compiler from discarding results of the benchmarked calls. */
+static volatile uint64_t sink;
+
+static void benchmark_random64(void)
+{
+    jaeger_benchmark benchmark;
+    jaeger_benchmark_start(&benchmark, "random64", NUM_ITERATIONS);
+    for (int i = 0; i < NUM_ITERATIONS; i++) {
+        sink += jaeger_random64();
+    }
+    jaeger_benchmark_stop(&benchmark);
+
+    /* Two values per iteration, as for a root span with a 128-bit trace ID.
+     */
+    uint64_t ids[2];
+    jaeger_benchmark_start(&benchmark, "random64_fill/2", NUM_ITERATIONS / 2);
+    for (int i = 0; i < NUM_ITERATIONS / 2; i++) {
+        jaeger_random64_fill(ids, 2);
+        sink += ids[0] ^ ids[1];
+    }
+    jaeger_benchmark_stop(&benchmark);
+
+    uint64_t batch[BATCH_SIZE];
+    jaeger_benchmark_start(
+        &benchmark, "random64_fill/64", NUM_ITERATIONS / BATCH_SIZE);
+    for (int i = 0; i < NUM_ITERATIONS / BATCH_SIZE; i++) {
+        jaeger_random64_fill(batch, BATCH_SIZE);
+        sink += batch[i % BATCH_SIZE];
+    }
+    jaeger_benchmark_stop(&benchmark);
+}
+
+/* The generator this replaced, minus its thread local lookup, for
+ * comparison. */
+static void benchmark_rand_r(void)
+{
+    unsigned int state = 1;
+    jaeger_benchmark benchmark;
+    jaeger_benchmark_start(&benchmark, "rand_r_64", NUM_ITERATIONS);
+    for (int i = 0; i < NUM_ITERATIONS; i++) {
+        const uint64_t high = (uint64_t) rand_r(&state);
+        sink += (high << 32u) | (uint64_t) rand_r(&state);
+    }
+    jaeger_benchmark_stop(&benchmark);
+}
+
+int main()
+{
+    benchmark_random64();
+    benchmark_rand_r();
+    return 0;
+}
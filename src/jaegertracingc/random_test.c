@@ -22,6 +22,8 @@
 #include "jaegertracingc/threading.h"
 
 #define NUM_THREADS 5
+#define NUM_DRAWS 1000000
+#define NUM_BIT_DRAWS 100000
 
 static void* random_func(void* arg)
 {
@@ -31,12 +33,76 @@ static void* random_func(void* arg)
     return NULL;
 }
 
+static int compare_uint64(const void* lhs, const void* rhs)
+{
+    const uint64_t x = *(const uint64_t*) lhs;
+    const uint64_t y = *(const uint64_t*) rhs;
+    return (x > y) - (x < y);
+}
+
+static inline void test_reference_output()
+{
+    /* Outputs of the reference xoshiro256** implementation. */
+    jaeger_rng rng = {.state = {1, 2, 3, 4}};
+    const uint64_t expected[] = {0x2d00,
+                                 0,
+                                 0x5a007080,
+                                 0x10e0000000009d80,
+                                 0x10e0b61ce1009d80,
+                                 0x870021ce143ad00};
+    const int num_expected = sizeof(expected) / sizeof(expected[0]);
+    for (int i = 0; i < num_expected; i++) {
+        TEST_ASSERT_EQUAL_HEX64(expected[i], jaeger_rng_next(&rng));
+    }
+
+    /* Seeds are expanded with the reference splitmix64. */
+    jaeger_rng_seed(&rng, 0);
+    TEST_ASSERT_EQUAL_HEX64(0xe220a8397b1dcdaf, rng.state[0]);
+    TEST_ASSERT_EQUAL_HEX64(0x6e789e6aa1b965f4, rng.state[1]);
+    TEST_ASSERT_EQUAL_HEX64(0x06c45d188009454f, rng.state[2]);
+}
+
+static inline void test_quality()
+{
+    uint64_t* values = jaeger_malloc(sizeof(uint64_t) * NUM_DRAWS);
+    TEST_ASSERT_NOT_NULL(values);
+    jaeger_random64_fill(values, NUM_DRAWS / 2);
+    for (int i = NUM_DRAWS / 2; i < NUM_DRAWS; i++) {
+        values[i] = jaeger_random64();
+    }
+
+    /* Each bit should be set about half the time, well within six standard
+     * deviations. */
+    for (int bit = 0; bit < 64; bit++) {
+        int count = 0;
+        for (int i = 0; i < NUM_BIT_DRAWS; i++) {
+            count += (int) ((values[i] >> (unsigned) bit) & 1u);
+        }
+        TEST_ASSERT_INT_WITHIN(NUM_BIT_DRAWS / 100, NUM_BIT_DRAWS / 2, count);
+    }
+
+    /* The odds of any collision in a million 64-bit values are about one in
+     * 4e7, so a collision means a broken generator. */
+    qsort(values, NUM_DRAWS, sizeof(values[0]), &compare_uint64);
+    for (int i = 1; i < NUM_DRAWS; i++) {
+        TEST_ASSERT_NOT_EQUAL(values[i - 1], values[i]);
+    }
+    jaeger_free(values);
+}
+
 void test_random()
 {
+#if defined(HAVE_THREAD_LOCAL) || !defined(JAEGERTRACINGC_MT)
+    /* Thread storage needs no allocation. */
+    jaeger_set_allocator(jaeger_null_allocator());
+    TEST_ASSERT_NOT_EQUAL(jaeger_random64(), jaeger_random64());
+    jaeger_set_allocator(jaeger_built_in_allocator());
+#else
     /* Test allocation failure. */
     jaeger_set_allocator(jaeger_null_allocator());
     TEST_ASSERT_EQUAL(0, jaeger_random64());
     jaeger_set_allocator(jaeger_built_in_allocator());
+#endif /* HAVE_THREAD_LOCAL || !JAEGERTRACINGC_MT */
 
     int64_t random_numbers[NUM_THREADS] = {0};
     jaeger_thread threads[NUM_THREADS];
@@ -48,6 +114,14 @@ void test_random()
     for (int i = 0; i < NUM_THREADS; i++) {
         jaeger_thread_join(threads[i], NULL);
     }
+#ifdef JAEGERTRACINGC_MT
+    /* Every thread seeds its own generator. */
+    for (int i = 0; i < NUM_THREADS; i++) {
+        for (int j = i + 1; j < NUM_THREADS; j++) {
+            TEST_ASSERT_NOT_EQUAL(random_numbers[i], random_numbers[j]);
+        }
+    }
+#endif /* JAEGERTRACINGC_MT */
 
     uint64_t seed[NUM_UINT64_IN_SEED];
     memset(seed, 0, sizeof(seed));
@@ -64,4 +138,7 @@ void test_random()
     TEST_ASSERT_EQUAL_HEX64(seed_values[0], seed[0]);
     TEST_ASSERT_EQUAL_HEX64(seed_values[1], seed[1]);
     remove("good-path");
+
+    test_reference_output();
+    test_quality();
 }
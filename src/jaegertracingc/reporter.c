@@ -17,7 +17,13 @@
 #include "jaegertracingc/reporter.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
 
+#include "jaegertracingc/accounting_allocator.h"
+#include "jaegertracingc/clock.h"
+#include "jaegertracingc/log_limiter.h"
 #include "jaegertracingc/threading.h"
 #include "jaegertracingc/tracer.h"
 
@@ -253,6 +259,201 @@ cleanup:
     return false;
 }
 
+/* Span buffers hold the protobuf spans reporters have not flushed yet. */
+
+static inline void span_buffer_destroy(jaeger_vector* spans)
+{
+    for (int i = 0, len = jaeger_vector_length(spans); i < len; i++) {
+        Jaeger__Model__Span** span = jaeger_vector_offset(spans, i);
+        assert(span != NULL);
+        if (*span == NULL) {
+            continue;
+        }
+        jaeger_span_protobuf_destroy(*span);
+        jaeger_free_sized(*span, sizeof(Jaeger__Model__Span));
+    }
+    jaeger_vector_destroy(spans);
+}
+
+static inline void update_queue_length(jaeger_metrics* metrics,
+                                       const jaeger_vector* spans)
+{
+    if (metrics == NULL) {
+        return;
+    }
+    jaeger_gauge* queue_length = metrics->reporter_queue_length;
+    assert(queue_length != NULL);
+    queue_length->update(queue_length, jaeger_vector_length(spans));
+}
+
+static inline void record_dropped_spans(jaeger_metrics* metrics,
+                                        int num_dropped)
+{
+    if (metrics == NULL) {
+        return;
+    }
+    jaeger_counter* dropped = metrics->reporter_dropped;
+    assert(dropped != NULL);
+    dropped->inc(dropped, num_dropped);
+}
+
+static inline void record_failure(jaeger_metrics* metrics)
+{
+    if (metrics == NULL) {
+        return;
+    }
+    jaeger_counter* failed = metrics->reporter_failure;
+    assert(failed != NULL);
+    failed->inc(failed, 1);
+}
+
+/* Must be called with the reporter locked and in the reporter allocation
+ * context. */
+static void span_buffer_append(jaeger_vector* spans,
+                               Jaeger__Model__Process* process,
+                               jaeger_metrics* metrics,
+                               const jaeger_span* span)
+{
+    /* Allocations fail here first when an accounting allocator's budget is
+     * exhausted, so count every failure as a dropped span. Flushing every
+     * span hands the buffer over to the batch, so it may need a new one. */
+    if ((spans->data == NULL &&
+         !jaeger_vector_init(spans, sizeof(Jaeger__Model__Span*))) ||
+        !jaeger_vector_reserve(spans, jaeger_vector_length(spans) + 1)) {
+        record_dropped_spans(metrics, 1);
+        return;
+    }
+
+    Jaeger__Model__Span* span_copy = jaeger_malloc(sizeof(Jaeger__Model__Span));
+    if (span_copy == NULL) {
+        JAEGERTRACINGC_LOG_ERROR_LIMITED(
+            "Cannot allocate span for reporter batch");
+        record_dropped_spans(metrics, 1);
+        return;
+    }
+
+    *span_copy = (Jaeger__Model__Span) JAEGER__MODEL__SPAN__INIT;
+    if (!jaeger_span_to_protobuf(span_copy, span)) {
+        record_dropped_spans(metrics, 1);
+        jaeger_span_protobuf_destroy(span_copy);
+        jaeger_free_sized(span_copy, sizeof(Jaeger__Model__Span));
+        return;
+    }
+    Jaeger__Model__Span** span_ptr = jaeger_vector_append(spans);
+    assert(span_ptr != NULL);
+    *span_ptr = span_copy;
+    update_queue_length(metrics, spans);
+
+    if (process->service_name == NULL || strlen(process->service_name) == 0) {
+        /* Building process will not affect this span, so ignore return value.
+         */
+        build_process(process, span->tracer);
+    }
+}
+
+/* Frees the spans of a batch that was sent. */
+static inline void batch_sent(Jaeger__Model__Batch* batch,
+                              jaeger_metrics* metrics,
+                              int64_t start)
+{
+    const int num_flushed = batch->n_spans;
+    for (int i = 0; i < num_flushed; i++) {
+        if (batch->spans[i] == NULL) {
+            continue;
+        }
+        jaeger_span_protobuf_destroy(batch->spans[i]);
+        jaeger_free_sized(batch->spans[i], sizeof(Jaeger__Model__Span));
+    }
+    jaeger_free(batch->spans);
+    if (metrics != NULL) {
+        jaeger_counter* num_success = metrics->reporter_success;
+        assert(num_success != NULL);
+        num_success->inc(num_success, num_flushed);
+        jaeger_histogram* flush_latency = metrics->reporter_flush_latency;
+        assert(flush_latency != NULL);
+        flush_latency->record(flush_latency, jaeger_duration_now_ns() - start);
+    }
+}
+
+/* Hands the spans of a batch that was not sent back to the span buffer,
+ * ahead of the spans left there, so the next flush retries them in order.
+ * Only the batch's own spans are handed back, since build_batch may have
+ * freed the ones that did not fit. capacity is the length of the batch's
+ * buffer. */
+static inline void batch_unsent(Jaeger__Model__Batch* batch,
+                                jaeger_vector* spans,
+                                int capacity,
+                                jaeger_metrics* metrics)
+{
+    const int num_unsent = batch->n_spans;
+    const int num_buffered =
+        (spans->data != NULL) ? jaeger_vector_length(spans) : 0;
+    if (num_unsent + num_buffered <= capacity) {
+        if (spans->data != NULL) {
+            /* No need to delete the span pointers because they are moved to
+             * batch's buffer. */
+            memcpy(&batch->spans[num_unsent],
+                   spans->data,
+                   sizeof(Jaeger__Model__Span*) * num_buffered);
+            jaeger_free(spans->data);
+        }
+        *spans = (jaeger_vector){.data = (char*) batch->spans,
+                                 .len = num_unsent + num_buffered,
+                                 .capacity = capacity,
+                                 .type_size = sizeof(Jaeger__Model__Span*)};
+        return;
+    }
+
+    Jaeger__Model__Span** unsent = jaeger_vector_extend(spans, 0, num_unsent);
+    if (unsent != NULL) {
+        memcpy(unsent, batch->spans, sizeof(Jaeger__Model__Span*) * num_unsent);
+    }
+    else {
+        JAEGERTRACINGC_LOG_ERROR_LIMITED(
+            "Cannot allocate space for span buffer, must drop unsent spans, "
+            "num dropped spans = %d",
+            num_unsent);
+        for (int i = 0; i < num_unsent; i++) {
+            jaeger_span_protobuf_destroy(batch->spans[i]);
+            jaeger_free_sized(batch->spans[i], sizeof(Jaeger__Model__Span));
+        }
+        record_dropped_spans(metrics, num_unsent);
+    }
+    jaeger_free(batch->spans);
+}
+
+/* Moves unsent spans taken out of the span buffer back to its front, ahead
+ * of the spans reported since. Must be called with the reporter locked and
+ * in the reporter allocation context. */
+static inline void span_buffer_prepend(jaeger_vector* spans,
+                                       jaeger_vector* unsent,
+                                       jaeger_metrics* metrics)
+{
+    const int num_unsent = jaeger_vector_length(unsent);
+    if (num_unsent == 0) {
+        jaeger_vector_destroy(unsent);
+        return;
+    }
+    if (jaeger_vector_length(spans) == 0) {
+        jaeger_vector_destroy(spans);
+        *spans = *unsent;
+        *unsent = (jaeger_vector) JAEGERTRACINGC_VECTOR_INIT;
+        return;
+    }
+    Jaeger__Model__Span** dst = jaeger_vector_extend(spans, 0, num_unsent);
+    if (dst == NULL) {
+        JAEGERTRACINGC_LOG_ERROR_LIMITED(
+            "Cannot allocate space for span buffer, must drop unsent spans, "
+            "num dropped spans = %d",
+            num_unsent);
+        span_buffer_destroy(unsent);
+        record_dropped_spans(metrics, num_unsent);
+        return;
+    }
+    memcpy(dst, unsent->data, sizeof(Jaeger__Model__Span*) * num_unsent);
+    jaeger_vector_destroy(unsent);
+}
+
 static inline void large_batch_error(Jaeger__Model__Batch* batch,
                                      jaeger_vector* spans,
                                      int initial_num_spans,
@@ -262,37 +463,35 @@ static inline void large_batch_error(Jaeger__Model__Batch* batch,
     Jaeger__Model__Batch tmp = *batch;
     memcpy(&tmp, batch, sizeof(tmp));
     tmp.n_spans = 1;
-    jaeger_log_error("Message is too large to send in a single packet, "
-                     "minimum message size = %zu, "
-                     "maximum packet size = %d",
-                     jaeger__model__batch__get_packed_size(&tmp),
-                     max_packet_size);
+    JAEGERTRACINGC_LOG_ERROR_LIMITED(
+        "Message is too large to send in a single packet, "
+        "minimum message size = %zu, "
+        "maximum packet size = %d",
+        jaeger__model__batch__get_packed_size(&tmp),
+        max_packet_size);
 
     const int batch_packed_size = jaeger__model__batch__get_packed_size(batch);
     if (batch_packed_size > max_packet_size) {
-        jaeger_log_error("Detected batch with zero spans exceeds maximum "
-                         "packet size, "
-                         "batch size (zero spans) = %d, "
-                         "maximum packet size = %d",
-                         batch_packed_size,
-                         max_packet_size);
+        JAEGERTRACINGC_LOG_ERROR_LIMITED(
+            "Detected batch with zero spans exceeds maximum "
+            "packet size, "
+            "batch size (zero spans) = %d, "
+            "maximum packet size = %d",
+            batch_packed_size,
+            max_packet_size);
     }
 
-    jaeger_log_error("Dropping first span to avoid repeated failures");
+    JAEGERTRACINGC_LOG_ERROR_LIMITED(
+        "Dropping first span to avoid repeated failures");
 
     spans->data = (char*) batch->spans;
     spans->len = initial_num_spans;
     *batch = (Jaeger__Model__Batch) JAEGER__MODEL__BATCH__INIT;
     Jaeger__Model__Span** span = jaeger_vector_get(spans, 0);
     jaeger_span_protobuf_destroy(*span);
-    jaeger_free(*span);
+    jaeger_free_sized(*span, sizeof(Jaeger__Model__Span));
     jaeger_vector_remove(spans, 0);
-
-    if (metrics != NULL) {
-        jaeger_counter* dropped = metrics->reporter_dropped;
-        assert(dropped != NULL);
-        dropped->inc(dropped, 1);
-    }
+    record_dropped_spans(metrics, 1);
 }
 
 static inline bool build_batch(Jaeger__Model__Batch* batch,
@@ -332,18 +531,21 @@ static inline bool build_batch(Jaeger__Model__Batch* batch,
         }
     }
     else if (remaining_spans > 0) {
-        jaeger_log_error("Cannot allocate space for span buffer, must "
-                         "drop remaining spans, num dropped spans = %d",
-                         remaining_spans);
+        JAEGERTRACINGC_LOG_ERROR_LIMITED(
+            "Cannot allocate space for span buffer, must "
+            "drop remaining spans, num dropped spans = %d",
+            remaining_spans);
         for (int i = 0; i < remaining_spans; i++) {
             jaeger_span_protobuf_destroy(batch->spans[batch->n_spans + i]);
-            jaeger_free(batch->spans[batch->n_spans + i]);
-        }
-        if (metrics != NULL) {
-            jaeger_counter* dropped = metrics->reporter_dropped;
-            assert(dropped != NULL);
-            dropped->inc(dropped, remaining_spans);
+            jaeger_free_sized(batch->spans[batch->n_spans + i],
+                              sizeof(Jaeger__Model__Span));
         }
+        record_dropped_spans(metrics, remaining_spans);
+    }
+    if (metrics != NULL) {
+        jaeger_histogram* batch_spans = metrics->reporter_batch_spans;
+        assert(batch_spans != NULL);
+        batch_spans->record(batch_spans, batch->n_spans);
     }
     return true;
 }
@@ -368,34 +570,16 @@ static void remote_reporter_destroy(jaeger_destructible* destructible)
         r->candidates = NULL;
     }
 
-    process_destroy(&r->process);
-
-    for (int i = 0, len = jaeger_vector_length(&r->spans); i < len; i++) {
-        Jaeger__Model__Span** span = jaeger_vector_offset(&r->spans, i);
-        assert(span != NULL);
-        if (*span == NULL) {
-            continue;
-        }
-        jaeger_span_protobuf_destroy(*span);
-        jaeger_free(*span);
-    }
-    jaeger_vector_destroy(&r->spans);
+    jaeger_shm_ring_destroy(&r->shm_ring);
+    jaeger_free(r->shm_name);
+    r->shm_name = NULL;
 
+    jaeger_spill_queue_destroy(&r->spill);
+    process_destroy(&r->process);
+    span_buffer_destroy(&r->spans);
     jaeger_mutex_destroy(&r->mutex);
 }
 
-static inline void
-remote_reporter_update_queue_length(jaeger_remote_reporter* reporter)
-{
-    assert(reporter != NULL);
-    if (reporter->metrics == NULL) {
-        return;
-    }
-    jaeger_counter* dropped = reporter->metrics->reporter_dropped;
-    assert(dropped != NULL);
-    dropped->inc(dropped, 1);
-}
-
 static void remote_reporter_report(jaeger_reporter* reporter,
                                    const jaeger_span* span)
 {
@@ -406,59 +590,164 @@ static void remote_reporter_report(jaeger_reporter* reporter,
 
     jaeger_remote_reporter* r = (jaeger_remote_reporter*) reporter;
     jaeger_mutex_lock(&r->mutex);
+    const jaeger_alloc_tag prev_tag =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_reporter);
+    span_buffer_append(&r->spans, &r->process, r->metrics, span);
+    jaeger_alloc_context_exit(prev_tag);
+    jaeger_mutex_unlock(&r->mutex);
+}
 
-    if (!jaeger_vector_reserve(&r->spans,
-                               jaeger_vector_length(&r->spans) + 1)) {
-        goto unlock;
+/* Opens the agent's ring, and packs batches to fit it from then on. */
+static bool remote_reporter_open_shm_ring(jaeger_remote_reporter* reporter)
+{
+    if (!jaeger_shm_ring_open(&reporter->shm_ring, reporter->shm_name)) {
+        return false;
     }
-
-    Jaeger__Model__Span* span_copy = jaeger_malloc(sizeof(Jaeger__Model__Span));
-    if (span_copy == NULL) {
-        jaeger_log_error("Cannot allocate span for reporter batch");
-        goto unlock;
+    const size_t max_record_size =
+        jaeger_shm_ring_max_record_size(&reporter->shm_ring);
+    if ((size_t) reporter->max_packet_size > max_record_size) {
+        reporter->max_packet_size = max_record_size;
     }
+    return true;
+}
 
-    *span_copy = (Jaeger__Model__Span) JAEGER__MODEL__SPAN__INIT;
-    if (!jaeger_span_to_protobuf(span_copy, span)) {
-        goto cleanup;
+/* Copies the message into the agent's ring, with no system calls unless the
+ * agent is asleep. Opens the ring on first use, and again once the agent
+ * closes it in case the agent restarted with a new ring. A full ring stays
+ * open, which tells remote_reporter_flush_batch to drop the batch. */
+static bool remote_reporter_write_to_shm_ring(jaeger_remote_reporter* reporter,
+                                              const uint8_t* buffer,
+                                              int buf_len)
+{
+    if (reporter->shm_ring.header == NULL &&
+        !remote_reporter_open_shm_ring(reporter)) {
+        record_failure(reporter->metrics);
+        return false;
     }
-    Jaeger__Model__Span** span_ptr = jaeger_vector_append(&r->spans);
-    assert(span_ptr != NULL);
-    *span_ptr = span_copy;
-    remote_reporter_update_queue_length(r);
+    if (jaeger_shm_ring_push(&reporter->shm_ring, buffer, buf_len)) {
+        return true;
+    }
+    record_failure(reporter->metrics);
+    if (jaeger_shm_ring_closed(&reporter->shm_ring)) {
+        JAEGERTRACINGC_LOG_ERROR_LIMITED(
+            "Shared memory ring was closed, name = \"%s\"",
+            reporter->shm_name);
+        jaeger_shm_ring_destroy(&reporter->shm_ring);
+        return false;
+    }
+    JAEGERTRACINGC_LOG_ERROR_LIMITED(
+        "Cannot write message to shared memory ring, name = \"%s\", "
+        "length = %d",
+        reporter->shm_name,
+        buf_len);
+    return false;
+}
 
-    if (r->process.service_name == NULL ||
-        strlen(r->process.service_name) == 0) {
-        /* Building process will not affect this span, so ignore return value.
-         */
-        build_process(&r->process, span->tracer);
+/* Returns true if the last write failed because the agent's ring is full.
+ * The agent drains the ring at its own pace, so retrying the batch would
+ * only hold spans that newer batches need the room for. */
+static inline bool
+remote_reporter_ring_full(const jaeger_remote_reporter* reporter)
+{
+    return reporter->shm_ring.header != NULL;
+}
+
+/* Agents that stop reading fill the socket's queue, and a blocking send or
+ * connect would then stall the flush with the reporter locked. Non-blocking
+ * sockets fail instead, leaving the spans buffered for the next flush. The
+ * send buffer bounds the size of a message. */
+static inline bool configure_unix_socket(const jaeger_remote_reporter* reporter,
+                                         int fd)
+{
+    const int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 ||
+        fcntl(fd, F_SETFL, (unsigned) flags | (unsigned) O_NONBLOCK) < 0) {
+        jaeger_log_error("Cannot make agent socket non-blocking, errno = %d",
+                         errno);
+        return false;
     }
+    const int send_buffer_size =
+        reporter->max_packet_size + JAEGERTRACINGC_UNIX_SEND_BUFFER_OVERHEAD;
+    setsockopt(
+        fd, SOL_SOCKET, SO_SNDBUF, &send_buffer_size, sizeof(send_buffer_size));
+    return true;
+}
 
-    goto unlock;
+/* Connects on first use, so the agent does not need to be listening when the
+ * reporter starts. A connected socket skips the address lookup on every
+ * send. */
+static bool
+remote_reporter_write_to_unix_socket(jaeger_remote_reporter* reporter,
+                                     const uint8_t* buffer,
+                                     int buf_len)
+{
+    if (!reporter->unix_connected) {
+        if (connect(reporter->fd,
+                    (struct sockaddr*) &reporter->unix_addr,
+                    sizeof(reporter->unix_addr)) != 0) {
+            JAEGERTRACINGC_LOG_ERROR_LIMITED(
+                "Cannot connect to agent socket, path = \"%s\", errno = %d",
+                reporter->unix_addr.sun_path,
+                errno);
+            record_failure(reporter->metrics);
+            return false;
+        }
+        reporter->unix_connected = true;
+    }
 
-cleanup:
-    jaeger_span_protobuf_destroy(span_copy);
-    jaeger_free(span_copy);
-unlock:
-    jaeger_mutex_unlock(&r->mutex);
+    const int num_written = send(reporter->fd, buffer, buf_len, MSG_NOSIGNAL);
+    if (num_written == buf_len) {
+        return true;
+    }
+    const int error = errno;
+    JAEGERTRACINGC_LOG_ERROR_LIMITED(
+        "Cannot write entire message to agent socket, "
+        "num written = %d, errno = %d",
+        num_written,
+        error);
+    record_failure(reporter->metrics);
+    /* EAGAIN means the agent's queue is full, which is not worth a new
+     * socket. */
+    if (num_written < 0 && error != EAGAIN && error != ENOBUFS &&
+        error != EMSGSIZE) {
+        /* The agent went away, or restarted and bound a new socket. A fresh
+         * socket connects to the new one on the next write. */
+        const int fd = open_socket(AF_UNIX, reporter->socket_type);
+        if (fd >= 0 && configure_unix_socket(reporter, fd)) {
+            close(reporter->fd);
+            reporter->fd = fd;
+            reporter->unix_connected = false;
+        }
+        else if (fd >= 0) {
+            close(fd);
+        }
+    }
+    return false;
 }
 
 static bool remote_reporter_write_to_socket(jaeger_remote_reporter* reporter,
                                             const uint8_t* buffer,
                                             int buf_len)
 {
-    /* Delay address resolution until the first write. */
+    if (reporter->shm_name != NULL) {
+        return remote_reporter_write_to_shm_ring(reporter, buffer, buf_len);
+    }
+    if (reporter->unix_addr.sun_family == AF_UNIX) {
+        return remote_reporter_write_to_unix_socket(reporter, buffer, buf_len);
+    }
+
+    /* Delay address resolution until the first write. The socket is
+     * connected to the agent, so the kernel reports an agent that is not
+     * listening as ECONNREFUSED. It does so on the write after the one the
+     * agent's host refused, so the batch that reveals an outage is lost,
+     * but the ones after it fail and can be spilled. */
     if (reporter->candidates != NULL) {
         bool success = false;
         for (struct addrinfo* iter = reporter->candidates; iter != NULL;
              iter = iter->ai_next) {
-            if (sendto(reporter->fd,
-                       buffer,
-                       buf_len,
-                       0,
-                       iter->ai_addr,
-                       iter->ai_addrlen) == buf_len &&
-                sizeof(reporter->addr) == iter->ai_addrlen) {
+            if (sizeof(reporter->addr) == iter->ai_addrlen &&
+                connect(reporter->fd, iter->ai_addr, iter->ai_addrlen) == 0 &&
+                send(reporter->fd, buffer, buf_len, 0) == buf_len) {
                 memcpy(&reporter->addr, iter->ai_addr, sizeof(reporter->addr));
                 success = true;
                 break;
@@ -468,43 +757,74 @@ static bool remote_reporter_write_to_socket(jaeger_remote_reporter* reporter,
         freeaddrinfo(reporter->candidates);
         reporter->candidates = NULL;
         if (!success) {
-            jaeger_log_error("Failed to resolve remote reporter host port");
-            if (reporter->metrics != NULL) {
-                jaeger_counter* failed = reporter->metrics->reporter_failure;
-                assert(failed != NULL);
-                failed->inc(failed, 1);
-            }
+            JAEGERTRACINGC_LOG_ERROR_LIMITED(
+                "Failed to resolve remote reporter host port");
+            record_failure(reporter->metrics);
         }
 
         return success;
     }
 
-    const int num_written = sendto(reporter->fd,
-                                   buffer,
-                                   buf_len,
-                                   0,
-                                   (struct sockaddr*) &reporter->addr,
-                                   sizeof(reporter->addr));
+    const int num_written = send(reporter->fd, buffer, buf_len, 0);
     const bool success = (num_written == buf_len);
     if (!success) {
-        jaeger_log_error("Cannot write entire message to UDP socket, "
-                         "num written = %d, errno = %d",
-                         num_written,
-                         errno);
-        if (reporter->metrics != NULL) {
-            jaeger_counter* failed = reporter->metrics->reporter_failure;
-            assert(failed != NULL);
-            failed->inc(failed, 1);
-        }
+        JAEGERTRACINGC_LOG_ERROR_LIMITED(
+            "Cannot write entire message to UDP socket, "
+            "num written = %d, errno = %d",
+            num_written,
+            errno);
+        record_failure(reporter->metrics);
     }
 
     return success;
 }
 
+/* Moves a packed batch to the spill queue, if it is enabled. */
+static inline bool remote_reporter_spill(jaeger_remote_reporter* reporter,
+                                         const uint8_t* buffer,
+                                         int buf_len,
+                                         int num_spans)
+{
+    if (reporter->spill.dir == NULL) {
+        return false;
+    }
+    int num_dropped_spans = 0;
+    const bool success = jaeger_spill_queue_push(
+        &reporter->spill, buffer, buf_len, num_spans, &num_dropped_spans);
+    record_dropped_spans(reporter->metrics, num_dropped_spans);
+    return success;
+}
+
+/* Sends spilled batches in the order they were spilled, until the queue is
+ * empty or a write fails. */
+static bool remote_reporter_replay_spill(jaeger_remote_reporter* reporter)
+{
+    const uint8_t* data = NULL;
+    size_t len = 0;
+    int num_spans = 0;
+    while (jaeger_spill_queue_peek(&reporter->spill, &data, &len, &num_spans)) {
+        if (!remote_reporter_write_to_socket(reporter, data, len)) {
+            return false;
+        }
+        jaeger_spill_queue_pop(&reporter->spill);
+        if (reporter->metrics != NULL) {
+            jaeger_counter* num_success = reporter->metrics->reporter_success;
+            assert(num_success != NULL);
+            num_success->inc(num_success, num_spans);
+        }
+    }
+    return true;
+}
+
 static bool remote_reporter_flush_batch(jaeger_remote_reporter* reporter)
 {
-    const int num_spans = jaeger_vector_length(&reporter->spans);
-    assert(num_spans > 0);
+    assert(jaeger_vector_length(&reporter->spans) > 0);
+    const int capacity = reporter->spans.capacity;
+    const int64_t start = jaeger_duration_now_ns();
+    /* Opening the ring before packing the batch makes it fit the ring. */
+    if (reporter->shm_name != NULL && reporter->shm_ring.header == NULL) {
+        remote_reporter_open_shm_ring(reporter);
+    }
 
     Jaeger__Model__Batch batch = JAEGER__MODEL__BATCH__INIT;
     if (!build_batch(&batch,
@@ -520,40 +840,32 @@ static bool remote_reporter_flush_batch(jaeger_remote_reporter* reporter)
     ProtobufCBufferSimple simple = PROTOBUF_C_BUFFER_SIMPLE_INIT(buffer);
     jaeger__model__batch__pack_to_buffer(&batch, (ProtobufCBuffer*) &simple);
     assert((int) simple.len <= reporter->max_packet_size);
+    if (reporter->metrics != NULL) {
+        jaeger_histogram* packet_size = reporter->metrics->reporter_packet_size;
+        assert(packet_size != NULL);
+        packet_size->record(packet_size, simple.len);
+    }
+    /* Spilled batches go out first, so batches stay in order. */
     const bool write_succeeded =
+        jaeger_spill_queue_empty(&reporter->spill) &&
         remote_reporter_write_to_socket(reporter, simple.data, simple.len);
-    PROTOBUF_C_BUFFER_SIMPLE_CLEAR(&simple);
-    if (!write_succeeded) {
-        goto cleanup;
+    if (write_succeeded) {
+        batch_sent(&batch, reporter->metrics, start);
     }
-    const int num_flushed = batch.n_spans;
-    for (int i = 0; i < num_flushed; i++) {
-        if (batch.spans[i] == NULL) {
-            continue;
-        }
-        jaeger_span_protobuf_destroy(batch.spans[i]);
-        jaeger_free(batch.spans[i]);
+    else if (remote_reporter_spill(
+                 reporter, simple.data, simple.len, batch.n_spans)) {
+        batch_sent(&batch, NULL, start);
     }
-    jaeger_free(batch.spans);
-    if (reporter->metrics != NULL) {
-        jaeger_counter* num_success = reporter->metrics->reporter_success;
-        assert(num_success != NULL);
-        num_success->inc(num_success, num_flushed);
+    else if (remote_reporter_ring_full(reporter)) {
+        record_dropped_spans(reporter->metrics, batch.n_spans);
+        batch_sent(&batch, NULL, start);
     }
-    remote_reporter_update_queue_length(reporter);
-    return true;
-
-cleanup:
-    if (reporter->spans.data != NULL) {
-        /* No need to delete the span pointers because they are still valid
-         * and in batch's buffer. */
-        jaeger_free(reporter->spans.data);
-        reporter->spans.data = NULL;
-    }
-    reporter->spans.data = (char*) batch.spans;
-    reporter->spans.len = num_spans;
-    remote_reporter_update_queue_length(reporter);
-    return false;
+    else {
+        batch_unsent(&batch, &reporter->spans, capacity, reporter->metrics);
+    }
+    PROTOBUF_C_BUFFER_SIMPLE_CLEAR(&simple);
+    update_queue_length(reporter->metrics, &reporter->spans);
+    return write_succeeded;
 }
 
 static bool remote_reporter_flush(jaeger_reporter* r)
@@ -561,19 +873,76 @@ static bool remote_reporter_flush(jaeger_reporter* r)
     assert(r != NULL);
 
     jaeger_remote_reporter* reporter = (jaeger_remote_reporter*) r;
-    bool success = true;
     jaeger_mutex_lock(&reporter->mutex);
+    const jaeger_alloc_tag prev_tag =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_reporter);
+    bool success = remote_reporter_replay_spill(reporter);
     for (int num_spans = jaeger_vector_length(&reporter->spans); num_spans > 0;
          num_spans = jaeger_vector_length(&reporter->spans)) {
         if (!remote_reporter_flush_batch(reporter)) {
             success = false;
-            break;
+            /* Keep going while failed batches are spilled, so the buffer
+             * empties during an outage. */
+            if (reporter->spill.dir == NULL ||
+                jaeger_vector_length(&reporter->spans) >= num_spans) {
+                break;
+            }
         }
     }
+    jaeger_alloc_context_exit(prev_tag);
     jaeger_mutex_unlock(&reporter->mutex);
     return success;
 }
 
+/* Parses "unix://<path>" and "unixpacket://<path>" into the socket type and
+ * path, or returns NULL for host ports. */
+static inline const char* parse_unix_socket(const char* host_port_str,
+                                            int* socket_type)
+{
+    if (strncmp(host_port_str,
+                JAEGERTRACINGC_UNIX_DGRAM_SCHEME,
+                strlen(JAEGERTRACINGC_UNIX_DGRAM_SCHEME)) == 0) {
+        *socket_type = SOCK_DGRAM;
+        return &host_port_str[strlen(JAEGERTRACINGC_UNIX_DGRAM_SCHEME)];
+    }
+    if (strncmp(host_port_str,
+                JAEGERTRACINGC_UNIX_SEQPACKET_SCHEME,
+                strlen(JAEGERTRACINGC_UNIX_SEQPACKET_SCHEME)) == 0) {
+        *socket_type = SOCK_SEQPACKET;
+        return &host_port_str[strlen(JAEGERTRACINGC_UNIX_SEQPACKET_SCHEME)];
+    }
+    return NULL;
+}
+
+static inline bool remote_reporter_init_unix(jaeger_remote_reporter* reporter,
+                                             const char* path)
+{
+    if (strlen(path) == 0 ||
+        strlen(path) >= sizeof(reporter->unix_addr.sun_path)) {
+        jaeger_log_error("Invalid agent socket path, path = \"%s\"", path);
+        return false;
+    }
+    reporter->unix_addr.sun_family = AF_UNIX;
+    strncpy(reporter->unix_addr.sun_path,
+            path,
+            sizeof(reporter->unix_addr.sun_path) - 1);
+    return configure_unix_socket(reporter, reporter->fd);
+}
+
+static inline bool remote_reporter_init_udp(jaeger_remote_reporter* reporter,
+                                            const char* host_port_str)
+{
+    jaeger_host_port host_port =
+        (jaeger_host_port) JAEGERTRACINGC_HOST_PORT_INIT;
+    struct addrinfo* candidates = NULL;
+    const bool success =
+        jaeger_host_port_scan(&host_port, host_port_str) &&
+        jaeger_host_port_resolve(&host_port, SOCK_DGRAM, &candidates);
+    jaeger_host_port_destroy(&host_port);
+    reporter->candidates = candidates;
+    return success;
+}
+
 bool jaeger_remote_reporter_init(jaeger_remote_reporter* reporter,
                                  const char* host_port_str,
                                  int max_packet_size,
@@ -581,48 +950,562 @@ bool jaeger_remote_reporter_init(jaeger_remote_reporter* reporter,
 {
     assert(reporter != NULL);
 
-    const int fd = open_socket(AF_INET, SOCK_DGRAM);
-    if (fd < 0) {
-        return false;
+    if (host_port_str == NULL || strlen(host_port_str) == 0) {
+        host_port_str = JAEGERTRACINGC_DEFAULT_UDP_SPAN_SERVER_HOST_PORT;
+    }
+    int socket_type = SOCK_DGRAM;
+    const char* unix_path = parse_unix_socket(host_port_str, &socket_type);
+    const char* shm_name = NULL;
+    if (strncmp(host_port_str,
+                JAEGERTRACINGC_SHM_SCHEME,
+                strlen(JAEGERTRACINGC_SHM_SCHEME)) == 0) {
+        shm_name = &host_port_str[strlen(JAEGERTRACINGC_SHM_SCHEME)];
+    }
+
+    reporter->spill = (jaeger_spill_queue) JAEGERTRACINGC_SPILL_QUEUE_INIT;
+    reporter->shm_name = NULL;
+    reporter->shm_ring = (jaeger_shm_ring) JAEGERTRACINGC_SHM_RING_INIT;
+    /* Shared memory rings need no socket. */
+    int fd = -1;
+    if (shm_name == NULL) {
+        fd = open_socket((unix_path != NULL) ? AF_UNIX : AF_INET, socket_type);
+        if (fd < 0) {
+            return false;
+        }
     }
     reporter->fd = fd;
+    reporter->metrics = metrics;
+    reporter->mutex = (jaeger_mutex) JAEGERTRACINGC_MUTEX_INIT;
+    reporter->socket_type = socket_type;
+    reporter->unix_connected = false;
+    reporter->candidates = NULL;
+    memset(&reporter->addr, 0, sizeof(reporter->addr));
+    memset(&reporter->unix_addr, 0, sizeof(reporter->unix_addr));
 
     reporter->process = (Jaeger__Model__Process) JAEGER__MODEL__PROCESS__INIT;
-    reporter->max_packet_size = (max_packet_size > 0)
-                                    ? max_packet_size
-                                    : JAEGERTRACINGC_DEFAULT_UDP_BUFFER_SIZE;
+    if (max_packet_size > 0) {
+        reporter->max_packet_size = max_packet_size;
+    }
+    else if (shm_name != NULL) {
+        reporter->max_packet_size = JAEGERTRACINGC_DEFAULT_SHM_BUFFER_SIZE;
+    }
+    else if (unix_path != NULL) {
+        reporter->max_packet_size = JAEGERTRACINGC_DEFAULT_UNIX_BUFFER_SIZE;
+    }
+    else {
+        reporter->max_packet_size = JAEGERTRACINGC_DEFAULT_UDP_BUFFER_SIZE;
+    }
     if (!jaeger_vector_init(&reporter->spans, sizeof(Jaeger__Model__Span*))) {
         goto cleanup;
     }
 
-    jaeger_host_port host_port =
-        (jaeger_host_port) JAEGERTRACINGC_HOST_PORT_INIT;
-    if (host_port_str == NULL || strlen(host_port_str) == 0) {
-        host_port_str = JAEGERTRACINGC_DEFAULT_UDP_SPAN_SERVER_HOST_PORT;
+    if (shm_name != NULL) {
+        reporter->shm_name = jaeger_strdup(shm_name);
+        if (reporter->shm_name == NULL) {
+            jaeger_log_error("Cannot allocate shared memory ring name");
+            goto cleanup;
+        }
     }
-    if (!jaeger_host_port_scan(&host_port, host_port_str)) {
-        goto cleanup_host_port;
+    else if (unix_path != NULL) {
+        if (!remote_reporter_init_unix(reporter, unix_path)) {
+            goto cleanup;
+        }
     }
-
-    reporter->candidates = NULL;
-    struct addrinfo* candidates = NULL;
-    memset(&reporter->addr, 0, sizeof(reporter->addr));
-    if (!jaeger_host_port_resolve(&host_port, SOCK_DGRAM, &candidates)) {
-        goto cleanup_host_port;
+    else if (!remote_reporter_init_udp(reporter, host_port_str)) {
+        goto cleanup;
     }
-    reporter->candidates = candidates;
 
-    jaeger_host_port_destroy(&host_port);
-    reporter->metrics = metrics;
     ((jaeger_destructible*) reporter)->destroy = &remote_reporter_destroy;
     ((jaeger_reporter*) reporter)->report = &remote_reporter_report;
     ((jaeger_reporter*) reporter)->flush = &remote_reporter_flush;
-    reporter->mutex = (jaeger_mutex) JAEGERTRACINGC_MUTEX_INIT;
     return true;
 
-cleanup_host_port:
-    jaeger_host_port_destroy(&host_port);
 cleanup:
     remote_reporter_destroy((jaeger_destructible*) reporter);
     return false;
 }
+
+bool jaeger_remote_reporter_enable_spill(jaeger_remote_reporter* reporter,
+                                         const char* dir,
+                                         size_t max_size)
+{
+    assert(reporter != NULL);
+    assert(dir != NULL);
+    jaeger_mutex_lock(&reporter->mutex);
+    const jaeger_alloc_tag prev_tag =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_reporter);
+    jaeger_spill_queue_destroy(&reporter->spill);
+    const bool success = jaeger_spill_queue_init(
+        &reporter->spill, dir, max_size, reporter->max_packet_size);
+    jaeger_alloc_context_exit(prev_tag);
+    jaeger_mutex_unlock(&reporter->mutex);
+    return success;
+}
+
+#define HTTP_DEFAULT_PORT 80
+#define HTTP_DEFAULT_PATH "/api/v2/spans"
+#define HTTP_HEADER_MAX_LEN 1024
+#define HTTP_READ_BUFFER_SIZE 1024
+
+typedef enum http_exchange_result {
+    http_exchange_ok,
+    /* The collector answered with a client error, so retrying will not
+     * help. */
+    http_exchange_rejected,
+    /* The connection was closed before any of the response arrived, i.e. an
+     * idle keep-alive connection the collector timed out. */
+    http_exchange_closed,
+    http_exchange_failed
+} http_exchange_result;
+
+static int http_reporter_on_message_complete(http_parser* parser)
+{
+    assert(parser != NULL);
+    assert(parser->data != NULL);
+    jaeger_http_reporter* reporter = (jaeger_http_reporter*) parser->data;
+    reporter->response_complete = true;
+    /* Stop at the end of the response. */
+    http_parser_pause(parser, 1);
+    return 0;
+}
+
+static inline void http_reporter_disconnect(jaeger_http_reporter* reporter)
+{
+    if (reporter->fd >= 0) {
+        close(reporter->fd);
+        reporter->fd = -1;
+    }
+}
+
+static inline bool http_reporter_connect(jaeger_http_reporter* reporter)
+{
+    assert(reporter->fd < 0);
+    struct addrinfo* host_addrs = NULL;
+    if (!jaeger_host_port_resolve(
+            &reporter->host_port, SOCK_STREAM, &host_addrs)) {
+        return false;
+    }
+
+    const struct timeval timeout = {
+        .tv_sec = JAEGERTRACINGC_HTTP_REPORTER_TIMEOUT_MS / 1000,
+        .tv_usec = (JAEGERTRACINGC_HTTP_REPORTER_TIMEOUT_MS % 1000) * 1000};
+    const int no_delay = 1;
+    for (struct addrinfo* addr_iter = host_addrs; addr_iter != NULL;
+         addr_iter = addr_iter->ai_next) {
+        const int fd = open_socket(addr_iter->ai_family, SOCK_STREAM);
+        if (fd < 0) {
+            continue;
+        }
+        /* The send timeout also bounds connect. */
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+        if (connect(fd, addr_iter->ai_addr, addr_iter->ai_addrlen) == 0) {
+            reporter->fd = fd;
+            break;
+        }
+        close(fd);
+    }
+    freeaddrinfo(host_addrs);
+    if (reporter->fd < 0) {
+        JAEGERTRACINGC_LOG_ERROR_LIMITED(
+            "Cannot connect to collector, URL = \"%s\", errno = %d",
+            reporter->collector_url.str,
+            errno);
+        return false;
+    }
+    return true;
+}
+
+static inline bool send_all(int fd, struct iovec* iov, int iov_len)
+{
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iov_len;
+    while (msg.msg_iovlen > 0) {
+        /* Write errors are reported through the return value, not SIGPIPE. */
+        const ssize_t num_written = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (num_written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (num_written <= 0) {
+            return false;
+        }
+        size_t remaining = num_written;
+        while (msg.msg_iovlen > 0 && remaining >= msg.msg_iov->iov_len) {
+            remaining -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = (char*) msg.msg_iov->iov_base + remaining;
+            msg.msg_iov->iov_len -= remaining;
+        }
+    }
+    return true;
+}
+
+static inline int http_reporter_format_header(jaeger_http_reporter* reporter,
+                                              char* buffer,
+                                              int buffer_len,
+                                              int body_len)
+{
+    const jaeger_url* url = &reporter->collector_url;
+    const char* path = HTTP_DEFAULT_PATH;
+    int path_len = strlen(HTTP_DEFAULT_PATH);
+    if ((url->parts.field_set & (1u << ((uint32_t) UF_PATH))) &&
+        url->parts.field_data[UF_PATH].len > 0) {
+        path = &url->str[url->parts.field_data[UF_PATH].off];
+        path_len = url->parts.field_data[UF_PATH].len;
+    }
+    char host_port[HOST_NAME_MAX + JAEGERTRACINGC_MAX_PORT_STR_LEN + 1];
+    const int host_port_len = jaeger_host_port_format(
+        &reporter->host_port, host_port, sizeof(host_port));
+    if (host_port_len >= (int) sizeof(host_port)) {
+        return -1;
+    }
+    const char* encoding =
+        jaeger_compression_encoding(reporter->compressor.type);
+    return snprintf(buffer,
+                    buffer_len,
+                    "POST %.*s HTTP/1.1\r\n"
+                    "Host: %s\r\n"
+                    "User-Agent: jaegertracing/%s\r\n"
+                    "Content-Type: application/x-protobuf\r\n"
+                    "%s%s%s"
+                    "Content-Length: %d\r\n\r\n",
+                    path_len,
+                    path,
+                    host_port,
+                    JAEGERTRACINGC_CLIENT_VERSION,
+                    (encoding != NULL) ? "Content-Encoding: " : "",
+                    (encoding != NULL) ? encoding : "",
+                    (encoding != NULL) ? "\r\n" : "",
+                    body_len);
+}
+
+static http_exchange_result
+http_reporter_exchange(jaeger_http_reporter* reporter,
+                       const uint8_t* body,
+                       int body_len)
+{
+    char header[HTTP_HEADER_MAX_LEN];
+    const int header_len = http_reporter_format_header(
+        reporter, header, sizeof(header), body_len);
+    if (header_len < 0 || header_len >= (int) sizeof(header)) {
+        jaeger_log_error("Cannot write entire HTTP request header to buffer, "
+                         "buffer size = %zu, header length = %d",
+                         sizeof(header),
+                         header_len);
+        return http_exchange_failed;
+    }
+    struct iovec iov[2] = {{.iov_base = header, .iov_len = header_len},
+                           {.iov_base = (void*) body, .iov_len = body_len}};
+    if (!send_all(reporter->fd, iov, 2)) {
+        return (errno == EPIPE || errno == ECONNRESET) ? http_exchange_closed
+                                                       : http_exchange_failed;
+    }
+
+    http_parser_init(&reporter->parser, HTTP_RESPONSE);
+    reporter->parser.data = reporter;
+    reporter->response_complete = false;
+    int total_read = 0;
+    char buffer[HTTP_READ_BUFFER_SIZE];
+    while (!reporter->response_complete) {
+        const ssize_t num_read = recv(reporter->fd, buffer, sizeof(buffer), 0);
+        if (num_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (num_read < 0) {
+            return (total_read == 0 && errno == ECONNRESET)
+                       ? http_exchange_closed
+                       : http_exchange_failed;
+        }
+        /* A zero length read tells the parser the connection was closed,
+         * which completes responses without a content length. */
+        http_parser_execute(
+            &reporter->parser, &reporter->settings, buffer, num_read);
+        if (HTTP_PARSER_ERRNO(&reporter->parser) != HPE_OK &&
+            HTTP_PARSER_ERRNO(&reporter->parser) != HPE_PAUSED) {
+            JAEGERTRACINGC_LOG_ERROR_LIMITED(
+                "Cannot parse collector response, error = \"%s\"",
+                http_errno_name(HTTP_PARSER_ERRNO(&reporter->parser)));
+            return http_exchange_failed;
+        }
+        if (num_read == 0 && !reporter->response_complete) {
+            return (total_read == 0) ? http_exchange_closed
+                                     : http_exchange_failed;
+        }
+        total_read += num_read;
+    }
+
+    if (!http_should_keep_alive(&reporter->parser)) {
+        http_reporter_disconnect(reporter);
+    }
+    const int status_code = reporter->parser.status_code;
+    if (status_code / 100 == 2) {
+        return http_exchange_ok;
+    }
+    JAEGERTRACINGC_LOG_ERROR_LIMITED(
+        "Collector did not accept spans, HTTP status code = %d", status_code);
+    return (status_code / 100 == 4) ? http_exchange_rejected
+                                    : http_exchange_failed;
+}
+
+static http_exchange_result http_reporter_post(jaeger_http_reporter* reporter,
+                                               const uint8_t* body,
+                                               int body_len)
+{
+    const bool reused = (reporter->fd >= 0);
+    if (!reused && !http_reporter_connect(reporter)) {
+        return http_exchange_failed;
+    }
+    http_exchange_result result =
+        http_reporter_exchange(reporter, body, body_len);
+    if (result == http_exchange_closed && reused) {
+        /* Nothing was processed, so it is safe to try again. */
+        http_reporter_disconnect(reporter);
+        if (!http_reporter_connect(reporter)) {
+            return http_exchange_failed;
+        }
+        result = http_reporter_exchange(reporter, body, body_len);
+    }
+    if (result == http_exchange_closed || result == http_exchange_failed) {
+        http_reporter_disconnect(reporter);
+    }
+    return result;
+}
+
+/* Feeds the packed request to the compressor as protobuf-c writes it, so
+ * the uncompressed request is never copied into one buffer. */
+typedef struct compressor_sink {
+    ProtobufCBuffer base;
+    jaeger_compressor* compressor;
+    bool failed;
+} compressor_sink;
+
+static void
+compressor_sink_append(ProtobufCBuffer* buffer, size_t len, const uint8_t* data)
+{
+    compressor_sink* sink = (compressor_sink*) buffer;
+    if (!sink->failed &&
+        !jaeger_compressor_append(sink->compressor, data, len)) {
+        sink->failed = true;
+    }
+}
+
+/* Must be called with the flush lock held. spans are the spans taken out of
+ * the span buffer, not the buffer itself, and process is a copy of the
+ * reporter's process taken under the reporter lock. */
+static bool http_reporter_flush_batch(jaeger_http_reporter* reporter,
+                                      Jaeger__Model__Process* process,
+                                      jaeger_vector* spans)
+{
+    assert(jaeger_vector_length(spans) > 0);
+    const int capacity = spans->capacity;
+    const int64_t start = jaeger_duration_now_ns();
+
+    Jaeger__Model__Batch batch = JAEGER__MODEL__BATCH__INIT;
+    if (!build_batch(&batch,
+                     process,
+                     spans,
+                     reporter->max_request_size,
+                     reporter->metrics)) {
+        return false;
+    }
+
+    Jaeger__Model__PostSpansRequest request =
+        JAEGER__MODEL__POST_SPANS_REQUEST__INIT;
+    request.batch = &batch;
+    const size_t body_len =
+        jaeger__model__post_spans_request__get_packed_size(&request);
+    http_exchange_result result = http_exchange_failed;
+    if (jaeger_compressor_begin(&reporter->compressor, body_len)) {
+        compressor_sink sink = {.base = {.append = &compressor_sink_append},
+                                .compressor = &reporter->compressor,
+                                .failed = false};
+        jaeger__model__post_spans_request__pack_to_buffer(
+            &request, (ProtobufCBuffer*) &sink);
+        size_t payload_len = 0;
+        const uint8_t* payload =
+            sink.failed
+                ? NULL
+                : jaeger_compressor_finish(&reporter->compressor, &payload_len);
+        if (payload != NULL) {
+            if (reporter->metrics != NULL) {
+                jaeger_histogram* packet_size =
+                    reporter->metrics->reporter_packet_size;
+                assert(packet_size != NULL);
+                packet_size->record(packet_size, payload_len);
+            }
+            result = http_reporter_post(reporter, payload, payload_len);
+        }
+    }
+
+    switch (result) {
+    case http_exchange_ok:
+        batch_sent(&batch, reporter->metrics, start);
+        break;
+    case http_exchange_rejected: {
+        const int num_rejected = batch.n_spans;
+        batch_sent(&batch, NULL, start);
+        record_dropped_spans(reporter->metrics, num_rejected);
+        record_failure(reporter->metrics);
+    } break;
+    default:
+        batch_unsent(&batch, spans, capacity, reporter->metrics);
+        record_failure(reporter->metrics);
+        break;
+    }
+    return result == http_exchange_ok;
+}
+
+static bool http_reporter_flush(jaeger_reporter* r)
+{
+    assert(r != NULL);
+    jaeger_http_reporter* reporter = (jaeger_http_reporter*) r;
+    bool success = true;
+    /* Posting can block for as long as the collector takes to answer, so it
+     * happens on spans taken out of the buffer. The flush lock keeps
+     * concurrent flushes off the connection, and the reporter lock is only
+     * held to take and return spans, leaving report free to buffer more. */
+    jaeger_mutex_lock(&reporter->flush_mutex);
+    jaeger_mutex_lock(&reporter->mutex);
+    jaeger_vector spans = reporter->spans;
+    reporter->spans = (jaeger_vector) JAEGERTRACINGC_VECTOR_INIT;
+    /* Report builds the process under the reporter lock, once its first
+     * span arrives, and never changes it after that. A shallow copy is
+     * then safe to read without the lock until the reporter is
+     * destroyed. */
+    Jaeger__Model__Process process = reporter->process;
+    jaeger_mutex_unlock(&reporter->mutex);
+
+    const jaeger_alloc_tag prev_tag =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_reporter);
+    while (jaeger_vector_length(&spans) > 0) {
+        if (!http_reporter_flush_batch(reporter, &process, &spans)) {
+            success = false;
+            break;
+        }
+    }
+    jaeger_mutex_lock(&reporter->mutex);
+    span_buffer_prepend(&reporter->spans, &spans, reporter->metrics);
+    update_queue_length(reporter->metrics, &reporter->spans);
+    jaeger_mutex_unlock(&reporter->mutex);
+    jaeger_alloc_context_exit(prev_tag);
+    jaeger_mutex_unlock(&reporter->flush_mutex);
+    return success;
+}
+
+static void http_reporter_report(jaeger_reporter* reporter,
+                                 const jaeger_span* span)
+{
+    assert(reporter != NULL);
+    if (span == NULL) {
+        return;
+    }
+
+    jaeger_http_reporter* r = (jaeger_http_reporter*) reporter;
+    jaeger_mutex_lock(&r->mutex);
+    const jaeger_alloc_tag prev_tag =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_reporter);
+    span_buffer_append(&r->spans, &r->process, r->metrics, span);
+    jaeger_alloc_context_exit(prev_tag);
+    jaeger_mutex_unlock(&r->mutex);
+}
+
+static void http_reporter_destroy(jaeger_destructible* destructible)
+{
+    if (destructible == NULL) {
+        return;
+    }
+    jaeger_http_reporter* r = (jaeger_http_reporter*) destructible;
+
+    /* Try to flush any spans we have not flushed yet. */
+    if (r->collector_url.str != NULL) {
+        ((jaeger_reporter*) r)->flush((jaeger_reporter*) r);
+    }
+
+    http_reporter_disconnect(r);
+    jaeger_compressor_destroy(&r->compressor);
+    jaeger_url_destroy(&r->collector_url);
+    jaeger_host_port_destroy(&r->host_port);
+    process_destroy(&r->process);
+    span_buffer_destroy(&r->spans);
+    jaeger_mutex_destroy(&r->mutex);
+    jaeger_mutex_destroy(&r->flush_mutex);
+}
+
+bool jaeger_http_reporter_init(jaeger_http_reporter* reporter,
+                               const char* collector_url,
+                               int max_request_size,
+                               jaeger_metrics* metrics)
+{
+    assert(reporter != NULL);
+    *reporter = (jaeger_http_reporter){
+        .max_request_size = (max_request_size > 0)
+                                ? max_request_size
+                                : JAEGERTRACINGC_DEFAULT_HTTP_MAX_REQUEST_SIZE,
+        .fd = -1,
+        .collector_url = JAEGERTRACINGC_URL_INIT,
+        .host_port = JAEGERTRACINGC_HOST_PORT_INIT,
+        .metrics = metrics,
+        .process = JAEGER__MODEL__PROCESS__INIT,
+        .spans = JAEGERTRACINGC_VECTOR_INIT,
+        .response_complete = false,
+        .compressor = JAEGERTRACINGC_COMPRESSOR_INIT,
+        .mutex = JAEGERTRACINGC_MUTEX_INIT,
+        .flush_mutex = JAEGERTRACINGC_MUTEX_INIT};
+    ((jaeger_destructible*) reporter)->destroy = &http_reporter_destroy;
+    ((jaeger_reporter*) reporter)->report = &http_reporter_report;
+    ((jaeger_reporter*) reporter)->flush = &http_reporter_flush;
+    /* Records the allocator for compressors set up later. */
+    jaeger_compressor_init(&reporter->compressor,
+                           jaeger_compression_none,
+                           JAEGERTRACINGC_COMPRESSION_DEFAULT_LEVEL);
+    http_parser_settings_init(&reporter->settings);
+    reporter->settings.on_message_complete =
+        &http_reporter_on_message_complete;
+
+    if (collector_url == NULL || strlen(collector_url) == 0) {
+        collector_url = JAEGERTRACINGC_DEFAULT_HTTP_COLLECTOR_URL;
+    }
+    if (!jaeger_vector_init(&reporter->spans, sizeof(Jaeger__Model__Span*)) ||
+        !jaeger_url_init(&reporter->collector_url, collector_url) ||
+        !jaeger_host_port_from_url(&reporter->host_port,
+                                   &reporter->collector_url)) {
+        jaeger_log_error("Cannot initialize HTTP reporter, URL = \"%s\"",
+                         collector_url);
+        jaeger_url_destroy(&reporter->collector_url);
+        http_reporter_destroy((jaeger_destructible*) reporter);
+        return false;
+    }
+    if (reporter->host_port.port == 0) {
+        reporter->host_port.port = HTTP_DEFAULT_PORT;
+    }
+    return true;
+}
+
+bool jaeger_http_reporter_set_compression(jaeger_http_reporter* reporter,
+                                          jaeger_compression_type type,
+                                          int level)
+{
+    assert(reporter != NULL);
+    /* Flushes use the compressor without the reporter lock. */
+    jaeger_mutex_lock(&reporter->flush_mutex);
+    /* The compressor lasts as long as the reporter, so it keeps the allocator
+     * the reporter was initialized with rather than the caller's. */
+    jaeger_allocator* prev_alloc =
+        jaeger_set_thread_allocator(reporter->compressor.allocator);
+    const jaeger_alloc_tag prev_tag =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_reporter);
+    jaeger_compressor_destroy(&reporter->compressor);
+    /* Leaves an uncompressed compressor on failure. */
+    const bool success =
+        jaeger_compressor_init(&reporter->compressor, type, level);
+    jaeger_alloc_context_exit(prev_tag);
+    jaeger_set_thread_allocator(prev_alloc);
+    jaeger_mutex_unlock(&reporter->flush_mutex);
+    return success;
+}
@@ -23,13 +23,18 @@
 #define JAEGERTRACINGC_REPORTER_H
 
 #include "jaegertracingc/common.h"
+#include "jaegertracingc/compression.h"
 #include "jaegertracingc/logging.h"
 #include "jaegertracingc/metrics.h"
 #include "jaegertracingc/net.h"
+#include "jaegertracingc/shm_ring.h"
 #include "jaegertracingc/span.h"
+#include "jaegertracingc/spill_queue.h"
 #include "jaegertracingc/threading.h"
 #include "jaegertracingc/vector.h"
 
+#include <sys/un.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -38,6 +43,29 @@ extern "C" {
 
 #define JAEGERTRACINGC_DEFAULT_UDP_BUFFER_SIZE USHRT_MAX
 
+/** Prefix of agent addresses that are Unix domain datagram sockets, i.e.
+ *  "unix:///var/run/jaeger.sock". */
+#define JAEGERTRACINGC_UNIX_DGRAM_SCHEME "unix://"
+
+/** Prefix of agent addresses that are Unix domain sequenced packet
+ *  sockets. */
+#define JAEGERTRACINGC_UNIX_SEQPACKET_SCHEME "unixpacket://"
+
+/** Unix domain sockets are not limited to the size of a UDP packet, so
+ *  batches can be larger. */
+#define JAEGERTRACINGC_DEFAULT_UNIX_BUFFER_SIZE (128 * 1024)
+
+/** Bytes the send buffer holds beyond the largest message. */
+#define JAEGERTRACINGC_UNIX_SEND_BUFFER_OVERHEAD 1024
+
+/** Prefix of agent addresses that are shared memory rings, i.e.
+ *  "shm:///jaeger-spans". */
+#define JAEGERTRACINGC_SHM_SCHEME "shm://"
+
+/** Default message size for shared memory rings. Lowered to the largest
+ *  record of the agent's ring once the ring is open. */
+#define JAEGERTRACINGC_DEFAULT_SHM_BUFFER_SIZE (128 * 1024)
+
 typedef struct jaeger_reporter {
     jaeger_destructible base;
 
@@ -87,14 +115,121 @@ typedef struct jaeger_remote_reporter {
     jaeger_vector spans;
     struct addrinfo* candidates;
     struct sockaddr_in addr;
+    int socket_type;
+    struct sockaddr_un unix_addr;
+    bool unix_connected;
+    char* shm_name;
+    jaeger_shm_ring shm_ring;
+    jaeger_spill_queue spill;
     jaeger_mutex mutex;
 } jaeger_remote_reporter;
 
+/**
+ * Initialize a reporter that sends batches to an agent.
+ * @param reporter Reporter to initialize.
+ * @param host_port_str Agent address, either a host port for UDP, the path
+ *                      of a Unix domain socket prefixed with
+ *                      JAEGERTRACINGC_UNIX_DGRAM_SCHEME or
+ *                      JAEGERTRACINGC_UNIX_SEQPACKET_SCHEME, or the name of
+ *                      a shared memory ring prefixed with
+ *                      JAEGERTRACINGC_SHM_SCHEME. NULL for
+ *                      JAEGERTRACINGC_DEFAULT_UDP_SPAN_SERVER_HOST_PORT.
+ * @param max_packet_size Maximum size of a message, or zero for the default
+ *                        of the transport.
+ * @param metrics Metrics to update, or NULL.
+ * @return True on success, false otherwise.
+ */
 bool jaeger_remote_reporter_init(jaeger_remote_reporter* reporter,
                                  const char* host_port_str,
                                  int max_packet_size,
                                  jaeger_metrics* metrics);
 
+/**
+ * Spill batches that cannot be sent to files in a directory, instead of
+ * keeping their spans in memory. Spilled batches are sent first on the next
+ * flush, in the order they were spilled, and batches spilled before a restart
+ * are sent by the next reporter using the directory. Once the files reach
+ * the size cap, the oldest batches are dropped. Over UDP, a write fails
+ * once the agent's host reports the agent's port as unreachable, so the
+ * batch written just before that is lost rather than spilled.
+ * @param reporter Reporter to configure.
+ * @param dir Existing directory for spill files, used by this reporter only.
+ * @param max_size Maximum number of bytes in the spill files.
+ * @return True on success, false otherwise.
+ */
+bool jaeger_remote_reporter_enable_spill(jaeger_remote_reporter* reporter,
+                                         const char* dir,
+                                         size_t max_size);
+
+#define JAEGERTRACINGC_DEFAULT_HTTP_COLLECTOR_URL \
+    "http://localhost:14268/api/v2/spans"
+
+#define JAEGERTRACINGC_DEFAULT_HTTP_MAX_REQUEST_SIZE (4 * 1024 * 1024)
+
+/** Timeout for connecting to, writing to and reading from the collector. */
+#define JAEGERTRACINGC_HTTP_REPORTER_TIMEOUT_MS 5000
+
+/**
+ * Reporter that posts batches to a collector as protobuf-encoded
+ * PostSpansRequest messages. Requests are not bound by the size of a UDP
+ * packet, and reuse one keep-alive connection for as long as the collector
+ * keeps it open. A connection the collector closed while idle is replaced
+ * and the request retried once. Failed batches stay buffered for the next
+ * flush, except batches the collector rejects with a client error, which are
+ * dropped. Spans reported while a flush waits on the collector are buffered
+ * for the next one.
+ * @extends jaeger_reporter
+ */
+typedef struct jaeger_http_reporter {
+    jaeger_reporter base;
+    int max_request_size;
+    int fd;
+    jaeger_url collector_url;
+    jaeger_host_port host_port;
+    jaeger_metrics* metrics;
+    Jaeger__Model__Process process;
+    jaeger_vector spans;
+    http_parser parser;
+    http_parser_settings settings;
+    bool response_complete;
+    jaeger_compressor compressor;
+    jaeger_mutex mutex;
+    /** Serializes flushes, which post without holding mutex. */
+    jaeger_mutex flush_mutex;
+} jaeger_http_reporter;
+
+/**
+ * Initialize an HTTP reporter. Connects lazily on the first flush.
+ * @param reporter Reporter to initialize.
+ * @param collector_url URL to post spans to, or NULL for
+ *                      JAEGERTRACINGC_DEFAULT_HTTP_COLLECTOR_URL.
+ * @param max_request_size Approximate maximum size of a request body, or zero
+ *                         for JAEGERTRACINGC_DEFAULT_HTTP_MAX_REQUEST_SIZE.
+ * @param metrics Metrics to update, or NULL.
+ * @return True on success, false otherwise.
+ */
+bool jaeger_http_reporter_init(jaeger_http_reporter* reporter,
+                               const char* collector_url,
+                               int max_request_size,
+                               jaeger_metrics* metrics);
+
+/**
+ * Compress request bodies before posting them. Compression trades CPU time
+ * on the flushing thread for fewer bytes on the wire. Span batches compress
+ * well because tag keys, service names and operation names repeat. The
+ * compressor is reused across flushes.
+ * @param reporter Reporter to configure.
+ * @param type Compression type, or jaeger_compression_none to send bodies
+ *             uncompressed.
+ * @param level Compression level, or JAEGERTRACINGC_COMPRESSION_DEFAULT_LEVEL.
+ * @return True on success, false if the type is not available or the
+ *         compressor cannot be initialized, in which case bodies are sent
+ *         uncompressed.
+ */
+bool jaeger_http_reporter_set_compression(jaeger_http_reporter* reporter,
+                                          jaeger_compression_type type,
+                                          int level);
+
 #ifdef __cplusplus
 } /* extern C */
 #endif /* __cplusplus */
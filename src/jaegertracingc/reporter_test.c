@@ -19,7 +19,11 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
 
+#include "jaegertracingc/accounting_allocator.h"
+#include "jaegertracingc/mock_collector.h"
 #include "jaegertracingc/span.h"
 #include "jaegertracingc/threading.h"
 #include "jaegertracingc/tracer.h"
@@ -27,13 +31,15 @@
 
 #define MAX_PORT_LEN 5
 
-static inline int start_udp_server()
+/* Binds a UDP socket to port, or to any free port if port is zero. */
+static inline int start_udp_server(in_port_t port)
 {
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
     const int fd = socket(AF_INET, SOCK_DGRAM, 0);
     TEST_ASSERT_GREATER_OR_EQUAL(0, fd);
     addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = port;
     TEST_ASSERT_EQUAL(0, bind(fd, (struct sockaddr*) &addr, sizeof(addr)));
     return fd;
 }
@@ -49,6 +55,398 @@ static void* flush_reporter(void* arg)
     return return_value;
 }
 
+static inline void test_remote_reporter_spill(const jaeger_span* span,
+                                              const char* host_port,
+                                              int* server_fd)
+{
+    char dir[] = "/tmp/jaeger-reporter-spill-XXXXXX";
+    TEST_ASSERT_NOT_NULL(mkdtemp(dir));
+    jaeger_remote_reporter remote_reporter;
+    TEST_ASSERT_TRUE(jaeger_remote_reporter_init(
+        &remote_reporter, host_port, 0, jaeger_null_metrics()));
+    TEST_ASSERT_TRUE(
+        jaeger_remote_reporter_enable_spill(&remote_reporter, dir, 1 << 20));
+    jaeger_reporter* r = (jaeger_reporter*) &remote_reporter;
+    char buffer[JAEGERTRACINGC_DEFAULT_UDP_BUFFER_SIZE];
+
+    /* Resolve the agent address with a successful write first. */
+    r->report(r, span);
+    TEST_ASSERT_TRUE(r->flush(r));
+    TEST_ASSERT_GREATER_THAN(0, recv(*server_fd, buffer, sizeof(buffer), 0));
+
+    /* Writes fail once the agent's port is reported unreachable, so spans
+     * go to disk instead of staying in memory. */
+    close(*server_fd);
+    int num_flushes = 0;
+    do {
+        r->report(r, span);
+        num_flushes++;
+    } while (r->flush(r) && num_flushes < 10);
+    TEST_ASSERT_LESS_THAN(10, num_flushes);
+    TEST_ASSERT_EQUAL(0, jaeger_vector_length(&remote_reporter.spans));
+    TEST_ASSERT_FALSE(jaeger_spill_queue_empty(&remote_reporter.spill));
+
+    /* The spilled batch goes out once the agent is back. */
+    *server_fd = start_udp_server(remote_reporter.addr.sin_port);
+    TEST_ASSERT_TRUE(r->flush(r));
+    TEST_ASSERT_TRUE(jaeger_spill_queue_empty(&remote_reporter.spill));
+    const int num_read = recv(*server_fd, buffer, sizeof(buffer), 0);
+    Jaeger__Model__Batch* batch =
+        jaeger__model__batch__unpack(NULL, num_read, (const uint8_t*) buffer);
+    TEST_ASSERT_NOT_NULL(batch);
+    TEST_ASSERT_EQUAL(1, batch->n_spans);
+    jaeger__model__batch__free_unpacked(batch, NULL);
+    ((jaeger_destructible*) r)->destroy((jaeger_destructible*) r);
+    TEST_ASSERT_EQUAL(0, rmdir(dir));
+}
+
+/* Runs out of reporter budget while a flush splits the buffer, then fails to
+ * send the batch, so the spans that did not fit are dropped and the batch
+ * goes back to the buffer. */
+static inline void test_remote_reporter_budget(const jaeger_span* span,
+                                               const char* host_port)
+{
+    jaeger_accounting_allocator alloc;
+    jaeger_accounting_allocator_init(&alloc, jaeger_get_allocator(), 0);
+    jaeger_allocator* prev_alloc = jaeger_get_allocator();
+    jaeger_set_allocator((jaeger_allocator*) &alloc);
+
+    jaeger_remote_reporter remote_reporter;
+    TEST_ASSERT_TRUE(jaeger_remote_reporter_init(
+        &remote_reporter, host_port, 0, jaeger_null_metrics()));
+    jaeger_reporter* r = (jaeger_reporter*) &remote_reporter;
+    for (int i = 0; i < 10; i++) {
+        r->report(r, span);
+    }
+    Jaeger__Model__Batch batch = JAEGER__MODEL__BATCH__INIT;
+    batch.process = &remote_reporter.process;
+    batch.spans = (Jaeger__Model__Span**) remote_reporter.spans.data;
+    batch.n_spans = 5;
+    remote_reporter.max_packet_size =
+        jaeger__model__batch__get_packed_size(&batch);
+
+    jaeger_alloc_stats stats;
+    jaeger_accounting_allocator_total(&alloc, &stats);
+    alloc.budget = stats.live_bytes;
+    const int fd = remote_reporter.fd;
+    remote_reporter.fd = -1;
+    TEST_ASSERT_FALSE(r->flush(r));
+    TEST_ASSERT_EQUAL(5, jaeger_vector_length(&remote_reporter.spans));
+
+    alloc.budget = 0;
+    close(fd);
+    ((jaeger_destructible*) r)->destroy((jaeger_destructible*) r);
+    /* Every span was freed exactly once. */
+    jaeger_accounting_allocator_stats(&alloc, jaeger_alloc_tag_reporter, &stats);
+    TEST_ASSERT_EQUAL(0, stats.live_allocations);
+    TEST_ASSERT_EQUAL(0, stats.live_bytes);
+    jaeger_set_allocator(prev_alloc);
+}
+
+static inline void test_http_reporter(const jaeger_span* span)
+{
+    mock_collector collector;
+    char url[64];
+    mock_collector_start(&collector, NULL, 0, url, sizeof(url));
+
+    jaeger_http_reporter http_reporter;
+    TEST_ASSERT_TRUE(jaeger_http_reporter_init(
+        &http_reporter, url, 0, jaeger_null_metrics()));
+    TEST_ASSERT_EQUAL(JAEGERTRACINGC_DEFAULT_HTTP_MAX_REQUEST_SIZE,
+                      http_reporter.max_request_size);
+    jaeger_reporter* r = (jaeger_reporter*) &http_reporter;
+    for (int i = 0; i < 10; i++) {
+        r->report(r, span);
+    }
+    TEST_ASSERT_TRUE(r->flush(r));
+    TEST_ASSERT_EQUAL(0, jaeger_vector_length(&http_reporter.spans));
+    r->report(r, span);
+    TEST_ASSERT_TRUE(r->flush(r));
+    /* Nothing left to send. */
+    TEST_ASSERT_TRUE(r->flush(r));
+    /* Falls back to uncompressed bodies if gzip is not available. */
+    const bool has_gzip = jaeger_compression_available(jaeger_compression_gzip);
+    TEST_ASSERT_EQUAL(has_gzip,
+                      jaeger_http_reporter_set_compression(
+                          &http_reporter,
+                          jaeger_compression_gzip,
+                          JAEGERTRACINGC_COMPRESSION_DEFAULT_LEVEL));
+    r->report(r, span);
+    TEST_ASSERT_TRUE(r->flush(r));
+    ((jaeger_destructible*) r)->destroy((jaeger_destructible*) r);
+
+    mock_collector_stop(&collector);
+    /* All requests share one keep-alive connection. */
+    TEST_ASSERT_EQUAL(1, collector.num_connections);
+    TEST_ASSERT_EQUAL(3, collector.num_requests);
+    TEST_ASSERT_EQUAL_STRING(has_gzip ? "gzip" : "",
+                             collector.content_encoding);
+
+    /* Spans stay buffered while the collector is down. */
+    TEST_ASSERT_TRUE(jaeger_http_reporter_init(
+        &http_reporter, url, 0, jaeger_null_metrics()));
+    r->report(r, span);
+    TEST_ASSERT_FALSE(r->flush(r));
+    TEST_ASSERT_EQUAL(1, jaeger_vector_length(&http_reporter.spans));
+    ((jaeger_destructible*) r)->destroy((jaeger_destructible*) r);
+}
+
+static inline void test_http_reporter_errors(const jaeger_span* span)
+{
+    /* Client errors drop the batch, server errors keep it for the next
+     * flush, and a reset keep-alive connection is replaced and the request
+     * retried at once. */
+    const int status_codes[] = {400, 503, 200, 200, MOCK_COLLECTOR_RESET, 200};
+    mock_collector collector;
+    char url[64];
+    mock_collector_start(&collector,
+                         status_codes,
+                         sizeof(status_codes) / sizeof(status_codes[0]),
+                         url,
+                         sizeof(url));
+
+    jaeger_http_reporter http_reporter;
+    TEST_ASSERT_TRUE(jaeger_http_reporter_init(
+        &http_reporter, url, 0, jaeger_null_metrics()));
+    jaeger_reporter* r = (jaeger_reporter*) &http_reporter;
+    r->report(r, span);
+    r->report(r, span);
+    TEST_ASSERT_FALSE(r->flush(r));
+    TEST_ASSERT_EQUAL(0, jaeger_vector_length(&http_reporter.spans));
+    /* Nothing was kept to retry. */
+    TEST_ASSERT_TRUE(r->flush(r));
+
+    r->report(r, span);
+    TEST_ASSERT_FALSE(r->flush(r));
+    TEST_ASSERT_EQUAL(1, jaeger_vector_length(&http_reporter.spans));
+    r->report(r, span);
+    TEST_ASSERT_TRUE(r->flush(r));
+    TEST_ASSERT_EQUAL(0, jaeger_vector_length(&http_reporter.spans));
+
+    r->report(r, span);
+    TEST_ASSERT_TRUE(r->flush(r));
+    r->report(r, span);
+    TEST_ASSERT_TRUE(r->flush(r));
+    TEST_ASSERT_EQUAL(0, jaeger_vector_length(&http_reporter.spans));
+    ((jaeger_destructible*) r)->destroy((jaeger_destructible*) r);
+
+    mock_collector_stop(&collector);
+    TEST_ASSERT_EQUAL(6, collector.num_requests);
+    /* One connection closed after the server error and one replaced the
+     * reset connection. */
+    TEST_ASSERT_EQUAL(3, collector.num_connections);
+    TEST_ASSERT_EQUAL_STRING("", collector.content_encoding);
+}
+
+static inline int start_unix_server(const char* path, int socket_type)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    const int fd = socket(AF_UNIX, socket_type, 0);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, fd);
+    TEST_ASSERT_EQUAL(0, bind(fd, (struct sockaddr*) &addr, sizeof(addr)));
+    return fd;
+}
+
+static inline void recv_batch(int fd, int num_spans)
+{
+    uint8_t buffer[JAEGERTRACINGC_DEFAULT_UNIX_BUFFER_SIZE];
+    const int num_read = recv(fd, buffer, sizeof(buffer), 0);
+    TEST_ASSERT_GREATER_THAN(0, num_read);
+    Jaeger__Model__Batch* batch =
+        jaeger__model__batch__unpack(NULL, num_read, buffer);
+    TEST_ASSERT_NOT_NULL(batch);
+    TEST_ASSERT_EQUAL(num_spans, batch->n_spans);
+    jaeger__model__batch__free_unpacked(batch, NULL);
+}
+
+static inline void test_unix_reporter(const jaeger_span* span)
+{
+    char dir[] = "/tmp/jaeger-reporter-unix-XXXXXX";
+    TEST_ASSERT_NOT_NULL(mkdtemp(dir));
+    char path[sizeof(dir) + 16];
+    snprintf(path, sizeof(path), "%s/agent.sock", dir);
+    char address[sizeof(path) + 16];
+    snprintf(address,
+             sizeof(address),
+             "%s%s",
+             JAEGERTRACINGC_UNIX_DGRAM_SCHEME,
+             path);
+
+    int server_fd = start_unix_server(path, SOCK_DGRAM);
+    jaeger_remote_reporter remote_reporter;
+    TEST_ASSERT_TRUE(jaeger_remote_reporter_init(
+        &remote_reporter, address, 0, jaeger_null_metrics()));
+    TEST_ASSERT_EQUAL(JAEGERTRACINGC_DEFAULT_UNIX_BUFFER_SIZE,
+                      remote_reporter.max_packet_size);
+    jaeger_reporter* r = (jaeger_reporter*) &remote_reporter;
+    for (int i = 0; i < 10; i++) {
+        r->report(r, span);
+    }
+    TEST_ASSERT_TRUE(r->flush(r));
+    recv_batch(server_fd, 10);
+
+    /* Spans stay buffered while the agent is down, and go out once it binds
+     * its socket again. */
+    close(server_fd);
+    unlink(path);
+    r->report(r, span);
+    TEST_ASSERT_FALSE(r->flush(r));
+    TEST_ASSERT_FALSE(remote_reporter.unix_connected);
+    server_fd = start_unix_server(path, SOCK_DGRAM);
+    r->report(r, span);
+    TEST_ASSERT_TRUE(r->flush(r));
+    TEST_ASSERT_TRUE(remote_reporter.unix_connected);
+    recv_batch(server_fd, 2);
+    ((jaeger_destructible*) r)->destroy((jaeger_destructible*) r);
+    close(server_fd);
+    unlink(path);
+
+    /* An agent that stops reading fills its queue, and flushes fail rather
+     * than block, keeping the spans. */
+    server_fd = start_unix_server(path, SOCK_DGRAM);
+    TEST_ASSERT_TRUE(jaeger_remote_reporter_init(
+        &remote_reporter, address, 0, jaeger_null_metrics()));
+    int num_flushed = 0;
+    while (num_flushed < 1000) {
+        r->report(r, span);
+        if (!r->flush(r)) {
+            break;
+        }
+        num_flushed++;
+    }
+    TEST_ASSERT_LESS_THAN(1000, num_flushed);
+    TEST_ASSERT_TRUE(remote_reporter.unix_connected);
+    TEST_ASSERT_EQUAL(1, jaeger_vector_length(&remote_reporter.spans));
+    recv_batch(server_fd, 1);
+    TEST_ASSERT_TRUE(r->flush(r));
+    TEST_ASSERT_EQUAL(0, jaeger_vector_length(&remote_reporter.spans));
+    ((jaeger_destructible*) r)->destroy((jaeger_destructible*) r);
+    close(server_fd);
+    unlink(path);
+
+    snprintf(address,
+             sizeof(address),
+             "%s%s",
+             JAEGERTRACINGC_UNIX_SEQPACKET_SCHEME,
+             path);
+    server_fd = start_unix_server(path, SOCK_SEQPACKET);
+    TEST_ASSERT_EQUAL(0, listen(server_fd, 1));
+    TEST_ASSERT_TRUE(jaeger_remote_reporter_init(
+        &remote_reporter, address, 0, jaeger_null_metrics()));
+    r->report(r, span);
+    TEST_ASSERT_TRUE(r->flush(r));
+    const int conn_fd = accept(server_fd, NULL, NULL);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, conn_fd);
+    recv_batch(conn_fd, 1);
+    ((jaeger_destructible*) r)->destroy((jaeger_destructible*) r);
+    close(conn_fd);
+    close(server_fd);
+    unlink(path);
+
+    /* Path does not fit in sockaddr_un. */
+    char long_address[sizeof(struct sockaddr_un) + 16];
+    const int prefix_len = strlen(JAEGERTRACINGC_UNIX_DGRAM_SCHEME);
+    memcpy(long_address, JAEGERTRACINGC_UNIX_DGRAM_SCHEME, prefix_len);
+    memset(&long_address[prefix_len], 'a', sizeof(long_address) - prefix_len);
+    long_address[sizeof(long_address) - 1] = '\0';
+    TEST_ASSERT_FALSE(jaeger_remote_reporter_init(
+        &remote_reporter, long_address, 0, jaeger_null_metrics()));
+
+    rmdir(dir);
+}
+
+static inline void test_shm_reporter(const jaeger_span* span)
+{
+#ifdef JAEGERTRACINGC_HAVE_ATOMICS
+    char name[64];
+    snprintf(name, sizeof(name), "/jaeger-reporter-test-%d", (int) getpid());
+    char address[sizeof(name) + 16];
+    snprintf(address,
+             sizeof(address),
+             "%s%s",
+             JAEGERTRACINGC_SHM_SCHEME,
+             name);
+
+    jaeger_metrics metrics;
+    TEST_ASSERT_TRUE(jaeger_default_metrics_init(&metrics));
+    jaeger_remote_reporter remote_reporter;
+    TEST_ASSERT_TRUE(
+        jaeger_remote_reporter_init(&remote_reporter, address, 0, &metrics));
+    TEST_ASSERT_EQUAL(JAEGERTRACINGC_DEFAULT_SHM_BUFFER_SIZE,
+                      remote_reporter.max_packet_size);
+    TEST_ASSERT_LESS_THAN(0, remote_reporter.fd);
+    jaeger_reporter* r = (jaeger_reporter*) &remote_reporter;
+    /* Spans stay buffered until the agent creates its ring. */
+    r->report(r, span);
+    TEST_ASSERT_FALSE(r->flush(r));
+
+    jaeger_shm_ring agent_ring;
+    TEST_ASSERT_TRUE(jaeger_shm_ring_create(
+        &agent_ring, name, JAEGERTRACINGC_SHM_RING_DEFAULT_CAPACITY));
+    for (int i = 0; i < 9; i++) {
+        r->report(r, span);
+    }
+    TEST_ASSERT_TRUE(r->flush(r));
+    TEST_ASSERT_TRUE(jaeger_shm_ring_wait(&agent_ring, 0));
+    const uint8_t* data = NULL;
+    size_t len = 0;
+    TEST_ASSERT_TRUE(jaeger_shm_ring_peek(&agent_ring, &data, &len));
+    Jaeger__Model__Batch* batch = jaeger__model__batch__unpack(NULL, len, data);
+    TEST_ASSERT_NOT_NULL(batch);
+    TEST_ASSERT_EQUAL(10, batch->n_spans);
+    jaeger__model__batch__free_unpacked(batch, NULL);
+    jaeger_shm_ring_pop(&agent_ring);
+    TEST_ASSERT_FALSE(jaeger_shm_ring_peek(&agent_ring, &data, &len));
+
+    /* Reopens the ring once the agent restarts. */
+    jaeger_shm_ring_destroy(&agent_ring);
+    r->report(r, span);
+    TEST_ASSERT_FALSE(r->flush(r));
+    TEST_ASSERT_TRUE(jaeger_shm_ring_create(
+        &agent_ring, name, JAEGERTRACINGC_SHM_RING_DEFAULT_CAPACITY));
+    TEST_ASSERT_TRUE(r->flush(r));
+    TEST_ASSERT_TRUE(jaeger_shm_ring_peek(&agent_ring, &data, &len));
+    jaeger_shm_ring_pop(&agent_ring);
+
+    /* Batches shrink to fit a small ring. Batches that do not fit in a full
+     * ring are dropped, and the ring stays open. */
+    jaeger_shm_ring_destroy(&agent_ring);
+    TEST_ASSERT_TRUE(jaeger_shm_ring_create(&agent_ring, name, 0));
+    r->report(r, span);
+    TEST_ASSERT_FALSE(r->flush(r));
+    TEST_ASSERT_TRUE(r->flush(r));
+    TEST_ASSERT_EQUAL(jaeger_shm_ring_max_record_size(&agent_ring),
+                      remote_reporter.max_packet_size);
+    const struct jaeger_shm_ring_header* ring_header =
+        remote_reporter.shm_ring.header;
+    int num_flushed = 0;
+    do {
+        r->report(r, span);
+        num_flushed++;
+    } while (r->flush(r) && num_flushed < 1000);
+    TEST_ASSERT_LESS_THAN(1000, num_flushed);
+    TEST_ASSERT_EQUAL(0, jaeger_vector_length(&remote_reporter.spans));
+    TEST_ASSERT_EQUAL_PTR(ring_header, remote_reporter.shm_ring.header);
+    TEST_ASSERT_EQUAL(1, jaeger_shm_ring_num_dropped(&agent_ring));
+    TEST_ASSERT_EQUAL(1,
+                      jaeger_striped_counter_total(
+                          (jaeger_striped_counter*) metrics.reporter_dropped));
+    while (jaeger_shm_ring_peek(&agent_ring, &data, &len)) {
+        jaeger_shm_ring_pop(&agent_ring);
+    }
+    r->report(r, span);
+    TEST_ASSERT_TRUE(r->flush(r));
+    ((jaeger_destructible*) r)->destroy((jaeger_destructible*) r);
+    jaeger_shm_ring_destroy(&agent_ring);
+    jaeger_metrics_destroy(&metrics);
+#else
+    (void) span;
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+}
+
 void test_reporter()
 {
     jaeger_const_sampler const_sampler;
@@ -142,7 +540,7 @@ void test_reporter()
     TEST_ASSERT_FALSE(jaeger_composite_reporter_init(&composite_reporter));
     jaeger_set_allocator(jaeger_built_in_allocator());
 
-    const int server_fd = start_udp_server();
+    int server_fd = start_udp_server(0);
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
     socklen_t addr_len = sizeof(addr);
@@ -197,7 +595,17 @@ void test_reporter()
     jaeger_free(success);
     ((jaeger_destructible*) r)->destroy((jaeger_destructible*) r);
 
+    test_remote_reporter_spill(&span, host_port, &server_fd);
+    test_remote_reporter_budget(&span, host_port);
     close(server_fd);
+
+    test_unix_reporter(&span);
+
+    test_shm_reporter(&span);
+
+    test_http_reporter(&span);
+    test_http_reporter_errors(&span);
+
     jaeger_span_destroy((jaeger_destructible*) &span);
 
     jaeger_tracer_destroy((jaeger_destructible*) &tracer);
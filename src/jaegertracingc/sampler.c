@@ -20,6 +20,8 @@
 #include <errno.h>
 #include <jansson.h>
 
+#include "jaegertracingc/accounting_allocator.h"
+#include "jaegertracingc/log_limiter.h"
 #include "jaegertracingc/random.h"
 
 #define HTTP_OK 200
@@ -341,83 +343,75 @@ jaeger_adaptive_sampler_find_sampler(jaeger_adaptive_sampler* sampler,
     return result;
 }
 
-static bool jaeger_adaptive_sampler_is_sampled(jaeger_sampler* sampler,
-                                               const jaeger_trace_id* trace_id,
-                                               const char* operation_name,
-                                               jaeger_vector* tags)
+static inline jaeger_operation_sampler*
+jaeger_adaptive_sampler_add_sampler(jaeger_adaptive_sampler* sampler,
+                                    const char* operation_name)
 {
-    (void) trace_id;
-    (void) operation_name;
-    assert(sampler != NULL);
-    jaeger_adaptive_sampler* s = (jaeger_adaptive_sampler*) sampler;
-    jaeger_mutex_lock(&s->mutex);
-    jaeger_operation_sampler* op_sampler =
-        jaeger_adaptive_sampler_find_sampler(s, operation_name);
-    if (op_sampler != NULL) {
-        assert(strcmp(op_sampler->operation_name, operation_name) == 0);
-        jaeger_guaranteed_throughput_probabilistic_sampler* g =
-            &op_sampler->sampler;
-        const bool decision =
-            ((jaeger_sampler*) g)
-                ->is_sampled(
-                    (jaeger_sampler*) g, trace_id, operation_name, tags);
-        jaeger_mutex_unlock(&s->mutex);
-        return decision;
-    }
-
-    if (jaeger_vector_length(&s->op_samplers) >= s->max_operations) {
-        goto use_default_sampler;
+    if (jaeger_vector_length(&sampler->op_samplers) >=
+        sampler->max_operations) {
+        return NULL;
     }
-
     char* operation_name_copy = jaeger_strdup(operation_name);
     if (operation_name_copy == NULL) {
-        goto use_default_sampler;
+        return NULL;
     }
     const jaeger_operation_sampler key = {.operation_name =
                                               operation_name_copy};
     const int pos =
-        jaeger_vector_lower_bound(&s->op_samplers, &key, &op_name_cmp);
-    jaeger_operation_sampler* op_sampler_ptr =
-        jaeger_vector_insert(&s->op_samplers, pos);
-    if (op_sampler_ptr == NULL) {
-        goto use_default_sampler;
+        jaeger_vector_lower_bound(&sampler->op_samplers, &key, &op_name_cmp);
+    jaeger_operation_sampler* op_sampler =
+        jaeger_vector_insert(&sampler->op_samplers, pos);
+    if (op_sampler == NULL) {
+        jaeger_free(operation_name_copy);
+        return NULL;
     }
-    op_sampler_ptr->operation_name = operation_name_copy;
+    op_sampler->operation_name = operation_name_copy;
     jaeger_guaranteed_throughput_probabilistic_sampler_init(
-        &op_sampler_ptr->sampler,
-        s->lower_bound,
-        s->default_sampler.sampling_rate);
+        &op_sampler->sampler,
+        sampler->lower_bound,
+        sampler->default_sampler.sampling_rate);
+    return op_sampler;
+}
 
-    const bool decision =
-        ((jaeger_sampler*) &op_sampler_ptr->sampler)
-            ->is_sampled((jaeger_sampler*) &op_sampler_ptr->sampler,
-                         trace_id,
-                         operation_name,
-                         tags);
-    jaeger_mutex_unlock(&s->mutex);
-    return decision;
+static bool jaeger_adaptive_sampler_is_sampled(jaeger_sampler* sampler,
+                                               const jaeger_trace_id* trace_id,
+                                               const char* operation_name,
+                                               jaeger_vector* tags)
+{
+    assert(sampler != NULL);
+    jaeger_adaptive_sampler* s = (jaeger_adaptive_sampler*) sampler;
+    jaeger_mutex_lock(&s->mutex);
+    /* Tags belong to the span, so only the lookup switches allocators. */
+    jaeger_allocator* prev_alloc = jaeger_set_thread_allocator(s->allocator);
+    jaeger_operation_sampler* op_sampler =
+        jaeger_adaptive_sampler_find_sampler(s, operation_name);
+    if (op_sampler == NULL) {
+        op_sampler = jaeger_adaptive_sampler_add_sampler(s, operation_name);
+    }
+    jaeger_set_thread_allocator(prev_alloc);
 
-use_default_sampler : {
+    jaeger_sampler* inner_sampler =
+        (op_sampler != NULL) ? (jaeger_sampler*) &op_sampler->sampler
+                             : (jaeger_sampler*) &s->default_sampler;
+    assert(op_sampler == NULL ||
+           strcmp(op_sampler->operation_name, operation_name) == 0);
     const bool decision =
-        ((jaeger_sampler*) &s->default_sampler)
-            ->is_sampled((jaeger_sampler*) &s->default_sampler,
-                         trace_id,
-                         operation_name,
-                         tags);
+        inner_sampler->is_sampled(inner_sampler, trace_id, operation_name, tags);
     jaeger_mutex_unlock(&s->mutex);
     return decision;
 }
-}
 
 static void jaeger_adaptive_sampler_destroy(jaeger_destructible* sampler)
 {
     assert(sampler != NULL);
     jaeger_adaptive_sampler* s = (jaeger_adaptive_sampler*) sampler;
+    jaeger_allocator* prev_alloc = jaeger_set_thread_allocator(s->allocator);
     JAEGERTRACINGC_VECTOR_FOR_EACH(&s->op_samplers,
                                    jaeger_operation_sampler_destroy,
                                    jaeger_operation_sampler);
     jaeger_vector_destroy(&s->op_samplers);
     jaeger_mutex_destroy(&s->mutex);
+    jaeger_set_thread_allocator(prev_alloc);
 }
 
 bool jaeger_adaptive_sampler_init(
@@ -439,6 +433,7 @@ bool jaeger_adaptive_sampler_init(
     sampler->lower_bound = strategies->default_lower_bound_traces_per_second;
     sampler->max_operations = max_operations;
     sampler->mutex = (jaeger_mutex) JAEGERTRACINGC_MUTEX_INIT;
+    sampler->allocator = jaeger_get_allocator();
     ((jaeger_sampler*) sampler)->is_sampled =
         &jaeger_adaptive_sampler_is_sampled;
     ((jaeger_destructible*) sampler)->destroy =
@@ -456,6 +451,8 @@ jaeger_adaptive_sampler_update(jaeger_adaptive_sampler* sampler,
     const double lower_bound =
         strategies->default_lower_bound_traces_per_second;
     jaeger_mutex_lock(&sampler->mutex);
+    jaeger_allocator* prev_alloc =
+        jaeger_set_thread_allocator(sampler->allocator);
     for (int i = 0; i < (int) strategies->n_per_operation_strategy; i++) {
         const jaeger_operation_strategy* strategy =
             &strategies->per_operation_strategy[i];
@@ -494,15 +491,18 @@ jaeger_adaptive_sampler_update(jaeger_adaptive_sampler* sampler,
             jaeger_operation_sampler* op_sampler_ptr =
                 jaeger_vector_insert(&sampler->op_samplers, pos);
             if (op_sampler_ptr == NULL) {
+                jaeger_free(operation_name);
                 success = false;
                 continue;
             }
+            op_sampler_ptr->operation_name = operation_name;
             jaeger_guaranteed_throughput_probabilistic_sampler_init(
                 &op_sampler_ptr->sampler,
                 lower_bound,
                 strategy->probabilistic.sampling_rate);
         }
     }
+    jaeger_set_thread_allocator(prev_alloc);
     jaeger_mutex_unlock(&sampler->mutex);
     return success;
 }
@@ -585,9 +585,10 @@ jaeger_http_sampling_manager_parser_on_headers_complete(http_parser* parser)
     assert(parser != NULL);
     assert(parser->data != NULL);
     if (parser->status_code != HTTP_OK) {
-        jaeger_log_error("HTTP sampling manager cannot retrieve sampling "
-                         "strategies, HTTP status code = %d",
-                         parser->status_code);
+        JAEGERTRACINGC_LOG_ERROR_LIMITED(
+            "HTTP sampling manager cannot retrieve sampling "
+            "strategies, HTTP status code = %d",
+            parser->status_code);
         return 1;
     }
     return 0;
@@ -647,8 +648,9 @@ jaeger_http_sampling_manager_connect(jaeger_http_sampling_manager* manager,
         close(fd);
     }
     if (!success) {
-        jaeger_log_error("Cannot connect to sampling server URL, URL = \"%s\"",
-                         manager->sampling_server_url.str);
+        JAEGERTRACINGC_LOG_ERROR_LIMITED(
+            "Cannot connect to sampling server URL, URL = \"%s\"",
+            manager->sampling_server_url.str);
     }
     freeaddrinfo(host_addrs);
     return success;
@@ -975,11 +977,12 @@ static inline bool jaeger_http_sampling_manager_get_sampling_strategies(
     const int num_written = write(
         manager->fd, &manager->request_buffer[0], manager->request_length);
     if (num_written != manager->request_length) {
-        jaeger_log_error("Cannot write entire HTTP sampling request, "
-                         "num written = %d, request length = %d, errno = %d",
-                         num_written,
-                         manager->request_length,
-                         errno);
+        JAEGERTRACINGC_LOG_ERROR_LIMITED(
+            "Cannot write entire HTTP sampling request, "
+            "num written = %d, request length = %d, errno = %d",
+            num_written,
+            manager->request_length,
+            errno);
         return false;
     }
 
@@ -1062,10 +1065,12 @@ jaeger_remotely_controlled_sampler_destroy(jaeger_destructible* sampler)
 {
     jaeger_remotely_controlled_sampler* s =
         (jaeger_remotely_controlled_sampler*) sampler;
+    jaeger_allocator* prev_alloc = jaeger_set_thread_allocator(s->allocator);
     jaeger_sampler_choice* sampler_choice = &s->sampler;
     jaeger_sampler_choice_destroy(sampler_choice);
     jaeger_http_sampling_manager_destroy(&s->manager);
     jaeger_mutex_destroy(&s->mutex);
+    jaeger_set_thread_allocator(prev_alloc);
 }
 
 static inline bool jaeger_remotely_controlled_sampler_update_adaptive_sampler(
@@ -1089,17 +1094,33 @@ bool jaeger_remotely_controlled_sampler_update(
     jaeger_remotely_controlled_sampler* sampler)
 {
     assert(sampler != NULL);
+    /* Updates usually run on a background thread, but whichever thread runs
+     * them, new samplers must last as long as this one. */
+    jaeger_allocator* prev_alloc =
+        jaeger_set_thread_allocator(sampler->allocator);
+    const jaeger_alloc_tag prev_tag =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_sampler);
     jaeger_strategy_response response = {.strategy = {}};
+    const int64_t start = jaeger_duration_now_ns();
     const bool result = jaeger_http_sampling_manager_get_sampling_strategies(
         &sampler->manager, &response);
+    if (sampler->metrics != NULL) {
+        jaeger_histogram* query_latency =
+            sampler->metrics->sampler_query_latency;
+        assert(query_latency != NULL);
+        query_latency->record(query_latency, jaeger_duration_now_ns() - start);
+    }
     if (!result) {
-        jaeger_log_error("Cannot get sampling strategies, will retry later");
+        JAEGERTRACINGC_LOG_ERROR_LIMITED(
+            "Cannot get sampling strategies, will retry later");
         if (sampler->metrics != NULL) {
             jaeger_counter* query_failure =
                 sampler->metrics->sampler_query_failure;
             assert(query_failure != NULL);
             query_failure->inc(query_failure, 1);
         }
+        jaeger_alloc_context_exit(prev_tag);
+        jaeger_set_thread_allocator(prev_alloc);
         return false;
     }
 
@@ -1158,6 +1179,8 @@ bool jaeger_remotely_controlled_sampler_update(
 
     jaeger_mutex_unlock(&sampler->mutex);
     jaeger_strategy_response_destroy(&response);
+    jaeger_alloc_context_exit(prev_tag);
+    jaeger_set_thread_allocator(prev_alloc);
     return success;
 }
 
@@ -1180,7 +1203,8 @@ bool jaeger_remotely_controlled_sampler_init(
         max_operations,
         metrics,
         JAEGERTRACINGC_HTTP_SAMPLING_MANAGER_INIT,
-        JAEGERTRACINGC_MUTEX_INIT};
+        JAEGERTRACINGC_MUTEX_INIT,
+        jaeger_get_allocator()};
 
     if (initial_sampler != NULL) {
         sampler->sampler = *initial_sampler;
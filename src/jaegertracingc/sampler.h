@@ -101,6 +101,10 @@ typedef struct jaeger_adaptive_sampler {
     double lower_bound;
     int max_operations;
     jaeger_mutex mutex;
+    /** Allocator the sampler was initialized with. Operation samplers outlive
+     *  the spans that add them, so they never come from the allocator bound
+     *  to the sampling thread. */
+    jaeger_allocator* allocator;
 } jaeger_adaptive_sampler;
 
 bool jaeger_adaptive_sampler_init(
@@ -168,6 +172,9 @@ typedef struct jaeger_remotely_controlled_sampler {
     jaeger_metrics* metrics;
     jaeger_http_sampling_manager manager;
     jaeger_mutex mutex;
+    /** Allocator the sampler was initialized with, used for updates
+     *  whatever thread runs them. */
+    jaeger_allocator* allocator;
 } jaeger_remotely_controlled_sampler;
 
 bool jaeger_remotely_controlled_sampler_init(
@@ -256,6 +256,96 @@ static inline void test_adaptive_sampler()
     TEAR_DOWN_SAMPLER_TEST(a);
 }
 
+#define TEST_ARENA_BLOCKS 1024
+
+/* Bump allocator standing in for a request-scoped arena. Resetting it
+ * poisons everything it handed out, like reusing the arena would. */
+typedef struct test_arena {
+    jaeger_allocator base;
+    size_t used;
+    max_align_t memory[TEST_ARENA_BLOCKS];
+} test_arena;
+
+static void* test_arena_malloc(jaeger_allocator* alloc, size_t sz)
+{
+    test_arena* arena = (test_arena*) alloc;
+    /* Keeps the size ahead of each block for realloc. */
+    const size_t num_blocks =
+        (sz + sizeof(max_align_t) - 1) / sizeof(max_align_t) + 1;
+    if (num_blocks > TEST_ARENA_BLOCKS - arena->used) {
+        return NULL;
+    }
+    max_align_t* block = &arena->memory[arena->used];
+    arena->used += num_blocks;
+    *(size_t*) block = sz;
+    return block + 1;
+}
+
+static void* test_arena_realloc(jaeger_allocator* alloc, void* ptr, size_t sz)
+{
+    void* new_ptr = test_arena_malloc(alloc, sz);
+    if (new_ptr != NULL && ptr != NULL) {
+        const size_t old_size = *(const size_t*) ((max_align_t*) ptr - 1);
+        memcpy(new_ptr, ptr, (old_size < sz) ? old_size : sz);
+    }
+    return new_ptr;
+}
+
+static void test_arena_free(jaeger_allocator* alloc, void* ptr)
+{
+    (void) alloc;
+    (void) ptr;
+}
+
+static inline void test_arena_reset(test_arena* arena)
+{
+    memset(arena->memory, 0xdd, sizeof(arena->memory));
+    arena->used = 0;
+}
+
+static inline void test_adaptive_sampler_arena()
+{
+    test_arena arena = {.base = {.malloc = &test_arena_malloc,
+                                 .realloc = &test_arena_realloc,
+                                 .free = &test_arena_free,
+                                 .free_sized = NULL},
+                        .used = 0};
+    jaeger_adaptive_sampler a;
+    jaeger_per_operation_strategy strategies =
+        JAEGERTRACINGC_PER_OPERATION_STRATEGY_INIT;
+    strategies.default_sampling_probability = 1;
+    TEST_ASSERT_TRUE(jaeger_adaptive_sampler_init(
+        &a, &strategies, TEST_DEFAULT_MAX_OPERATIONS));
+
+    /* Sample new operations on a thread bound to a request arena. */
+    const jaeger_trace_id trace_id = JAEGERTRACINGC_TRACE_ID_INIT;
+    jaeger_allocator* prev_alloc =
+        jaeger_set_thread_allocator((jaeger_allocator*) &arena);
+    jaeger_vector tags;
+    TEST_ASSERT_TRUE(jaeger_vector_init(&tags, sizeof(jaeger_tag)));
+    TEST_ASSERT_TRUE(((jaeger_sampler*) &a)
+                         ->is_sampled((jaeger_sampler*) &a,
+                                      &trace_id,
+                                      "first-operation",
+                                      &tags));
+    TEST_ASSERT_EQUAL(2, jaeger_vector_length(&tags));
+    TEST_ASSERT_EQUAL(1, jaeger_vector_length(&a.op_samplers));
+    test_arena_reset(&arena);
+
+    TEST_ASSERT_TRUE(
+        ((jaeger_sampler*) &a)
+            ->is_sampled(
+                (jaeger_sampler*) &a, &trace_id, "second-operation", NULL));
+    jaeger_set_thread_allocator(prev_alloc);
+    TEST_ASSERT_EQUAL(2, jaeger_vector_length(&a.op_samplers));
+    const jaeger_operation_sampler* op_sampler =
+        jaeger_vector_get(&a.op_samplers, 0);
+    TEST_ASSERT_EQUAL_STRING("first-operation", op_sampler->operation_name);
+    op_sampler = jaeger_vector_get(&a.op_samplers, 1);
+    TEST_ASSERT_EQUAL_STRING("second-operation", op_sampler->operation_name);
+    ((jaeger_destructible*) &a)->destroy((jaeger_destructible*) &a);
+}
+
 static inline void test_remotely_controlled_sampler()
 {
     jaeger_metrics* metrics = jaeger_null_metrics();
@@ -405,6 +495,7 @@ void test_sampler()
     RUN_TEST(test_rate_limiting_sampler);
     RUN_TEST(test_guaranteed_throughput_probabilistic_sampler);
     RUN_TEST(test_adaptive_sampler);
+    RUN_TEST(test_adaptive_sampler_arena);
     RUN_TEST(test_remotely_controlled_sampler);
     RUN_TEST(test_sampler_choice);
 }
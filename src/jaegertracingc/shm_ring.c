@@ -0,0 +1,506 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jaegertracingc/shm_ring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_FUTEX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif /* HAVE_FUTEX */
+
+#include "jaegertracingc/alloc.h"
+#include "jaegertracingc/clock.h"
+#include "jaegertracingc/log_limiter.h"
+#include "jaegertracingc/logging.h"
+
+#define SHM_RING_MAGIC 0x4a524e47
+#define SHM_RING_VERSION 2
+#define MIN_CAPACITY 4096
+#define CACHE_LINE_SIZE 64
+
+/* Readers and writers may be built separately, so the layout only uses fixed
+ * size fields. Fields written by writers and by the reader are kept on
+ * separate cache lines. The magic is written last, so writers do not open a
+ * ring that is not ready. */
+struct jaeger_shm_ring_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint32_t closed;
+    uint8_t padding0[CACHE_LINE_SIZE - 20];
+    /* Number of bytes writers have reserved. */
+    uint64_t head;
+    int64_t num_dropped;
+    uint8_t padding1[CACHE_LINE_SIZE - 16];
+    /* Number of bytes the reader has consumed. */
+    uint64_t tail;
+    uint32_t doorbell;
+    uint32_t reader_waiting;
+    uint8_t padding2[CACHE_LINE_SIZE - 16];
+};
+
+/* Precedes every record. The reader zeroes records as it consumes them, so
+ * a writer's reserved space reads as uncommitted until the writer sets the
+ * state. Writers describe a record as reserved before copying it, so the
+ * reader knows how much to skip if the writer dies. Records that would
+ * straddle the end of the data are preceded by a padding record filling
+ * the rest of the data, and skipped records become padding. */
+typedef struct record_header {
+    uint32_t len;
+    uint32_t state;
+} record_header;
+
+#define RECORD_COMMITTED 1
+#define RECORD_PADDING 2
+#define RECORD_RESERVED 4
+
+#ifdef JAEGERTRACINGC_HAVE_ATOMICS
+
+#define LOAD(x, order) __atomic_load_n(&(x), (order))
+#define STORE(x, value, order) __atomic_store_n(&(x), (value), (order))
+#define ADD(x, delta) __atomic_add_fetch(&(x), (delta), __ATOMIC_RELAXED)
+#define COMPARE_EXCHANGE(x, expected, desired)    \
+    __atomic_compare_exchange_n(&(x),             \
+                                (expected),       \
+                                (desired),        \
+                                true,             \
+                                __ATOMIC_RELAXED, \
+                                __ATOMIC_RELAXED)
+#define COMPARE_EXCHANGE_STATE(x, expected, desired) \
+    __atomic_compare_exchange_n(&(x),                \
+                                (expected),          \
+                                (desired),           \
+                                false,               \
+                                __ATOMIC_SEQ_CST,    \
+                                __ATOMIC_SEQ_CST)
+
+#else
+
+/* Unreachable, since rings cannot be created or opened without atomics. */
+#define LOAD(x, order) (x)
+#define STORE(x, value, order) ((x) = (value))
+#define ADD(x, delta) ((x) += (delta))
+
+static inline bool
+compare_exchange(uint64_t* x, uint64_t* expected, uint64_t desired)
+{
+    if (*x == *expected) {
+        *x = desired;
+        return true;
+    }
+    *expected = *x;
+    return false;
+}
+
+#define COMPARE_EXCHANGE(x, expected, desired) \
+    compare_exchange(&(x), (expected), (desired))
+
+static inline bool
+compare_exchange_state(uint32_t* x, uint32_t* expected, uint32_t desired)
+{
+    if (*x == *expected) {
+        *x = desired;
+        return true;
+    }
+    *expected = *x;
+    return false;
+}
+
+#define COMPARE_EXCHANGE_STATE(x, expected, desired) \
+    compare_exchange_state(&(x), (expected), (desired))
+
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+
+static inline size_t record_size(size_t len)
+{
+    const size_t align = sizeof(record_header);
+    return sizeof(record_header) + (len + align - 1) / align * align;
+}
+
+static inline record_header* record_at(const jaeger_shm_ring* ring,
+                                       uint64_t position)
+{
+    const uint64_t offset = position & (ring->header->capacity - 1);
+    return (record_header*) &ring->data[offset];
+}
+
+static inline bool check_atomics(void)
+{
+#ifdef JAEGERTRACINGC_HAVE_ATOMICS
+    return true;
+#else
+    jaeger_log_error("Shared memory rings are not supported without atomics");
+    return false;
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+}
+
+static inline void ring_doorbell(struct jaeger_shm_ring_header* header)
+{
+#ifdef HAVE_FUTEX
+    ADD(header->doorbell, 1);
+    syscall(SYS_futex, &header->doorbell, FUTEX_WAKE, 1, NULL, NULL, 0);
+#else
+    /* The reader polls. */
+    (void) header;
+#endif /* HAVE_FUTEX */
+}
+
+bool jaeger_shm_ring_create(jaeger_shm_ring* ring,
+                            const char* name,
+                            size_t capacity)
+{
+    assert(ring != NULL);
+    assert(name != NULL);
+    *ring = (jaeger_shm_ring) JAEGERTRACINGC_SHM_RING_INIT;
+    if (!check_atomics()) {
+        return false;
+    }
+
+    size_t power_of_two = MIN_CAPACITY;
+    while (power_of_two < capacity) {
+        power_of_two <<= 1;
+    }
+    capacity = power_of_two;
+
+    char* name_copy = jaeger_strdup(name);
+    if (name_copy == NULL) {
+        jaeger_log_error("Cannot allocate shared memory ring name");
+        return false;
+    }
+    /* A reader that exited without destroying its ring leaves the object
+     * behind. Writers still attached to it reopen once it fills up. */
+    shm_unlink(name);
+    const int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        jaeger_log_error(
+            "Cannot create shared memory ring, name = \"%s\", errno = %d",
+            name,
+            errno);
+        goto cleanup;
+    }
+    const size_t map_size = sizeof(struct jaeger_shm_ring_header) + capacity;
+    /* Extends the object with zeros, so the ring starts with no records. */
+    if (ftruncate(fd, map_size) != 0) {
+        jaeger_log_error(
+            "Cannot resize shared memory ring, name = \"%s\", errno = %d",
+            name,
+            errno);
+        close(fd);
+        goto cleanup_object;
+    }
+    void* map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        jaeger_log_error(
+            "Cannot map shared memory ring, name = \"%s\", errno = %d",
+            name,
+            errno);
+        goto cleanup_object;
+    }
+
+    struct jaeger_shm_ring_header* header =
+        (struct jaeger_shm_ring_header*) map;
+    header->version = SHM_RING_VERSION;
+    header->capacity = capacity;
+    STORE(header->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+    ring->header = header;
+    ring->data = (uint8_t*) &header[1];
+    ring->map_size = map_size;
+    ring->name = name_copy;
+    return true;
+
+cleanup_object:
+    shm_unlink(name);
+cleanup:
+    jaeger_free(name_copy);
+    return false;
+}
+
+bool jaeger_shm_ring_open(jaeger_shm_ring* ring, const char* name)
+{
+    assert(ring != NULL);
+    assert(name != NULL);
+    *ring = (jaeger_shm_ring) JAEGERTRACINGC_SHM_RING_INIT;
+    if (!check_atomics()) {
+        return false;
+    }
+
+    const int fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0) {
+        JAEGERTRACINGC_LOG_ERROR_LIMITED(
+            "Cannot open shared memory ring, name = \"%s\", errno = %d",
+            name,
+            errno);
+        return false;
+    }
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) != 0 ||
+        stat_buf.st_size < (off_t) sizeof(struct jaeger_shm_ring_header)) {
+        JAEGERTRACINGC_LOG_ERROR_LIMITED(
+            "Shared memory ring is not ready, name = \"%s\"", name);
+        close(fd);
+        return false;
+    }
+    const size_t map_size = stat_buf.st_size;
+    void* map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        JAEGERTRACINGC_LOG_ERROR_LIMITED(
+            "Cannot map shared memory ring, name = \"%s\", errno = %d",
+            name,
+            errno);
+        return false;
+    }
+
+    struct jaeger_shm_ring_header* header =
+        (struct jaeger_shm_ring_header*) map;
+    const bool ready = LOAD(header->magic, __ATOMIC_ACQUIRE) == SHM_RING_MAGIC;
+    const uint64_t capacity = header->capacity;
+    if (!ready || header->version != SHM_RING_VERSION ||
+        capacity < MIN_CAPACITY || (capacity & (capacity - 1)) != 0 ||
+        sizeof(struct jaeger_shm_ring_header) + capacity != map_size) {
+        JAEGERTRACINGC_LOG_ERROR_LIMITED(
+            "Invalid shared memory ring, name = \"%s\"", name);
+        munmap(map, map_size);
+        return false;
+    }
+    ring->header = header;
+    ring->data = (uint8_t*) &header[1];
+    ring->map_size = map_size;
+    return true;
+}
+
+size_t jaeger_shm_ring_max_record_size(const jaeger_shm_ring* ring)
+{
+    assert(ring != NULL);
+    assert(ring->header != NULL);
+    /* Leaves room for records on either side of the wrap. */
+    return ring->header->capacity / 4 - sizeof(record_header);
+}
+
+bool jaeger_shm_ring_push(jaeger_shm_ring* ring,
+                          const uint8_t* data,
+                          size_t len)
+{
+    assert(ring != NULL);
+    assert(ring->header != NULL);
+    assert(data != NULL || len == 0);
+    struct jaeger_shm_ring_header* header = ring->header;
+    if (len > jaeger_shm_ring_max_record_size(ring) ||
+        LOAD(header->closed, __ATOMIC_ACQUIRE) != 0) {
+        return false;
+    }
+
+    const uint64_t capacity = header->capacity;
+    const size_t size = record_size(len);
+    uint64_t head = LOAD(header->head, __ATOMIC_RELAXED);
+    uint64_t reserved;
+    while (true) {
+        /* Acquire pairs with the reader's release, so the space is zeroed
+         * before we write to it. */
+        const uint64_t tail = LOAD(header->tail, __ATOMIC_ACQUIRE);
+        const uint64_t to_end = capacity - (head & (capacity - 1));
+        reserved = (to_end < size) ? to_end + size : size;
+        if (head + reserved - tail > capacity) {
+            ADD(header->num_dropped, 1);
+            return false;
+        }
+        if (COMPARE_EXCHANGE(header->head, &head, head + reserved)) {
+            break;
+        }
+    }
+
+    record_header* record = record_at(ring, head);
+    if (reserved != size) {
+        record->len = reserved - size - sizeof(record_header);
+        STORE(record->state,
+              RECORD_COMMITTED | RECORD_PADDING,
+              __ATOMIC_RELEASE);
+        record = record_at(ring, head + reserved - size);
+    }
+    record->len = len;
+    STORE(record->state, RECORD_RESERVED, __ATOMIC_RELEASE);
+    memcpy(&record[1], data, len);
+    /* Sequentially consistent with the reader's check of reader_waiting, so
+     * either the reader sees the record or we see the reader waiting. Fails
+     * if the reader gave up on the record and skipped it. */
+    uint32_t state = RECORD_RESERVED;
+    if (!COMPARE_EXCHANGE_STATE(record->state, &state, RECORD_COMMITTED)) {
+        return false;
+    }
+    if (LOAD(header->reader_waiting, __ATOMIC_SEQ_CST) != 0) {
+        ring_doorbell(header);
+    }
+    return true;
+}
+
+/* Returns true if the record at position has been uncommitted for longer
+ * than the commit timeout, starting the wait if it is new. */
+static inline bool stalled(jaeger_shm_ring* ring, uint64_t position)
+{
+    const int64_t now = jaeger_duration_now_ns();
+    if (ring->stalled_since == 0 || ring->stalled_position != position) {
+        ring->stalled_position = position;
+        ring->stalled_since = now;
+    }
+    return now - ring->stalled_since >=
+           (int64_t) ring->commit_timeout_ms * 1000 * 1000;
+}
+
+/* Returns the oldest record that is not padding, or NULL if the ring is
+ * empty or the oldest record is not committed yet. Skips records that stay
+ * uncommitted past the commit timeout. */
+static inline record_header* next_record(jaeger_shm_ring* ring)
+{
+    struct jaeger_shm_ring_header* header = ring->header;
+    while (true) {
+        const uint64_t tail = LOAD(header->tail, __ATOMIC_RELAXED);
+        record_header* record = record_at(ring, tail);
+        uint32_t state = LOAD(record->state, __ATOMIC_SEQ_CST);
+        if ((state & RECORD_COMMITTED) == 0) {
+            if (LOAD(header->head, __ATOMIC_RELAXED) == tail ||
+                !stalled(ring, tail)) {
+                return NULL;
+            }
+            if (state != RECORD_RESERVED) {
+                JAEGERTRACINGC_LOG_ERROR_LIMITED(
+                    "Shared memory ring is stuck on a record its writer "
+                    "never described, name = \"%s\"",
+                    ring->name);
+                return NULL;
+            }
+            /* Fails if the writer committed the record after all. */
+            if (!COMPARE_EXCHANGE_STATE(record->state,
+                                        &state,
+                                        RECORD_COMMITTED | RECORD_PADDING)) {
+                continue;
+            }
+            ADD(header->num_dropped, 1);
+            JAEGERTRACINGC_LOG_ERROR_LIMITED(
+                "Skipping shared memory ring record its writer did not "
+                "commit, name = \"%s\", length = %u",
+                ring->name,
+                (unsigned) record->len);
+        }
+        else if ((state & RECORD_PADDING) == 0) {
+            return record;
+        }
+        jaeger_shm_ring_pop(ring);
+    }
+}
+
+bool jaeger_shm_ring_peek(jaeger_shm_ring* ring,
+                          const uint8_t** data,
+                          size_t* len)
+{
+    assert(ring != NULL);
+    assert(ring->header != NULL);
+    assert(data != NULL);
+    assert(len != NULL);
+    const record_header* record = next_record(ring);
+    if (record == NULL) {
+        return false;
+    }
+    *data = (const uint8_t*) &record[1];
+    *len = record->len;
+    return true;
+}
+
+void jaeger_shm_ring_pop(jaeger_shm_ring* ring)
+{
+    assert(ring != NULL);
+    assert(ring->header != NULL);
+    struct jaeger_shm_ring_header* header = ring->header;
+    const uint64_t tail = LOAD(header->tail, __ATOMIC_RELAXED);
+    record_header* record = record_at(ring, tail);
+    assert((LOAD(record->state, __ATOMIC_RELAXED) & RECORD_COMMITTED) != 0);
+    const size_t size = record_size(record->len);
+    memset(record, 0, size);
+    STORE(header->tail, tail + size, __ATOMIC_RELEASE);
+}
+
+bool jaeger_shm_ring_wait(jaeger_shm_ring* ring, int timeout_ms)
+{
+    assert(ring != NULL);
+    assert(ring->header != NULL);
+    if (next_record(ring) != NULL) {
+        return true;
+    }
+    struct jaeger_shm_ring_header* header = ring->header;
+#ifdef HAVE_FUTEX
+    const uint32_t doorbell = LOAD(header->doorbell, __ATOMIC_SEQ_CST);
+    STORE(header->reader_waiting, 1, __ATOMIC_SEQ_CST);
+    if (next_record(ring) == NULL) {
+        const struct timespec timeout = {
+            .tv_sec = timeout_ms / 1000,
+            .tv_nsec = (timeout_ms % 1000) * 1000 * 1000};
+        /* Returns at once if a writer rang the doorbell since we read it. */
+        syscall(SYS_futex,
+                &header->doorbell,
+                FUTEX_WAIT,
+                doorbell,
+                &timeout,
+                NULL,
+                0);
+    }
+    STORE(header->reader_waiting, 0, __ATOMIC_SEQ_CST);
+#else
+    (void) header;
+    const struct timespec poll_interval = {.tv_sec = 0,
+                                           .tv_nsec = 1000 * 1000};
+    for (int i = 0; i < timeout_ms && next_record(ring) == NULL; i++) {
+        nanosleep(&poll_interval, NULL);
+    }
+#endif /* HAVE_FUTEX */
+    return next_record(ring) != NULL;
+}
+
+int64_t jaeger_shm_ring_num_dropped(const jaeger_shm_ring* ring)
+{
+    assert(ring != NULL);
+    assert(ring->header != NULL);
+    return LOAD(ring->header->num_dropped, __ATOMIC_RELAXED);
+}
+
+bool jaeger_shm_ring_closed(const jaeger_shm_ring* ring)
+{
+    assert(ring != NULL);
+    assert(ring->header != NULL);
+    return LOAD(ring->header->closed, __ATOMIC_ACQUIRE) != 0;
+}
+
+void jaeger_shm_ring_destroy(jaeger_shm_ring* ring)
+{
+    if (ring == NULL) {
+        return;
+    }
+    if (ring->header != NULL) {
+        if (ring->name != NULL) {
+            STORE(ring->header->closed, 1, __ATOMIC_RELEASE);
+            shm_unlink(ring->name);
+        }
+        munmap(ring->header, ring->map_size);
+    }
+    jaeger_free(ring->name);
+    *ring = (jaeger_shm_ring) JAEGERTRACINGC_SHM_RING_INIT;
+}
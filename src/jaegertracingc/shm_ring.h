@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ * Ring of encoded batches in shared memory, for agents on the same host.
+ */
+
+#ifndef JAEGERTRACINGC_SHM_RING_H
+#define JAEGERTRACINGC_SHM_RING_H
+
+#include "jaegertracingc/common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Default number of data bytes in a ring. */
+#define JAEGERTRACINGC_SHM_RING_DEFAULT_CAPACITY (8 * 1024 * 1024)
+
+/** Default number of milliseconds a record may stay uncommitted before the
+ *  reader skips it. */
+#define JAEGERTRACINGC_SHM_RING_DEFAULT_COMMIT_TIMEOUT_MS 1000
+
+struct jaeger_shm_ring_header;
+
+/**
+ * Multi-producer, single-consumer ring of records in a POSIX shared memory
+ * object. The agent creates the ring and reads from it, and any number of
+ * threads and processes open it and push to it. Pushing is a compare and
+ * swap and a copy, with no system calls unless the reader is asleep, in
+ * which case the writer rings a futex doorbell. Records that do not fit are
+ * dropped and counted, so writers never wait for the reader.
+ *
+ * A writer that dies between reserving a record and committing it would
+ * stop the reader at that record. The reader skips records that stay
+ * uncommitted for longer than the commit timeout, and counts them as
+ * dropped. The timeout must outlast any writer that is merely descheduled
+ * mid-record, since a writer that resumes after its record was skipped may
+ * overwrite the records that followed it. A writer that dies in the few
+ * instructions between reserving a record and describing it leaves nothing
+ * to skip, so the reader only logs that the ring is stuck.
+ *
+ * The reader must be the only thread reading a ring. Shared memory needs
+ * atomics, so rings cannot be created or opened in builds without them.
+ */
+typedef struct jaeger_shm_ring {
+    /** Shared header, or NULL if the ring is not open. */
+    struct jaeger_shm_ring_header* header;
+    /** Shared records, following the header. */
+    uint8_t* data;
+    /** Size of the mapping. */
+    size_t map_size;
+    /** Name of the shared memory object if this ring created it, NULL
+     *  otherwise. */
+    char* name;
+    /** Reader only: milliseconds a record may stay uncommitted before the
+     *  reader skips it. */
+    int commit_timeout_ms;
+    /** Reader only: position of the uncommitted record the reader is
+     *  waiting on. */
+    uint64_t stalled_position;
+    /** Reader only: time the reader started waiting on the record at
+     *  stalled_position, or zero if it is not waiting. */
+    int64_t stalled_since;
+} jaeger_shm_ring;
+
+#define JAEGERTRACINGC_SHM_RING_INIT                                     \
+    {                                                                    \
+        .header = NULL, .data = NULL, .map_size = 0, .name = NULL,       \
+        .commit_timeout_ms =                                             \
+            JAEGERTRACINGC_SHM_RING_DEFAULT_COMMIT_TIMEOUT_MS,            \
+        .stalled_position = 0, .stalled_since = 0                        \
+    }
+
+/**
+ * Create a ring and open it for reading. Replaces any ring left behind by a
+ * reader that exited without destroying its ring.
+ * @param ring Ring to initialize.
+ * @param name Name of the shared memory object, i.e. "/jaeger-spans".
+ * @param capacity Number of data bytes, rounded up to a power of two.
+ * @return True on success, false otherwise.
+ */
+bool jaeger_shm_ring_create(jaeger_shm_ring* ring,
+                            const char* name,
+                            size_t capacity);
+
+/**
+ * Open a ring the reader created, for writing.
+ * @param ring Ring to initialize.
+ * @param name Name of the shared memory object.
+ * @return True on success, false otherwise.
+ */
+bool jaeger_shm_ring_open(jaeger_shm_ring* ring, const char* name);
+
+/**
+ * Get the size of the largest record the ring accepts.
+ * @param ring Open ring.
+ * @return Maximum record length.
+ */
+size_t jaeger_shm_ring_max_record_size(const jaeger_shm_ring* ring);
+
+/**
+ * Append a record. Safe to call from several threads and processes at once.
+ * @param ring Ring opened for writing.
+ * @param data Record to append.
+ * @param len Length of record.
+ * @return True on success, false if the record is too large, the ring is
+ *         full, the reader destroyed the ring or the reader skipped the
+ *         record because it took longer than the commit timeout.
+ */
+bool jaeger_shm_ring_push(jaeger_shm_ring* ring,
+                          const uint8_t* data,
+                          size_t len);
+
+/**
+ * Get the oldest record without removing it.
+ * @param ring Ring opened for reading.
+ * @param[out] data Record, valid until the next call to jaeger_shm_ring_pop.
+ * @param[out] len Length of record.
+ * @return True if there was a record, false if the ring is empty.
+ */
+bool jaeger_shm_ring_peek(jaeger_shm_ring* ring,
+                          const uint8_t** data,
+                          size_t* len);
+
+/**
+ * Remove the oldest record, making room for writers. The ring must not be
+ * empty.
+ * @param ring Ring opened for reading.
+ */
+void jaeger_shm_ring_pop(jaeger_shm_ring* ring);
+
+/**
+ * Sleep until a record is ready or the timeout expires.
+ * @param ring Ring opened for reading.
+ * @param timeout_ms Maximum number of milliseconds to sleep.
+ * @return True if a record is ready, false otherwise.
+ */
+bool jaeger_shm_ring_wait(jaeger_shm_ring* ring, int timeout_ms);
+
+/**
+ * Get the number of records dropped because the ring was full or their
+ * writers did not commit them.
+ * @param ring Open ring.
+ * @return Number of dropped records.
+ */
+int64_t jaeger_shm_ring_num_dropped(const jaeger_shm_ring* ring);
+
+/**
+ * Check whether the reader destroyed the ring, in which case writers should
+ * destroy their rings and open the reader's next one.
+ * @param ring Ring opened for writing.
+ * @return True if the ring is closed, false otherwise.
+ */
+bool jaeger_shm_ring_closed(const jaeger_shm_ring* ring);
+
+/**
+ * Unmap the ring. If this ring created it, writers see it as closed and the
+ * shared memory object is removed.
+ * @param ring Ring to destroy.
+ */
+void jaeger_shm_ring_destroy(jaeger_shm_ring* ring);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif /* __cplusplus */
+
+#endif /* JAEGERTRACINGC_SHM_RING_H */
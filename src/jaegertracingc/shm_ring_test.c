@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jaegertracingc/shm_ring.h"
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "jaegertracingc/threading.h"
+#include "unity.h"
+
+#define RECORD_LEN 120
+#define NUM_THREADS 4
+#define NUM_RECORDS 10000
+
+typedef struct test_record {
+    int thread_index;
+    int sequence;
+    uint8_t padding[RECORD_LEN - 2 * sizeof(int)];
+} test_record;
+
+static inline void push_record(jaeger_shm_ring* ring, int index)
+{
+    uint8_t record[RECORD_LEN];
+    memset(record, index, sizeof(record));
+    TEST_ASSERT_TRUE(jaeger_shm_ring_push(ring, record, sizeof(record)));
+}
+
+static inline void pop_record(jaeger_shm_ring* ring, int index)
+{
+    const uint8_t* data = NULL;
+    size_t len = 0;
+    TEST_ASSERT_TRUE(jaeger_shm_ring_peek(ring, &data, &len));
+    TEST_ASSERT_EQUAL(RECORD_LEN, len);
+    TEST_ASSERT_EQUAL(index & 0xff, data[0]);
+    TEST_ASSERT_EQUAL(index & 0xff, data[RECORD_LEN - 1]);
+    jaeger_shm_ring_pop(ring);
+}
+
+typedef struct writer_arg {
+    const char* name;
+    int thread_index;
+} writer_arg;
+
+static void* write_records(void* arg)
+{
+    const writer_arg* writer = (const writer_arg*) arg;
+    jaeger_shm_ring ring;
+    TEST_ASSERT_TRUE(jaeger_shm_ring_open(&ring, writer->name));
+    test_record record;
+    memset(&record, 0, sizeof(record));
+    record.thread_index = writer->thread_index;
+    for (int i = 0; i < NUM_RECORDS; i++) {
+        record.sequence = i;
+        jaeger_shm_ring_push(&ring, (const uint8_t*) &record, sizeof(record));
+    }
+    jaeger_shm_ring_destroy(&ring);
+    return NULL;
+}
+
+/* Reads records from writer threads like an agent would, checking each
+ * writer's records arrive in order. */
+static inline void test_shm_ring_consumer(const char* name)
+{
+    jaeger_shm_ring reader;
+    TEST_ASSERT_TRUE(jaeger_shm_ring_create(&reader, name, 0));
+    jaeger_thread threads[NUM_THREADS];
+    writer_arg args[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; i++) {
+        args[i] = (writer_arg){.name = name, .thread_index = i};
+        TEST_ASSERT_EQUAL(
+            0, jaeger_thread_init(&threads[i], &write_records, &args[i]));
+    }
+
+    int next_sequence[NUM_THREADS] = {0};
+    int num_read = 0;
+    while (num_read + jaeger_shm_ring_num_dropped(&reader) <
+           NUM_THREADS * NUM_RECORDS) {
+        if (!jaeger_shm_ring_wait(&reader, 10)) {
+            continue;
+        }
+        const uint8_t* data = NULL;
+        size_t len = 0;
+        while (jaeger_shm_ring_peek(&reader, &data, &len)) {
+            TEST_ASSERT_EQUAL(sizeof(test_record), len);
+            test_record record;
+            memcpy(&record, data, sizeof(record));
+            TEST_ASSERT_GREATER_OR_EQUAL(0, record.thread_index);
+            TEST_ASSERT_LESS_THAN(NUM_THREADS, record.thread_index);
+            TEST_ASSERT_GREATER_OR_EQUAL(next_sequence[record.thread_index],
+                                         record.sequence);
+            next_sequence[record.thread_index] = record.sequence + 1;
+            jaeger_shm_ring_pop(&reader);
+            num_read++;
+        }
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        jaeger_thread_join(threads[i], NULL);
+    }
+    TEST_ASSERT_FALSE(jaeger_shm_ring_wait(&reader, 0));
+    TEST_ASSERT_GREATER_THAN(0, num_read);
+    jaeger_shm_ring_destroy(&reader);
+}
+
+static void exit_on_fault(int signum)
+{
+    (void) signum;
+    _exit(0);
+}
+
+/* Forks a writer that dies while copying its record, leaving the record
+ * reserved but not committed. */
+static inline void push_and_die(const char* name)
+{
+    const pid_t pid = fork();
+    TEST_ASSERT_GREATER_OR_EQUAL(0, pid);
+    if (pid == 0) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = &exit_on_fault;
+        sigaction(SIGSEGV, &action, NULL);
+        sigaction(SIGBUS, &action, NULL);
+        jaeger_shm_ring ring;
+        if (!jaeger_shm_ring_open(&ring, name)) {
+            _exit(1);
+        }
+        /* Copying from an inaccessible page faults mid-push. */
+        void* page = mmap(NULL,
+                          RECORD_LEN,
+                          PROT_NONE,
+                          MAP_PRIVATE | MAP_ANONYMOUS,
+                          -1,
+                          0);
+        if (page == MAP_FAILED) {
+            _exit(1);
+        }
+        jaeger_shm_ring_push(&ring, (const uint8_t*) page, RECORD_LEN);
+        _exit(1);
+    }
+    int status = 0;
+    TEST_ASSERT_EQUAL(pid, waitpid(pid, &status, 0));
+    TEST_ASSERT_TRUE(WIFEXITED(status));
+    TEST_ASSERT_EQUAL(0, WEXITSTATUS(status));
+}
+
+/* Checks the reader skips a record whose writer died before committing it,
+ * once the commit timeout expires. */
+static inline void test_shm_ring_dead_writer(const char* name)
+{
+    jaeger_shm_ring reader = JAEGERTRACINGC_SHM_RING_INIT;
+    jaeger_shm_ring writer = JAEGERTRACINGC_SHM_RING_INIT;
+    TEST_ASSERT_TRUE(jaeger_shm_ring_create(&reader, name, 0));
+    TEST_ASSERT_TRUE(jaeger_shm_ring_open(&writer, name));
+    push_and_die(name);
+    push_record(&writer, 1);
+
+    const uint8_t* data = NULL;
+    size_t len = 0;
+    reader.commit_timeout_ms = 60 * 1000;
+    TEST_ASSERT_FALSE(jaeger_shm_ring_peek(&reader, &data, &len));
+    TEST_ASSERT_FALSE(jaeger_shm_ring_wait(&reader, 0));
+    TEST_ASSERT_EQUAL(0, jaeger_shm_ring_num_dropped(&reader));
+
+    reader.commit_timeout_ms = 0;
+    pop_record(&reader, 1);
+    TEST_ASSERT_EQUAL(1, jaeger_shm_ring_num_dropped(&reader));
+    TEST_ASSERT_FALSE(jaeger_shm_ring_peek(&reader, &data, &len));
+    push_record(&writer, 2);
+    pop_record(&reader, 2);
+
+    TEST_ASSERT_FALSE(jaeger_shm_ring_closed(&writer));
+    jaeger_shm_ring_destroy(&reader);
+    TEST_ASSERT_TRUE(jaeger_shm_ring_closed(&writer));
+    jaeger_shm_ring_destroy(&writer);
+}
+
+void test_shm_ring()
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/jaeger-shm-ring-test-%d", (int) getpid());
+    jaeger_shm_ring reader = JAEGERTRACINGC_SHM_RING_INIT;
+    jaeger_shm_ring writer = JAEGERTRACINGC_SHM_RING_INIT;
+#ifndef JAEGERTRACINGC_HAVE_ATOMICS
+    TEST_ASSERT_FALSE(jaeger_shm_ring_create(&reader, name, 0));
+    return;
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+
+    /* Writers cannot open a ring before the reader creates it. */
+    TEST_ASSERT_FALSE(jaeger_shm_ring_open(&writer, name));
+
+    TEST_ASSERT_TRUE(jaeger_shm_ring_create(&reader, name, 4000));
+    TEST_ASSERT_TRUE(jaeger_shm_ring_open(&writer, name));
+    const size_t max_record_size = jaeger_shm_ring_max_record_size(&writer);
+    TEST_ASSERT_EQUAL(4096 / 4 - 8, max_record_size);
+    uint8_t large_record[4096];
+    memset(large_record, 0, sizeof(large_record));
+    TEST_ASSERT_FALSE(
+        jaeger_shm_ring_push(&writer, large_record, max_record_size + 1));
+    TEST_ASSERT_TRUE(
+        jaeger_shm_ring_push(&writer, large_record, max_record_size));
+    TEST_ASSERT_TRUE(jaeger_shm_ring_push(&writer, large_record, 0));
+    const uint8_t* data = NULL;
+    size_t len = 0;
+    TEST_ASSERT_TRUE(jaeger_shm_ring_peek(&reader, &data, &len));
+    TEST_ASSERT_EQUAL(max_record_size, len);
+    jaeger_shm_ring_pop(&reader);
+    TEST_ASSERT_TRUE(jaeger_shm_ring_peek(&reader, &data, &len));
+    TEST_ASSERT_EQUAL(0, len);
+    jaeger_shm_ring_pop(&reader);
+    TEST_ASSERT_FALSE(jaeger_shm_ring_peek(&reader, &data, &len));
+
+    /* Records take 128 bytes with their headers. The empty record left them
+     * off that boundary, so one straddles the end of the ring and is moved
+     * to the start, after padding. The padding leaves room for 31. */
+    const int records_per_ring = 4096 / (RECORD_LEN + 8) - 1;
+    int index = 0;
+    for (; index < records_per_ring; index++) {
+        push_record(&writer, index);
+    }
+    uint8_t record[RECORD_LEN];
+    TEST_ASSERT_FALSE(jaeger_shm_ring_push(&writer, record, sizeof(record)));
+    TEST_ASSERT_EQUAL(1, jaeger_shm_ring_num_dropped(&reader));
+    TEST_ASSERT_TRUE(jaeger_shm_ring_wait(&reader, 0));
+
+    /* Records keep their order across the end of the ring. */
+    for (int i = 0; i < 3 * records_per_ring; i++) {
+        pop_record(&reader, i);
+        push_record(&writer, index++);
+    }
+    for (int i = 3 * records_per_ring; i < index; i++) {
+        pop_record(&reader, i);
+    }
+    TEST_ASSERT_FALSE(jaeger_shm_ring_peek(&reader, &data, &len));
+    TEST_ASSERT_FALSE(jaeger_shm_ring_wait(&reader, 1));
+
+    /* Writers stop once the reader destroys the ring. */
+    jaeger_shm_ring_destroy(&reader);
+    TEST_ASSERT_FALSE(jaeger_shm_ring_push(&writer, record, sizeof(record)));
+    jaeger_shm_ring_destroy(&writer);
+    TEST_ASSERT_FALSE(jaeger_shm_ring_open(&writer, name));
+
+    test_shm_ring_consumer(name);
+    test_shm_ring_dead_writer(name);
+}
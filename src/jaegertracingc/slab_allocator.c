@@ -0,0 +1,511 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jaegertracingc/slab_allocator.h"
+
+/* Slabs start with a header, found by rounding a block address down to the
+ * slab size. */
+#define HEADER_SIZE 64
+/* Large allocations come from malloc, after a header that keeps the block
+ * aligned. */
+#define LARGE_HEADER_SIZE JAEGERTRACINGC_SLAB_ALIGNMENT
+#define MIN_SLAB_TABLE_CAPACITY 64
+/* Upper bound on the bytes a cache takes from a class at once. */
+#define BATCH_BYTES 4096
+#define MIN_BATCH_SIZE 4
+
+typedef struct slab_header {
+    /** Size class of the blocks in the slab. */
+    int class_index;
+    /** Next slab owned by the allocator. */
+    struct slab_header* next;
+} slab_header;
+
+typedef struct large_header {
+    /** Size of the allocation. */
+    size_t size;
+} large_header;
+
+/* Open addressed set of slab addresses, which free checks to tell slab
+ * blocks from large allocations. Lookups take no lock: a full table is
+ * replaced rather than resized, and replaced tables are kept until the
+ * allocator is destroyed. */
+typedef struct slab_table {
+    /** Table this one replaced. */
+    struct slab_table* prev;
+    /** Number of slots, a power of two. */
+    size_t capacity;
+    /** Number of slots in use, at most half of capacity. */
+    size_t size;
+    /** Slab addresses, or zero for empty slots. */
+    uintptr_t slots[];
+} slab_table;
+
+typedef struct slab_block {
+    struct slab_block* next;
+} slab_block;
+
+typedef struct slab_free_list {
+    slab_block* head;
+    int count;
+} slab_free_list;
+
+typedef struct slab_cache {
+    jaeger_destructible base;
+    jaeger_slab_allocator* alloc;
+    slab_free_list lists[JAEGERTRACINGC_SLAB_NUM_CLASSES];
+} slab_cache;
+
+static const size_t block_sizes[JAEGERTRACINGC_SLAB_NUM_CLASSES] = {
+    16, 32, 48, 64, 80, 96, 128, 160, 192, 256, 320, 384, 512, 768, 1024};
+
+#ifdef JAEGERTRACINGC_HAVE_ATOMICS
+
+#define LOCK_SLAB_TABLE(alloc) (void) (alloc)
+#define UNLOCK_SLAB_TABLE(alloc) (void) (alloc)
+#define LOAD(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define STORE(x, value) __atomic_store_n(&(x), (value), __ATOMIC_RELEASE)
+
+#else
+
+#define LOCK_SLAB_TABLE(alloc) jaeger_mutex_lock(&(alloc)->mutex)
+#define UNLOCK_SLAB_TABLE(alloc) jaeger_mutex_unlock(&(alloc)->mutex)
+#define LOAD(x) (x)
+#define STORE(x, value) ((x) = (value))
+
+#endif /* JAEGERTRACINGC_HAVE_ATOMICS */
+
+static inline slab_header* find_header(void* ptr)
+{
+    return (slab_header*) ((uintptr_t) ptr &
+                           ~((uintptr_t) JAEGERTRACINGC_SLAB_SIZE - 1));
+}
+
+static inline large_header* find_large_header(void* ptr)
+{
+    return (large_header*) ((char*) ptr - LARGE_HEADER_SIZE);
+}
+
+static inline size_t slab_table_index(const slab_table* table,
+                                      uintptr_t slab)
+{
+    const uint64_t hash =
+        (uint64_t) (slab / JAEGERTRACINGC_SLAB_SIZE) * 0x9e3779b97f4a7c15ULL;
+    return (size_t) (hash >> 32) & (table->capacity - 1);
+}
+
+/* Caller must hold the allocator lock. */
+static inline void slab_table_put(slab_table* table, uintptr_t slab)
+{
+    size_t i = slab_table_index(table, slab);
+    while (table->slots[i] != 0) {
+        i = (i + 1) & (table->capacity - 1);
+    }
+    /* Readers may be probing the table, so the slot is published last. */
+    STORE(table->slots[i], slab);
+    table->size++;
+}
+
+/* Adds a slab to the set, replacing the table if it is half full. Caller
+ * must hold the allocator lock. */
+static inline bool add_slab(jaeger_slab_allocator* alloc, slab_header* header)
+{
+    slab_table* table = (slab_table*) alloc->slab_table;
+    if (table == NULL || 2 * (table->size + 1) > table->capacity) {
+        const size_t capacity =
+            (table == NULL) ? MIN_SLAB_TABLE_CAPACITY : 2 * table->capacity;
+        slab_table* new_table = (slab_table*) calloc(
+            1, sizeof(slab_table) + capacity * sizeof(uintptr_t));
+        if (new_table == NULL) {
+            jaeger_log_error("Cannot allocate slab table, capacity = %zu",
+                             capacity);
+            return false;
+        }
+        new_table->prev = table;
+        new_table->capacity = capacity;
+        if (table != NULL) {
+            for (size_t i = 0; i < table->capacity; i++) {
+                if (table->slots[i] != 0) {
+                    slab_table_put(new_table, table->slots[i]);
+                }
+            }
+        }
+        STORE(alloc->slab_table, (void*) new_table);
+        table = new_table;
+    }
+    slab_table_put(table, (uintptr_t) header);
+    return true;
+}
+
+/* Returns whether ptr is a block of one of the allocator's slabs, as opposed
+ * to a large allocation. */
+static inline bool is_slab_block(jaeger_slab_allocator* alloc, void* ptr)
+{
+    const uintptr_t slab = (uintptr_t) find_header(ptr);
+    bool found = false;
+    LOCK_SLAB_TABLE(alloc);
+    const slab_table* table = (const slab_table*) LOAD(alloc->slab_table);
+    if (table != NULL) {
+        for (size_t i = slab_table_index(table, slab);;
+             i = (i + 1) & (table->capacity - 1)) {
+            const uintptr_t slot = LOAD(table->slots[i]);
+            if (slot == 0 || slot == slab) {
+                found = (slot == slab);
+                break;
+            }
+        }
+    }
+    UNLOCK_SLAB_TABLE(alloc);
+    return found;
+}
+
+static inline int size_class(const jaeger_slab_allocator* alloc, size_t size)
+{
+    assert(size <= JAEGERTRACINGC_SLAB_MAX_BLOCK_SIZE);
+    return alloc->class_index[(size + JAEGERTRACINGC_SLAB_ALIGNMENT - 1) /
+                              JAEGERTRACINGC_SLAB_ALIGNMENT];
+}
+
+static inline void* aligned_alloc_from_system(size_t size)
+{
+    void* mem = NULL;
+    const int return_code =
+        posix_memalign(&mem, JAEGERTRACINGC_SLAB_SIZE, size);
+    if (return_code != 0) {
+        jaeger_log_error("Cannot allocate slab, size = %zu, return code = %d",
+                         size,
+                         return_code);
+        return NULL;
+    }
+    return mem;
+}
+
+/* Carves a block from the newest slab of a class, allocating a new slab if
+ * it is used up. Caller must hold the class lock. */
+static inline slab_block* carve_block(jaeger_slab_allocator* alloc,
+                                      int class_index)
+{
+    jaeger_slab_class* c = &alloc->classes[class_index];
+    if (c->next_block == NULL || c->next_block + c->block_size > c->slab_end) {
+        slab_header* header =
+            (slab_header*) aligned_alloc_from_system(JAEGERTRACINGC_SLAB_SIZE);
+        if (header == NULL) {
+            return NULL;
+        }
+        *header = (slab_header){.class_index = class_index, .next = NULL};
+        jaeger_mutex_lock(&alloc->mutex);
+        if (!add_slab(alloc, header)) {
+            jaeger_mutex_unlock(&alloc->mutex);
+            free(header);
+            return NULL;
+        }
+        header->next = (slab_header*) alloc->slabs;
+        alloc->slabs = header;
+        jaeger_mutex_unlock(&alloc->mutex);
+        c->next_block = (char*) header + HEADER_SIZE;
+        c->slab_end = (char*) header + JAEGERTRACINGC_SLAB_SIZE;
+    }
+    slab_block* block = (slab_block*) c->next_block;
+    c->next_block += c->block_size;
+    return block;
+}
+
+/* Moves up to max_blocks blocks from a class to a free list, returning the
+ * number moved. */
+static int take_blocks(jaeger_slab_allocator* alloc,
+                       int class_index,
+                       slab_free_list* list,
+                       int max_blocks)
+{
+    jaeger_slab_class* c = &alloc->classes[class_index];
+    int num_taken = 0;
+    jaeger_mutex_lock(&c->mutex);
+    for (; num_taken < max_blocks; num_taken++) {
+        slab_block* block = (slab_block*) c->free_list;
+        if (block != NULL) {
+            c->free_list = block->next;
+        }
+        else {
+            block = carve_block(alloc, class_index);
+            if (block == NULL) {
+                break;
+            }
+        }
+        block->next = list->head;
+        list->head = block;
+    }
+    jaeger_mutex_unlock(&c->mutex);
+    list->count += num_taken;
+    return num_taken;
+}
+
+/* Moves the first num_blocks blocks of a free list back to a class. */
+static void
+return_blocks(jaeger_slab_class* c, slab_free_list* list, int num_blocks)
+{
+    assert(num_blocks <= list->count);
+    if (num_blocks == 0) {
+        return;
+    }
+    slab_block* first = list->head;
+    slab_block* last = first;
+    for (int i = 1; i < num_blocks; i++) {
+        last = last->next;
+    }
+    list->head = last->next;
+    list->count -= num_blocks;
+    jaeger_mutex_lock(&c->mutex);
+    last->next = (slab_block*) c->free_list;
+    c->free_list = first;
+    jaeger_mutex_unlock(&c->mutex);
+}
+
+static void slab_cache_destroy(jaeger_destructible* d)
+{
+    if (d == NULL) {
+        return;
+    }
+    slab_cache* cache = (slab_cache*) d;
+    jaeger_slab_allocator* alloc = cache->alloc;
+    for (int i = 0; i < JAEGERTRACINGC_SLAB_NUM_CLASSES; i++) {
+        slab_free_list* list = &cache->lists[i];
+        return_blocks(&alloc->classes[i], list, list->count);
+    }
+    /* The cache itself is a block of the class that fits it. */
+    slab_free_list list = {.head = (slab_block*) cache, .count = 1};
+    ((slab_block*) cache)->next = NULL;
+    return_blocks(
+        &alloc->classes[size_class(alloc, sizeof(slab_cache))], &list, 1);
+}
+
+/* Returns the cache of the calling thread, creating it on first use, or NULL
+ * if it cannot be created. */
+static inline slab_cache* get_cache(jaeger_slab_allocator* alloc)
+{
+    slab_cache* cache =
+        (slab_cache*) jaeger_thread_local_get_value(&alloc->caches);
+    if (cache != NULL) {
+        return cache;
+    }
+    const int class_index = size_class(alloc, sizeof(slab_cache));
+    slab_free_list list = {.head = NULL, .count = 0};
+    if (take_blocks(alloc, class_index, &list, 1) == 0) {
+        return NULL;
+    }
+    cache = (slab_cache*) list.head;
+    memset(cache, 0, sizeof(*cache));
+    cache->base.destroy = &slab_cache_destroy;
+    cache->alloc = alloc;
+    if (!jaeger_thread_local_set_value(&alloc->caches,
+                                       (jaeger_destructible*) cache)) {
+        ((slab_block*) cache)->next = NULL;
+        return_blocks(&alloc->classes[class_index], &list, 1);
+        return NULL;
+    }
+    return cache;
+}
+
+/* Sizes past the largest class need no more than the natural alignment
+ * malloc gives them. */
+static void* large_malloc(size_t size)
+{
+    if (size > SIZE_MAX - LARGE_HEADER_SIZE) {
+        return NULL;
+    }
+    large_header* header = (large_header*) malloc(LARGE_HEADER_SIZE + size);
+    if (header == NULL) {
+        return NULL;
+    }
+    header->size = size;
+    return (char*) header + LARGE_HEADER_SIZE;
+}
+
+static void* large_realloc(void* ptr, size_t size)
+{
+    if (size > SIZE_MAX - LARGE_HEADER_SIZE) {
+        return NULL;
+    }
+    large_header* header = (large_header*) realloc(find_large_header(ptr),
+                                                   LARGE_HEADER_SIZE + size);
+    if (header == NULL) {
+        return NULL;
+    }
+    header->size = size;
+    return (char*) header + LARGE_HEADER_SIZE;
+}
+
+static void* slab_malloc(jaeger_allocator* base, size_t size)
+{
+    assert(base != NULL);
+    jaeger_slab_allocator* alloc = (jaeger_slab_allocator*) base;
+    if (size > JAEGERTRACINGC_SLAB_MAX_BLOCK_SIZE) {
+        return large_malloc(size);
+    }
+    const int class_index = size_class(alloc, size);
+    slab_cache* cache = get_cache(alloc);
+    if (cache == NULL) {
+        /* Go straight to the shared class. */
+        slab_free_list list = {.head = NULL, .count = 0};
+        take_blocks(alloc, class_index, &list, 1);
+        return list.head;
+    }
+    slab_free_list* list = &cache->lists[class_index];
+    if (list->head == NULL &&
+        take_blocks(alloc,
+                    class_index,
+                    list,
+                    alloc->classes[class_index].batch_size) == 0) {
+        return NULL;
+    }
+    slab_block* block = list->head;
+    list->head = block->next;
+    list->count--;
+    return block;
+}
+
+static void free_block(jaeger_slab_allocator* alloc, void* ptr, int class_index)
+{
+    jaeger_slab_class* c = &alloc->classes[class_index];
+    slab_block* block = (slab_block*) ptr;
+    slab_cache* cache = get_cache(alloc);
+    if (cache == NULL) {
+        slab_free_list list = {.head = block, .count = 1};
+        block->next = NULL;
+        return_blocks(c, &list, 1);
+        return;
+    }
+    slab_free_list* list = &cache->lists[class_index];
+    block->next = list->head;
+    list->head = block;
+    list->count++;
+    /* Keep a batch after returning one, so that alternating allocations and
+     * frees do not move blocks back and forth. */
+    if (list->count > 2 * c->batch_size) {
+        return_blocks(c, list, c->batch_size);
+    }
+}
+
+static void slab_free(jaeger_allocator* base, void* ptr)
+{
+    assert(base != NULL);
+    if (ptr == NULL) {
+        return;
+    }
+    jaeger_slab_allocator* alloc = (jaeger_slab_allocator*) base;
+    if (!is_slab_block(alloc, ptr)) {
+        free(find_large_header(ptr));
+        return;
+    }
+    free_block(alloc, ptr, find_header(ptr)->class_index);
+}
+
+/* Small sizes map straight to their class, without reading the slab
+ * header. */
+static void slab_free_sized(jaeger_allocator* base, void* ptr, size_t size)
+{
+    assert(base != NULL);
+    if (ptr == NULL) {
+        return;
+    }
+    if (size > JAEGERTRACINGC_SLAB_MAX_BLOCK_SIZE) {
+        free(find_large_header(ptr));
+        return;
+    }
+    jaeger_slab_allocator* alloc = (jaeger_slab_allocator*) base;
+    assert(find_header(ptr)->class_index == size_class(alloc, size));
+    free_block(alloc, ptr, size_class(alloc, size));
+}
+
+static void* slab_realloc(jaeger_allocator* base, void* ptr, size_t size)
+{
+    assert(base != NULL);
+    if (ptr == NULL) {
+        return slab_malloc(base, size);
+    }
+    jaeger_slab_allocator* alloc = (jaeger_slab_allocator*) base;
+    const bool large = !is_slab_block(alloc, ptr);
+    /* Blocks stay put only if the new size has the same class, so that
+     * free_sized can find the class from the size alone. Large allocations
+     * that stay large are left to the system. */
+    const bool small = size <= JAEGERTRACINGC_SLAB_MAX_BLOCK_SIZE;
+    if (large && !small) {
+        return large_realloc(ptr, size);
+    }
+    const int class_index = large ? -1 : find_header(ptr)->class_index;
+    if (small && size_class(alloc, size) == class_index) {
+        return ptr;
+    }
+    const size_t old_size = large ? find_large_header(ptr)->size
+                                  : alloc->classes[class_index].block_size;
+    void* new_ptr = slab_malloc(base, size);
+    if (new_ptr == NULL) {
+        return NULL;
+    }
+    memcpy(new_ptr, ptr, JAEGERTRACINGC_MIN(old_size, size));
+    slab_free(base, ptr);
+    return new_ptr;
+}
+
+bool jaeger_slab_allocator_init(jaeger_slab_allocator* alloc)
+{
+    assert(alloc != NULL);
+    memset(alloc, 0, sizeof(*alloc));
+    size_t class_index = 0;
+    for (int i = 0; i < JAEGERTRACINGC_SLAB_NUM_CLASSES; i++) {
+        jaeger_slab_class* c = &alloc->classes[i];
+        c->block_size = block_sizes[i];
+        c->batch_size = JAEGERTRACINGC_MAX((int) (BATCH_BYTES / c->block_size),
+                                           MIN_BATCH_SIZE);
+        c->mutex = (jaeger_mutex) JAEGERTRACINGC_MUTEX_INIT;
+        for (; class_index * JAEGERTRACINGC_SLAB_ALIGNMENT <= c->block_size;
+             class_index++) {
+            alloc->class_index[class_index] = (uint8_t) i;
+        }
+    }
+    alloc->mutex = (jaeger_mutex) JAEGERTRACINGC_MUTEX_INIT;
+    if (!jaeger_thread_local_init(&alloc->caches)) {
+        return false;
+    }
+    ((jaeger_allocator*) alloc)->malloc = &slab_malloc;
+    ((jaeger_allocator*) alloc)->realloc = &slab_realloc;
+    ((jaeger_allocator*) alloc)->free = &slab_free;
+    ((jaeger_allocator*) alloc)->free_sized = &slab_free_sized;
+    return true;
+}
+
+void jaeger_slab_allocator_destroy(jaeger_slab_allocator* alloc)
+{
+    if (alloc == NULL) {
+        return;
+    }
+    jaeger_thread_local_destroy(&alloc->caches);
+    for (slab_header* header = (slab_header*) alloc->slabs; header != NULL;) {
+        slab_header* next = header->next;
+        free(header);
+        header = next;
+    }
+    alloc->slabs = NULL;
+    for (slab_table* table = (slab_table*) alloc->slab_table; table != NULL;) {
+        slab_table* prev = table->prev;
+        free(table);
+        table = prev;
+    }
+    alloc->slab_table = NULL;
+    for (int i = 0; i < JAEGERTRACINGC_SLAB_NUM_CLASSES; i++) {
+        jaeger_mutex_destroy(&alloc->classes[i].mutex);
+    }
+    jaeger_mutex_destroy(&alloc->mutex);
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ * Size-class slab allocator with per-thread caches.
+ */
+
+#ifndef JAEGERTRACINGC_SLAB_ALLOCATOR_H
+#define JAEGERTRACINGC_SLAB_ALLOCATOR_H
+
+#include "jaegertracingc/alloc.h"
+#include "jaegertracingc/common.h"
+#include "jaegertracingc/threading.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Size and alignment of a slab. Must be a power of two. */
+#define JAEGERTRACINGC_SLAB_SIZE 65536
+/** Number of size classes. */
+#define JAEGERTRACINGC_SLAB_NUM_CLASSES 15
+/** Largest size served from slabs. Larger sizes go to the system. */
+#define JAEGERTRACINGC_SLAB_MAX_BLOCK_SIZE 1024
+/** Granularity of size classes, and alignment of every block. */
+#define JAEGERTRACINGC_SLAB_ALIGNMENT 16
+
+/** Blocks of one size, shared by all threads. */
+typedef struct jaeger_slab_class {
+    /** Size of every block in the class. */
+    size_t block_size;
+    /** Number of blocks moved between a thread cache and the class at once. */
+    int batch_size;
+    /** Free blocks not held by any thread cache. */
+    void* free_list;
+    /** Start of the unused part of the newest slab. */
+    char* next_block;
+    /** End of the newest slab. */
+    char* slab_end;
+    /** Lock to avoid data races. */
+    jaeger_mutex mutex;
+} jaeger_slab_class;
+
+/**
+ * Allocator that serves small sizes from fixed size classes carved out of
+ * aligned slabs. Each thread allocates from and frees to its own cache of
+ * blocks, and only takes a lock to move a batch of blocks between its cache
+ * and the shared class. Nearly everything the tracer allocates (spans, tags,
+ * IDs, short strings) fits a size class, and blocks need no header, since
+ * the slab a block belongs to records its size class. Larger sizes come
+ * straight from malloc. Slabs are returned to the system only when the
+ * allocator is destroyed.
+ * @extends jaeger_allocator
+ */
+typedef struct jaeger_slab_allocator {
+    /** Base class member. */
+    jaeger_allocator base;
+    /** Size classes in increasing order of block size. */
+    jaeger_slab_class classes[JAEGERTRACINGC_SLAB_NUM_CLASSES];
+    /** Size class of each size, in units of the alignment. */
+    uint8_t class_index[JAEGERTRACINGC_SLAB_MAX_BLOCK_SIZE /
+                            JAEGERTRACINGC_SLAB_ALIGNMENT +
+                        1];
+    /** Cache of the calling thread. */
+    jaeger_thread_local caches;
+    /** Every slab the allocator owns. */
+    void* slabs;
+    /** Set of slab addresses, to tell slab blocks from large allocations. */
+    void* slab_table;
+    /** Lock guarding the list and set of slabs. */
+    jaeger_mutex mutex;
+} jaeger_slab_allocator;
+
+/**
+ * Initialize a slab allocator. Install it with jaeger_set_allocator before
+ * any allocation made with the previous allocator is freed, or after all of
+ * them are.
+ * @param alloc Allocator to initialize.
+ * @return True on success, false otherwise.
+ */
+bool jaeger_slab_allocator_init(jaeger_slab_allocator* alloc);
+
+/**
+ * Release all memory held by a slab allocator, including blocks that were
+ * never freed. No other thread may use the allocator during or after the
+ * call.
+ * @param alloc Allocator to destroy.
+ */
+void jaeger_slab_allocator_destroy(jaeger_slab_allocator* alloc);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif /* __cplusplus */
+
+#endif /* JAEGERTRACINGC_SLAB_ALLOCATOR_H */
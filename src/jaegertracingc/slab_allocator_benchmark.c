@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jaegertracingc/benchmark_helpers.h"
+#include "jaegertracingc/key_value.h"
+#include "jaegertracingc/slab_allocator.h"
+#include "jaegertracingc/span.h"
+
+#define NUM_SPANS 1048576
+#define MAX_THREADS 8
+/* Spans held at once, as in a reporter queue waiting for a flush. */
+#define WINDOW_SIZE 256
+#define NUM_TAGS 4
+/* Span struct, protobuf span, trace ID, log record and three allocations
+ * per tag: node, key and value. */
+#define ALLOCS_PER_SPAN (4 + 3 * NUM_TAGS)
+
+typedef struct span_allocs {
+    void* ptrs[ALLOCS_PER_SPAN];
+} span_allocs;
+
+/* Allocates what a sampled span allocates, in sizes taken from the real
+ * structs, and frees spans in the order they were started. */
+static void* span_workload(void* arg)
+{
+    const int num_spans = *(int*) arg;
+    static const size_t tag_sizes[] = {
+        sizeof(jaeger_key_value_node), 12, 24};
+    span_allocs window[WINDOW_SIZE];
+    memset(window, 0, sizeof(window));
+    for (int i = 0; i < num_spans; i++) {
+        span_allocs* span = &window[i % WINDOW_SIZE];
+        for (int j = 0; j < ALLOCS_PER_SPAN; j++) {
+            jaeger_free(span->ptrs[j]);
+        }
+        int j = 0;
+        span->ptrs[j++] = jaeger_malloc(sizeof(jaeger_span));
+        span->ptrs[j++] = jaeger_malloc(sizeof(Jaeger__Model__Span));
+        span->ptrs[j++] = jaeger_malloc(2 * sizeof(uint64_t));
+        span->ptrs[j++] = jaeger_malloc(sizeof(jaeger_log_record));
+        for (int k = 0; k < NUM_TAGS; k++) {
+            for (int l = 0; l < 3; l++) {
+                span->ptrs[j++] = jaeger_malloc(tag_sizes[l]);
+            }
+        }
+    }
+    for (int i = 0; i < WINDOW_SIZE; i++) {
+        for (int j = 0; j < ALLOCS_PER_SPAN; j++) {
+            jaeger_free(window[i].ptrs[j]);
+        }
+    }
+    return NULL;
+}
+
+static void benchmark_allocator(const char* name,
+                                jaeger_allocator* alloc,
+                                int num_threads)
+{
+    char benchmark_name[64];
+    snprintf(benchmark_name,
+             sizeof(benchmark_name),
+             "%s/%d_threads",
+             name,
+             num_threads);
+    jaeger_allocator* prev_alloc = jaeger_get_allocator();
+    jaeger_set_allocator(alloc);
+    int num_spans = NUM_SPANS / num_threads;
+    jaeger_thread threads[MAX_THREADS];
+    jaeger_benchmark benchmark;
+    jaeger_benchmark_start(&benchmark, benchmark_name, NUM_SPANS);
+    for (int i = 0; i < num_threads; i++) {
+        jaeger_thread_init(&threads[i], &span_workload, &num_spans);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        jaeger_thread_join(threads[i], NULL);
+    }
+    jaeger_benchmark_stop(&benchmark);
+    jaeger_set_allocator(prev_alloc);
+}
+
+/* The built-in allocator measures whichever malloc the benchmark is linked
+ * with, so running it with LD_PRELOAD set to jemalloc or tcmalloc compares
+ * those as well. */
+int main()
+{
+    jaeger_slab_allocator slab_alloc;
+    if (!jaeger_slab_allocator_init(&slab_alloc)) {
+        return 1;
+    }
+    for (int num_threads = 1; num_threads <= MAX_THREADS; num_threads *= 2) {
+        benchmark_allocator(
+            "built_in_allocator", jaeger_built_in_allocator(), num_threads);
+        benchmark_allocator(
+            "slab_allocator", (jaeger_allocator*) &slab_alloc, num_threads);
+    }
+    jaeger_slab_allocator_destroy(&slab_alloc);
+    return 0;
+}
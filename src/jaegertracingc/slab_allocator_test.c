@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jaegertracingc/slab_allocator.h"
+#include "jaegertracingc/vector.h"
+#include "unity.h"
+
+#define NUM_THREADS 8
+#define NUM_BLOCKS 4096
+
+static inline void fill(char* ptr, size_t size, char value)
+{
+    memset(ptr, value, size);
+}
+
+static inline bool is_filled(const char* ptr, size_t size, char value)
+{
+    for (size_t i = 0; i < size; i++) {
+        if (ptr[i] != value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline void test_sizes(jaeger_allocator* alloc)
+{
+    /* Covers every size class and a few large sizes. */
+    char* ptrs[1200];
+    const int num_ptrs = sizeof(ptrs) / sizeof(ptrs[0]);
+    for (int i = 0; i < num_ptrs; i++) {
+        ptrs[i] = alloc->malloc(alloc, i);
+        TEST_ASSERT_NOT_NULL(ptrs[i]);
+        TEST_ASSERT_EQUAL(
+            0, (uintptr_t) ptrs[i] % JAEGERTRACINGC_SLAB_ALIGNMENT);
+        fill(ptrs[i], i, (char) i);
+    }
+    for (int i = 0; i < num_ptrs; i++) {
+        TEST_ASSERT_TRUE(is_filled(ptrs[i], i, (char) i));
+        alloc->free(alloc, ptrs[i]);
+    }
+    alloc->free(alloc, NULL);
+}
+
+static inline void test_free_sized(jaeger_allocator* alloc)
+{
+    TEST_ASSERT_NOT_NULL(alloc->free_sized);
+    char* ptrs[1200];
+    const int num_ptrs = sizeof(ptrs) / sizeof(ptrs[0]);
+    for (int i = 0; i < num_ptrs; i++) {
+        ptrs[i] = alloc->malloc(alloc, i);
+        TEST_ASSERT_NOT_NULL(ptrs[i]);
+        fill(ptrs[i], i, (char) i);
+    }
+    for (int i = 0; i < num_ptrs; i++) {
+        TEST_ASSERT_TRUE(is_filled(ptrs[i], i, (char) i));
+        alloc->free_sized(alloc, ptrs[i], i);
+    }
+    alloc->free_sized(alloc, NULL, 0);
+
+    /* Blocks freed by size are reused like any other. */
+    char* ptr = alloc->malloc(alloc, 100);
+    TEST_ASSERT_NOT_NULL(ptr);
+    alloc->free_sized(alloc, ptr, 100);
+    TEST_ASSERT_EQUAL_PTR(ptr, alloc->malloc(alloc, 100));
+    alloc->free(alloc, ptr);
+
+    /* A reallocated block is freed with its latest size. */
+    ptr = alloc->malloc(alloc, 10);
+    TEST_ASSERT_NOT_NULL(ptr);
+    ptr = alloc->realloc(alloc, ptr, 2 * JAEGERTRACINGC_SLAB_MAX_BLOCK_SIZE);
+    TEST_ASSERT_NOT_NULL(ptr);
+    alloc->free_sized(alloc, ptr, 2 * JAEGERTRACINGC_SLAB_MAX_BLOCK_SIZE);
+}
+
+static inline void test_realloc(jaeger_allocator* alloc)
+{
+    char* ptr = alloc->realloc(alloc, NULL, 10);
+    TEST_ASSERT_NOT_NULL(ptr);
+    fill(ptr, 10, 'a');
+    /* Growing within a size class keeps the block. */
+    TEST_ASSERT_EQUAL_PTR(ptr, alloc->realloc(alloc, ptr, 16));
+    for (size_t size = 32; size <= 4 * JAEGERTRACINGC_SLAB_MAX_BLOCK_SIZE;
+         size *= 2) {
+        ptr = alloc->realloc(alloc, ptr, size);
+        TEST_ASSERT_NOT_NULL(ptr);
+        TEST_ASSERT_TRUE(is_filled(ptr, 10, 'a'));
+    }
+    /* Shrinking a large allocation to a small size moves it to a slab. */
+    ptr = alloc->realloc(alloc, ptr, 10);
+    TEST_ASSERT_NOT_NULL(ptr);
+    TEST_ASSERT_TRUE(is_filled(ptr, 10, 'a'));
+    alloc->free(alloc, ptr);
+}
+
+static inline void test_large(jaeger_allocator* alloc)
+{
+    /* Enough blocks for over a hundred slabs, between large allocations
+     * that free must tell apart from them. */
+    enum { num_ptrs = 2 * NUM_BLOCKS };
+    static char* ptrs[num_ptrs];
+    for (int i = 0; i < num_ptrs; i++) {
+        const size_t size = (i % 2 == 0) ? JAEGERTRACINGC_SLAB_MAX_BLOCK_SIZE
+                                         : JAEGERTRACINGC_SLAB_MAX_BLOCK_SIZE + 1;
+        ptrs[i] = alloc->malloc(alloc, size);
+        TEST_ASSERT_NOT_NULL(ptrs[i]);
+        TEST_ASSERT_EQUAL(
+            0, (uintptr_t) ptrs[i] % JAEGERTRACINGC_SLAB_ALIGNMENT);
+        fill(ptrs[i], size, (char) i);
+    }
+    /* Large allocations that stay large keep their contents. */
+    for (int i = 1; i < num_ptrs; i += 2) {
+        ptrs[i] = alloc->realloc(alloc, ptrs[i], 4096);
+        TEST_ASSERT_NOT_NULL(ptrs[i]);
+        TEST_ASSERT_TRUE(is_filled(
+            ptrs[i], JAEGERTRACINGC_SLAB_MAX_BLOCK_SIZE + 1, (char) i));
+    }
+    for (int i = 0; i < num_ptrs; i++) {
+        TEST_ASSERT_TRUE(
+            is_filled(ptrs[i], JAEGERTRACINGC_SLAB_MAX_BLOCK_SIZE, (char) i));
+        alloc->free(alloc, ptrs[i]);
+    }
+}
+
+typedef struct thread_arg {
+    jaeger_allocator* alloc;
+    char** blocks;
+    int num_blocks;
+} thread_arg;
+
+static void* alloc_func(void* arg)
+{
+    thread_arg* a = (thread_arg*) arg;
+    jaeger_allocator* alloc = a->alloc;
+    char* blocks[NUM_BLOCKS];
+    for (int round = 0; round < 4; round++) {
+        for (int i = 0; i < NUM_BLOCKS; i++) {
+            const size_t size = (i * 7) % JAEGERTRACINGC_SLAB_MAX_BLOCK_SIZE;
+            blocks[i] = alloc->malloc(alloc, size);
+            TEST_ASSERT_NOT_NULL(blocks[i]);
+            fill(blocks[i], size, (char) i);
+        }
+        for (int i = 0; i < NUM_BLOCKS; i++) {
+            const size_t size = (i * 7) % JAEGERTRACINGC_SLAB_MAX_BLOCK_SIZE;
+            TEST_ASSERT_TRUE(is_filled(blocks[i], size, (char) i));
+            alloc->free(alloc, blocks[i]);
+        }
+    }
+    /* Free blocks that another thread allocated. */
+    for (int i = 0; i < a->num_blocks; i++) {
+        alloc->free(alloc, a->blocks[i]);
+    }
+    return NULL;
+}
+
+static inline void test_threads(jaeger_allocator* alloc)
+{
+    static char* blocks[NUM_THREADS][NUM_BLOCKS];
+    thread_arg args[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; i++) {
+        for (int j = 0; j < NUM_BLOCKS; j++) {
+            blocks[i][j] = alloc->malloc(alloc, 40);
+            TEST_ASSERT_NOT_NULL(blocks[i][j]);
+        }
+        args[i] = (thread_arg){
+            .alloc = alloc, .blocks = blocks[i], .num_blocks = NUM_BLOCKS};
+    }
+    jaeger_thread threads[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; i++) {
+        TEST_ASSERT_EQUAL(
+            0, jaeger_thread_init(&threads[i], &alloc_func, &args[i]));
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        jaeger_thread_join(threads[i], NULL);
+    }
+}
+
+static inline void test_installed(jaeger_allocator* alloc)
+{
+    jaeger_allocator* prev_alloc = jaeger_get_allocator();
+    jaeger_set_allocator(alloc);
+    char* str = jaeger_strdup("hello world");
+    TEST_ASSERT_EQUAL_STRING("hello world", str);
+    jaeger_free_sized(str, sizeof("hello world"));
+    jaeger_vector vec;
+    TEST_ASSERT_TRUE(jaeger_vector_init(&vec, sizeof(int)));
+    for (int i = 0; i < 1000; i++) {
+        int* x = jaeger_vector_append(&vec);
+        TEST_ASSERT_NOT_NULL(x);
+        *x = i;
+    }
+    TEST_ASSERT_EQUAL(999, *(int*) jaeger_vector_get(&vec, 999));
+    jaeger_vector_destroy(&vec);
+    jaeger_set_allocator(prev_alloc);
+}
+
+void test_slab_allocator()
+{
+    jaeger_slab_allocator slab_alloc;
+    TEST_ASSERT_TRUE(jaeger_slab_allocator_init(&slab_alloc));
+    jaeger_allocator* alloc = (jaeger_allocator*) &slab_alloc;
+    test_sizes(alloc);
+    test_free_sized(alloc);
+    test_realloc(alloc);
+    test_large(alloc);
+    test_threads(alloc);
+    test_installed(alloc);
+    jaeger_slab_allocator_destroy(&slab_alloc);
+    jaeger_slab_allocator_destroy(NULL);
+
+    /* Blocks still allocated are released on destroy. */
+    TEST_ASSERT_TRUE(jaeger_slab_allocator_init(&slab_alloc));
+    TEST_ASSERT_NOT_NULL(alloc->malloc(alloc, 100));
+    jaeger_slab_allocator_destroy(&slab_alloc);
+}
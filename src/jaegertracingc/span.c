@@ -15,6 +15,8 @@
  */
 
 #include "jaegertracingc/span.h"
+#include "jaegertracingc/accounting_allocator.h"
+#include "jaegertracingc/strings.h"
 
 void jaeger_span_context_destroy(jaeger_destructible* d)
 {
@@ -27,6 +29,10 @@ void jaeger_span_context_destroy(jaeger_destructible* d)
         jaeger_free(ctx->debug_id);
         ctx->debug_id = NULL;
     }
+    if (ctx->trace_state != NULL) {
+        jaeger_free(ctx->trace_state);
+        ctx->trace_state = NULL;
+    }
     jaeger_mutex_destroy(&ctx->mutex);
 }
 
@@ -68,10 +74,13 @@ bool jaeger_span_context_copy(jaeger_span_context* restrict dst,
     *dst = (jaeger_span_context) JAEGERTRACINGC_SPAN_CONTEXT_INIT;
     jaeger_lock((jaeger_mutex*) &src->mutex, &dst->mutex);
     if (!jaeger_hashtable_copy(&dst->baggage, &src->baggage)) {
-        jaeger_mutex_unlock((jaeger_mutex*) &src->mutex);
-        jaeger_mutex_unlock(&dst->mutex);
-        jaeger_span_context_destroy((jaeger_destructible*) dst);
-        return false;
+        goto cleanup;
+    }
+    if (src->trace_state != NULL) {
+        dst->trace_state = jaeger_strdup(src->trace_state);
+        if (dst->trace_state == NULL) {
+            goto cleanup;
+        }
     }
     dst->trace_id = src->trace_id;
     dst->span_id = src->span_id;
@@ -79,6 +88,12 @@ bool jaeger_span_context_copy(jaeger_span_context* restrict dst,
     jaeger_mutex_unlock((jaeger_mutex*) &src->mutex);
     jaeger_mutex_unlock(&dst->mutex);
     return true;
+
+cleanup:
+    jaeger_mutex_unlock((jaeger_mutex*) &src->mutex);
+    jaeger_mutex_unlock(&dst->mutex);
+    jaeger_span_context_destroy((jaeger_destructible*) dst);
+    return false;
 }
 
 bool jaeger_span_context_is_valid(const jaeger_span_context* ctx)
@@ -138,9 +153,9 @@ void jaeger_span_ref_protobuf_destroy(Jaeger__Model__SpanRef* span_ref)
         return;
     }
 
-    jaeger_free(span_ref->trace_id.data);
+    jaeger_free_sized(span_ref->trace_id.data, span_ref->trace_id.len);
     span_ref->trace_id = (ProtobufCBinaryData){.data = NULL, .len = 0};
-    jaeger_free(span_ref->span_id.data);
+    jaeger_free_sized(span_ref->span_id.data, span_ref->span_id.len);
     span_ref->span_id = (ProtobufCBinaryData){.data = NULL, .len = 0};
 }
 
@@ -164,7 +179,7 @@ bool jaeger_span_ref_to_protobuf(Jaeger__Model__SpanRef* restrict dst,
         .data = jaeger_malloc(sizeof(src->context.span_id))};
     if (dst->span_id.data == NULL) {
         jaeger_log_error("Cannot allocate span ID for span ref message");
-        jaeger_free(dst->trace_id.data);
+        jaeger_free_sized(dst->trace_id.data, dst->trace_id.len);
         dst->trace_id = (ProtobufCBinaryData){.data = NULL, .len = 0};
         dst->span_id = (ProtobufCBinaryData){.data = NULL, .len = 0};
         return false;
@@ -180,6 +195,17 @@ bool jaeger_span_ref_to_protobuf(Jaeger__Model__SpanRef* restrict dst,
     return true;
 }
 
+/* Binds the span's allocator to the calling thread and returns the previous
+ * binding. Spans that were never initialized keep the current binding. */
+static inline jaeger_allocator* bind_allocator(const jaeger_span* span)
+{
+    jaeger_allocator* prev_alloc = jaeger_get_thread_allocator();
+    if (span->allocator != NULL) {
+        jaeger_set_thread_allocator(span->allocator);
+    }
+    return prev_alloc;
+}
+
 void jaeger_span_destroy(jaeger_destructible* d)
 {
     if (d == NULL) {
@@ -187,6 +213,7 @@ void jaeger_span_destroy(jaeger_destructible* d)
     }
 
     jaeger_span* span = (jaeger_span*) d;
+    jaeger_allocator* prev_alloc = bind_allocator(span);
     if (span->tracer != NULL) {
         span->tracer = NULL;
     }
@@ -204,6 +231,7 @@ void jaeger_span_destroy(jaeger_destructible* d)
     jaeger_vector_destroy(&span->logs);
     jaeger_vector_destroy(&span->refs);
     jaeger_mutex_destroy(&span->mutex);
+    jaeger_set_thread_allocator(prev_alloc);
 }
 
 bool jaeger_span_init_vectors(jaeger_span* span)
@@ -257,20 +285,20 @@ void jaeger_span_finish_with_options(
     }
     jaeger_mutex_lock(&span->mutex);
     if (jaeger_span_is_sampled_no_locking(span)) {
-        jaeger_duration finish_time = options->finish_time;
-        if (finish_time.value.tv_sec == 0 && finish_time.value.tv_nsec == 0) {
-            jaeger_duration_now(&finish_time);
+        int64_t finish_time =
+            jaeger_time_value_to_ns(&options->finish_time.value);
+        if (finish_time == 0) {
+            finish_time = jaeger_duration_now_ns();
         }
-        const bool result = jaeger_time_subtract(finish_time.value,
-                                                 span->start_time_steady.value,
-                                                 &span->duration.value);
-        (void) result;
-        assert(result);
+        span->duration = finish_time - span->start_time_steady;
+        assert(span->duration >= 0);
 
         assert(options->num_log_records == 0 || options->log_records != NULL);
+        jaeger_allocator* prev_alloc = bind_allocator(span);
         for (int i = 0; i < options->num_log_records; i++) {
             jaeger_span_log_no_locking(span, &options->log_records[i]);
         }
+        jaeger_set_thread_allocator(prev_alloc);
     }
     jaeger_mutex_unlock(&span->mutex);
 
@@ -303,6 +331,7 @@ void jaeger_span_set_operation_name(opentracing_span* s,
     assert(operation_name != NULL);
     jaeger_span* span = (jaeger_span*) s;
     jaeger_mutex_lock(&span->mutex);
+    jaeger_allocator* prev_alloc = bind_allocator(span);
     if (!jaeger_span_is_sampled_no_locking(span)) {
         goto cleanup;
     }
@@ -319,6 +348,7 @@ void jaeger_span_set_operation_name(opentracing_span* s,
     goto cleanup;
 
 cleanup:
+    jaeger_set_thread_allocator(prev_alloc);
     jaeger_mutex_unlock(&span->mutex);
 }
 
@@ -329,7 +359,12 @@ void jaeger_span_set_baggage_item(opentracing_span* span,
     jaeger_span* s = (jaeger_span*) span;
     jaeger_lock(&s->mutex, &s->context.mutex);
     /* TODO: Use baggage setter for validation once implemented. */
+    jaeger_allocator* prev_alloc = bind_allocator(s);
+    const jaeger_alloc_tag prev_tag =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_baggage);
     jaeger_hashtable_put(&s->context.baggage, key, value);
+    jaeger_alloc_context_exit(prev_tag);
+    jaeger_set_thread_allocator(prev_alloc);
     jaeger_mutex_unlock(&s->mutex);
     jaeger_mutex_unlock(&s->context.mutex);
 }
@@ -411,7 +446,12 @@ void jaeger_span_set_tag(opentracing_span* span,
     }
     jaeger_mutex_lock(&s->mutex);
     if (jaeger_span_is_sampled_no_locking(s)) {
+        jaeger_allocator* prev_alloc = bind_allocator(s);
+        const jaeger_alloc_tag prev_tag =
+            jaeger_alloc_context_enter(jaeger_alloc_tag_span);
         jaeger_span_set_tag_no_locking(s, key, value);
+        jaeger_alloc_context_exit(prev_tag);
+        jaeger_set_thread_allocator(prev_alloc);
     }
     jaeger_mutex_unlock(&s->mutex);
 }
@@ -431,7 +471,12 @@ void jaeger_span_log(opentracing_span* span,
     jaeger_span* s = (jaeger_span*) span;
     jaeger_mutex_lock(&s->mutex);
     if (jaeger_span_is_sampled_no_locking(s)) {
+        jaeger_allocator* prev_alloc = bind_allocator(s);
+        const jaeger_alloc_tag prev_tag =
+            jaeger_alloc_context_enter(jaeger_alloc_tag_span);
         jaeger_span_log_no_locking(s, &log_record);
+        jaeger_alloc_context_exit(prev_tag);
+        jaeger_set_thread_allocator(prev_alloc);
     }
     jaeger_mutex_unlock(&s->mutex);
 }
@@ -440,6 +485,7 @@ bool jaeger_span_init(jaeger_span* span)
 {
     assert(span != NULL);
     *span = (jaeger_span) JAEGERTRACINGC_SPAN_INIT;
+    span->allocator = jaeger_get_allocator();
     if (!jaeger_span_context_init(&span->context)) {
         return false;
     }
@@ -459,6 +505,7 @@ bool jaeger_span_copy(jaeger_span* restrict dst,
     assert(dst != NULL);
     assert(src != NULL);
     *dst = (jaeger_span) JAEGERTRACINGC_SPAN_INIT;
+    dst->allocator = jaeger_get_allocator();
     if (!jaeger_span_init_vectors(dst)) {
         return false;
     }
@@ -501,7 +548,12 @@ cleanup:
     return false;
 }
 
-void jaeger_protobuf_list_destroy(void** data, int num, void (*destroy)(void*))
+/* Frees each element with jaeger_free_sized, or with jaeger_free if
+ * value_size is zero. */
+static inline void protobuf_list_destroy(void** data,
+                                         int num,
+                                         size_t value_size,
+                                         void (*destroy)(void*))
 {
     if (num == 0) {
         return;
@@ -514,32 +566,60 @@ void jaeger_protobuf_list_destroy(void** data, int num, void (*destroy)(void*))
             continue;
         }
         destroy(data[i]);
-        jaeger_free(data[i]);
+        if (value_size == 0) {
+            jaeger_free(data[i]);
+        }
+        else {
+            jaeger_free_sized(data[i], value_size);
+        }
     }
     jaeger_free(data);
 }
 
+void jaeger_protobuf_list_destroy(void** data, int num, void (*destroy)(void*))
+{
+    protobuf_list_destroy(data, num, 0, destroy);
+}
+
+void jaeger_protobuf_list_destroy_sized(void** data,
+                                        int num,
+                                        size_t value_size,
+                                        void (*destroy)(void*))
+{
+    protobuf_list_destroy(data, num, value_size, destroy);
+}
+
 void jaeger_span_protobuf_destroy(Jaeger__Model__Span* span)
 {
     if (span == NULL) {
         return;
     }
-    jaeger_free(span->trace_id.data);
+    jaeger_free_sized(span->trace_id.data, span->trace_id.len);
     span->trace_id = (ProtobufCBinaryData){.data = NULL, .len = 0};
-    jaeger_free(span->span_id.data);
+    jaeger_free_sized(span->span_id.data, span->span_id.len);
     span->span_id = (ProtobufCBinaryData){.data = NULL, .len = 0};
     jaeger_free(span->operation_name);
     span->operation_name = NULL;
-    jaeger_protobuf_list_destroy((void**) span->references,
-                                 span->n_references,
-                                 &jaeger_span_ref_protobuf_destroy_wrapper);
+    jaeger_free_sized(span->start_time, sizeof(Google__Protobuf__Timestamp));
+    span->start_time = NULL;
+    jaeger_free_sized(span->duration, sizeof(Google__Protobuf__Duration));
+    span->duration = NULL;
+    jaeger_protobuf_list_destroy_sized(
+        (void**) span->references,
+        span->n_references,
+        sizeof(Jaeger__Model__SpanRef),
+        &jaeger_span_ref_protobuf_destroy_wrapper);
     span->references = NULL;
-    jaeger_protobuf_list_destroy((void**) span->logs,
-                                 span->n_logs,
-                                 &jaeger_log_record_protobuf_destroy_wrapper);
+    jaeger_protobuf_list_destroy_sized(
+        (void**) span->logs,
+        span->n_logs,
+        sizeof(Jaeger__Model__Log),
+        &jaeger_log_record_protobuf_destroy_wrapper);
     span->logs = NULL;
-    jaeger_protobuf_list_destroy(
-        (void**) span->tags, span->n_tags, &jaeger_tag_destroy_wrapper);
+    jaeger_protobuf_list_destroy_sized((void**) span->tags,
+                                       span->n_tags,
+                                       sizeof(jaeger_tag),
+                                       &jaeger_tag_destroy_wrapper);
     span->tags = NULL;
 }
 
@@ -572,6 +652,27 @@ bool jaeger_span_to_protobuf(Jaeger__Model__Span* restrict dst,
         goto cleanup;
     }
 
+    dst->start_time = jaeger_malloc(sizeof(Google__Protobuf__Timestamp));
+    if (dst->start_time == NULL) {
+        goto cleanup;
+    }
+    *dst->start_time =
+        (Google__Protobuf__Timestamp) GOOGLE__PROTOBUF__TIMESTAMP__INIT;
+    opentracing_time_value time_value;
+    jaeger_time_value_from_ns(src->start_time_system, &time_value);
+    dst->start_time->seconds = time_value.tv_sec;
+    dst->start_time->nanos = time_value.tv_nsec;
+
+    dst->duration = jaeger_malloc(sizeof(Google__Protobuf__Duration));
+    if (dst->duration == NULL) {
+        goto cleanup;
+    }
+    *dst->duration =
+        (Google__Protobuf__Duration) GOOGLE__PROTOBUF__DURATION__INIT;
+    jaeger_time_value_from_ns(src->duration, &time_value);
+    dst->duration->seconds = time_value.tv_sec;
+    dst->duration->nanos = time_value.tv_nsec;
+
     if (!jaeger_vector_protobuf_copy((void***) &dst->tags,
                                      &dst->n_tags,
                                      &src->tags,
@@ -621,74 +722,258 @@ int jaeger_span_context_format(const jaeger_span_context* ctx,
     assert(ctx != NULL);
     assert(buffer != NULL);
     assert(buffer_len >= 0);
-    const int trace_id_len =
-        jaeger_trace_id_format(&ctx->trace_id, buffer, buffer_len);
+    char str[JAEGERTRACINGC_SPAN_CONTEXT_MAX_STR_LEN + 1];
+    jaeger_mutex_lock((jaeger_mutex*) &ctx->mutex);
+    int len = jaeger_trace_id_format(&ctx->trace_id, str, sizeof(str));
+    str[len++] = ':';
+    len += encode_hex_uint64_trimmed(&str[len], ctx->span_id);
+    str[len++] = ':';
+    len += encode_hex_uint64_trimmed(&str[len], ctx->flags);
+    jaeger_mutex_unlock((jaeger_mutex*) &ctx->mutex);
+    assert(len <= JAEGERTRACINGC_SPAN_CONTEXT_MAX_STR_LEN);
+    copy_formatted(buffer, buffer_len, str, len);
+    return len;
+}
+
+bool jaeger_span_context_scan(jaeger_span_context* ctx, const char* str)
+{
+    assert(ctx != NULL);
+    assert(str != NULL);
+    /* Parse each field in place instead of copying and tokenizing the input.
+     * Fields following the flags are ignored. */
+    const char* trace_id_end = strchr(str, ':');
+    if (trace_id_end == NULL) {
+        return false;
+    }
+    jaeger_trace_id trace_id = JAEGERTRACINGC_TRACE_ID_INIT;
+    if (!jaeger_trace_id_scan_n(&trace_id, str, trace_id_end - str)) {
+        return false;
+    }
+
+    const char* span_id_str = trace_id_end + 1;
+    const char* span_id_end = strchr(span_id_str, ':');
+    uint64_t span_id = 0;
+    if (span_id_end == NULL ||
+        !decode_hex_uint64(span_id_str, span_id_end - span_id_str, &span_id)) {
+        return false;
+    }
+
+    const char* flags_str = span_id_end + 1;
+    const char* flags_end = strchr(flags_str, ':');
+    if (flags_end == NULL) {
+        flags_end = flags_str + strlen(flags_str);
+    }
+    uint64_t flags = 0;
+    if (!decode_hex_uint64(flags_str, flags_end - flags_str, &flags)) {
+        return false;
+    }
+
+    jaeger_mutex_lock(&ctx->mutex);
+    ctx->trace_id = trace_id;
+    ctx->span_id = span_id;
+    ctx->flags = (uint8_t) flags;
+    jaeger_mutex_unlock(&ctx->mutex);
+    return true;
+}
+
+int jaeger_span_context_format_traceparent(const jaeger_span_context* ctx,
+                                           char* buffer,
+                                           int buffer_len)
+{
+    assert(ctx != NULL);
+    assert(buffer != NULL);
+    assert(buffer_len >= 0);
+    char str[JAEGERTRACINGC_TRACEPARENT_STR_LEN + 1];
+    memcpy(str, "00-", 3);
+    jaeger_mutex_lock((jaeger_mutex*) &ctx->mutex);
+    encode_hex_uint64(&str[3], ctx->trace_id.high);
+    encode_hex_uint64(&str[19], ctx->trace_id.low);
+    str[35] = '-';
+    encode_hex_uint64(&str[36], ctx->span_id);
+    const bool sampled =
+        (ctx->flags & (uint8_t) jaeger_sampling_flag_sampled) != 0;
+    jaeger_mutex_unlock((jaeger_mutex*) &ctx->mutex);
+    memcpy(&str[52], sampled ? "-01" : "-00", 3);
+    copy_formatted(
+        buffer, buffer_len, str, JAEGERTRACINGC_TRACEPARENT_STR_LEN);
+    return JAEGERTRACINGC_TRACEPARENT_STR_LEN;
+}
+
+/* W3C Trace Context only allows lowercase hex digits. The digits are
+ * checked explicitly, since ctype functions depend on the locale. */
+static inline bool
+decode_lowercase_hex_uint64(const char* str, size_t len, uint64_t* result)
+{
+    assert(len > 0 && len <= sizeof(uint64_t) * 2);
+    uint64_t value = 0;
+    for (size_t i = 0; i < len; i++) {
+        const char c = str[i];
+        uint64_t nibble;
+        if (c >= '0' && c <= '9') {
+            nibble = (uint64_t) (c - '0');
+        }
+        else if (c >= 'a' && c <= 'f') {
+            nibble = (uint64_t) (c - 'a' + 10);
+        }
+        else {
+            return false;
+        }
+        value = (value << 4u) | nibble;
+    }
+    *result = value;
+    return true;
+}
+
+bool jaeger_span_context_scan_traceparent(jaeger_span_context* ctx,
+                                          const char* str)
+{
+    assert(ctx != NULL);
+    assert(str != NULL);
+    const size_t len = strlen(str);
+    if (len < JAEGERTRACINGC_TRACEPARENT_STR_LEN || str[2] != '-' ||
+        str[35] != '-' || str[52] != '-') {
+        return false;
+    }
+    uint64_t version = 0;
+    if (!decode_lowercase_hex_uint64(str, 2, &version) || version == 0xff) {
+        return false;
+    }
+    /* Version 00 has a fixed length. Later versions may append fields after
+     * the flags, which are ignored. */
+    if (version == 0 ? len != JAEGERTRACINGC_TRACEPARENT_STR_LEN
+                     : (len > JAEGERTRACINGC_TRACEPARENT_STR_LEN &&
+                        str[JAEGERTRACINGC_TRACEPARENT_STR_LEN] != '-')) {
+        return false;
+    }
+
+    jaeger_trace_id trace_id = JAEGERTRACINGC_TRACE_ID_INIT;
+    uint64_t span_id = 0;
+    uint64_t flags = 0;
+    if (!decode_lowercase_hex_uint64(&str[3], 16, &trace_id.high) ||
+        !decode_lowercase_hex_uint64(&str[19], 16, &trace_id.low) ||
+        !decode_lowercase_hex_uint64(&str[36], 16, &span_id) ||
+        !decode_lowercase_hex_uint64(&str[53], 2, &flags)) {
+        return false;
+    }
+    if ((trace_id.high == 0 && trace_id.low == 0) || span_id == 0) {
+        return false;
+    }
+
+    jaeger_mutex_lock(&ctx->mutex);
+    ctx->trace_id = trace_id;
+    ctx->span_id = span_id;
+    ctx->flags = (flags & 1u) != 0 ? (uint8_t) jaeger_sampling_flag_sampled : 0;
+    jaeger_mutex_unlock(&ctx->mutex);
+    return true;
+}
+
+int jaeger_span_context_format_b3(const jaeger_span_context* ctx,
+                                  char* buffer,
+                                  int buffer_len)
+{
+    assert(ctx != NULL);
+    assert(buffer != NULL);
+    assert(buffer_len >= 0);
+    char str[JAEGERTRACINGC_B3_MAX_STR_LEN + 1];
+    int len = 0;
     jaeger_mutex_lock((jaeger_mutex*) &ctx->mutex);
+    if (ctx->trace_id.high != 0) {
+        encode_hex_uint64(str, ctx->trace_id.high);
+        len += JAEGERTRACINGC_UINT64_MAX_STR_LEN;
+    }
+    encode_hex_uint64(&str[len], ctx->trace_id.low);
+    len += JAEGERTRACINGC_UINT64_MAX_STR_LEN;
+    str[len++] = '-';
+    encode_hex_uint64(&str[len], ctx->span_id);
+    len += JAEGERTRACINGC_UINT64_MAX_STR_LEN;
     const uint8_t flags = ctx->flags;
     jaeger_mutex_unlock((jaeger_mutex*) &ctx->mutex);
-    if (trace_id_len > buffer_len) {
-        return trace_id_len +
-               snprintf(NULL, 0, ":%" PRIx64 ":%" PRIx8, ctx->span_id, flags);
+    str[len++] = '-';
+    if ((flags & (uint8_t) jaeger_sampling_flag_debug) != 0) {
+        str[len++] = 'd';
     }
-    return snprintf(&buffer[trace_id_len],
-                    buffer_len - trace_id_len,
-                    ":%" PRIx64 ":%" PRIx8,
-                    ctx->span_id,
-                    flags);
+    else {
+        str[len++] =
+            (flags & (uint8_t) jaeger_sampling_flag_sampled) != 0 ? '1' : '0';
+    }
+    assert(len <= JAEGERTRACINGC_B3_MAX_STR_LEN);
+    copy_formatted(buffer, buffer_len, str, len);
+    return len;
 }
 
-bool jaeger_span_context_scan(jaeger_span_context* ctx, const char* str)
+/* Returns the end of the field starting at str, which is either the next '-'
+ * or the null byte. */
+static inline const char* b3_field_end(const char* str)
+{
+    const char* end = strchr(str, '-');
+    return end == NULL ? str + strlen(str) : end;
+}
+
+bool jaeger_span_context_scan_b3(jaeger_span_context* ctx, const char* str)
 {
     assert(ctx != NULL);
     assert(str != NULL);
-    bool result = true;
+    const char* trace_id_end = b3_field_end(str);
+    const int trace_id_len = trace_id_end - str;
     jaeger_trace_id trace_id = JAEGERTRACINGC_TRACE_ID_INIT;
-    char* buffer = jaeger_strdup(str);
-    if (buffer == NULL) {
+    if ((trace_id_len != JAEGERTRACINGC_UINT64_MAX_STR_LEN &&
+         trace_id_len != JAEGERTRACINGC_TRACE_ID_MAX_STR_LEN) ||
+        *trace_id_end != '-' ||
+        !jaeger_trace_id_scan_n(&trace_id, str, trace_id_len)) {
         return false;
     }
+
+    const char* span_id_str = trace_id_end + 1;
+    const char* span_id_end = b3_field_end(span_id_str);
     uint64_t span_id = 0;
+    if (span_id_end - span_id_str != JAEGERTRACINGC_UINT64_MAX_STR_LEN ||
+        !decode_hex_uint64(
+            span_id_str, JAEGERTRACINGC_UINT64_MAX_STR_LEN, &span_id)) {
+        return false;
+    }
+
+    /* The sampling state is absent when the decision is deferred. */
     uint8_t flags = 0;
-    char* token = buffer;
-    char* token_context = NULL;
-    char* token_end = NULL;
-    for (int i = 0; i < 4; i++) {
-        token = strtok_r(i == 0 ? token : NULL, ":", &token_context);
-        if (token == NULL && i != 3) {
-            result = false;
-            goto cleanup;
+    if (*span_id_end == '-') {
+        const char* sampling_str = span_id_end + 1;
+        const char* sampling_end = b3_field_end(sampling_str);
+        if (sampling_end - sampling_str != 1) {
+            return false;
         }
-        token_end = NULL;
-        switch (i) {
-        case 0:
-            if (!jaeger_trace_id_scan(&trace_id, token)) {
-                result = false;
-                goto cleanup;
-            }
+        switch (*sampling_str) {
+        case '0':
             break;
-        case 1:
-            span_id = strtoull(token, &token_end, 16);
+        case '1':
+            flags = jaeger_sampling_flag_sampled;
             break;
-        case 2:
-            flags = strtoull(token, &token_end, 16);
+        case 'd':
+            flags = (uint8_t) jaeger_sampling_flag_sampled |
+                    (uint8_t) jaeger_sampling_flag_debug;
             break;
         default:
-            assert(i == 3);
-            break;
+            return false;
         }
-        if (token_end != NULL && *token_end != '\0') {
-            result = false;
-            goto cleanup;
+
+        if (*sampling_end == '-') {
+            const char* parent_id_str = sampling_end + 1;
+            uint64_t parent_id = 0;
+            if (strlen(parent_id_str) != JAEGERTRACINGC_UINT64_MAX_STR_LEN ||
+                !decode_hex_uint64(parent_id_str,
+                                   JAEGERTRACINGC_UINT64_MAX_STR_LEN,
+                                   &parent_id)) {
+                return false;
+            }
         }
     }
 
+    if ((trace_id.high == 0 && trace_id.low == 0) || span_id == 0) {
+        return false;
+    }
+
     jaeger_mutex_lock(&ctx->mutex);
     ctx->trace_id = trace_id;
     ctx->span_id = span_id;
     ctx->flags = flags;
     jaeger_mutex_unlock(&ctx->mutex);
-
-cleanup:
-    jaeger_free(buffer);
-    return result;
+    return true;
 }
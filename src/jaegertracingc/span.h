@@ -45,6 +45,22 @@ extern "C" {
 #define JAEGERTRACINGC_SPAN_CONTEXT_MAX_STR_LEN \
     (JAEGERTRACINGC_TRACE_ID_MAX_STR_LEN + 21)
 
+/**
+ * Number of characters in a W3C traceparent representation of
+ * jaeger_span_context (excluding null byte).
+ * 2 hex version, 3 delimiters, 32 hex trace ID, 16 hex span ID, 2 hex flags.
+ * 2 + 3 + 32 + 16 + 2 = 55
+ */
+#define JAEGERTRACINGC_TRACEPARENT_STR_LEN 55
+
+/**
+ * Max number of characters needed for B3 single header representation of
+ * jaeger_span_context (excluding null byte).
+ * 2 delimiters, 32 hex trace ID, 16 hex span ID, 1 sampling state.
+ * 2 + 32 + 16 + 1 = 51
+ */
+#define JAEGERTRACINGC_B3_MAX_STR_LEN 51
+
 #define JAEGERTRACINGC_SAMPLING_PRIORITY "sampling.priority"
 
 enum {
@@ -81,6 +97,13 @@ typedef struct jaeger_span_context {
      */
     char* debug_id;
 
+    /**
+     * W3C tracestate received along with the span context, or NULL if there
+     * was none. Passed on unchanged to child spans.
+     * @see JAEGERTRACINGC_TRACESTATE_HEADER
+     */
+    char* trace_state;
+
     /**
      * Lock to protect mutable members.
      * @see baggage
@@ -102,7 +125,7 @@ static const int jaeger_span_context_type_descriptor_length =
                      jaeger_span_context_type_descriptor_length},           \
         .trace_id = JAEGERTRACINGC_TRACE_ID_INIT, .span_id = 0, .flags = 0, \
         .baggage = JAEGERTRACINGC_HASHTABLE_INIT, .debug_id = NULL,         \
-        .mutex = JAEGERTRACINGC_MUTEX_INIT                                  \
+        .trace_state = NULL, .mutex = JAEGERTRACINGC_MUTEX_INIT             \
     }
 
 void jaeger_span_context_destroy(jaeger_destructible* d);
@@ -175,16 +198,21 @@ typedef struct jaeger_span {
     opentracing_span base;
     /** Tracer that creates this span. */
     struct jaeger_tracer* tracer;
+    /**
+     * Allocator the span was initialized with, bound to the calling thread
+     * whenever the span allocates or frees memory.
+     */
+    jaeger_allocator* allocator;
     /** Span context. */
     jaeger_span_context context;
     /** Operation represented by this span. */
     char* operation_name;
-    /** Start time using system clock. */
-    jaeger_timestamp start_time_system;
-    /** Start time using monotonic/steady clock. */
-    jaeger_duration start_time_steady;
-    /** Overall duration of span (set on span finish). */
-    jaeger_duration duration;
+    /** Start time using system clock, in nanoseconds since the epoch. */
+    int64_t start_time_system;
+    /** Start time using monotonic/steady clock, in nanoseconds. */
+    int64_t start_time_steady;
+    /** Overall duration of span in nanoseconds (set on span finish). */
+    int64_t duration;
     /** Span tags. */
     jaeger_vector tags;
     /** Span log records. */
@@ -329,11 +357,10 @@ void jaeger_span_log(opentracing_span* span,
                  .log_fields = &jaeger_span_log,                               \
                  .set_baggage_item = &jaeger_span_set_baggage_item,            \
                  .baggage_item = &jaeger_span_baggage_item},                   \
-        .tracer = NULL, .context = JAEGERTRACINGC_SPAN_CONTEXT_INIT,           \
+        .tracer = NULL, .allocator = NULL,                                     \
+        .context = JAEGERTRACINGC_SPAN_CONTEXT_INIT,                           \
         .operation_name = NULL,                                                \
-        .start_time_system = JAEGERTRACINGC_TIMESTAMP_INIT,                    \
-        .start_time_steady = JAEGERTRACINGC_DURATION_INIT,                     \
-        .duration = JAEGERTRACINGC_DURATION_INIT,                              \
+        .start_time_system = 0, .start_time_steady = 0, .duration = 0,         \
         .tags = JAEGERTRACINGC_VECTOR_INIT,                                    \
         .logs = JAEGERTRACINGC_VECTOR_INIT,                                    \
         .refs = JAEGERTRACINGC_VECTOR_INIT, .mutex = JAEGERTRACINGC_MUTEX_INIT \
@@ -354,6 +381,13 @@ bool jaeger_span_copy(jaeger_span* restrict dst,
 
 void jaeger_protobuf_list_destroy(void** data, int num, void (*destroy)(void*));
 
+/* Same as jaeger_protobuf_list_destroy, but frees each element with
+ * jaeger_free_sized, given the size every element was allocated with. */
+void jaeger_protobuf_list_destroy_sized(void** data,
+                                        int num,
+                                        size_t value_size,
+                                        void (*destroy)(void*));
+
 void jaeger_span_protobuf_destroy(Jaeger__Model__Span* span);
 
 bool jaeger_span_to_protobuf(Jaeger__Model__Span* restrict dst,
@@ -365,6 +399,57 @@ int jaeger_span_context_format(const jaeger_span_context* ctx,
 
 bool jaeger_span_context_scan(jaeger_span_context* ctx, const char* str);
 
+/**
+ * Format a span context as a W3C traceparent header value. 64 bit trace IDs
+ * are padded to 128 bits. Only the sampled flag is propagated.
+ * @param ctx The span context to format.
+ * @param buffer The output character buffer.
+ * @param buffer_len The length of the output character buffer.
+ * @return The number of characters needed to represent the entire span
+ *         context, always JAEGERTRACINGC_TRACEPARENT_STR_LEN.
+ */
+int jaeger_span_context_format_traceparent(const jaeger_span_context* ctx,
+                                           char* buffer,
+                                           int buffer_len);
+
+/**
+ * Scan a W3C traceparent header value into a span context. Accepts version 00
+ * and, for forward compatibility, later versions with extra trailing fields.
+ * Rejects uppercase hex digits, all-zero trace and span IDs, and version ff.
+ * @param ctx The output span context.
+ * @param str The input traceparent.
+ * @return True on success, false otherwise.
+ * @see jaeger_span_context_format_traceparent()
+ */
+bool jaeger_span_context_scan_traceparent(jaeger_span_context* ctx,
+                                          const char* str);
+
+/**
+ * Format a span context as a B3 single header value of the form
+ * {trace ID}-{span ID}-{sampling state}. 64 bit trace IDs use 16 hex digits.
+ * The sampling state is "d" for debug spans, otherwise "1" or "0".
+ * @param ctx The span context to format.
+ * @param buffer The output character buffer.
+ * @param buffer_len The length of the output character buffer.
+ * @return The number of characters needed to represent the entire span
+ *         context, similar to the behavior of snprintf.
+ */
+int jaeger_span_context_format_b3(const jaeger_span_context* ctx,
+                                  char* buffer,
+                                  int buffer_len);
+
+/**
+ * Scan a B3 single header value into a span context. The trace ID must have
+ * 16 or 32 hex digits and the span ID 16. The sampling state and parent span
+ * ID are optional, and the parent span ID is validated but not kept. A value
+ * holding only a sampling state carries no span context and is rejected.
+ * @param ctx The output span context.
+ * @param str The input B3 value.
+ * @return True on success, false otherwise.
+ * @see jaeger_span_context_format_b3()
+ */
+bool jaeger_span_context_scan_b3(jaeger_span_context* ctx, const char* str);
+
 #ifdef __cplusplus
 } /* extern C */
 #endif /* __cplusplus */
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "jaegertracingc/span.h"
+
+static void check_traceparent_round_trip(const char* str)
+{
+    jaeger_span_context ctx = JAEGERTRACINGC_SPAN_CONTEXT_INIT;
+    if (!jaeger_span_context_scan_traceparent(&ctx, str)) {
+        return;
+    }
+    char traceparent[JAEGERTRACINGC_TRACEPARENT_STR_LEN + 1];
+    const int len = jaeger_span_context_format_traceparent(
+        &ctx, traceparent, sizeof(traceparent));
+    jaeger_span_context decoded_ctx = JAEGERTRACINGC_SPAN_CONTEXT_INIT;
+    if (len != JAEGERTRACINGC_TRACEPARENT_STR_LEN ||
+        !jaeger_span_context_scan_traceparent(&decoded_ctx, traceparent) ||
+        decoded_ctx.trace_id.high != ctx.trace_id.high ||
+        decoded_ctx.trace_id.low != ctx.trace_id.low ||
+        decoded_ctx.span_id != ctx.span_id ||
+        decoded_ctx.flags != ctx.flags) {
+        abort();
+    }
+}
+
+static void check_b3_round_trip(const char* str)
+{
+    jaeger_span_context ctx = JAEGERTRACINGC_SPAN_CONTEXT_INIT;
+    if (!jaeger_span_context_scan_b3(&ctx, str)) {
+        return;
+    }
+    char b3[JAEGERTRACINGC_B3_MAX_STR_LEN + 1];
+    const int len = jaeger_span_context_format_b3(&ctx, b3, sizeof(b3));
+    jaeger_span_context decoded_ctx = JAEGERTRACINGC_SPAN_CONTEXT_INIT;
+    if (len > JAEGERTRACINGC_B3_MAX_STR_LEN ||
+        !jaeger_span_context_scan_b3(&decoded_ctx, b3) ||
+        decoded_ctx.trace_id.high != ctx.trace_id.high ||
+        decoded_ctx.trace_id.low != ctx.trace_id.low ||
+        decoded_ctx.span_id != ctx.span_id) {
+        abort();
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    uint8_t buffer[size + 1];
+    memcpy(buffer, data, size);
+    buffer[size] = '\0';
+    check_traceparent_round_trip((const char*) buffer);
+    check_b3_round_trip((const char*) buffer);
+    jaeger_span_context ctx = JAEGERTRACINGC_SPAN_CONTEXT_INIT;
+    if (!jaeger_span_context_scan(&ctx, (const char*) buffer)) {
+        return 0;
+    }
+
+    /* Anything accepted must survive a format/scan round trip. */
+    char str[JAEGERTRACINGC_SPAN_CONTEXT_MAX_STR_LEN + 1];
+    const int len = jaeger_span_context_format(&ctx, str, sizeof(str));
+    jaeger_span_context decoded_ctx = JAEGERTRACINGC_SPAN_CONTEXT_INIT;
+    if (len > JAEGERTRACINGC_SPAN_CONTEXT_MAX_STR_LEN ||
+        !jaeger_span_context_scan(&decoded_ctx, str) ||
+        decoded_ctx.trace_id.high != ctx.trace_id.high ||
+        decoded_ctx.trace_id.low != ctx.trace_id.low ||
+        decoded_ctx.span_id != ctx.span_id ||
+        decoded_ctx.flags != ctx.flags) {
+        abort();
+    }
+    return 0;
+}
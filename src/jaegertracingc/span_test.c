@@ -15,6 +15,7 @@
  */
 
 #include "jaegertracingc/span.h"
+#include "jaegertracingc/accounting_allocator.h"
 #include "unity.h"
 
 static const jaeger_key_value baggage[] = {
@@ -42,6 +43,251 @@ visit_baggage(void* arg, const char* key, const char* value)
     return opentracing_true;
 }
 
+static inline void test_span_context_format()
+{
+    typedef struct test_case {
+        jaeger_trace_id trace_id;
+        uint64_t span_id;
+        uint8_t flags;
+        const char* expected;
+    } test_case;
+    const test_case cases[] = {
+        {{.high = 0, .low = 0}, 0, 0, "0:0:0"},
+        {{.high = 0, .low = 0xab}, 0xcd, 1, "ab:cd:1"},
+        {{.high = 1, .low = 2},
+         UINT64_MAX,
+         3,
+         "10000000000000002:ffffffffffffffff:3"},
+        {{.high = UINT64_MAX, .low = UINT64_MAX},
+         0x0123456789abcdef,
+         UINT8_MAX,
+         "ffffffffffffffffffffffffffffffff:123456789abcdef:ff"}};
+    for (int i = 0, len = sizeof(cases) / sizeof(cases[0]); i < len; i++) {
+        const test_case test = cases[i];
+        jaeger_span_context ctx = JAEGERTRACINGC_SPAN_CONTEXT_INIT;
+        ctx.trace_id = test.trace_id;
+        ctx.span_id = test.span_id;
+        ctx.flags = test.flags;
+        char buffer[JAEGERTRACINGC_SPAN_CONTEXT_MAX_STR_LEN + 1];
+        TEST_ASSERT_EQUAL(
+            strlen(test.expected),
+            jaeger_span_context_format(&ctx, buffer, sizeof(buffer)));
+        TEST_ASSERT_EQUAL_STRING(test.expected, buffer);
+
+        char truncated[4];
+        TEST_ASSERT_EQUAL(
+            strlen(test.expected),
+            jaeger_span_context_format(&ctx, truncated, sizeof(truncated)));
+        TEST_ASSERT_EQUAL(sizeof(truncated) - 1, strlen(truncated));
+        TEST_ASSERT_EQUAL(
+            0, strncmp(test.expected, truncated, sizeof(truncated) - 1));
+
+        jaeger_span_context decoded = JAEGERTRACINGC_SPAN_CONTEXT_INIT;
+        TEST_ASSERT_TRUE(jaeger_span_context_scan(&decoded, buffer));
+        TEST_ASSERT_EQUAL_HEX64(test.trace_id.high, decoded.trace_id.high);
+        TEST_ASSERT_EQUAL_HEX64(test.trace_id.low, decoded.trace_id.low);
+        TEST_ASSERT_EQUAL_HEX64(test.span_id, decoded.span_id);
+        TEST_ASSERT_EQUAL(test.flags, decoded.flags);
+    }
+}
+
+static inline void test_span_context_traceparent()
+{
+    typedef struct test_case {
+        const char* input;
+        bool success;
+    } test_case;
+    const test_case cases[] = {
+        {"00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01", true},
+        {"00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-00", true},
+        {"01-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01-xyz", true},
+        {"01-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01", true},
+        {"00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01-", false},
+        {"01-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01x", false},
+        {"ff-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01", false},
+        {"00-0AF7651916CD43DD8448EB211C80319C-B7AD6B7169203331-01", false},
+        {"00-00000000000000000000000000000000-b7ad6b7169203331-01", false},
+        {"00-0af7651916cd43dd8448eb211c80319c-0000000000000000-01", false},
+        {"00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-0x", false},
+        {"00_0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01", false},
+        {"00-0af7651916cd43dd8448eb211c80319cb7ad6b7169203331-01", false},
+        {"", false}};
+    const int num_cases = sizeof(cases) / sizeof(cases[0]);
+    for (int i = 0; i < num_cases; i++) {
+        const test_case test = cases[i];
+        jaeger_span_context ctx = JAEGERTRACINGC_SPAN_CONTEXT_INIT;
+        const bool success =
+            jaeger_span_context_scan_traceparent(&ctx, test.input);
+        TEST_ASSERT_EQUAL_MESSAGE(test.success, success, test.input);
+    }
+
+    jaeger_span_context ctx = JAEGERTRACINGC_SPAN_CONTEXT_INIT;
+    TEST_ASSERT_TRUE(jaeger_span_context_scan_traceparent(
+        &ctx, "00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01"));
+    TEST_ASSERT_EQUAL_HEX64(0x0af7651916cd43dd, ctx.trace_id.high);
+    TEST_ASSERT_EQUAL_HEX64(0x8448eb211c80319c, ctx.trace_id.low);
+    TEST_ASSERT_EQUAL_HEX64(0xb7ad6b7169203331, ctx.span_id);
+    TEST_ASSERT_EQUAL(jaeger_sampling_flag_sampled, ctx.flags);
+
+    /* 64 bit trace IDs are padded and the debug flag is dropped. */
+    ctx.trace_id.high = 0;
+    ctx.flags |= (uint8_t) jaeger_sampling_flag_debug;
+    char buffer[JAEGERTRACINGC_TRACEPARENT_STR_LEN + 1];
+    TEST_ASSERT_EQUAL(
+        JAEGERTRACINGC_TRACEPARENT_STR_LEN,
+        jaeger_span_context_format_traceparent(&ctx, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_STRING(
+        "00-00000000000000008448eb211c80319c-b7ad6b7169203331-01", buffer);
+    ctx.flags = 0;
+    jaeger_span_context_format_traceparent(&ctx, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL_STRING(
+        "00-00000000000000008448eb211c80319c-b7ad6b7169203331-00", buffer);
+    TEST_ASSERT_EQUAL(
+        JAEGERTRACINGC_TRACEPARENT_STR_LEN,
+        jaeger_span_context_format_traceparent(&ctx, buffer, 3));
+    TEST_ASSERT_EQUAL_STRING("00", buffer);
+
+    /* Copies keep the trace state. */
+    jaeger_span_context src;
+    TEST_ASSERT_TRUE(jaeger_span_context_init(&src));
+    src.trace_state = jaeger_strdup("rojo=00f067aa0ba902b7");
+    TEST_ASSERT_NOT_NULL(src.trace_state);
+    jaeger_span_context dst;
+    TEST_ASSERT_TRUE(jaeger_span_context_copy(&dst, &src));
+    TEST_ASSERT_EQUAL_STRING(src.trace_state, dst.trace_state);
+    TEST_ASSERT_TRUE(src.trace_state != dst.trace_state);
+    jaeger_span_context_destroy((jaeger_destructible*) &src);
+    jaeger_span_context_destroy((jaeger_destructible*) &dst);
+}
+
+static inline void test_span_context_b3()
+{
+    typedef struct test_case {
+        const char* input;
+        bool success;
+    } test_case;
+    const test_case cases[] = {
+        {"80f198ee56343ba864fe8b2a57d3eff7-e457b5a2e4d86bd1-1", true},
+        {"80f198ee56343ba864fe8b2a57d3eff7-e457b5a2e4d86bd1-1-05e3ac9a4f6e3b90",
+         true},
+        {"64fe8b2a57d3eff7-e457b5a2e4d86bd1", true},
+        {"64fe8b2a57d3eff7-e457b5a2e4d86bd1-d", true},
+        {"64FE8B2A57D3EFF7-E457B5A2E4D86BD1-0", true},
+        {"64fe8b2a57d3eff7-e457b5a2e4d86bd1-", false},
+        {"64fe8b2a57d3eff7-e457b5a2e4d86bd1-x", false},
+        {"64fe8b2a57d3eff7-e457b5a2e4d86bd1-1-", false},
+        {"64fe8b2a57d3eff7-e457b5a2e4d86bd1-1-05e3ac9a4f6e3b9", false},
+        {"64fe8b2a57d3eff7-e457b5a2e4d86bd1-1-05e3ac9a4f6e3b90-", false},
+        {"4fe8b2a57d3eff7-e457b5a2e4d86bd1", false},
+        {"64fe8b2a57d3eff7-457b5a2e4d86bd1", false},
+        {"0000000000000000-e457b5a2e4d86bd1", false},
+        {"64fe8b2a57d3eff7-0000000000000000", false},
+        {"64fe8b2a57d3eff7", false},
+        {"1", false},
+        {"", false}};
+    const int num_cases = sizeof(cases) / sizeof(cases[0]);
+    for (int i = 0; i < num_cases; i++) {
+        const test_case test = cases[i];
+        jaeger_span_context ctx = JAEGERTRACINGC_SPAN_CONTEXT_INIT;
+        const bool success = jaeger_span_context_scan_b3(&ctx, test.input);
+        TEST_ASSERT_EQUAL_MESSAGE(test.success, success, test.input);
+    }
+
+    jaeger_span_context ctx = JAEGERTRACINGC_SPAN_CONTEXT_INIT;
+    TEST_ASSERT_TRUE(jaeger_span_context_scan_b3(
+        &ctx,
+        "80f198ee56343ba864fe8b2a57d3eff7-e457b5a2e4d86bd1-d-"
+        "05e3ac9a4f6e3b90"));
+    TEST_ASSERT_EQUAL_HEX64(0x80f198ee56343ba8, ctx.trace_id.high);
+    TEST_ASSERT_EQUAL_HEX64(0x64fe8b2a57d3eff7, ctx.trace_id.low);
+    TEST_ASSERT_EQUAL_HEX64(0xe457b5a2e4d86bd1, ctx.span_id);
+    TEST_ASSERT_EQUAL(jaeger_sampling_flag_sampled | jaeger_sampling_flag_debug,
+                      ctx.flags);
+
+    char buffer[JAEGERTRACINGC_B3_MAX_STR_LEN + 1];
+    jaeger_span_context_format_b3(&ctx, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL_STRING(
+        "80f198ee56343ba864fe8b2a57d3eff7-e457b5a2e4d86bd1-d", buffer);
+
+    /* 64 bit trace IDs are not padded. */
+    ctx.trace_id.high = 0;
+    ctx.flags = 0;
+    TEST_ASSERT_EQUAL(
+        35, jaeger_span_context_format_b3(&ctx, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_STRING("64fe8b2a57d3eff7-e457b5a2e4d86bd1-0", buffer);
+    ctx.flags = jaeger_sampling_flag_sampled;
+    TEST_ASSERT_EQUAL(35, jaeger_span_context_format_b3(&ctx, buffer, 5));
+    TEST_ASSERT_EQUAL_STRING("64fe", buffer);
+    jaeger_span_context_format_b3(&ctx, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL_STRING("64fe8b2a57d3eff7-e457b5a2e4d86bd1-1", buffer);
+
+    /* A missing sampling state means the receiver decides. */
+    TEST_ASSERT_TRUE(jaeger_span_context_scan_b3(
+        &ctx, "64fe8b2a57d3eff7-e457b5a2e4d86bd1"));
+    TEST_ASSERT_EQUAL(0, ctx.flags);
+}
+
+static inline void test_span_to_protobuf_times()
+{
+    const int64_t ns_per_s = JAEGERTRACINGC_NANOSECONDS_PER_SECOND;
+    jaeger_span span = JAEGERTRACINGC_SPAN_INIT;
+    TEST_ASSERT_TRUE(jaeger_span_init(&span));
+    span.operation_name = jaeger_strdup("test-operation");
+    TEST_ASSERT_NOT_NULL(span.operation_name);
+    span.start_time_system = 1500000000 * ns_per_s + 123;
+    span.duration = 2 * ns_per_s + 456;
+
+    Jaeger__Model__Span span_protobuf;
+    TEST_ASSERT_TRUE(jaeger_span_to_protobuf(&span_protobuf, &span));
+    TEST_ASSERT_NOT_NULL(span_protobuf.start_time);
+    TEST_ASSERT_EQUAL(1500000000, span_protobuf.start_time->seconds);
+    TEST_ASSERT_EQUAL(123, span_protobuf.start_time->nanos);
+    TEST_ASSERT_NOT_NULL(span_protobuf.duration);
+    TEST_ASSERT_EQUAL(2, span_protobuf.duration->seconds);
+    TEST_ASSERT_EQUAL(456, span_protobuf.duration->nanos);
+    jaeger_span_protobuf_destroy(&span_protobuf);
+    jaeger_span_destroy((jaeger_destructible*) &span);
+}
+
+static inline void test_span_allocator()
+{
+    jaeger_accounting_allocator arena;
+    jaeger_accounting_allocator_init(&arena, jaeger_built_in_allocator(), 0);
+    jaeger_accounting_allocator other;
+    jaeger_accounting_allocator_init(&other, jaeger_built_in_allocator(), 0);
+    jaeger_alloc_stats stats;
+
+    jaeger_allocator* prev_alloc =
+        jaeger_set_thread_allocator((jaeger_allocator*) &arena);
+    jaeger_span span = JAEGERTRACINGC_SPAN_INIT;
+    TEST_ASSERT_TRUE(jaeger_span_init(&span));
+    TEST_ASSERT_EQUAL_PTR(&arena, span.allocator);
+    span.context.flags = (uint8_t) jaeger_sampling_flag_sampled;
+
+    /* Whatever the thread is bound to, the span allocates from its own. */
+    jaeger_set_thread_allocator((jaeger_allocator*) &other);
+    const opentracing_value value = {.type = opentracing_value_string,
+                                     .value = {.string_value = "value"}};
+    ((opentracing_span*) &span)
+        ->set_tag((opentracing_span*) &span, "key", &value);
+    ((opentracing_span*) &span)
+        ->set_baggage_item((opentracing_span*) &span, "key", "value");
+    ((opentracing_span*) &span)
+        ->set_operation_name((opentracing_span*) &span, "operation");
+    TEST_ASSERT_EQUAL_PTR(&other, jaeger_get_thread_allocator());
+    jaeger_accounting_allocator_total(&other, &stats);
+    TEST_ASSERT_EQUAL(0, stats.num_allocations);
+    jaeger_accounting_allocator_total(&arena, &stats);
+    TEST_ASSERT_TRUE(stats.live_bytes > 0);
+
+    ((opentracing_destructible*) &span)
+        ->destroy((opentracing_destructible*) &span);
+    jaeger_accounting_allocator_total(&arena, &stats);
+    TEST_ASSERT_EQUAL(0, stats.live_bytes);
+    TEST_ASSERT_EQUAL_PTR(&other, jaeger_get_thread_allocator());
+    jaeger_set_thread_allocator(prev_alloc);
+}
+
 void test_span()
 {
     typedef struct test_case {
@@ -53,6 +299,14 @@ void test_span()
         {"x:1:1", false},
         {"1:x:1", false},
         {"1:1:x", false},
+        {"1:1", false},
+        {"1::1", false},
+        {":1:1", false},
+        {"1:1:", false},
+        {"0x1:1:1", false},
+        {" 1:1:1", false},
+        {"1:01234567890123456:1", false},
+        {"1:1:1:1", true},
         {"01234567890123456789012345678901234:1:1", false},
         {"01234567890123456789012345678901:1:1", true}};
     const int num_cases = sizeof(cases) / sizeof(cases[0]);
@@ -63,6 +317,12 @@ void test_span()
         TEST_ASSERT_EQUAL_MESSAGE(test.success, success, test.input);
     }
 
+    test_span_context_format();
+    test_span_context_traceparent();
+    test_span_context_b3();
+    test_span_to_protobuf_times();
+    test_span_allocator();
+
     jaeger_key_value_destroy(NULL);
     jaeger_log_record_destroy(NULL);
     jaeger_span_ref_destroy(NULL);
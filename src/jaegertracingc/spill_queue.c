@@ -0,0 +1,457 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "jaegertracingc/spill_queue.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "jaegertracingc/alloc.h"
+#include "jaegertracingc/log_limiter.h"
+#include "jaegertracingc/logging.h"
+
+#define SEGMENT_PREFIX "jaeger-spill-"
+#define SEGMENT_SUFFIX ".seg"
+
+/* Precedes every record. Segments start out zeroed and the length is written
+ * last, so a zero length marks the end of the records, including a record
+ * cut short by a crash. */
+typedef struct record_header {
+    uint32_t len;
+    uint32_t num_spans;
+    uint32_t read;
+} record_header;
+
+/* Pads records so every header is aligned. */
+static inline size_t record_size(size_t len)
+{
+    const size_t align = sizeof(uint32_t);
+    return sizeof(record_header) + (len + align - 1) / align * align;
+}
+
+/* Returns the header of the record at offset, or NULL at the end of the
+ * records. */
+static inline record_header* record_at(uint8_t* map, size_t size, size_t offset)
+{
+    if (map == NULL || offset > size || size - offset < sizeof(record_header)) {
+        return NULL;
+    }
+    record_header* header = (record_header*) &map[offset];
+    if (header->len == 0 || record_size(header->len) > size - offset) {
+        return NULL;
+    }
+    return header;
+}
+
+static inline bool
+segment_path(const jaeger_spill_queue* queue, uint64_t seq, char* path)
+{
+    const int result = snprintf(path,
+                                PATH_MAX,
+                                "%s/" SEGMENT_PREFIX "%020" PRIu64
+                                SEGMENT_SUFFIX,
+                                queue->dir,
+                                seq);
+    if (result < 0 || result >= PATH_MAX) {
+        jaeger_log_error("Spill segment path is too long, directory = \"%s\"",
+                         queue->dir);
+        return false;
+    }
+    return true;
+}
+
+static uint8_t* map_segment(const jaeger_spill_queue* queue,
+                            uint64_t seq,
+                            bool create,
+                            size_t* size)
+{
+    char path[PATH_MAX];
+    if (!segment_path(queue, seq, path)) {
+        return NULL;
+    }
+    const int fd =
+        open(path, O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_TRUNC : 0), 0600);
+    if (fd < 0) {
+        JAEGERTRACINGC_LOG_ERROR_LIMITED(
+            "Cannot open spill segment, path = \"%s\", errno = %d",
+            path,
+            errno);
+        return NULL;
+    }
+    struct stat stat_buf;
+    if (create) {
+        /* Extends the file with zeros, so the segment starts with no
+         * records. */
+        if (ftruncate(fd, queue->segment_size) != 0) {
+            JAEGERTRACINGC_LOG_ERROR_LIMITED(
+                "Cannot resize spill segment, path = \"%s\", errno = %d",
+                path,
+                errno);
+            close(fd);
+            unlink(path);
+            return NULL;
+        }
+        *size = queue->segment_size;
+    }
+    else if (fstat(fd, &stat_buf) == 0 && stat_buf.st_size > 0) {
+        *size = stat_buf.st_size;
+    }
+    else {
+        close(fd);
+        return NULL;
+    }
+    void* map = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        JAEGERTRACINGC_LOG_ERROR_LIMITED(
+            "Cannot map spill segment, path = \"%s\", errno = %d",
+            path,
+            errno);
+        if (create) {
+            unlink(path);
+        }
+        return NULL;
+    }
+    return (uint8_t*) map;
+}
+
+static inline void remove_segment(const jaeger_spill_queue* queue,
+                                  uint64_t seq)
+{
+    char path[PATH_MAX];
+    if (segment_path(queue, seq, path)) {
+        unlink(path);
+    }
+}
+
+static inline void unmap_segment(uint8_t* map, size_t size)
+{
+    if (map != NULL) {
+        munmap(map, size);
+    }
+}
+
+static inline uint8_t* current_read_map(const jaeger_spill_queue* queue,
+                                        size_t* size)
+{
+    if (queue->read_seq == queue->write_seq) {
+        *size = queue->write_size;
+        return queue->write_map;
+    }
+    *size = queue->read_size;
+    return queue->read_map;
+}
+
+/* Deletes the read segment and maps the next one. */
+static inline void next_read_segment(jaeger_spill_queue* queue)
+{
+    assert(queue->read_seq < queue->write_seq);
+    unmap_segment(queue->read_map, queue->read_size);
+    queue->read_map = NULL;
+    queue->read_size = 0;
+    remove_segment(queue, queue->read_seq);
+    queue->read_seq++;
+    queue->read_offset = 0;
+    if (queue->read_seq != queue->write_seq) {
+        /* A segment that cannot be mapped reads as empty and is skipped. */
+        queue->read_map =
+            map_segment(queue, queue->read_seq, false, &queue->read_size);
+    }
+}
+
+/* Moves the read position to the next unread record, deleting segments that
+ * have been read in full. */
+static void skip_read_records(jaeger_spill_queue* queue)
+{
+    while (true) {
+        size_t size;
+        uint8_t* map = current_read_map(queue, &size);
+        const record_header* header;
+        while ((header = record_at(map, size, queue->read_offset)) != NULL) {
+            if (!header->read) {
+                return;
+            }
+            queue->read_offset += record_size(header->len);
+        }
+        if (queue->read_seq == queue->write_seq) {
+            return;
+        }
+        next_read_segment(queue);
+    }
+}
+
+static inline int count_unread_spans(uint8_t* map, size_t size, size_t offset)
+{
+    int num_spans = 0;
+    const record_header* header;
+    while ((header = record_at(map, size, offset)) != NULL) {
+        if (!header->read) {
+            num_spans += header->num_spans;
+        }
+        offset += record_size(header->len);
+    }
+    return num_spans;
+}
+
+/* Starts a new write segment, deleting the oldest segments to stay under the
+ * size cap. */
+static bool next_write_segment(jaeger_spill_queue* queue,
+                               int* num_dropped_spans)
+{
+    const uint64_t seq = queue->write_seq + 1;
+    while (seq - queue->read_seq + 1 > (uint64_t) queue->max_segments) {
+        *num_dropped_spans += count_unread_spans(
+            queue->read_map, queue->read_size, queue->read_offset);
+        next_read_segment(queue);
+    }
+    /* The new read segment may start with records that were read before a
+     * restart, or may not map at all. */
+    skip_read_records(queue);
+    if (*num_dropped_spans > 0) {
+        JAEGERTRACINGC_LOG_WARN_LIMITED(
+            "Spill queue is full, dropped oldest segment, "
+            "num dropped spans = %d",
+            *num_dropped_spans);
+    }
+
+    size_t size = 0;
+    uint8_t* map = map_segment(queue, seq, true, &size);
+    if (map == NULL) {
+        return false;
+    }
+    if (queue->read_seq == queue->write_seq) {
+        queue->read_map = queue->write_map;
+        queue->read_size = queue->write_size;
+    }
+    else {
+        unmap_segment(queue->write_map, queue->write_size);
+    }
+    queue->write_seq = seq;
+    queue->write_map = map;
+    queue->write_size = size;
+    queue->write_offset = 0;
+    return true;
+}
+
+/* Finds the oldest and newest segments left in the directory. */
+static bool find_segments(const char* dir,
+                          uint64_t* min_seq,
+                          uint64_t* max_seq,
+                          bool* found)
+{
+    DIR* dir_stream = opendir(dir);
+    if (dir_stream == NULL) {
+        jaeger_log_error(
+            "Cannot open spill directory, path = \"%s\", errno = %d",
+            dir,
+            errno);
+        return false;
+    }
+    *found = false;
+    const size_t prefix_len = strlen(SEGMENT_PREFIX);
+    struct dirent* entry;
+    while ((entry = readdir(dir_stream)) != NULL) {
+        if (strncmp(entry->d_name, SEGMENT_PREFIX, prefix_len) != 0) {
+            continue;
+        }
+        char* end = NULL;
+        const uint64_t seq = strtoull(&entry->d_name[prefix_len], &end, 10);
+        if (end == &entry->d_name[prefix_len] ||
+            strcmp(end, SEGMENT_SUFFIX) != 0) {
+            continue;
+        }
+        if (!*found || seq < *min_seq) {
+            *min_seq = seq;
+        }
+        if (!*found || seq > *max_seq) {
+            *max_seq = seq;
+        }
+        *found = true;
+    }
+    closedir(dir_stream);
+    return true;
+}
+
+bool jaeger_spill_queue_init(jaeger_spill_queue* queue,
+                             const char* dir,
+                             size_t max_size,
+                             size_t max_record_size)
+{
+    assert(queue != NULL);
+    assert(dir != NULL);
+    *queue = (jaeger_spill_queue) JAEGERTRACINGC_SPILL_QUEUE_INIT;
+
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    if (max_record_size == 0 || max_record_size > UINT32_MAX) {
+        jaeger_log_error("Invalid spill record size, size = %zu",
+                         max_record_size);
+        return false;
+    }
+    /* Each segment must hold the largest record. */
+    size_t segment_size = JAEGERTRACINGC_CLAMP(
+        max_size / JAEGERTRACINGC_SPILL_NUM_SEGMENTS,
+        record_size(max_record_size),
+        JAEGERTRACINGC_MAX(record_size(max_record_size),
+                           (size_t) JAEGERTRACINGC_SPILL_MAX_SEGMENT_SIZE));
+    segment_size = (segment_size + page_size - 1) / page_size * page_size;
+    if (max_size / segment_size < 2) {
+        jaeger_log_error("Spill queue size cap must hold at least two "
+                         "segments, size cap = %zu, segment size = %zu",
+                         max_size,
+                         segment_size);
+        return false;
+    }
+    queue->segment_size = segment_size;
+    queue->max_segments = JAEGERTRACINGC_MIN(max_size / segment_size,
+                                             (size_t) INT_MAX);
+    queue->dir = jaeger_strdup(dir);
+    if (queue->dir == NULL) {
+        jaeger_log_error("Cannot allocate spill directory path");
+        return false;
+    }
+
+    uint64_t min_seq = 0;
+    uint64_t max_seq = 0;
+    bool found = false;
+    if (!find_segments(dir, &min_seq, &max_seq, &found)) {
+        goto cleanup;
+    }
+    queue->read_seq = min_seq;
+    queue->write_seq = max_seq;
+    queue->write_map = map_segment(queue, max_seq, !found, &queue->write_size);
+    if (queue->write_map == NULL) {
+        goto cleanup;
+    }
+    const record_header* header;
+    while ((header = record_at(queue->write_map,
+                               queue->write_size,
+                               queue->write_offset)) != NULL) {
+        queue->write_offset += record_size(header->len);
+    }
+    if (min_seq != max_seq) {
+        queue->read_map = map_segment(queue, min_seq, false, &queue->read_size);
+    }
+    skip_read_records(queue);
+    return true;
+
+cleanup:
+    jaeger_spill_queue_destroy(queue);
+    return false;
+}
+
+bool jaeger_spill_queue_empty(const jaeger_spill_queue* queue)
+{
+    assert(queue != NULL);
+    return queue->dir == NULL || (queue->read_seq == queue->write_seq &&
+                                  queue->read_offset >= queue->write_offset);
+}
+
+bool jaeger_spill_queue_push(jaeger_spill_queue* queue,
+                             const uint8_t* data,
+                             size_t len,
+                             int num_spans,
+                             int* num_dropped_spans)
+{
+    assert(queue != NULL);
+    assert(queue->dir != NULL);
+    assert(data != NULL);
+    assert(num_dropped_spans != NULL);
+    *num_dropped_spans = 0;
+    const size_t size = record_size(len);
+    if (len == 0 || len > UINT32_MAX || size > queue->segment_size) {
+        JAEGERTRACINGC_LOG_ERROR_LIMITED(
+            "Record does not fit in spill segment, "
+            "record size = %zu, segment size = %zu",
+            size,
+            queue->segment_size);
+        return false;
+    }
+    if (queue->write_size - queue->write_offset < size &&
+        !next_write_segment(queue, num_dropped_spans)) {
+        return false;
+    }
+
+    record_header* header =
+        (record_header*) &queue->write_map[queue->write_offset];
+    memcpy(header + 1, data, len);
+    header->num_spans = num_spans;
+    header->read = 0;
+    header->len = len;
+    queue->write_offset += size;
+    return true;
+}
+
+bool jaeger_spill_queue_peek(jaeger_spill_queue* queue,
+                             const uint8_t** data,
+                             size_t* len,
+                             int* num_spans)
+{
+    assert(queue != NULL);
+    assert(data != NULL);
+    assert(len != NULL);
+    assert(num_spans != NULL);
+    skip_read_records(queue);
+    if (jaeger_spill_queue_empty(queue)) {
+        return false;
+    }
+    size_t size;
+    uint8_t* map = current_read_map(queue, &size);
+    const record_header* header = record_at(map, size, queue->read_offset);
+    if (header == NULL) {
+        /* Segments that cannot be mapped have no records to read. */
+        return false;
+    }
+    assert(!header->read);
+    *data = (const uint8_t*) (header + 1);
+    *len = header->len;
+    *num_spans = header->num_spans;
+    return true;
+}
+
+void jaeger_spill_queue_pop(jaeger_spill_queue* queue)
+{
+    assert(queue != NULL);
+    assert(!jaeger_spill_queue_empty(queue));
+    size_t size;
+    uint8_t* map = current_read_map(queue, &size);
+    record_header* header = record_at(map, size, queue->read_offset);
+    assert(header != NULL);
+    header->read = 1;
+    queue->read_offset += record_size(header->len);
+    skip_read_records(queue);
+}
+
+void jaeger_spill_queue_destroy(jaeger_spill_queue* queue)
+{
+    if (queue == NULL || queue->dir == NULL) {
+        return;
+    }
+    const bool empty = jaeger_spill_queue_empty(queue);
+    unmap_segment(queue->read_map, queue->read_size);
+    unmap_segment(queue->write_map, queue->write_size);
+    if (empty && queue->write_map != NULL) {
+        /* Nothing left to recover. */
+        remove_segment(queue, queue->write_seq);
+    }
+    jaeger_free(queue->dir);
+    *queue = (jaeger_spill_queue) JAEGERTRACINGC_SPILL_QUEUE_INIT;
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * @file
+ * Queue of encoded batches kept on disk while the transport is down.
+ */
+
+#ifndef JAEGERTRACINGC_SPILL_QUEUE_H
+#define JAEGERTRACINGC_SPILL_QUEUE_H
+
+#include "jaegertracingc/common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Largest segment the queue creates, unless one record needs more. */
+#define JAEGERTRACINGC_SPILL_MAX_SEGMENT_SIZE (4 * 1024 * 1024)
+
+/** Number of segments the size cap is split into, where the records
+ *  allow. */
+#define JAEGERTRACINGC_SPILL_NUM_SEGMENTS 8
+
+/**
+ * FIFO queue of records in memory-mapped segment files. Records are appended
+ * to the newest segment and read from the oldest, and a segment is deleted
+ * once all of its records have been read. When the queue would grow past its
+ * size cap, the oldest segment is deleted, records and all.
+ *
+ * Segments stay on disk when the queue is destroyed, so a queue initialized
+ * in the same directory later picks up the records that were not read. Each
+ * record is marked as read in place, so records are not read twice across
+ * restarts.
+ *
+ * The queue is not thread-safe. Only one process may use a directory at a
+ * time.
+ */
+typedef struct jaeger_spill_queue {
+    /** Directory holding the segments, or NULL if the queue is disabled. */
+    char* dir;
+    /** Size of new segments. */
+    size_t segment_size;
+    /** Maximum number of segments on disk. */
+    int max_segments;
+    /** Sequence number of the segment to read from. */
+    uint64_t read_seq;
+    /** Offset of the next record to read. */
+    size_t read_offset;
+    /** Mapping of the read segment, or NULL if it is the write segment. */
+    uint8_t* read_map;
+    /** Size of the read mapping. */
+    size_t read_size;
+    /** Sequence number of the segment to append to. */
+    uint64_t write_seq;
+    /** Offset of the next record to append. */
+    size_t write_offset;
+    /** Mapping of the write segment. */
+    uint8_t* write_map;
+    /** Size of the write mapping. */
+    size_t write_size;
+} jaeger_spill_queue;
+
+#define JAEGERTRACINGC_SPILL_QUEUE_INIT                                   \
+    {                                                                     \
+        .dir = NULL, .segment_size = 0, .max_segments = 0, .read_seq = 0, \
+        .read_offset = 0, .read_map = NULL, .read_size = 0,               \
+        .write_seq = 0, .write_offset = 0, .write_map = NULL,             \
+        .write_size = 0                                                   \
+    }
+
+/**
+ * Initialize a spill queue, recovering any records left in the directory.
+ * @param queue Queue to initialize.
+ * @param dir Existing directory to keep segments in.
+ * @param max_size Maximum number of bytes on disk.
+ * @param max_record_size Size of the largest record that will be pushed.
+ * @return True on success, false otherwise.
+ */
+bool jaeger_spill_queue_init(jaeger_spill_queue* queue,
+                             const char* dir,
+                             size_t max_size,
+                             size_t max_record_size);
+
+/**
+ * Check whether the queue has no records to read. A queue that was never
+ * initialized is always empty.
+ * @param queue Queue to check.
+ * @return True if empty, false otherwise.
+ */
+bool jaeger_spill_queue_empty(const jaeger_spill_queue* queue);
+
+/**
+ * Append a record, deleting the oldest segments if the queue is full.
+ * @param queue Queue to append to.
+ * @param data Record to append.
+ * @param len Length of record.
+ * @param num_spans Number of spans in the record.
+ * @param[out] num_dropped_spans Number of spans in deleted segments that had
+ *                               not been read.
+ * @return True on success, false otherwise.
+ */
+bool jaeger_spill_queue_push(jaeger_spill_queue* queue,
+                             const uint8_t* data,
+                             size_t len,
+                             int num_spans,
+                             int* num_dropped_spans);
+
+/**
+ * Get the oldest record without removing it.
+ * @param queue Queue to read.
+ * @param[out] data Record, valid until the next call that modifies the
+ *                  queue.
+ * @param[out] len Length of record.
+ * @param[out] num_spans Number of spans in the record.
+ * @return True if there was a record, false if the queue is empty.
+ */
+bool jaeger_spill_queue_peek(jaeger_spill_queue* queue,
+                             const uint8_t** data,
+                             size_t* len,
+                             int* num_spans);
+
+/**
+ * Remove the oldest record. The queue must not be empty.
+ * @param queue Queue to modify.
+ */
+void jaeger_spill_queue_pop(jaeger_spill_queue* queue);
+
+/**
+ * Unmap the segments, leaving the records that were not read on disk.
+ * @param queue Queue to destroy.
+ */
+void jaeger_spill_queue_destroy(jaeger_spill_queue* queue);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif /* __cplusplus */
+
+#endif /* JAEGERTRACINGC_SPILL_QUEUE_H */
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "jaegertracingc/spill_queue.h"
+
+#include <dirent.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "unity.h"
+
+#define RECORD_LEN 1000
+
+static inline int count_files(const char* dir)
+{
+    DIR* dir_stream = opendir(dir);
+    TEST_ASSERT_NOT_NULL(dir_stream);
+    int count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir_stream)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            count++;
+        }
+    }
+    closedir(dir_stream);
+    return count;
+}
+
+static inline void push_record(jaeger_spill_queue* queue,
+                               int index,
+                               int* num_dropped_spans)
+{
+    uint8_t record[RECORD_LEN];
+    memset(record, index, sizeof(record));
+    TEST_ASSERT_TRUE(jaeger_spill_queue_push(
+        queue, record, sizeof(record), index, num_dropped_spans));
+}
+
+static inline void pop_record(jaeger_spill_queue* queue, int index)
+{
+    const uint8_t* data = NULL;
+    size_t len = 0;
+    int num_spans = 0;
+    TEST_ASSERT_TRUE(jaeger_spill_queue_peek(queue, &data, &len, &num_spans));
+    TEST_ASSERT_EQUAL(RECORD_LEN, len);
+    TEST_ASSERT_EQUAL(index, num_spans);
+    TEST_ASSERT_EQUAL(index, data[0]);
+    TEST_ASSERT_EQUAL(index, data[RECORD_LEN - 1]);
+    jaeger_spill_queue_pop(queue);
+}
+
+void test_spill_queue()
+{
+    char dir[] = "/tmp/jaeger-spill-test-XXXXXX";
+    TEST_ASSERT_NOT_NULL(mkdtemp(dir));
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    /* Small records give one page segments, so two pages hold two
+     * segments. */
+    const size_t max_size = 2 * page_size;
+    const int records_per_segment = page_size / (RECORD_LEN + 12);
+
+    jaeger_spill_queue queue = JAEGERTRACINGC_SPILL_QUEUE_INIT;
+    TEST_ASSERT_TRUE(jaeger_spill_queue_empty(&queue));
+    TEST_ASSERT_FALSE(jaeger_spill_queue_init(&queue, dir, page_size, 1));
+    TEST_ASSERT_TRUE(jaeger_spill_queue_init(&queue, dir, max_size, 1));
+    TEST_ASSERT_EQUAL(page_size, queue.segment_size);
+    TEST_ASSERT_EQUAL(2, queue.max_segments);
+    TEST_ASSERT_TRUE(jaeger_spill_queue_empty(&queue));
+
+    int num_dropped_spans = 0;
+    for (int i = 1; i <= 3; i++) {
+        push_record(&queue, i, &num_dropped_spans);
+        TEST_ASSERT_EQUAL(0, num_dropped_spans);
+    }
+    TEST_ASSERT_FALSE(jaeger_spill_queue_empty(&queue));
+    pop_record(&queue, 1);
+
+    /* The records that were not read survive a restart. */
+    jaeger_spill_queue_destroy(&queue);
+    TEST_ASSERT_TRUE(jaeger_spill_queue_init(&queue, dir, max_size, 1));
+    pop_record(&queue, 2);
+    pop_record(&queue, 3);
+    TEST_ASSERT_TRUE(jaeger_spill_queue_empty(&queue));
+
+    /* An empty queue leaves nothing behind. */
+    jaeger_spill_queue_destroy(&queue);
+    TEST_ASSERT_EQUAL(0, count_files(dir));
+    TEST_ASSERT_TRUE(jaeger_spill_queue_init(&queue, dir, max_size, 1));
+
+    /* Filling a third segment deletes the first one. */
+    const int num_records = 3 * records_per_segment;
+    int total_dropped_spans = 0;
+    for (int i = 1; i <= num_records; i++) {
+        push_record(&queue, i, &num_dropped_spans);
+        total_dropped_spans += num_dropped_spans;
+    }
+    TEST_ASSERT_EQUAL(2, count_files(dir));
+    int expected_dropped_spans = 0;
+    for (int i = 1; i <= records_per_segment; i++) {
+        expected_dropped_spans += i;
+    }
+    TEST_ASSERT_EQUAL(expected_dropped_spans, total_dropped_spans);
+    for (int i = records_per_segment + 1; i <= num_records; i++) {
+        pop_record(&queue, i);
+    }
+    TEST_ASSERT_TRUE(jaeger_spill_queue_empty(&queue));
+    TEST_ASSERT_EQUAL(1, count_files(dir));
+
+    uint8_t large_record[2 * RECORD_LEN * 4];
+    memset(large_record, 0, sizeof(large_record));
+    TEST_ASSERT_FALSE(jaeger_spill_queue_push(
+        &queue, large_record, sizeof(large_record), 1, &num_dropped_spans));
+
+    jaeger_spill_queue_destroy(&queue);
+    TEST_ASSERT_EQUAL(0, count_files(dir));
+
+    /* A segment that cannot be mapped is skipped once the segment before it
+     * is dropped. */
+    TEST_ASSERT_TRUE(jaeger_spill_queue_init(&queue, dir, 3 * page_size, 1));
+    for (int i = 1; i <= 3 * records_per_segment; i++) {
+        push_record(&queue, i, &num_dropped_spans);
+    }
+    char path[PATH_MAX];
+    snprintf(path,
+             sizeof(path),
+             "%s/jaeger-spill-%020d.seg",
+             dir,
+             (int) queue.read_seq + 1);
+    TEST_ASSERT_EQUAL(0, truncate(path, 0));
+    push_record(&queue, 1, &num_dropped_spans);
+    TEST_ASSERT_EQUAL(expected_dropped_spans, num_dropped_spans);
+    for (int i = 2 * records_per_segment + 1; i <= 3 * records_per_segment;
+         i++) {
+        pop_record(&queue, i);
+    }
+    pop_record(&queue, 1);
+    TEST_ASSERT_TRUE(jaeger_spill_queue_empty(&queue));
+
+    jaeger_spill_queue_destroy(&queue);
+    TEST_ASSERT_EQUAL(0, count_files(dir));
+    TEST_ASSERT_EQUAL(0, rmdir(dir));
+}
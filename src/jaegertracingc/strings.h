@@ -25,9 +25,11 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <limits.h>
 #include <string.h>
 
 #include "jaegertracingc/config.h"
+#include "jaegertracingc/endian.h"
 #include "jaegertracingc/hashtable.h"
 
 #ifdef __cplusplus
@@ -36,149 +38,202 @@ extern "C" {
 
 static inline int decode_hex(char ch)
 {
-    if (islower(ch)) {
-        if (ch > 'f') {
-            return -1;
-        }
-        return (ch - 'a') + 10;
-    }
-    if (isupper(ch)) {
-        if (ch > 'F') {
-            return -1;
-        }
-        return (ch - 'A') + 10;
-    }
-    if (isdigit(ch)) {
-        return ch - '0';
-    }
-    return -1;
+    /* Maps each character to its value plus one, so zero-initialized entries
+     * mark invalid characters. Unlike isxdigit, does not depend on locale. */
+    static const uint8_t table[UCHAR_MAX + 1] = {
+        ['0'] = 1,  ['1'] = 2,  ['2'] = 3,  ['3'] = 4,  ['4'] = 5,
+        ['5'] = 6,  ['6'] = 7,  ['7'] = 8,  ['8'] = 9,  ['9'] = 10,
+        ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15,
+        ['f'] = 16, ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14,
+        ['E'] = 15, ['F'] = 16};
+    return (int) table[(unsigned char) ch] - 1;
 }
 
 static inline char encode_hex(int num)
 {
     assert(num >= 0 && num < 16);
-    if (num < 10) {
-        return '0' + num;
+    return "0123456789abcdef"[num];
+}
+
+/**
+ * Encodes a 32-bit number as eight hex digits without branching per digit.
+ * Spreads each nibble into its own byte, then converts all eight bytes to
+ * ASCII at once.
+ * @return The eight digits in the order they should appear in memory.
+ */
+static inline uint64_t encode_hex_uint32_swar(uint32_t num)
+{
+    uint64_t x = num;
+    x = (x | (x << 16u)) & 0x0000ffff0000ffffull;
+    x = (x | (x << 8u)) & 0x00ff00ff00ff00ffull;
+    x = (x | (x << 4u)) & 0x0f0f0f0f0f0f0f0full;
+    /* Bytes holding a nibble of 10 or more are set to 1 in the mask. */
+    const uint64_t mask =
+        ((x + 0x0606060606060606ull) >> 4u) & 0x0101010101010101ull;
+    x += 0x3030303030303030ull + mask * (uint64_t) ('a' - '0' - 10);
+    /* Most significant digit first. */
+    return HOST_TO_BIG_ENDIAN_64(x);
+}
+
+/**
+ * Writes num as exactly 16 zero-padded hex digits. Does not null-terminate.
+ */
+static inline void encode_hex_uint64(char* dst, uint64_t num)
+{
+    const uint64_t high = encode_hex_uint32_swar((uint32_t) (num >> 32u));
+    const uint64_t low = encode_hex_uint32_swar((uint32_t) num);
+    memcpy(dst, &high, sizeof(high));
+    memcpy(&dst[sizeof(high)], &low, sizeof(low));
+}
+
+/**
+ * Writes num as hex without leading zeros, like printf's "%" PRIx64. Does not
+ * null-terminate.
+ * @return Number of digits written, between 1 and 16.
+ */
+static inline int encode_hex_uint64_trimmed(char* dst, uint64_t num)
+{
+    enum { max_digits = sizeof(num) * 2 };
+#ifdef HAVE_BUILTIN
+    const int num_digits =
+        num == 0 ? 1
+                 : (int) ((sizeof(num) * CHAR_BIT - __builtin_clzll(num) + 3) /
+                          4);
+#else
+    int num_digits = 1;
+    for (uint64_t x = num >> 4u; x != 0; x >>= 4u) {
+        num_digits++;
     }
-    return 'a' + (num - 10);
+#endif /* HAVE_BUILTIN */
+    char buffer[max_digits];
+    encode_hex_uint64(buffer, num);
+    memcpy(dst, &buffer[max_digits - num_digits], num_digits);
+    return num_digits;
+}
+
+/**
+ * Copies a formatted string of length len into buffer with the same
+ * truncation rules as snprintf: at most buffer_len - 1 characters are copied
+ * and the result is null-terminated unless buffer_len is zero.
+ */
+static inline void
+copy_formatted(char* buffer, int buffer_len, const char* str, int len)
+{
+    if (buffer_len <= 0) {
+        return;
+    }
+    const int copy_len = JAEGERTRACINGC_MIN(len, buffer_len - 1);
+    memcpy(buffer, str, copy_len);
+    buffer[copy_len] = '\0';
+}
+
+/**
+ * Checks whether a character may appear unescaped in an encoded URI value:
+ * alphanumerics plus the reserved and unreserved marks of RFC 2396. Unlike
+ * isalnum, does not depend on locale.
+ */
+static inline bool is_uri_unreserved(char ch)
+{
+    /* Characters 0x80 and above are left zero-initialized. */
+    static const uint8_t table[UCHAR_MAX + 1] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0x00 */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0x10 */
+        0, 1, 0, 0, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 0x20 */
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, /* 0x30 */
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 0x40 */
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1, /* 0x50 */
+        0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 0x60 */
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 0, /* 0x70 */
+    };
+    return table[(unsigned char) ch] != 0;
 }
 
+/**
+ * Decodes percent-encoded octets in src into dst. Malformed escape sequences
+ * are copied through unchanged, except that a dangling hex digit is
+ * lowercased. dst must hold at least strlen(src) + 1 characters.
+ */
 static inline void decode_uri_value(char* restrict dst,
                                     const char* restrict src)
 {
-    enum state { default_state, percent_state, first_hex_state };
-
-    enum state state = default_state;
-    const int src_len = strlen(src);
-    int dst_len = 0;
-    int first_nibble = 0;
-    int second_nibble = 0;
-
-#define APPEND_CHAR(x)                      \
-    do {                                    \
-        assert(dst_len + 1 <= src_len + 1); \
-        assert((x) < 0x7f);                 \
-        dst[dst_len] = (x);                 \
-        dst_len++;                          \
-    } while (0)
-
-    for (int i = 0; i < src_len; i++) {
-        char ch = src[i];
-        switch (state) {
-        case default_state:
-            if (ch == '%') {
-                state = percent_state;
-            }
-            else {
-                APPEND_CHAR(ch);
-            }
+    const char* const end = src + strlen(src);
+    while (src < end) {
+        /* Copy everything up to the next escape sequence in bulk. memchr
+         * is vectorized by most C libraries. */
+        const char* percent = memchr(src, '%', end - src);
+        if (percent == NULL) {
+            percent = end;
+        }
+        memcpy(dst, src, percent - src);
+        dst += percent - src;
+        src = percent;
+        if (src == end) {
             break;
-        case percent_state:
-            first_nibble = decode_hex(ch);
-            if (first_nibble == -1) {
-                APPEND_CHAR('%');
-                APPEND_CHAR(ch);
-                state = default_state;
-            }
-            else {
-                state = first_hex_state;
-            }
+        }
+
+        *dst++ = '%';
+        src++;
+        if (src == end) {
             break;
-        default:
-            assert(state == first_hex_state);
-            second_nibble = decode_hex(ch);
-            if (second_nibble == -1) {
-                APPEND_CHAR('%');
-                APPEND_CHAR(encode_hex(first_nibble));
-                APPEND_CHAR(ch);
-            }
-            else {
-                APPEND_CHAR((char) (((((uint8_t) first_nibble) & 0xfu) << 4u) |
-                                    (((uint8_t) second_nibble) & 0xfu)));
-            }
-            state = default_state;
+        }
+        const int first_nibble = decode_hex(*src);
+        if (first_nibble == -1) {
+            *dst++ = *src++;
+            continue;
+        }
+        src++;
+        if (src == end) {
+            *dst++ = encode_hex(first_nibble);
             break;
         }
+        const int second_nibble = decode_hex(*src);
+        if (second_nibble == -1) {
+            *dst++ = encode_hex(first_nibble);
+            *dst++ = *src++;
+            continue;
+        }
+        /* Overwrite the '%' written above with the decoded octet. */
+        dst[-1] = (char) ((((unsigned) first_nibble) << 4u) |
+                          (unsigned) second_nibble);
+        src++;
     }
-    switch (state) {
-    case percent_state:
-        APPEND_CHAR('%');
-        break;
-    case first_hex_state:
-        APPEND_CHAR('%');
-        APPEND_CHAR(encode_hex(first_nibble));
-        break;
-    default:
-        break;
-    }
-    APPEND_CHAR('\0');
-
-#undef APPEND_CHAR
+    *dst = '\0';
 }
 
+/**
+ * Percent-encodes every character of src that is not unreserved into dst.
+ * dst must hold at least strlen(src) * 3 + 1 characters.
+ */
 static inline void encode_uri_value(char* restrict dst,
                                     const char* restrict src)
 {
-    int pos = 0;
-    for (int i = 0; i < (int) strlen(src); i++) {
-        const char ch = src[i];
-        if (isalnum(ch)) {
-            dst[pos++] = ch;
+    const char* const end = src + strlen(src);
+    while (src < end) {
+        /* Find the end of the run of unreserved characters, checking four at
+         * a time while they fit before the terminator. */
+        const char* run_end = src;
+        while (end - run_end >= 4 &&
+               (is_uri_unreserved(run_end[0]) & is_uri_unreserved(run_end[1]) &
+                is_uri_unreserved(run_end[2]) &
+                is_uri_unreserved(run_end[3]))) {
+            run_end += 4;
         }
-        else {
-            switch (ch) {
-            case ';':
-            case '/':
-            case '?':
-            case ':':
-            case '@':
-            case '&':
-            case '=':
-            case '+':
-            case '$':
-            case ',':
-            case '-':
-            case '_':
-            case '.':
-            case '!':
-            case '~':
-            case '*':
-            case '\'':
-            case '(':
-            case ')':
-                dst[pos++] = ch;
-                break;
-            default: {
-                dst[pos++] = '%';
-                const uint8_t first_nibble = (((uint32_t) ch) >> 4u) & 0x0fu;
-                const uint8_t second_nibble = ((uint8_t) ch) & 0x0fu;
-                dst[pos++] = encode_hex(first_nibble);
-                dst[pos++] = encode_hex(second_nibble);
-            } break;
-            }
+        while (run_end < end && is_uri_unreserved(*run_end)) {
+            run_end++;
         }
+        memcpy(dst, src, run_end - src);
+        dst += run_end - src;
+        if (run_end == end) {
+            break;
+        }
+        const unsigned char ch = (unsigned char) *run_end;
+        dst[0] = '%';
+        dst[1] = encode_hex(ch >> 4u);
+        dst[2] = encode_hex(ch & 0x0fu);
+        dst += 3;
+        src = run_end + 1;
     }
-    dst[pos] = '\0';
+    *dst = '\0';
 }
 
 static inline void copy_str(char* restrict dst, const char* restrict src)
@@ -195,6 +250,54 @@ static inline void to_lowercase(char* restrict dst, const char* restrict src)
     dst[len] = '\0';
 }
 
+/**
+ * Compares the first len characters of str to lowercase, ignoring the case of
+ * str. Equivalent to calling to_lowercase() on str and comparing the result,
+ * without the copy.
+ */
+static inline bool lowercase_equals(const char* str,
+                                    const char* lowercase,
+                                    size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (tolower((unsigned char) str[i]) != lowercase[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Decodes a hex number from the first len characters of str. Unlike strtoull,
+ * str need not be null-terminated and no whitespace, sign, or "0x" prefix is
+ * accepted.
+ * @return True on success, false if len is not in [1, 16] or str contains a
+ *         character that is not a hex digit.
+ */
+static inline bool
+decode_hex_uint64(const char* str, size_t len, uint64_t* result)
+{
+    assert(str != NULL);
+    assert(result != NULL);
+    if (len == 0 || len > sizeof(uint64_t) * 2) {
+        return false;
+    }
+    /* Accumulate invalid digits instead of branching on each one. Any -1
+     * leaves invalid negative. */
+    uint64_t value = 0;
+    int invalid = 0;
+    for (size_t i = 0; i < len; i++) {
+        const int nibble = decode_hex(str[i]);
+        invalid |= nibble;
+        value = (value << 4u) | (uint64_t) (nibble & 0xf);
+    }
+    if (invalid < 0) {
+        return false;
+    }
+    *result = value;
+    return true;
+}
+
 static inline opentracing_propagation_error_code
 parse_key_value(jaeger_hashtable* baggage, char* str)
 {
@@ -144,7 +144,11 @@ bool jaeger_tag_from_key_value(jaeger_tag* restrict dst,
         return false;
     }
 
-    return jaeger_tag_copy(dst, &src);
+    const bool success = jaeger_tag_copy(dst, &src);
+    if (src.v_type == JAEGER__MODEL__VALUE_TYPE__STRING) {
+        jaeger_free(src.v_str);
+    }
+    return success;
 }
 
 bool jaeger_tag_vector_append(jaeger_vector* vec, const jaeger_tag* tag)
@@ -250,7 +250,7 @@ bool jaeger_thread_local_init(jaeger_thread_local* local)
 {
     assert(local != NULL);
     local->value = NULL;
-    return 0;
+    return true;
 }
 
 jaeger_destructible* jaeger_thread_local_get_value(jaeger_thread_local* local)
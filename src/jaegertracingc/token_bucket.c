@@ -24,23 +24,17 @@ void jaeger_token_bucket_init(jaeger_token_bucket* tok,
     tok->balance = max_balance;
     tok->credits_per_second = credits_per_second;
     tok->max_balance = max_balance;
-    jaeger_duration_now(&tok->last_tick);
+    tok->last_tick = jaeger_duration_now_ns();
 }
 
 bool jaeger_token_bucket_check_credit(jaeger_token_bucket* tok, double cost)
 {
     assert(tok != NULL);
-    jaeger_duration current_time;
-    jaeger_duration_now(&current_time);
-    jaeger_duration interval;
-    const bool result = jaeger_time_subtract(
-        current_time.value, tok->last_tick.value, &interval.value);
-    (void) result;
-    assert(result);
-    const double diff = (((double) interval.value.tv_nsec) /
-                             JAEGERTRACINGC_NANOSECONDS_PER_SECOND +
-                         interval.value.tv_sec) *
-                        tok->credits_per_second;
+    const int64_t current_time = jaeger_duration_now_ns();
+    assert(current_time >= tok->last_tick);
+    const double diff = (double) (current_time - tok->last_tick) *
+                        tok->credits_per_second /
+                        JAEGERTRACINGC_NANOSECONDS_PER_SECOND;
     const double new_balance = tok->balance + diff;
     tok->balance =
         (tok->max_balance < new_balance) ? tok->max_balance : new_balance;
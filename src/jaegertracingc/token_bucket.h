@@ -34,7 +34,8 @@ typedef struct jaeger_token_bucket {
     double credits_per_second;
     double max_balance;
     double balance;
-    jaeger_duration last_tick;
+    /** Steady time of the last check, in nanoseconds. */
+    int64_t last_tick;
 } jaeger_token_bucket;
 
 void jaeger_token_bucket_init(jaeger_token_bucket* tok,
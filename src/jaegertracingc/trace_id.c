@@ -15,6 +15,7 @@
  */
 
 #include "jaegertracingc/trace_id.h"
+#include "jaegertracingc/strings.h"
 
 void jaeger_trace_id_to_protobuf(ProtobufCBinaryData* dst,
                                  const jaeger_trace_id* src)
@@ -34,44 +35,46 @@ int jaeger_trace_id_format(const jaeger_trace_id* trace_id,
     assert(trace_id != NULL);
     assert(buffer != NULL);
     assert(buffer_len >= 0);
+    /* Equivalent to snprintf with "%" PRIx64 "%016" PRIx64, omitting the high
+     * part if it is zero. */
+    char str[JAEGERTRACINGC_TRACE_ID_MAX_STR_LEN];
+    int len = 0;
     if (trace_id->high == 0) {
-        return snprintf(buffer, buffer_len, "%" PRIx64, trace_id->low);
+        len = encode_hex_uint64_trimmed(str, trace_id->low);
     }
-    return snprintf(buffer,
-                    buffer_len,
-                    "%" PRIx64 "%016" PRIx64,
-                    trace_id->high,
-                    trace_id->low);
+    else {
+        len = encode_hex_uint64_trimmed(str, trace_id->high);
+        encode_hex_uint64(&str[len], trace_id->low);
+        len += JAEGERTRACINGC_UINT64_MAX_STR_LEN;
+    }
+    copy_formatted(buffer, buffer_len, str, len);
+    return len;
 }
 
 bool jaeger_trace_id_scan(jaeger_trace_id* trace_id, const char* str)
 {
     assert(trace_id != NULL);
     assert(str != NULL);
-    const int len = strlen(str);
-    if (len > JAEGERTRACINGC_UINT64_MAX_STR_LEN * 2) {
+    return jaeger_trace_id_scan_n(trace_id, str, strlen(str));
+}
+
+bool jaeger_trace_id_scan_n(jaeger_trace_id* trace_id,
+                            const char* str,
+                            int len)
+{
+    assert(trace_id != NULL);
+    assert(str != NULL);
+    if (len <= 0 || len > JAEGERTRACINGC_TRACE_ID_MAX_STR_LEN) {
         return false;
     }
     uint64_t high = 0;
     uint64_t low = 0;
-    char* iter = NULL;
-    if (len > JAEGERTRACINGC_UINT64_MAX_STR_LEN) {
-        const char* low_start = str + len - JAEGERTRACINGC_UINT64_MAX_STR_LEN;
-        const int high_len = low_start - str;
-        char buffer[JAEGERTRACINGC_UINT64_MAX_STR_LEN + 1];
-        memcpy(buffer, str, high_len);
-        buffer[high_len] = '\0';
-        high = strtoull(buffer, &iter, JAEGERTRACINGC_HEX_BASE);
-        assert(iter != NULL);
-        if (*iter != '\0') {
-            return false;
-        }
-        iter = NULL;
-        str = low_start;
+    const int high_len =
+        JAEGERTRACINGC_MAX(len - JAEGERTRACINGC_UINT64_MAX_STR_LEN, 0);
+    if (high_len > 0 && !decode_hex_uint64(str, high_len, &high)) {
+        return false;
     }
-    low = strtoull(str, &iter, JAEGERTRACINGC_HEX_BASE);
-    assert(iter != NULL);
-    if (*iter != '\0') {
+    if (!decode_hex_uint64(&str[high_len], len - high_len, &low)) {
         return false;
     }
     *trace_id = (jaeger_trace_id){.high = high, .low = low};
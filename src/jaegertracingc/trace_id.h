@@ -82,6 +82,19 @@ int jaeger_trace_id_format(const jaeger_trace_id* trace_id,
  */
 bool jaeger_trace_id_scan(jaeger_trace_id* trace_id, const char* str);
 
+/**
+ * Scan the first len characters of a string into a trace ID instance. Allows
+ * callers to parse a trace ID embedded in a larger string without copying it.
+ * @param trace_id The output trace ID.
+ * @param str The input string representation. Need not be null-terminated.
+ * @param len The number of characters to scan.
+ * @return True on success, false otherwise.
+ * @see jaeger_trace_id_scan()
+ */
+bool jaeger_trace_id_scan_n(jaeger_trace_id* trace_id,
+                            const char* str,
+                            int len);
+
 #ifdef __cplusplus
 } /* extern C */
 #endif /* __cplusplus */
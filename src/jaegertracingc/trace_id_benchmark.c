@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "jaegertracingc/benchmark_helpers.h"
+#include "jaegertracingc/span.h"
+#include "jaegertracingc/trace_id.h"
+
+#define NUM_ITERATIONS 10000000
+
+/* Keeps the compiler from discarding results of the benchmarked calls. */
+static volatile uint64_t sink;
+
+static void benchmark_trace_id(void)
+{
+    const jaeger_trace_id trace_id = {.high = 0x3f9a1c2b4d5e6f70,
+                                      .low = 0xa1b2c3d4e5f60718};
+    char buffer[JAEGERTRACINGC_TRACE_ID_MAX_STR_LEN + 1];
+    jaeger_benchmark benchmark;
+    jaeger_benchmark_start(
+        &benchmark, "trace_id_format/128_bit", NUM_ITERATIONS);
+    for (int i = 0; i < NUM_ITERATIONS; i++) {
+        jaeger_trace_id id = trace_id;
+        id.low += (uint64_t) i;
+        sink += (uint64_t) jaeger_trace_id_format(&id, buffer, sizeof(buffer));
+    }
+    jaeger_benchmark_stop(&benchmark);
+
+    jaeger_benchmark_start(&benchmark, "trace_id_scan/128_bit", NUM_ITERATIONS);
+    for (int i = 0; i < NUM_ITERATIONS; i++) {
+        jaeger_trace_id id;
+        jaeger_trace_id_scan(&id, buffer);
+        sink += id.low;
+    }
+    jaeger_benchmark_stop(&benchmark);
+}
+
+static void benchmark_span_context(void)
+{
+    jaeger_span_context ctx = JAEGERTRACINGC_SPAN_CONTEXT_INIT;
+    ctx.trace_id = (jaeger_trace_id){.high = 0x3f9a1c2b4d5e6f70,
+                                     .low = 0xa1b2c3d4e5f60718};
+    ctx.span_id = 0xa1b2c3d4e5f60718;
+    ctx.flags = jaeger_sampling_flag_sampled;
+    char buffer[JAEGERTRACINGC_SPAN_CONTEXT_MAX_STR_LEN + 1];
+    jaeger_benchmark benchmark;
+    jaeger_benchmark_start(&benchmark, "span_context_format", NUM_ITERATIONS);
+    for (int i = 0; i < NUM_ITERATIONS; i++) {
+        sink += (uint64_t) jaeger_span_context_format(
+            &ctx, buffer, sizeof(buffer));
+    }
+    jaeger_benchmark_stop(&benchmark);
+
+    jaeger_benchmark_start(&benchmark, "span_context_scan", NUM_ITERATIONS);
+    for (int i = 0; i < NUM_ITERATIONS; i++) {
+        jaeger_span_context_scan(&ctx, buffer);
+        sink += ctx.span_id;
+    }
+    jaeger_benchmark_stop(&benchmark);
+}
+
+int main()
+{
+    benchmark_trace_id();
+    benchmark_span_context();
+    return 0;
+}
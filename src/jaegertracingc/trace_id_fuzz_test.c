@@ -22,6 +22,19 @@ int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
     memcpy(buffer, data, size);
     buffer[size] = '\0';
     jaeger_trace_id trace_id;
-    jaeger_trace_id_scan(&trace_id, (const char*) buffer);
+    if (!jaeger_trace_id_scan(&trace_id, (const char*) buffer)) {
+        return 0;
+    }
+
+    /* Anything accepted must survive a format/scan round trip. */
+    char str[JAEGERTRACINGC_TRACE_ID_MAX_STR_LEN + 1];
+    const int len = jaeger_trace_id_format(&trace_id, str, sizeof(str));
+    jaeger_trace_id decoded_trace_id;
+    if (len > JAEGERTRACINGC_TRACE_ID_MAX_STR_LEN ||
+        !jaeger_trace_id_scan(&decoded_trace_id, str) ||
+        decoded_trace_id.high != trace_id.high ||
+        decoded_trace_id.low != trace_id.low) {
+        abort();
+    }
     return 0;
 }
@@ -17,6 +17,59 @@
 #include "jaegertracingc/trace_id.h"
 #include "unity.h"
 
+static inline uint64_t random_uint64()
+{
+    /* Vary the number of significant digits to cover trimming. */
+    const uint64_t x = ((uint64_t) rand() << 33u) ^ ((uint64_t) rand() << 11u) ^
+                       (uint64_t) rand();
+    return x >> (unsigned) (rand() % 64);
+}
+
+static inline void test_format_matches_snprintf()
+{
+    enum { num_iterations = 1000 };
+    for (int i = 0; i < num_iterations; i++) {
+        const jaeger_trace_id trace_id = {
+            .high = rand() % 2 == 0 ? 0 : random_uint64(),
+            .low = random_uint64()};
+        char expected[JAEGERTRACINGC_TRACE_ID_MAX_STR_LEN + 1];
+        int expected_len = 0;
+        if (trace_id.high == 0) {
+            expected_len = snprintf(
+                expected, sizeof(expected), "%" PRIx64, trace_id.low);
+        }
+        else {
+            expected_len = snprintf(expected,
+                                    sizeof(expected),
+                                    "%" PRIx64 "%016" PRIx64,
+                                    trace_id.high,
+                                    trace_id.low);
+        }
+        char buffer[JAEGERTRACINGC_TRACE_ID_MAX_STR_LEN + 1];
+        TEST_ASSERT_EQUAL(
+            expected_len,
+            jaeger_trace_id_format(&trace_id, buffer, sizeof(buffer)));
+        TEST_ASSERT_EQUAL_STRING(expected, buffer);
+
+        /* Truncates like snprintf. */
+        const int truncated_len = rand() % (expected_len + 1);
+        char truncated[truncated_len + 1];
+        TEST_ASSERT_EQUAL(
+            expected_len,
+            jaeger_trace_id_format(&trace_id, truncated, truncated_len));
+        if (truncated_len > 0) {
+            TEST_ASSERT_EQUAL(truncated_len - 1, strlen(truncated));
+            TEST_ASSERT_EQUAL(
+                0, strncmp(expected, truncated, truncated_len - 1));
+        }
+
+        jaeger_trace_id decoded_trace_id = JAEGERTRACINGC_TRACE_ID_INIT;
+        TEST_ASSERT_TRUE(jaeger_trace_id_scan(&decoded_trace_id, buffer));
+        TEST_ASSERT_EQUAL_HEX64(trace_id.high, decoded_trace_id.high);
+        TEST_ASSERT_EQUAL_HEX64(trace_id.low, decoded_trace_id.low);
+    }
+}
+
 void test_trace_id()
 {
     const jaeger_trace_id trace_ids[] = {{.high = 0, .low = 0},
@@ -42,4 +95,17 @@ void test_trace_id()
     bad_trace_id_str = "g0000000000000000";
     TEST_ASSERT_FALSE(
         jaeger_trace_id_scan(&decoded_trace_id, bad_trace_id_str));
+    const char* bad_trace_id_strs[] = {"", " 1", "-1", "0x1", "1\xff"};
+    const int num_bad_trace_id_strs =
+        sizeof(bad_trace_id_strs) / sizeof(bad_trace_id_strs[0]);
+    for (int i = 0; i < num_bad_trace_id_strs; i++) {
+        TEST_ASSERT_FALSE(
+            jaeger_trace_id_scan(&decoded_trace_id, bad_trace_id_strs[i]));
+    }
+    TEST_ASSERT_TRUE(
+        jaeger_trace_id_scan(&decoded_trace_id, "ABCDEF0123456789abcdef"));
+    TEST_ASSERT_EQUAL_HEX64(0xabcdef, decoded_trace_id.high);
+    TEST_ASSERT_EQUAL_HEX64(0x0123456789abcdef, decoded_trace_id.low);
+
+    test_format_matches_snprintf();
 }
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jaegertracingc/trace_state.h"
+
+#define MAX_KEY_LEN 256
+#define MAX_TENANT_ID_LEN 241
+#define MAX_SYSTEM_ID_LEN 14
+#define MAX_VALUE_LEN 256
+/* Members longer than this are the first to go when truncating. */
+#define LARGE_MEMBER_LEN 128
+
+static inline bool is_lcalpha(char ch)
+{
+    return ch >= 'a' && ch <= 'z';
+}
+
+static inline bool is_digit(char ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+
+static inline bool is_key_char(char ch)
+{
+    return is_lcalpha(ch) || is_digit(ch) || ch == '_' || ch == '-' ||
+           ch == '*' || ch == '/';
+}
+
+static inline bool is_whitespace(char ch)
+{
+    return ch == ' ' || ch == '\t';
+}
+
+static inline bool is_valid_key(const char* key, int len)
+{
+    if (len == 0 || len > MAX_KEY_LEN) {
+        return false;
+    }
+    int at_pos = -1;
+    for (int i = 0; i < len; i++) {
+        if (key[i] == '@') {
+            if (at_pos != -1) {
+                return false;
+            }
+            at_pos = i;
+        }
+        else if (!is_key_char(key[i])) {
+            return false;
+        }
+    }
+    if (at_pos == -1) {
+        /* Simple key. */
+        return is_lcalpha(key[0]);
+    }
+    /* Multi-tenant key of the form tenant-id@system-id. */
+    const int tenant_id_len = at_pos;
+    const int system_id_len = len - at_pos - 1;
+    return tenant_id_len > 0 && tenant_id_len <= MAX_TENANT_ID_LEN &&
+           system_id_len > 0 && system_id_len <= MAX_SYSTEM_ID_LEN &&
+           is_lcalpha(key[at_pos + 1]);
+}
+
+static inline bool is_valid_value(const char* value, int len)
+{
+    if (len == 0 || len > MAX_VALUE_LEN || value[len - 1] == ' ') {
+        return false;
+    }
+    for (int i = 0; i < len; i++) {
+        const char ch = value[i];
+        if (ch < ' ' || ch > '~' || ch == ',' || ch == '=') {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline bool has_key(const jaeger_trace_state* state,
+                           const char* key,
+                           int key_len)
+{
+    for (int i = 0; i < state->num_members; i++) {
+        const jaeger_trace_state_member* member = &state->members[i];
+        if (member->key_len == key_len &&
+            memcmp(member->key, key, key_len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline bool
+parse_member(jaeger_trace_state* state, const char* str, int len)
+{
+    const char* eq = memchr(str, '=', len);
+    if (eq == NULL) {
+        return false;
+    }
+    const int key_len = eq - str;
+    const char* value = eq + 1;
+    const int value_len = len - key_len - 1;
+    if (!is_valid_key(str, key_len) || !is_valid_value(value, value_len) ||
+        has_key(state, str, key_len) ||
+        state->num_members == JAEGERTRACINGC_TRACE_STATE_MAX_MEMBERS) {
+        return false;
+    }
+    state->members[state->num_members] =
+        (jaeger_trace_state_member){.key = str,
+                                   .key_len = key_len,
+                                   .value = value,
+                                   .value_len = value_len};
+    state->num_members++;
+    return true;
+}
+
+bool jaeger_trace_state_parse(jaeger_trace_state* state,
+                              const char* str,
+                              int len)
+{
+    assert(state != NULL);
+    assert(str != NULL);
+    assert(len >= 0);
+    int pos = 0;
+    do {
+        const char* comma = memchr(&str[pos], ',', len - pos);
+        const int member_end = (comma == NULL) ? len : comma - str;
+        int begin = pos;
+        int end = member_end;
+        while (begin < end && is_whitespace(str[begin])) {
+            begin++;
+        }
+        while (end > begin && is_whitespace(str[end - 1])) {
+            end--;
+        }
+        if (begin < end && !parse_member(state, &str[begin], end - begin)) {
+            return false;
+        }
+        pos = member_end + 1;
+    } while (pos <= len);
+    return true;
+}
+
+static inline int member_len(const jaeger_trace_state_member* member)
+{
+    return member->key_len + 1 + member->value_len;
+}
+
+static inline int formatted_len(const jaeger_trace_state* state)
+{
+    int len = 0;
+    for (int i = 0; i < state->num_members; i++) {
+        len += member_len(&state->members[i]) + (i > 0 ? 1 : 0);
+    }
+    return len;
+}
+
+static inline void remove_member(jaeger_trace_state* state, int index)
+{
+    assert(index >= 0 && index < state->num_members);
+    memmove(&state->members[index],
+            &state->members[index + 1],
+            sizeof(state->members[0]) * (state->num_members - index - 1));
+    state->num_members--;
+}
+
+void jaeger_trace_state_truncate(jaeger_trace_state* state, int max_len)
+{
+    assert(state != NULL);
+    int len = formatted_len(state);
+    for (int i = state->num_members - 1; i >= 0 && len > max_len; i--) {
+        if (member_len(&state->members[i]) > LARGE_MEMBER_LEN) {
+            remove_member(state, i);
+            len = formatted_len(state);
+        }
+    }
+    while (len > max_len) {
+        remove_member(state, state->num_members - 1);
+        len = formatted_len(state);
+    }
+}
+
+static inline void append_formatted(
+    char* buffer, int buffer_len, int* len, const char* str, int str_len)
+{
+    const int available = buffer_len - 1 - *len;
+    if (available > 0) {
+        memcpy(&buffer[*len], str, JAEGERTRACINGC_MIN(available, str_len));
+    }
+    *len += str_len;
+}
+
+int jaeger_trace_state_format(const jaeger_trace_state* state,
+                              char* buffer,
+                              int buffer_len)
+{
+    assert(state != NULL);
+    assert(buffer != NULL);
+    assert(buffer_len >= 0);
+    int len = 0;
+    for (int i = 0; i < state->num_members; i++) {
+        const jaeger_trace_state_member* member = &state->members[i];
+        if (i > 0) {
+            append_formatted(buffer, buffer_len, &len, ",", 1);
+        }
+        append_formatted(
+            buffer, buffer_len, &len, member->key, member->key_len);
+        append_formatted(buffer, buffer_len, &len, "=", 1);
+        append_formatted(
+            buffer, buffer_len, &len, member->value, member->value_len);
+    }
+    if (buffer_len > 0) {
+        buffer[JAEGERTRACINGC_MIN(len, buffer_len - 1)] = '\0';
+    }
+    return len;
+}
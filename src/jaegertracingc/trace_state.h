@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ * @internal
+ * W3C Trace Context tracestate parsing and formatting.
+ */
+
+#ifndef JAEGERTRACINGC_TRACE_STATE_H
+#define JAEGERTRACINGC_TRACE_STATE_H
+
+#include "jaegertracingc/common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Max number of list members in a tracestate. */
+#define JAEGERTRACINGC_TRACE_STATE_MAX_MEMBERS 32
+/**
+ * Max string length of a propagated tracestate (not including null byte).
+ * Longer tracestates are truncated to fit.
+ * @see jaeger_trace_state_truncate()
+ */
+#define JAEGERTRACINGC_TRACE_STATE_MAX_STR_LEN 512
+
+/**
+ * Single key-value pair in a tracestate. Points into the string it was parsed
+ * from rather than owning a copy.
+ */
+typedef struct jaeger_trace_state_member {
+    /** Start of the key. Not null-terminated. */
+    const char* key;
+    /** Length of the key. */
+    int key_len;
+    /** Start of the value. Not null-terminated. */
+    const char* value;
+    /** Length of the value. */
+    int value_len;
+} jaeger_trace_state_member;
+
+/**
+ * Parsed tracestate. Holds at most JAEGERTRACINGC_TRACE_STATE_MAX_MEMBERS
+ * members in fixed storage, so parsing never allocates.
+ */
+typedef struct jaeger_trace_state {
+    /** List members in order of appearance. */
+    jaeger_trace_state_member members[JAEGERTRACINGC_TRACE_STATE_MAX_MEMBERS];
+    /** Number of members in use. */
+    int num_members;
+} jaeger_trace_state;
+
+/** Static initializer for trace state struct. */
+#define JAEGERTRACINGC_TRACE_STATE_INIT    \
+    {                                      \
+        .members = {{0}}, .num_members = 0 \
+    }
+
+/**
+ * Parse the first len characters of a tracestate header value, appending its
+ * members to state. Empty list members and optional whitespace around members
+ * are skipped. Call once per header when a carrier holds several tracestate
+ * headers. The members point into str, which must outlive state.
+ * @param state The trace state to append to.
+ * @param str The header value. Need not be null-terminated.
+ * @param len The number of characters to parse.
+ * @return True on success, false if any member is malformed, a key appears
+ *         more than once, or there are more than
+ *         JAEGERTRACINGC_TRACE_STATE_MAX_MEMBERS members. On failure, the
+ *         entire trace state must be discarded.
+ */
+bool jaeger_trace_state_parse(jaeger_trace_state* state,
+                              const char* str,
+                              int len);
+
+/**
+ * Drop members until the formatted trace state fits in max_len characters.
+ * Members longer than 128 characters are dropped first, then members from
+ * the end of the list, as recommended by the W3C Trace Context specification.
+ * @param state The trace state to truncate.
+ * @param max_len The maximum formatted length.
+ */
+void jaeger_trace_state_truncate(jaeger_trace_state* state, int max_len);
+
+/**
+ * Format a trace state as a comma-separated header value.
+ * @param state The trace state to format.
+ * @param buffer The output character buffer.
+ * @param buffer_len The length of the output character buffer.
+ * @return The number of characters needed to represent the entire trace
+ *         state, similar to the behavior of snprintf.
+ */
+int jaeger_trace_state_format(const jaeger_trace_state* state,
+                              char* buffer,
+                              int buffer_len);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif /* __cplusplus */
+
+#endif /* JAEGERTRACINGC_TRACE_STATE_H */
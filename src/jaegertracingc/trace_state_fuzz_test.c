@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "jaegertracingc/trace_state.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    jaeger_trace_state state = JAEGERTRACINGC_TRACE_STATE_INIT;
+    if (!jaeger_trace_state_parse(&state, (const char*) data, size)) {
+        return 0;
+    }
+
+    /* Anything accepted must survive truncation and a format/parse round
+     * trip unchanged. */
+    jaeger_trace_state_truncate(&state,
+                                JAEGERTRACINGC_TRACE_STATE_MAX_STR_LEN);
+    char str[JAEGERTRACINGC_TRACE_STATE_MAX_STR_LEN + 1];
+    const int len = jaeger_trace_state_format(&state, str, sizeof(str));
+    jaeger_trace_state decoded_state = JAEGERTRACINGC_TRACE_STATE_INIT;
+    if (len > JAEGERTRACINGC_TRACE_STATE_MAX_STR_LEN ||
+        !jaeger_trace_state_parse(&decoded_state, str, len) ||
+        decoded_state.num_members != state.num_members) {
+        abort();
+    }
+    for (int i = 0; i < state.num_members; i++) {
+        const jaeger_trace_state_member* member = &state.members[i];
+        const jaeger_trace_state_member* decoded_member =
+            &decoded_state.members[i];
+        if (member->key_len != decoded_member->key_len ||
+            member->value_len != decoded_member->value_len ||
+            memcmp(member->key, decoded_member->key, member->key_len) != 0 ||
+            memcmp(member->value, decoded_member->value, member->value_len) !=
+                0) {
+            abort();
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2018 The Jaeger Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jaegertracingc/trace_state.h"
+#include "unity.h"
+
+static inline void test_parse()
+{
+    typedef struct test_case {
+        const char* input;
+        bool success;
+        const char* formatted;
+    } test_case;
+    const test_case cases[] = {
+        {"", true, ""},
+        {"rojo=00f067aa0ba902b7", true, "rojo=00f067aa0ba902b7"},
+        {" rojo=1 ,\tcongo=t61rcWkgMzE ", true, "rojo=1,congo=t61rcWkgMzE"},
+        {"rojo=1,,, congo=2,", true, "rojo=1,congo=2"},
+        {"tenant@vendor=x", true, "tenant@vendor=x"},
+        {"0tenant@vendor=x", true, "0tenant@vendor=x"},
+        {"a_-*/z=value with spaces", true, "a_-*/z=value with spaces"},
+        {"rojo=%20!~", true, "rojo=%20!~"},
+        {"0rojo=1", false, NULL},
+        {"Rojo=1", false, NULL},
+        {"rojo", false, NULL},
+        {"rojo=", false, NULL},
+        {"=1", false, NULL},
+        {"rojo=1=2", false, NULL},
+        {"rojo=1,rojo=2", false, NULL},
+        {"tenant@=x", false, NULL},
+        {"@vendor=x", false, NULL},
+        {"tenant@0vendor=x", false, NULL},
+        {"tenant@vendor@x=x", false, NULL},
+        {"tenant@vendorvendorvend=x", false, NULL},
+        {"rojo=caf\xc3\xa9", false, NULL},
+        {"rojo=\x01", false, NULL}};
+    const int num_cases = sizeof(cases) / sizeof(cases[0]);
+    for (int i = 0; i < num_cases; i++) {
+        const test_case test = cases[i];
+        jaeger_trace_state state = JAEGERTRACINGC_TRACE_STATE_INIT;
+        const bool success =
+            jaeger_trace_state_parse(&state, test.input, strlen(test.input));
+        TEST_ASSERT_EQUAL_MESSAGE(test.success, success, test.input);
+        if (success) {
+            char buffer[JAEGERTRACINGC_TRACE_STATE_MAX_STR_LEN + 1];
+            const int len =
+                jaeger_trace_state_format(&state, buffer, sizeof(buffer));
+            TEST_ASSERT_EQUAL_STRING(test.formatted, buffer);
+            TEST_ASSERT_EQUAL(strlen(test.formatted), len);
+        }
+    }
+}
+
+static inline void test_multiple_headers()
+{
+    const char* first = "rojo=1,congo=2";
+    const char* second = "vendor=3";
+    jaeger_trace_state state = JAEGERTRACINGC_TRACE_STATE_INIT;
+    TEST_ASSERT_TRUE(jaeger_trace_state_parse(&state, first, strlen(first)));
+    TEST_ASSERT_TRUE(jaeger_trace_state_parse(&state, second, strlen(second)));
+    TEST_ASSERT_EQUAL(3, state.num_members);
+    char buffer[JAEGERTRACINGC_TRACE_STATE_MAX_STR_LEN + 1];
+    jaeger_trace_state_format(&state, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL_STRING("rojo=1,congo=2,vendor=3", buffer);
+
+    /* Keys must be unique across headers too. */
+    TEST_ASSERT_FALSE(jaeger_trace_state_parse(&state, "rojo=4", 6));
+}
+
+static inline void test_max_members()
+{
+    char str[JAEGERTRACINGC_TRACE_STATE_MAX_MEMBERS * 8 + 1];
+    int len = 0;
+    for (int i = 0; i < JAEGERTRACINGC_TRACE_STATE_MAX_MEMBERS; i++) {
+        len += snprintf(&str[len], sizeof(str) - len, "k%02d=v,", i);
+    }
+    jaeger_trace_state state = JAEGERTRACINGC_TRACE_STATE_INIT;
+    TEST_ASSERT_TRUE(jaeger_trace_state_parse(&state, str, len));
+    TEST_ASSERT_EQUAL(JAEGERTRACINGC_TRACE_STATE_MAX_MEMBERS,
+                      state.num_members);
+    TEST_ASSERT_FALSE(jaeger_trace_state_parse(&state, "extra=v", 7));
+}
+
+static inline void test_truncate()
+{
+    /* The large member goes first, then members from the end. */
+    char large_value[200];
+    memset(large_value, 'x', sizeof(large_value) - 1);
+    large_value[sizeof(large_value) - 1] = '\0';
+    char str[512];
+    const int len = snprintf(
+        str, sizeof(str), "a=1,large=%s,b=2,c=3", large_value);
+    jaeger_trace_state state = JAEGERTRACINGC_TRACE_STATE_INIT;
+    TEST_ASSERT_TRUE(jaeger_trace_state_parse(&state, str, len));
+    TEST_ASSERT_EQUAL(4, state.num_members);
+
+    jaeger_trace_state_truncate(&state, len);
+    TEST_ASSERT_EQUAL(4, state.num_members);
+
+    char buffer[JAEGERTRACINGC_TRACE_STATE_MAX_STR_LEN + 1];
+    jaeger_trace_state_truncate(&state, 100);
+    jaeger_trace_state_format(&state, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL_STRING("a=1,b=2,c=3", buffer);
+
+    jaeger_trace_state_truncate(&state, 7);
+    jaeger_trace_state_format(&state, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL_STRING("a=1,b=2", buffer);
+
+    jaeger_trace_state_truncate(&state, 0);
+    TEST_ASSERT_EQUAL(0, state.num_members);
+}
+
+static inline void test_format_truncation()
+{
+    const char* str = "rojo=1,congo=2";
+    jaeger_trace_state state = JAEGERTRACINGC_TRACE_STATE_INIT;
+    TEST_ASSERT_TRUE(jaeger_trace_state_parse(&state, str, strlen(str)));
+    for (int buffer_len = 0; buffer_len <= (int) strlen(str) + 1;
+         buffer_len++) {
+        char buffer[buffer_len + 1];
+        buffer[0] = 'x';
+        const int len = jaeger_trace_state_format(&state, buffer, buffer_len);
+        TEST_ASSERT_EQUAL(strlen(str), len);
+        if (buffer_len == 0) {
+            TEST_ASSERT_EQUAL('x', buffer[0]);
+        }
+        else {
+            TEST_ASSERT_EQUAL(buffer_len - 1, strlen(buffer));
+            TEST_ASSERT_EQUAL(0, strncmp(str, buffer, buffer_len - 1));
+        }
+    }
+}
+
+void test_trace_state()
+{
+    test_parse();
+    test_multiple_headers();
+    test_max_members();
+    test_truncate();
+    test_format_truncation();
+}
@@ -24,6 +24,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "jaegertracingc/accounting_allocator.h"
+#include "jaegertracingc/log_limiter.h"
 #include "jaegertracingc/propagation.h"
 #include "jaegertracingc/random.h"
 #include "jaegertracingc/span.h"
@@ -215,6 +217,8 @@ void jaeger_tracer_destroy(jaeger_destructible* d)
     }
 
     jaeger_tracer* tracer = (jaeger_tracer*) d;
+    jaeger_allocator* prev_alloc =
+        jaeger_set_thread_allocator(tracer->options.allocator);
     ((opentracing_tracer*) tracer)->close(((opentracing_tracer*) tracer));
     if (tracer->service_name != NULL) {
         jaeger_free(tracer->service_name);
@@ -253,6 +257,7 @@ void jaeger_tracer_destroy(jaeger_destructible* d)
     JAEGERTRACINGC_VECTOR_FOR_EACH(
         &tracer->tags, jaeger_tag_destroy, jaeger_tag);
     jaeger_vector_destroy(&tracer->tags);
+    jaeger_set_thread_allocator(prev_alloc);
 }
 
 bool jaeger_tracer_init(jaeger_tracer* tracer,
@@ -265,6 +270,12 @@ bool jaeger_tracer_init(jaeger_tracer* tracer,
 {
     assert(tracer != NULL);
 
+    tracer->options = (options != NULL)
+                          ? *options
+                          : (jaeger_tracer_options) JAEGER_TRACER_OPTIONS_INIT;
+    jaeger_allocator* prev_alloc =
+        jaeger_set_thread_allocator(tracer->options.allocator);
+
     tracer->service_name = jaeger_strdup(service_name);
     if (tracer->service_name == NULL) {
         goto cleanup;
@@ -306,13 +317,10 @@ bool jaeger_tracer_init(jaeger_tracer* tracer,
         tracer->allocated.reporter = false;
     }
 
-    if (options != NULL) {
-        tracer->options = *options;
-    }
-
     if (headers != NULL) {
         tracer->headers = *headers;
     }
+    jaeger_header_table_init(&tracer->header_table, &tracer->headers);
 
     if (!jaeger_vector_init(&tracer->tags, sizeof(jaeger_tag))) {
         /* If we run out of memory on tracer construction, we might as well
@@ -321,6 +329,7 @@ bool jaeger_tracer_init(jaeger_tracer* tracer,
          * is not worth considering the edge case given the clear memory issues
          * this case would imply.
          */
+        jaeger_set_thread_allocator(prev_alloc);
         return false;
     }
 
@@ -342,9 +351,11 @@ bool jaeger_tracer_init(jaeger_tracer* tracer,
     }
 
 finish:
+    jaeger_set_thread_allocator(prev_alloc);
     return true;
 
 cleanup:
+    jaeger_set_thread_allocator(prev_alloc);
     jaeger_tracer_destroy((jaeger_destructible*) tracer);
     return false;
 }
@@ -396,9 +407,11 @@ span_inherit_from_parent(jaeger_tracer* tracer,
 
     if (!*has_parent || parent == NULL ||
         !jaeger_span_context_is_valid(parent)) {
-        span->context.trace_id.low = jaeger_random64();
+        uint64_t ids[2];
+        jaeger_random64_fill(ids, tracer->options.gen_128_bit ? 2 : 1);
+        span->context.trace_id.low = ids[0];
         if (tracer->options.gen_128_bit) {
-            span->context.trace_id.high = jaeger_random64();
+            span->context.trace_id.high = ids[1];
         }
         span->context.span_id = span->context.trace_id.low;
         span->context.flags = 0;
@@ -427,6 +440,12 @@ span_inherit_from_parent(jaeger_tracer* tracer,
         if (!jaeger_hashtable_copy(&span->context.baggage, &parent->baggage)) {
             return false;
         }
+        if (parent->trace_state != NULL) {
+            span->context.trace_state = jaeger_strdup(parent->trace_state);
+            if (span->context.trace_state == NULL) {
+                return false;
+            }
+        }
     }
 
     return true;
@@ -472,12 +491,14 @@ opentracing_span* jaeger_tracer_start_span_with_options(
     assert(operation_name != NULL);
 
     if (options == NULL) {
-        opentracing_start_span_options opts = {.references = NULL,
-                                               .num_references = 0,
-                                               .tags = NULL,
-                                               .num_tags = 0};
-        jaeger_duration_now(&opts.start_time_steady);
-        jaeger_timestamp_now(&opts.start_time_system);
+        /* Zero start times are read from the clock below. */
+        const opentracing_start_span_options opts = {
+            .start_time_steady = JAEGERTRACINGC_DURATION_INIT,
+            .start_time_system = JAEGERTRACINGC_TIMESTAMP_INIT,
+            .references = NULL,
+            .num_references = 0,
+            .tags = NULL,
+            .num_tags = 0};
         return jaeger_tracer_start_span_with_options(
             tracer, operation_name, &opts);
     }
@@ -489,10 +510,20 @@ opentracing_span* jaeger_tracer_start_span_with_options(
     assert(options->tags == NULL || options->num_tags == 0);
 
     jaeger_tracer* t = (jaeger_tracer*) tracer;
+    /* Spans come from the allocator bound to the thread, falling back to the
+     * tracer's. jaeger_span_init records it in the span. */
+    jaeger_allocator* prev_alloc = jaeger_get_thread_allocator();
+    if (prev_alloc == NULL) {
+        jaeger_set_thread_allocator(t->options.allocator);
+    }
+    const jaeger_alloc_tag prev_tag =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_span);
     jaeger_span* span = jaeger_malloc(sizeof(jaeger_span));
     if (span == NULL) {
-        jaeger_log_error("Cannot allocate span, operation name = %s",
-                         operation_name);
+        JAEGERTRACINGC_LOG_ERROR_LIMITED(
+            "Cannot allocate span, operation name = %s", operation_name);
+        jaeger_alloc_context_exit(prev_tag);
+        jaeger_set_thread_allocator(prev_alloc);
         return NULL;
     }
     bool has_parent;
@@ -528,38 +559,44 @@ opentracing_span* jaeger_tracer_start_span_with_options(
     if (span->operation_name == NULL) {
         goto cleanup;
     }
-    span->duration = (jaeger_duration) JAEGERTRACINGC_DURATION_INIT;
+    span->duration = 0;
 
-    if (options->start_time_system.value.tv_sec == 0 &&
-        options->start_time_system.value.tv_nsec == 0) {
-        jaeger_timestamp_now(&span->start_time_system);
+    span->start_time_system =
+        jaeger_time_value_to_ns(&options->start_time_system.value);
+    span->start_time_steady =
+        jaeger_time_value_to_ns(&options->start_time_steady.value);
+    if (span->start_time_system == 0 && span->start_time_steady == 0) {
+        jaeger_time_now(&span->start_time_system, &span->start_time_steady);
     }
-    else {
-        span->start_time_system = options->start_time_system;
-    }
-
-    if (options->start_time_steady.value.tv_sec == 0 &&
-        options->start_time_steady.value.tv_nsec == 0) {
-        jaeger_duration_now(&span->start_time_steady);
+    else if (span->start_time_system == 0) {
+        span->start_time_system = jaeger_timestamp_now_ns();
     }
-    else {
-        span->start_time_steady = options->start_time_steady;
+    else if (span->start_time_steady == 0) {
+        span->start_time_steady = jaeger_duration_now_ns();
     }
 
     update_metrics_for_new_span(t->metrics, span, !has_parent);
 
+    jaeger_alloc_context_exit(prev_tag);
+    jaeger_set_thread_allocator(prev_alloc);
     return (opentracing_span*) span;
 
 cleanup:
     jaeger_span_destroy((jaeger_destructible*) span);
-    jaeger_free(span);
+    jaeger_free_sized(span, sizeof(jaeger_span));
+    jaeger_alloc_context_exit(prev_tag);
+    jaeger_set_thread_allocator(prev_alloc);
     return NULL;
 }
 
 bool jaeger_tracer_flush(jaeger_tracer* tracer)
 {
     assert(tracer != NULL);
-    return tracer->reporter->flush(tracer->reporter);
+    jaeger_allocator* prev_alloc =
+        jaeger_set_thread_allocator(tracer->options.allocator);
+    const bool result = tracer->reporter->flush(tracer->reporter);
+    jaeger_set_thread_allocator(prev_alloc);
+    return result;
 }
 
 void jaeger_tracer_report_span(jaeger_tracer* tracer, jaeger_span* span)
@@ -567,7 +604,15 @@ void jaeger_tracer_report_span(jaeger_tracer* tracer, jaeger_span* span)
     jaeger_counter* spans_finished = tracer->metrics->spans_finished;
     spans_finished->inc(spans_finished, 1);
     if (jaeger_span_is_sampled(span)) {
+        /* The reporter outlives the span, so it must not allocate from a
+         * request-scoped allocator bound to the thread. */
+        jaeger_allocator* prev_alloc =
+            jaeger_set_thread_allocator(tracer->options.allocator);
+        const jaeger_alloc_tag prev_tag =
+            jaeger_alloc_context_enter(jaeger_alloc_tag_reporter);
         tracer->reporter->report(tracer->reporter, span);
+        jaeger_alloc_context_exit(prev_tag);
+        jaeger_set_thread_allocator(prev_alloc);
     }
     /* TODO: pooling? */
 }
@@ -591,7 +636,12 @@ jaeger_tracer_inject_text_map(opentracing_tracer* tracer,
     CHECK_SPAN_CONTEXT(span_context);
     jaeger_tracer* t = (jaeger_tracer*) tracer;
     const jaeger_span_context* ctx = (jaeger_span_context*) span_context;
-    return jaeger_inject_into_text_map(writer, ctx, &t->headers);
+    const jaeger_alloc_tag prev_tag =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_propagation);
+    const opentracing_propagation_error_code result =
+        jaeger_inject_into_text_map(writer, ctx, &t->headers);
+    jaeger_alloc_context_exit(prev_tag);
+    return result;
 }
 
 opentracing_propagation_error_code
@@ -602,7 +652,12 @@ jaeger_tracer_inject_http_headers(opentracing_tracer* tracer,
     CHECK_SPAN_CONTEXT(span_context);
     jaeger_tracer* t = (jaeger_tracer*) tracer;
     const jaeger_span_context* ctx = (jaeger_span_context*) span_context;
-    return jaeger_inject_into_http_headers(writer, ctx, &t->headers);
+    const jaeger_alloc_tag prev_tag =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_propagation);
+    const opentracing_propagation_error_code result =
+        jaeger_inject_into_http_headers(writer, ctx, &t->headers);
+    jaeger_alloc_context_exit(prev_tag);
+    return result;
 }
 
 opentracing_propagation_error_code
@@ -614,7 +669,12 @@ jaeger_tracer_inject_binary(opentracing_tracer* tracer,
     (void) tracer;
     CHECK_SPAN_CONTEXT(span_context);
     const jaeger_span_context* ctx = (jaeger_span_context*) span_context;
-    return jaeger_inject_into_binary(callback, arg, ctx);
+    const jaeger_alloc_tag prev_tag =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_propagation);
+    const opentracing_propagation_error_code result =
+        jaeger_inject_into_binary(callback, arg, ctx);
+    jaeger_alloc_context_exit(prev_tag);
+    return result;
 }
 
 opentracing_propagation_error_code
@@ -625,7 +685,12 @@ jaeger_tracer_inject_custom(opentracing_tracer* tracer,
     CHECK_SPAN_CONTEXT(span_context);
     jaeger_tracer* t = (jaeger_tracer*) tracer;
     const jaeger_span_context* ctx = (jaeger_span_context*) span_context;
-    return jaeger_inject_into_custom(carrier, t, ctx);
+    const jaeger_alloc_tag prev_tag =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_propagation);
+    const opentracing_propagation_error_code result =
+        jaeger_inject_into_custom(carrier, t, ctx);
+    jaeger_alloc_context_exit(prev_tag);
+    return result;
 }
 
 #undef CHECK_SPAN_CONTEXT
@@ -636,8 +701,15 @@ jaeger_tracer_extract_text_map(struct opentracing_tracer* tracer,
                                opentracing_span_context** span_context)
 {
     jaeger_tracer* t = (jaeger_tracer*) tracer;
-    return jaeger_extract_from_text_map(
-        carrier, (jaeger_span_context**) span_context, t->metrics, &t->headers);
+    const jaeger_alloc_tag prev_tag =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_propagation);
+    const opentracing_propagation_error_code result =
+        jaeger_extract_from_text_map_table(carrier,
+                                           (jaeger_span_context**) span_context,
+                                           t->metrics,
+                                           &t->header_table);
+    jaeger_alloc_context_exit(prev_tag);
+    return result;
 }
 
 opentracing_propagation_error_code
@@ -646,8 +718,16 @@ jaeger_tracer_extract_http_headers(opentracing_tracer* tracer,
                                    opentracing_span_context** span_context)
 {
     jaeger_tracer* t = (jaeger_tracer*) tracer;
-    return jaeger_extract_from_http_headers(
-        carrier, (jaeger_span_context**) span_context, t->metrics, &t->headers);
+    const jaeger_alloc_tag prev_tag =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_propagation);
+    const opentracing_propagation_error_code result =
+        jaeger_extract_from_http_headers_table(
+            carrier,
+            (jaeger_span_context**) span_context,
+            t->metrics,
+            &t->header_table);
+    jaeger_alloc_context_exit(prev_tag);
+    return result;
 }
 
 opentracing_propagation_error_code
@@ -657,8 +737,13 @@ jaeger_tracer_extract_binary(opentracing_tracer* tracer,
                              opentracing_span_context** span_context)
 {
     jaeger_tracer* t = (jaeger_tracer*) tracer;
-    return jaeger_extract_from_binary(
-        callback, arg, (jaeger_span_context**) span_context, t->metrics);
+    const jaeger_alloc_tag prev_tag =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_propagation);
+    const opentracing_propagation_error_code result =
+        jaeger_extract_from_binary(
+            callback, arg, (jaeger_span_context**) span_context, t->metrics);
+    jaeger_alloc_context_exit(prev_tag);
+    return result;
 }
 
 opentracing_propagation_error_code
@@ -666,5 +751,10 @@ jaeger_tracer_extract_custom(opentracing_tracer* tracer,
                              opentracing_custom_carrier_reader* carrier,
                              opentracing_span_context** span_context)
 {
-    return carrier->extract(carrier, tracer, span_context);
+    const jaeger_alloc_tag prev_tag =
+        jaeger_alloc_context_enter(jaeger_alloc_tag_propagation);
+    const opentracing_propagation_error_code result =
+        carrier->extract(carrier, tracer, span_context);
+    jaeger_alloc_context_exit(prev_tag);
+    return result;
 }
@@ -25,6 +25,7 @@
 #include <opentracing-c/tracer.h>
 
 #include "jaegertracingc/common.h"
+#include "jaegertracingc/header_table.h"
 #include "jaegertracingc/options.h"
 #include "jaegertracingc/reporter.h"
 #include "jaegertracingc/sampler.h"
@@ -47,11 +48,19 @@ typedef struct jaeger_tracer_options {
      * @see jaeger_trace_id
      */
     bool gen_128_bit;
+
+    /**
+     * Allocator for the tracer's own state, including its sampler, reporter
+     * and the spans it reports, and for spans started on threads that have no
+     * allocator bound. NULL to use the installed allocator.
+     * @see jaeger_set_thread_allocator
+     */
+    jaeger_allocator* allocator;
 } jaeger_tracer_options;
 
-#define JAEGER_TRACER_OPTIONS_INIT \
-    {                              \
-        .gen_128_bit = false       \
+#define JAEGER_TRACER_OPTIONS_INIT              \
+    {                                           \
+        .gen_128_bit = false, .allocator = NULL \
     }
 
 /**
@@ -95,6 +104,12 @@ typedef struct jaeger_tracer {
      */
     jaeger_headers_config headers;
 
+    /**
+     * Header names of headers, compiled for extraction by jaeger_tracer_init.
+     * @see jaeger_header_table
+     */
+    jaeger_header_table header_table;
+
     /**
      * Tags to store metadata about the current process (i.e. hostname,
      * client version, etc.).
@@ -140,6 +155,7 @@ typedef struct jaeger_tracer {
         .service_name = NULL, .metrics = NULL, .sampler = NULL,               \
         .reporter = NULL, .options = JAEGER_TRACER_OPTIONS_INIT,              \
         .headers = JAEGERTRACINGC_HEADERS_CONFIG_INIT,                        \
+        .header_table = {.num_entries = 0},                                   \
         .tags = JAEGERTRACINGC_VECTOR_INIT, .allocated = {                    \
             .metrics = false,                                                 \
             .sampler = false,                                                 \
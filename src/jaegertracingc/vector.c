@@ -149,7 +149,8 @@ void jaeger_vector_destroy(jaeger_vector* vec)
 {
     if (vec != NULL) {
         if (vec->data != NULL) {
-            jaeger_free(vec->data);
+            jaeger_free_sized(vec->data,
+                              (size_t) vec->type_size * vec->capacity);
             vec->data = NULL;
         }
         vec->capacity = 0;
@@ -242,7 +243,7 @@ static inline bool jaeger_vector_ptr_copy_helper(void* arg,
         return false;
     }
     if (!ctx->copy(ctx->arg, *ptr, src)) {
-        jaeger_free(*ptr);
+        jaeger_free_sized(*ptr, ctx->type_size);
         *ptr = NULL;
         return false;
     }
@@ -272,7 +273,7 @@ bool jaeger_vector_ptr_copy(jaeger_vector* restrict dst,
             if (destroy != NULL) {                \
                 destroy(*(ptr));                  \
             }                                     \
-            jaeger_free(*(ptr));                  \
+            jaeger_free_sized(*(ptr), value_size); \
         }                                         \
     } while (0)
 